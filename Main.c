@@ -34,12 +34,14 @@
 #include "./include/arena.h"
 #include "./include/base_graphics.h"
 #include "./include/font.h"
+#include "./include/draw_list.h"
 #include "./include/todo.h"
 
 #include "./src/util.c"
 #include "./src/arena.c"
 #include "./src/base_graphics.c"
 #include "./src/font.c"
+#include "./src/draw_list.c"
 #include "./src/todo.c"
 
 __declspec(dllexport) DWORD NvOptimusEnablement = 0x00000001;// Optimus: force switch to discrete GPU
@@ -51,6 +53,8 @@ __declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;//AMD
 
 #define ANIMATION_TIME      0.2f
 
+#define RENDER_TILE_SIZE    128
+
 /*
     Stuff that we wish to retain between frames
     per block
@@ -64,6 +68,21 @@ typedef struct
 
 typedef struct { char *key; ui_block_state_t value; } ui_block_map_t;
 
+/*
+    What a cached block drew, retained between frames and keyed by
+    title like the block state. Allocated on its own so the image
+    stays put while the map grows, draw commands point to it
+*/
+typedef struct
+{
+    image_view_t    image;
+    u64             hash;       // of everything the pixels were drawn from
+    bool            opaque;
+    bool            used;       // drawn this frame, the rest are freed at its end
+} ui_surface_t;
+
+typedef struct { char *key; ui_surface_t *value; } ui_surface_map_t;
+
 typedef enum {
     UI_INTERACT_NONE,
     UI_INTERACT_HOVER,
@@ -196,6 +215,13 @@ typedef struct ui_block_t
     i32 child_count;
     
     bool is_leaf; 
+
+    // draw the subtree into a surface and reuse it for as long as 
+    // nothing it is drawn from changes. See ui_render_block_cached
+    bool cached;
+
+    // whatever the block is drawn from that it does not hold itself
+    u64 cache_key;
 }ui_block_t;
 
 #define IS_CONTAINER(b) (!(b)->is_leaf)
@@ -253,18 +279,30 @@ typedef struct
 
 typedef struct { char *key; text_edit_state_t value; } text_edit_map_t;
 
+/*
+    One frame's tiled replay, shared by every thread working on it.
+    Threads take the next dirty tile until there are none left.
+ */
 typedef struct 
 {
-    u32 start_x, end_x;
-    u32 start_y, end_y;
-    u32 width, height;
+    draw_list_t     *list;
+    draw_bins_t     *bins;
+    image_view_t    *img;
+    u32             *tiles;
+    i32             tile_count;
+    atomic_int_t    next_tile;
 } tile_data_t;
 
 struct context_t
 {
     void               *window;
 
-    image_view_t        draw_buffer;
+    image_view_t        draw_buffer;    // kept between frames, only damaged tiles are redrawn
+    u32                 draw_buffer_capacity;
+    draw_list_t         draw_list;      // what the frame draws, replayed into draw_buffer
+    draw_bins_t         draw_bins;      // draw_list split by tiles
+    draw_damage_t       draw_damage;    // the tiles that changed since the last frame
+    thread_pool_t       *pool;
     u32                 screen_width;
     u32                 screen_height;
 
@@ -295,6 +333,8 @@ struct context_t
 
     ui_context_t        *ui_ctx;
     ui_block_map_t      *block_map;
+    ui_surface_map_t    *surface_map;
+    draw_list_t         surface_list;   // a cached block records into it when redrawn
     text_edit_map_t     *text_map;
 
     char                *focused_text_edit;
@@ -311,12 +351,16 @@ struct context_t
     bool                running;
     bool                resize;
     bool                rescale;
-    bool                render;
+    bool                render;         // draw the next frame even if nothing asks for it
     bool                dock;
     bool                capture;
     bool                profile;
-    bool                changed;
+    bool                changed;        // input or a resize since the last frame
     bool                debug;
+    bool                parallel;
+    bool                full_redraw;
+    bool                idle;           // sleep until something needs a frame
+    f64                 wake_time;      // when a timer next needs a frame, see wake_after
 
     bool                scroll;
     f32                 scroll_x;
@@ -378,7 +422,7 @@ bool manipulator_axis_x(u32* x, u32 rad)
 
     if (dragging)
     {
-        draw_rect_outline(&gc.draw_buffer, left, 0, right, gc.screen_height, COLOR_BLUE);
+        draw_list_rect_outline(&gc.draw_list, left, 0, right - left + 1, gc.screen_height + 1, COLOR_BLUE);
 
         if (gc.left_button_down)
         {
@@ -392,7 +436,7 @@ bool manipulator_axis_x(u32* x, u32 rad)
     }
     else if (Inside((u32)gc.mouse_x, left, right))
     {
-        draw_rect_outline(&gc.draw_buffer, left, 0, right, gc.screen_height, COLOR_BLUE);
+        draw_list_rect_outline(&gc.draw_list, left, 0, right - left + 1, gc.screen_height + 1, COLOR_BLUE);
 
         if (gc.left_button_down)
         {
@@ -453,7 +497,7 @@ void render_prof_entries(void)
         width = MAX(width, (int)get_string_width(gc.font, prof_buf[i]));
     }
 
-    draw_rect_solid_wh(&gc.draw_buffer, 0, 0, width+10, height+10, HEX_TO_COLOR4(0x282a36));
+    draw_list_rect(&gc.draw_list, 0, 0, width+10, height+10, HEX_TO_COLOR4(0x282a36));
 
     PROFILE("Rendering all prof entries")
     {
@@ -465,7 +509,7 @@ void render_prof_entries(void)
                 .color = COLOR_WHITE,
                 .string = prof_buf[i]
             };
-            render_text_tt(&gc.draw_buffer, &text);
+            draw_list_text(&gc.draw_list, &text);
         }
     }
 
@@ -483,6 +527,7 @@ void reset_input_for_frame(void)
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     (void)window;
+    gc.changed = true;
     gc.screen_width  = width;
     gc.screen_height = height;
 
@@ -496,12 +541,15 @@ void error_callback(int error, const char* description)
 
 void window_refresh_callback(GLFWwindow* window)
 {
+    (void)window;
+    gc.changed = true;
     // glfwSwapBuffers(window);
 }
 
 void drop_callback(GLFWwindow* window, int count, const char** paths) 
 {
     (void)window;
+    gc.changed = true;
     for (int i = 0; i < count; i++){
         printf("Dropped file: %s\n", paths[i]);
     }
@@ -526,6 +574,7 @@ void get_mouse_delta(f32 *xoffset, f32 *yoffset)
 void mouse_callback(GLFWwindow* window, f64 xpos, f64 ypos)
 {
     (void)window;
+    gc.changed = true;
 
     gc.mouse_x = (u32)xpos;
     gc.mouse_y = (u32)ypos;
@@ -545,6 +594,8 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     (void)xoffset;
     (void)yoffset;
 
+    gc.changed = true;
+
     f32 scroll_sensitivity = 25.0f;
     gc.scroll_x += (f32)xoffset * scroll_sensitivity;
     gc.scroll_y += (f32)yoffset * scroll_sensitivity;
@@ -556,6 +607,8 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
     (void)window;
     (void)mods;
+
+    gc.changed = true;
     
     if (button == GLFW_MOUSE_BUTTON_LEFT)
     {
@@ -574,6 +627,8 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     (void)scancode;
     (void)mods;
 
+    gc.changed = true;
+
     if (action == GLFW_PRESS) 
     {
         gc.key_pressed[key] = true;
@@ -603,6 +658,15 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
             case GLFW_KEY_F8:
                 gc.debug ^= 1;
                 break;
+            case GLFW_KEY_F6:
+                gc.parallel ^= 1;
+                break;
+            case GLFW_KEY_F5:
+                gc.full_redraw ^= 1;
+                break;
+            case GLFW_KEY_F4:
+                gc.idle ^= 1;
+                break;
             case GLFW_KEY_F7:
                 gc.dock = !gc.dock;
                 if(gc.dock)
@@ -651,6 +715,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void char_callback(GLFWwindow* window, unsigned int codepoint) 
 {
     (void)window;
+    gc.changed = true;
 
     if (codepoint >= 32 && codepoint <= 126) {
         if (gc.input_char_count < 31) {
@@ -662,8 +727,39 @@ void char_callback(GLFWwindow* window, unsigned int codepoint)
 void poll_events(void)
 {
     glfwPollEvents();
-    // glfwWaitEvents(); // find a way to make it work with animations
-    // glfwWaitEventsTimeout(0.016);
+}
+
+/*
+    Asks for a frame in at most seconds, for things that change with
+    time alone like a blinking cursor. Only the earliest request counts,
+    they are dropped when a frame starts, so ask again every frame for
+    as long as it matters.
+ */
+void wake_after(f64 seconds)
+{
+    gc.wake_time = MIN(gc.wake_time, glfwGetTime() + MAX(seconds, 0.0));
+}
+
+/*
+    Whether a frame would show anything new. Input and resizes set
+    gc.changed from the callbacks, animations need every frame until
+    they end and timers go through wake_after. The debug and profile
+    overlays show live timings, they always do.
+ */
+bool frame_needed(void)
+{
+    return !gc.idle || gc.render || gc.changed || gc.debug || gc.profile ||
+           animation_item_count > 0 || glfwGetTime() >= gc.wake_time;
+}
+
+// sleeps until an event arrives or the next timer is due
+void wait_events(void)
+{
+    if (gc.wake_time == max_f64) {
+        glfwWaitEvents();
+    } else {
+        glfwWaitEventsTimeout(MAX(gc.wake_time - glfwGetTime(), 0.0));
+    }
 }
 
 ui_context_t* ui_new_ctx(void)
@@ -671,6 +767,10 @@ ui_context_t* ui_new_ctx(void)
     ui_context_t *ctx = (ui_context_t*)calloc(1, sizeof(ui_context_t));
     gc.block_map = NULL;
 
+    // titles can live in arrays that move, surfaces outlive a frame so they keep a copy
+    gc.surface_map = NULL;
+    sh_new_strdup(gc.surface_map);
+
     return ctx;
 }
 
@@ -856,7 +956,7 @@ void ui_set_pixel_in_block(ui_block_t *block, i32 block_x, i32 block_y, color4_t
 {
     i32 screen_x, screen_y;
     ui_block_to_screen_coords(block, block_x, block_y, &screen_x, &screen_y);
-    draw_pixel(&gc.draw_buffer, screen_x, screen_y, color);
+    draw_list_rect(&gc.draw_list, screen_x, screen_y, 1, 1, color);
 }
 
 void ui_draw_rect_in_block(ui_block_t *block, i32 block_x, i32 block_y, u32 width, u32 height, color4_t color)
@@ -864,8 +964,8 @@ void ui_draw_rect_in_block(ui_block_t *block, i32 block_x, i32 block_y, u32 widt
     i32 screen_x, screen_y;
     ui_block_to_screen_coords(block, block_x, block_y,
                                      &screen_x, &screen_y);
-    draw_rect_scissored(&gc.draw_buffer, screen_x, screen_y,
-                         width, height, color);
+    draw_list_rect(&gc.draw_list, screen_x, screen_y,
+                    width, height, color);
 }
 
 void ui_draw_rounded_rect_in_block(ui_block_t *block, i32 block_x, i32 block_y, u32 width, u32 height, color4_t color)
@@ -873,8 +973,8 @@ void ui_draw_rounded_rect_in_block(ui_block_t *block, i32 block_x, i32 block_y,
     i32 screen_x, screen_y;
     ui_block_to_screen_coords(block, block_x, block_y,
                                      &screen_x, &screen_y);
-    draw_rounded_rectangle_filled_aa_wh(&gc.draw_buffer, screen_x, screen_y,
-                                 width, height, 25, color);
+    draw_list_rounded_rect(&gc.draw_list, screen_x, screen_y,
+                           width, height, 25, color);
 }
 
 void ui_render_text_in_block(ui_block_t *block)
@@ -886,7 +986,7 @@ void ui_render_text_in_block(ui_block_t *block)
     block->text.pos.x = screen_x;
     block->text.pos.y = screen_y;
 
-    render_text_tt(&gc.draw_buffer, &block->text);
+    draw_list_text(&gc.draw_list, &block->text);
 }
 
 void ui_draw_block_background(ui_block_t *block)
@@ -896,55 +996,55 @@ void ui_draw_block_background(ui_block_t *block)
         return;
     }
 
-    draw_rect_scissored(&gc.draw_buffer, 
-                        block->abs_x, 
-                        block->abs_y, 
-                        block->w, 
-                        block->h, 
-                        block->bg_color);
+    draw_list_rect(&gc.draw_list, 
+                   block->abs_x, 
+                   block->abs_y, 
+                   block->w, 
+                   block->h, 
+                   block->bg_color);
 
     if(block->draggable || block->resizeable)
     {
         rect_t handle_rect;
         if(is_in_hit_region(block, gc.mouse_x, gc.mouse_y, &handle_rect))
         {
-            draw_rect_scissored(&gc.draw_buffer,
-                                handle_rect.x,
-                                handle_rect.y,
-                                handle_rect.w,
-                                handle_rect.h,
-                                lite(block->bg_color));
+            draw_list_rect(&gc.draw_list,
+                           handle_rect.x,
+                           handle_rect.y,
+                           handle_rect.w,
+                           handle_rect.h,
+                           lite(block->bg_color));
         }
     }
     if (block->border_width > 0) 
     {
-        draw_rect_scissored(&gc.draw_buffer,
-                            block->abs_x,
-                            block->abs_y,
-                            block->w,
-                            block->border_width,
-                            block->border_color);
+        draw_list_rect(&gc.draw_list,
+                       block->abs_x,
+                       block->abs_y,
+                       block->w,
+                       block->border_width,
+                       block->border_color);
         
-        draw_rect_scissored(&gc.draw_buffer,
-                            block->abs_x,
-                            block->abs_y + block->h - block->border_width,
-                            block->w,
-                            block->border_width,
-                            block->border_color);
+        draw_list_rect(&gc.draw_list,
+                       block->abs_x,
+                       block->abs_y + block->h - block->border_width,
+                       block->w,
+                       block->border_width,
+                       block->border_color);
         
-        draw_rect_scissored(&gc.draw_buffer,
-                            block->abs_x,
-                            block->abs_y,
-                            block->border_width,
-                            block->h,
-                            block->border_color);
+        draw_list_rect(&gc.draw_list,
+                       block->abs_x,
+                       block->abs_y,
+                       block->border_width,
+                       block->h,
+                       block->border_color);
         
-        draw_rect_scissored(&gc.draw_buffer,
-                            block->abs_x + block->w - block->border_width,
-                            block->abs_y,
-                            block->border_width,
-                            block->h,
-                            block->border_color);
+        draw_list_rect(&gc.draw_list,
+                       block->abs_x + block->w - block->border_width,
+                       block->abs_y,
+                       block->border_width,
+                       block->h,
+                       block->border_color);
 
 // draw_rounded_rectangle_filled_aa(&gc.draw_buffer, 
 //                                  block->abs_x + block->border_width, 
@@ -1650,8 +1750,8 @@ void draw_scroll_bar(ui_block_t *block)
                                                     : (inside_rect(gc.mouse_x, gc.mouse_y, &scroll_handle)) ? HEX_TO_COLOR4(0x525356) 
                                                                                                              : HEX_TO_COLOR4(0x464649);
 
-        draw_rect_solid_wh(&gc.draw_buffer, scroll_handle.x, scroll_handle.y, 
-                            scroll_handle.w, scroll_handle.h, color);
+        draw_list_rect(&gc.draw_list, scroll_handle.x, scroll_handle.y, 
+                        scroll_handle.w, scroll_handle.h, color);
     }
 }
 
@@ -1707,8 +1807,8 @@ void ui_update_floating_panel(ui_block_t *block)
                 snap = true;
                 snap_x = (gc.screen_width - block->w);
                 snap_y = 0;
-                draw_rect_solid_wh(&gc.draw_buffer, snap_x, snap_y,
-                                   block->w,block->h, color);
+                draw_list_rect(&gc.draw_list, snap_x, snap_y,
+                               block->w,block->h, color);
             }
             else if(new_pos.x < block->w 
                     && new_pos.y < block->h)
@@ -1716,8 +1816,8 @@ void ui_update_floating_panel(ui_block_t *block)
                 snap = true;
                 snap_x = 0;
                 snap_y = 0;
-                draw_rect_solid_wh(&gc.draw_buffer, snap_x, snap_y,
-                                    block->w, block->h, color);
+                draw_list_rect(&gc.draw_list, snap_x, snap_y,
+                                block->w, block->h, color);
             }
             else if((new_pos.x > ((i32)gc.screen_width - block->w)) 
                 && (new_pos.y > ((i32)gc.screen_height - block->h)))
@@ -1725,8 +1825,8 @@ void ui_update_floating_panel(ui_block_t *block)
                 snap = true;
                 snap_x = (gc.screen_width - block->w);
                 snap_y = (gc.screen_height - block->h);
-                draw_rect_solid_wh(&gc.draw_buffer, snap_x, snap_y,
-                                   block->w, block->h, color);
+                draw_list_rect(&gc.draw_list, snap_x, snap_y,
+                               block->w, block->h, color);
             }
             else if(new_pos.x < block->w 
                     && (new_pos.y > ((i32)gc.screen_height - block->h)))
@@ -1737,8 +1837,8 @@ void ui_update_floating_panel(ui_block_t *block)
                 snap = true;
                 snap_x = 0;
                 snap_y = (gc.screen_height - block->h);
-                draw_rect_solid_wh(&gc.draw_buffer, snap_x, snap_y,
-                                    block->w, block->h, color);
+                draw_list_rect(&gc.draw_list, snap_x, snap_y,
+                                block->w, block->h, color);
             }
         }
 
@@ -1941,14 +2041,218 @@ void ui_update_block_interaction(ui_block_t *block)
     ui_block_save_state(block);
 }
 
+void ui_render_block_ex(ui_block_t *block, bool update);
+
 void ui_render_block(ui_block_t *block)
+{
+    ui_render_block_ex(block, true);
+}
+
+// the updates ui_render_block would run on the subtree, in the same order
+void ui_update_block_tree(ui_block_t *block)
 {
     if(!block || !block->visible){
         return;
     }
-    
+
     ui_update_block_interaction(block);
 
+    ui_block_t *child = NULL;
+    LIST_FOR_EACH_DOWN(child, block->first)
+    {
+        ui_update_block_tree(child);
+    }
+}
+
+#define HASH_VALUE(h, v) fnv1a_hash64((h), &(v), sizeof(v))
+
+/*
+    Everything the subtree of a block is drawn from as far as the blocks
+    know, positions relative to root so moving the whole thing is free.
+    Widgets drawing from state kept elsewhere (text edits, user_data)
+    must fold it into cache_key.
+ */
+u64 ui_block_hash(ui_block_t *block, ui_block_t *root, u64 h)
+{
+    i32 rel_x = block->abs_x - root->abs_x;
+    i32 rel_y = block->abs_y - root->abs_y;
+    i32 scissor_x = block->scissor_region.x - root->abs_x;
+    i32 scissor_y = block->scissor_region.y - root->abs_y;
+    bool hot    = ui_is_hot(gc.ui_ctx, block);
+    bool active = ui_is_active(gc.ui_ctx, block);
+
+    h = HASH_VALUE(h, rel_x);
+    h = HASH_VALUE(h, rel_y);
+    h = HASH_VALUE(h, block->w);
+    h = HASH_VALUE(h, block->h);
+    h = HASH_VALUE(h, scissor_x);
+    h = HASH_VALUE(h, scissor_y);
+    h = HASH_VALUE(h, block->scissor_region.w);
+    h = HASH_VALUE(h, block->scissor_region.h);
+    h = HASH_VALUE(h, block->layout);
+    h = HASH_VALUE(h, block->is_leaf);
+    h = HASH_VALUE(h, block->visible);
+    h = HASH_VALUE(h, block->enabled);
+    h = HASH_VALUE(h, block->border_width);
+    h = HASH_VALUE(h, block->bg_color);
+    h = HASH_VALUE(h, block->hover_color);
+    h = HASH_VALUE(h, block->border_color);
+    h = HASH_VALUE(h, block->scroll_x);
+    h = HASH_VALUE(h, block->scroll_y);
+    h = HASH_VALUE(h, block->content_width);
+    h = HASH_VALUE(h, block->content_height);
+    h = HASH_VALUE(h, block->toggled);
+    h = HASH_VALUE(h, block->value);
+    h = HASH_VALUE(h, block->min_value);
+    h = HASH_VALUE(h, block->max_value);
+    h = HASH_VALUE(h, block->hot_anim_t);
+    h = HASH_VALUE(h, block->active_anim_t);
+    h = HASH_VALUE(h, block->custom_render);
+    h = HASH_VALUE(h, block->user_data);
+    h = HASH_VALUE(h, block->cache_key);
+    h = HASH_VALUE(h, hot);
+    h = HASH_VALUE(h, active);
+    if (active) {
+        h = HASH_VALUE(h, gc.ui_ctx->interaction.mode);
+    }
+
+    h = HASH_VALUE(h, block->text.font);
+    h = HASH_VALUE(h, block->text.color);
+    h = HASH_VALUE(h, block->text.pos);
+    if (block->text.string) {
+        h = fnv1a_hash64(h, block->text.string, strlen(block->text.string) + 1);
+    }
+
+    // handles and scroll thumbs light up under the mouse
+    if (block->draggable || block->resizeable)
+    {
+        rect_t handle = {0};
+        hit_region_t region = is_in_hit_region(block, gc.mouse_x, gc.mouse_y, &handle);
+        h = HASH_VALUE(h, region);
+        h = HASH_VALUE(h, handle);
+    }
+    if (block->scrollable)
+    {
+        rect_t thumb = {0};
+        bool over = get_scroll_thumb_rect(block, &thumb) && inside_rect(gc.mouse_x, gc.mouse_y, &thumb);
+        h = HASH_VALUE(h, over);
+    }
+
+    ui_block_t *child = NULL;
+    LIST_FOR_EACH_DOWN(child, block->first)
+    {
+        h = ui_block_hash(child, root, h);
+    }
+    return h;
+}
+
+/*
+    Draws a cached block as a single image. The subtree is still updated
+    every frame, it is only redrawn into its surface when the hash says
+    something changed. The surface holds the block's own rect, anything
+    the block draws past its edges is cut off, and textures hanging off
+    its left or top edge are dropped like at the screen's. Where the
+    block leaves what is under it showing through, the result can be a
+    step or two off drawing directly, opaque parts come out the same.
+ */
+void ui_render_block_cached(ui_block_t *block)
+{
+    ui_update_block_tree(block);
+
+    u64 h = ui_block_hash(block, block, FNV1A_SEED64);
+
+    ui_surface_t *surface = shget(gc.surface_map, block->title);
+    if (!surface)
+    {
+        surface = CHECK_PTR(calloc(1, sizeof(ui_surface_t)));
+        if (!surface) {
+            ui_render_block_ex(block, false);
+            return;
+        }
+        shput(gc.surface_map, block->title, surface);
+    }
+    surface->used = true;
+
+    bool resized = surface->image.width != (u32)block->w || surface->image.height != (u32)block->h;
+    if (resized)
+    {
+        color4_t *pixels = realloc(surface->image.pixels, (size_t)block->w * block->h * sizeof(color4_t));
+        if (!pixels) {
+            fprintf(stderr, "Error : could not allocate a %dx%d surface for %s\n", block->w, block->h, block->title);
+            ui_render_block_ex(block, false);
+            return;
+        }
+        surface->image.pixels = pixels;
+        surface->image.width  = block->w;
+        surface->image.height = block->h;
+        surface->image.premultiplied = true;
+    }
+
+    if (resized || surface->hash != h)
+    {
+        // record the subtree on its own, the screen's list waits
+        draw_list_t screen_list = gc.draw_list;
+        gc.draw_list = gc.surface_list;
+
+        draw_list_begin_at(&gc.draw_list, block->abs_x, block->abs_y, block->w, block->h);
+        draw_list_clear(&gc.draw_list, COLOR_TRANSPARENT);
+        ui_render_block_ex(block, false);
+
+        gc.surface_list = gc.draw_list;
+        gc.draw_list    = screen_list;
+
+        draw_list_execute(&gc.surface_list, &surface->image);
+
+        surface->opaque = true;
+        for (u32 i = 0; i < surface->image.width * surface->image.height; i++) {
+            if (!IS_OPAQUE(surface->image.pixels[i])) {
+                surface->opaque = false;
+                break;
+            }
+        }
+        surface->hash = h;
+    }
+
+    draw_list_image(&gc.draw_list, &surface->image, block->abs_x, block->abs_y, surface->opaque, surface->hash);
+}
+
+// frees the surfaces of cached blocks that were not drawn this frame
+void ui_release_surfaces(void)
+{
+    for (i32 i = (i32)shlen(gc.surface_map) - 1; i >= 0; i--)
+    {
+        ui_surface_t *surface = gc.surface_map[i].value;
+        if (surface->used) {
+            surface->used = false;
+            continue;
+        }
+        free(surface->image.pixels);
+        free(surface);
+        shdel(gc.surface_map, gc.surface_map[i].key);
+    }
+}
+
+/*
+    update is false while a cached block redraws into its surface, the
+    subtree was already updated this frame, and cached blocks inside it
+    draw directly into the same surface
+ */
+void ui_render_block_ex(ui_block_t *block, bool update)
+{
+    if(!block || !block->visible){
+        return;
+    }
+
+    if (update && block->cached && block->w > 0 && block->h > 0)
+    {
+        ui_render_block_cached(block);
+        return;
+    }
+    
+    if (update) {
+        ui_update_block_interaction(block);
+    }
+
     if (block->custom_render) 
     {
         block->custom_render(block);
@@ -1972,23 +2276,23 @@ void ui_render_block(ui_block_t *block)
         }
     }
 
-    push_scissor(block->scissor_region.x + block->border_width,
-                block->scissor_region.y + block->border_width,
-                block->scissor_region.w - 2 * block->border_width,
-                block->scissor_region.h - 2 *  block->border_width);
+    draw_list_push_scissor(&gc.draw_list, block->scissor_region.x + block->border_width,
+                          block->scissor_region.y + block->border_width,
+                          block->scissor_region.w - 2 * block->border_width,
+                          block->scissor_region.h - 2 *  block->border_width);
 
 
         ui_block_t *child = NULL;
         LIST_FOR_EACH_DOWN(child, block->first)
         {
-            ui_render_block(child);
+            ui_render_block_ex(child, update);
         }
 
         if(block->scrollable)
         {
             draw_scroll_bar(block);
         }
-    pop_scissor();
+    draw_list_pop_scissor(&gc.draw_list);
 }
 
 
@@ -2037,7 +2341,7 @@ void ui_render_checkbox(ui_block_t *block)
             .string = EDIT_ICON
         };
 
-        render_string_unicode(&gc.draw_buffer, &icon); 
+        draw_list_text_unicode(&gc.draw_list, &icon); 
         */
     }
 }
@@ -2054,6 +2358,7 @@ bool ui_checkbox(ui_context_t *ctx, char *title)
     checkbox->bg_color = HEX_TO_COLOR4(0x47a777);
     checkbox->hover_color = lite(HEX_TO_COLOR4(0x47a777));
     checkbox->custom_render = ui_render_checkbox;
+    checkbox->cached = true;
     
     ui_add_child(ctx, checkbox);
 
@@ -2197,11 +2502,11 @@ void ui_render_toggle(ui_block_t *block)
 
     color4_t thumb_color = HEX_TO_COLOR4(0xf8f8f2);
 
-    draw_circle_filled_aa(&gc.draw_buffer,
-                          block->abs_x + thumb_x + thumb_size / 2,
-                          block->abs_y + thumb_y + thumb_size / 2,
-                          thumb_size / 2.0f,
-                          thumb_color);
+    draw_list_circle(&gc.draw_list,
+                     block->abs_x + thumb_x + thumb_size / 2,
+                     block->abs_y + thumb_y + thumb_size / 2,
+                     thumb_size / 2.0f,
+                     thumb_color);
 
     // if (block->text.string)
     // {
@@ -2276,7 +2581,7 @@ void ui_render_radio(ui_block_t *block)
                 .color = HEX_TO_COLOR4(0xe7f8f2),
                 .string = CHECK_ICON
             };
-            render_string_unicode(&gc.draw_buffer, &icon);
+            draw_list_text_unicode(&gc.draw_list, &icon);
         } */
     }
 }
@@ -2365,9 +2670,9 @@ void ui_render_slider(ui_block_t *block)
                             block->active_anim_t, -0.1f);    // shrinks a bit when pressed.
 
 
-    draw_circle_filled_aa(&gc.draw_buffer, block->abs_x + handle_x, block->abs_y + handle_y,
-                         handle_size*scale/2.0, handle_color);
-    draw_circle_aa(&gc.draw_buffer, block->abs_x + handle_x, block->abs_y + handle_y,
+    draw_list_circle(&gc.draw_list, block->abs_x + handle_x, block->abs_y + handle_y,
+                    handle_size*scale/2.0, handle_color);
+    draw_list_circle_outline(&gc.draw_list, block->abs_x + handle_x, block->abs_y + handle_y,
                          handle_size*scale*glow_scale/2.0, handle_color);
     // draw_rounded_rect_scissored(&gc.draw_buffer, handle_x, handle_y, handle_size, handle_size*2, 25, handle_color);
 
@@ -2460,7 +2765,7 @@ void ui_render_knob(ui_block_t *block)
         };
         color4_t glow_color = HEX_TO_COLOR4(0xbd93f9);
         glow_color.a = (u8)(120 * block->hot_anim_t);
-        draw_radial_segment_filled(&gc.draw_buffer, &layout, &glow, glow_color);
+        draw_list_radial_segment(&gc.draw_list, &layout, &glow, glow_color);
     }
 
     radial_segment_t track = {
@@ -2470,7 +2775,7 @@ void ui_render_knob(ui_block_t *block)
         .outer_radius = layout.outer_radius,
     };
     color4_t track_color = HEX_TO_COLOR4(0x44475a);
-    draw_radial_segment_filled(&gc.draw_buffer, &layout, &track, track_color);
+    draw_list_radial_segment(&gc.draw_list, &layout, &track, track_color);
 
     f32 t = 0.0f; 
     if (block->max_value > block->min_value){
@@ -2491,7 +2796,7 @@ void ui_render_knob(ui_block_t *block)
             .inner_radius = layout.inner_radius,
             .outer_radius = layout.outer_radius,
         };
-        draw_radial_segment_filled(&gc.draw_buffer, &layout, &fill, fill_color);
+        draw_list_radial_segment(&gc.draw_list, &layout, &fill, fill_color);
     }
 
     f32 dot_angle = KNOB_START_ANGLE + t * (KNOB_END_ANGLE - KNOB_START_ANGLE);
@@ -2502,8 +2807,8 @@ void ui_render_knob(ui_block_t *block)
                        1.0f, 1.0f, &dot_x, &dot_y);
 
     f32 dot_size = 4.0f + 3.0f * block->hot_anim_t;
-    draw_circle_filled_aa(&gc.draw_buffer, (i32)dot_x, (i32)dot_y, (i32)dot_size,
-                          HEX_TO_COLOR4(0xffffff));
+    draw_list_circle(&gc.draw_list, (i32)dot_x, (i32)dot_y, (i32)dot_size,
+                     HEX_TO_COLOR4(0xffffff));
 }
 
 f32 ui_knob(ui_context_t *ctx, char *title, f32 min, f32 max)
@@ -2573,7 +2878,7 @@ void ui_render_tree_node(ui_block_t *block)
             .color = COLOR_WHITE,
             .string = node->collapsed?RIGHT_CIRCLE_ARROW:DOWN_CIRCLE_ARROW,
         };
-        render_string_unicode(&gc.draw_buffer, &icon);
+        draw_list_text_unicode(&gc.draw_list, &icon);
 
         block->text.pos.x = 50;
         block->text.pos.y = (block->h - get_line_height(block->text.font)) / 2;
@@ -2661,9 +2966,9 @@ void ui_render_modal(ui_context_t *ctx)
     if (ctx->modal_active && ctx->modal_block)
     {
         color4_t dim_color = {0, 0, 0, 180};
-        draw_rect_solid_wh(&gc.draw_buffer, 0, 0, 
-                          gc.screen_width, gc.screen_height, 
-                          dim_color);
+        draw_list_rect(&gc.draw_list, 0, 0, 
+                      gc.screen_width, gc.screen_height, 
+                      dim_color);
         
         ui_render_block(ctx->modal_block);
     }
@@ -2759,7 +3064,7 @@ void ui_render_radial_menu(ui_block_t *block)
             color = lite(color);
         }
         
-        draw_radial_segment_filled(&gc.draw_buffer, &menu->layout, &seg, color);
+        draw_list_radial_segment(&gc.draw_list, &menu->layout, &seg, color);
         
         if (item->label) 
         {
@@ -2781,7 +3086,7 @@ void ui_render_radial_menu(ui_block_t *block)
                 .color = HEX_TO_COLOR4(0xe7f8f2),
                 .string = NOTE_ICON
             };
-            render_string_unicode(&gc.draw_buffer, &icon);
+            draw_list_text_unicode(&gc.draw_list, &icon);
         }
     }
 }
@@ -2919,30 +3224,80 @@ void buffer_make_room(text_edit_state_t* state, size_t position, size_t count)
     state->buffer_len += count;
 }
 
-i32 text_edit_get_char_at_x(ui_block_t *block, text_edit_state_t *state, i32 mouse_x)
+/*
+    A pasted newline makes the buffer several lines, drawn one under the
+    other. Caret x is measured from the start of the caret's own line,
+    a click finds its line by y and then the byte by x within it.
+ */
+
+// byte index the line holding index starts at
+i32 text_edit_line_start(text_edit_state_t *state, i32 index)
+{
+    i32 start = MIN(MAX(index, 0), state->buffer_len);
+    while (start > 0 && state->buffer[start - 1] != '\n') {
+        start--;
+    }
+    return start;
+}
+
+// line of the caret before byte index, 0 for the first
+i32 text_edit_line_of(text_edit_state_t *state, i32 index)
+{
+    i32 line = 0;
+    i32 end  = MIN(MAX(index, 0), state->buffer_len);
+    for (i32 i = 0; i < end; i++) {
+        if (state->buffer[i] == '\n') line++;
+    }
+    return line;
+}
+
+// x of the caret before byte index, in block space before scrolling, with the 5 pixels of padding
+f32 text_edit_x_at(ui_block_t *block, text_edit_state_t *state, i32 index)
+{
+    index = MIN(MAX(index, 0), state->buffer_len);
+
+    i32 start = text_edit_line_start(state, index);
+    text_measure_t const *measure = measure_text(block->text.font, state->buffer + start);
+    return 5 + measure->x[MIN((u32)(index - start), measure->count)];
+}
+
+i32 text_edit_get_char_at(ui_block_t *block, text_edit_state_t *state, i32 mouse_x, i32 mouse_y)
 {
     // we are now in the block space
     i32 local_x = mouse_x - block->abs_x;
     // acount for scroll
     local_x += state->scroll_offset;
 
-    f32 cumulative_width = 5;
+    // the first line is centered like ui_render_text_edit draws it, the rest follow below
+    i32 line_height = get_line_height(block->text.font);
+    i32 local_y     = mouse_y - block->abs_y - (block->h - line_height) / 2;
+    i32 line        = local_y > 0 ? local_y / line_height : 0;
+
+    // past the last line stays on the last line
+    i32 start = 0;
+    for (i32 i = 0; i < state->buffer_len && line > 0; i++) {
+        if (state->buffer[i] == '\n') {
+            start = i + 1;
+            line--;
+        }
+    }
+
+    text_measure_t const *measure = measure_text(block->text.font, state->buffer + start);
 
-    for (i32 i = 0; i < state->buffer_len; i++) 
+    for (u32 i = 0; i < measure->count; i++) 
     {
-        f32 char_width = get_char_width(block->text.font, state->buffer[i]);
+        f32 char_width = measure->x[i + 1] - measure->x[i];
 
         // inside the char area
-        if(local_x < (cumulative_width + (char_width/2)))
+        if(local_x < (5 + measure->x[i] + (char_width/2)))
         {
             // found it
-            return i;
+            return start + (i32)i;
         }
-        cumulative_width += char_width;
     }
 
-    // not inside it
-    return state->buffer_len;
+    // not inside it, the end of that line
+    return start + (i32)measure->count;
 }
 
 void text_edit_remove_selection(text_edit_state_t *state)
@@ -3206,13 +3561,18 @@ void ui_text_edit_update(ui_block_t *block)
         state->cursor_blink_timer = 0.0;
     }
 
+    // the cursor only shows when focused, an idle frame loop need not wake for the others
+    if (state->focused) {
+        wake_after(0.5 - state->cursor_blink_timer);
+    }
+
     if(ui_is_clicked(gc.ui_ctx, block))
     {
         // gain focus
         gc.focused_text_edit = block->title;
         state->focused =  true;
 
-        state->cursor_pos = text_edit_get_char_at_x(block, state, gc.mouse_x);
+        state->cursor_pos = text_edit_get_char_at(block, state, gc.mouse_x, gc.mouse_y);
         state->selection_start = -1;
         state->cursor_visible = true;
         state->cursor_blink_timer = 0.0;
@@ -3235,6 +3595,7 @@ void ui_text_edit_update(ui_block_t *block)
             {
                 state->dragging = true;
                 gc.ui_ctx->interaction.drag_start_x = gc.mouse_x;
+                gc.ui_ctx->interaction.drag_start_y = gc.mouse_y;
             }
         }
     }
@@ -3248,11 +3609,12 @@ void ui_text_edit_update(ui_block_t *block)
         if(!state->mouse_selecting)
         {
             state->mouse_selecting = true;
-            state->drag_start_x = text_edit_get_char_at_x(block, state, gc.ui_ctx->interaction.drag_start_x);
+            state->drag_start_x = text_edit_get_char_at(block, state, gc.ui_ctx->interaction.drag_start_x,
+                                                        gc.ui_ctx->interaction.drag_start_y);
             state->selection_start = state->drag_start_x;
         }
 
-        i32 current_pos = text_edit_get_char_at_x(block, state, gc.mouse_x);
+        i32 current_pos = text_edit_get_char_at(block, state, gc.mouse_x, gc.mouse_y);
         state->selection_end = current_pos;
         state->cursor_pos = current_pos;
 
@@ -3279,11 +3641,7 @@ void ui_text_edit_update(ui_block_t *block)
     }
     gc.input_char_count = 0;
 
-    f32 cursor_x = 5; // Left padding
-    for (i32 i = 0; i < state->cursor_pos; i++) 
-    {
-        cursor_x += get_char_width(block->text.font, state->buffer[i]);
-    }
+    f32 cursor_x = text_edit_x_at(block, state, state->cursor_pos);
     
     i32 visible_width = block->w - 10; // Account for padding
     if (cursor_x - state->scroll_offset > visible_width) {
@@ -3317,31 +3675,38 @@ void ui_render_text_edit(ui_block_t *block)
     ui_draw_rect_in_block(block, block->w - border, 0,
                          border, block->h, border_color);
     
-    push_scissor(block->abs_x + border, block->abs_y + border, 
-                 block->w - border * 2, block->h - border * 2);
+    draw_list_push_scissor(&gc.draw_list, block->abs_x + border, block->abs_y + border, 
+                           block->w - border * 2, block->h - border * 2);
     
         if (state->selection_start >= 0) 
         {
             i32 start = MIN(state->selection_start, state->selection_end);
             i32 end = MAX(state->selection_start, state->selection_end);
             
-            f32 sel_start_x = 5;
-            for (i32 i = 0; i < start; i++) {
-                sel_start_x += get_char_width(block->text.font, state->buffer[i]);
-            }
-            
-            f32 sel_width = 0;
-            for (i32 i = start; i < end; i++) {
-                sel_width += get_char_width(block->text.font, state->buffer[i]);
-            }
-            
-            i32 sel_x = (i32)sel_start_x - state->scroll_offset;
-            i32 sel_y = 5;
-            i32 sel_h = block->h - 10;
-            
+            i32 line_height = get_line_height(block->text.font);
+            i32 sel_h       = block->h - 10;
             color4_t selection_color = {100, 150, 200, 128};
-            ui_draw_rect_in_block(block, sel_x, sel_y, 
-                                  (i32)sel_width, sel_h, selection_color);
+
+            // a rect per line the selection touches, up to the end of each but the last
+            i32 line = text_edit_line_of(state, start);
+            for (i32 line_start = start; line_start <= end; line++)
+            {
+                i32 line_end = line_start;
+                while (line_end < end && state->buffer[line_end] != '\n') {
+                    line_end++;
+                }
+
+                f32 sel_start_x = text_edit_x_at(block, state, line_start);
+                f32 sel_width   = text_edit_x_at(block, state, line_end) - sel_start_x;
+
+                i32 sel_x = (i32)sel_start_x - state->scroll_offset;
+                i32 sel_y = 5 + line * line_height;
+
+                ui_draw_rect_in_block(block, sel_x, sel_y, 
+                                      (i32)sel_width, sel_h, selection_color);
+
+                line_start = line_end + 1;
+            }
         }
         
         if (state->buffer_len > 0) 
@@ -3361,20 +3726,17 @@ void ui_render_text_edit(ui_block_t *block)
         
         if (state->focused && state->cursor_visible) 
         {
-            f32 cursor_x = 5;
-            for (i32 i = 0; i < state->cursor_pos; i++) {
-                cursor_x += get_char_width(block->text.font, state->buffer[i]);
-            }
+            f32 cursor_x = text_edit_x_at(block, state, state->cursor_pos);
             
             i32 cx = (i32)cursor_x - state->scroll_offset;
-            i32 cy = 5;
+            i32 cy = 5 + text_edit_line_of(state, state->cursor_pos) * get_line_height(block->text.font);
             i32 ch = block->h - 10;
             
             color4_t cursor_color = {255, 255, 255, 255};
             ui_draw_rect_in_block(block, cx, cy, 2, ch, cursor_color);
         }
     
-    pop_scissor();
+    draw_list_pop_scissor(&gc.draw_list);
 }
 
 text_edit_state_t *ui_text_edit(ui_context_t *ctx, char *title, i32 x, i32 y, i32 width, char *initial_text)
@@ -3420,8 +3782,8 @@ void ui_render_text_label (ui_block_t *block)
     }
 
     i32 padding = 5;
-    push_scissor(block->abs_x + padding, block->abs_y + padding, 
-                 block->w - padding * 2, block->h - padding * 2);
+    draw_list_push_scissor(&gc.draw_list, block->abs_x + padding, block->abs_y + padding, 
+                           block->w - padding * 2, block->h - padding * 2);
                  
         i32 line_height = get_line_height(block->text.font);
         
@@ -3466,7 +3828,7 @@ void ui_render_text_label (ui_block_t *block)
                 }
             }
         }
-    pop_scissor();
+    draw_list_pop_scissor(&gc.draw_list);
 }
 
 void ui_text_label(ui_context_t *ctx, char *title, const char *text, i32 x, i32 y, i32 max_width, color4_t bg_color, bool wrap)
@@ -3514,129 +3876,102 @@ void ui_end_frame(ui_context_t *ctx)
 {
     // glfwGetCursorPos(gc.window, &gc.mouse_x, &gc.mouse_y);
     ui_handle_mouse_move(ctx,0,0);
+    ui_release_surfaces();
 }
 
-/* For when I feel like experimenting with multithreading */
-thread_func_ret_t render_tile(thread_func_param_t data) 
+void render_tile(void *data) 
 {
-    tile_data_t *tile = (tile_data_t *)data;
-
-    fast_srand(tile->start_x * 1000 + tile->start_y + 1);
+    tile_data_t *job = (tile_data_t *)data;
 
-    for (u32 y = tile->start_y; y < tile->end_y; ++y) 
+    for (;;)
     {
-        for (u32 x = tile->start_x; x < tile->end_x; ++x) 
-        {
+        i32 next = atomic_inc(&job->next_tile) - 1;
+        if (next >= job->tile_count) {
+            break;
         }
+        draw_list_execute_tile(job->list, job->bins, job->tiles[next], job->img);
     }
-
-    #ifdef _WIN32
-        return 0;
-    #else
-        return NULL;
-    #endif
 }
 
-void render_all_parallel(void)
+/*
+    Rasterizes the tiles of the recorded frame that differ from the
+    last one, the rest of draw_buffer is still right. On the thread
+    pool when parallel, the main thread takes tiles as well instead of
+    just waiting.
+ */
+void render_draw_list(void)
 {
-    gc.draw_buffer.height = gc.screen_height;
-    gc.draw_buffer.width  = gc.screen_width;
-
-    u32 height  = gc.draw_buffer.height;
-    u32 width   = gc.draw_buffer.width;
-
-    gc.draw_buffer.pixels = ARENA_ALLOC(gc.frame_arena, height * width * sizeof(color4_t));
-
-    clear_screen(&gc.draw_buffer, HEX_TO_COLOR4(0xFFFFFF));
-
-    i32 num_threads = get_core_count();
-    const u32 tile_size = 64;
-
-    u32 tiles_x = CEIL_DIV(width, tile_size);
-    u32 tiles_y = CEIL_DIV(height, tile_size);
-    u32 total_tiles = tiles_x * tiles_y;
-
-    tile_data_t* tiles = ARENA_ALLOC(gc.frame_arena, total_tiles * sizeof(tile_data_t));
-    thread_handle_t* threads = ARENA_ALLOC(gc.frame_arena, num_threads * sizeof(thread_handle_t));
-
-    i32 tile_idx = 0;
-    
-    for (u32 ty = 0; ty < tiles_y; ty++) 
+    PROFILE("Binning")
     {
-        u32 start_y = ty * tile_size;
-        u32 end_y = (start_y + tile_size > height) ? height : start_y + tile_size;
-        
-        for (u32 tx = 0; tx < tiles_x; tx++) 
-        {
-            u32 start_x = tx * tile_size;
-            u32 end_x = (start_x + tile_size > width) ? width : start_x + tile_size;
-            
-            tiles[tile_idx] = (tile_data_t){
-                .start_x = start_x, .end_x = end_x,
-                .start_y = start_y, .end_y = end_y,
-                .width = width, .height = height
-            };
-            
-            int thread_slot = tile_idx % num_threads;
-            
-            if (tile_idx >= num_threads) {
-                PROFILE("Waiting for a slot"){
-                    join_thread(threads[thread_slot]);
-                }
-            }
-            
-            PROFILE("Actually creating a thread, does it matter ?")
-            {
-                threads[thread_slot] = create_thread(render_tile, &tiles[tile_idx]);
-            }
-            
-            tile_idx++;
-        }
+        draw_list_bin(&gc.draw_list, &gc.draw_bins, RENDER_TILE_SIZE);
     }
 
-    int remaining_threads = (total_tiles < num_threads) ? total_tiles : num_threads;
-
-    PROFILE("Waiting to join")
+    PROFILE("Damage")
     {
-        for (int i = 0; i < remaining_threads; i++) {
-            join_thread(threads[i]);
+        if (gc.full_redraw) {
+            draw_damage_invalidate(&gc.draw_damage);
         }
+        draw_list_damage(&gc.draw_list, &gc.draw_bins, &gc.draw_damage);
     }
 
-    u32 pos = gc.screen_width-20*10;
-
-    rendered_text_tt text = {
-        .font = gc.font,
-        .pos = {.x=pos, .y=0},
-        .color = {.r = 255, .g = 255, .b = 255, .a=255},
-        .string = frametime
+    tile_data_t job = {
+        .list       = &gc.draw_list,
+        .bins       = &gc.draw_bins,
+        .img        = &gc.draw_buffer,
+        .tiles      = gc.draw_damage.tiles,
+        .tile_count = (i32)arrlen(gc.draw_damage.tiles),
     };
-    
-    snprintf(frametime, BUFFER_SIZE, "%.2f ms, %d cores", gc.average_frame_time*1000,num_threads);
-    render_text_tt(&gc.draw_buffer, &text);
+    atomic_store_int(&job.next_tile, 0);
 
-    if(gc.profile)
+    if (gc.parallel && gc.pool)
     {
-        render_prof_entries();
+        i32 workers = MIN((i32)arrlen(gc.pool->threads), job.tile_count - 1);
+        for (i32 i = 0; i < workers; i++) {
+            threadpool_queue_job(gc.pool, render_tile, &job);
+        }
     }
 
-    prof_buf_count = 0;
-    
-    if(gc.capture)
+    render_tile(&job);
+
+    if (gc.parallel && gc.pool)
     {
-        export_image(&gc.draw_buffer, "capture.tga");
-        gc.capture = false;
+        PROFILE("Waiting for tiles")
+        {
+            threadpool_wait(gc.pool);
+        }
     }
 }
 
-void blit_to_screen(void *pixels, u32 width, u32 height)
+/*
+    Uploads only the damaged parts of view, the texture keeps the rest
+    from earlier frames. Past half the screen a single upload of the
+    whole frame beats many small ones.
+ */
+void blit_to_screen(image_view_t *view, rect_t const *rects, i32 rect_count, i32 area)
 {
+    u32 width  = view->width;
+    u32 height = view->height;
+
     glBindTexture(GL_TEXTURE_2D, gc.texture);
 
-    // update it with the new frame
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 
-                    (int)width, (int)height,
-                    GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    if (area * 2 >= (i32)(width * height))
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 
+                        (int)width, (int)height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, view->pixels);
+    }
+    else if (rect_count > 0)
+    {
+        // rows of a sub rect are width pixels apart in the buffer
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, (int)width);
+        for (i32 i = 0; i < rect_count; i++)
+        {
+            rect_t r = rects[i];
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.w, r.h,
+                            GL_RGBA, GL_UNSIGNED_BYTE, view->pixels + r.y * width + r.x);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
     
     glBindFramebuffer(GL_READ_FRAMEBUFFER, gc.read_fbo); // source
     glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);           // destination, make the default framebuffer active again ?
@@ -3652,7 +3987,7 @@ void present_frame(image_view_t* view)
 {
     PROFILE("blit_to_screen")
     {
-        blit_to_screen(view->pixels, view->width, view->height);
+        blit_to_screen(view, gc.draw_damage.rects, (i32)arrlen(gc.draw_damage.rects), gc.draw_damage.area);
     }
 
     PROFILE("swapping buffers")
@@ -3670,7 +4005,7 @@ void render_frame_history_graph(void)
     color4_t bg_color = HEX_TO_COLOR4(0x282a36);
     bg_color.a = 180;
     
-    draw_rect_solid_wh(&gc.draw_buffer, 0, 0, graph_width, graph_height, bg_color);
+    draw_list_rect(&gc.draw_list, 0, 0, graph_width, graph_height, bg_color);
     
     const f64 target_time = 0.01667;//60fps
     
@@ -3712,7 +4047,7 @@ void render_frame_history_graph(void)
         y1 = Clamp(margin, y1, graph_height - margin);
         y2 = Clamp(margin, y2, graph_height - margin);
         
-        draw_line(&gc.draw_buffer, x1, y1, x2, y2, line_color);
+        draw_list_line(&gc.draw_list, x1, y1, x2, y2, line_color);
     }
     
     color4_t ref_color = HEX_TO_COLOR4(0xffb86c);  
@@ -3720,16 +4055,16 @@ void render_frame_history_graph(void)
     
     for (i32 x = margin; x < graph_width - margin; x += 4) 
     {
-        draw_line(&gc.draw_buffer, x, center_y, x + 2, center_y, ref_color);
+        draw_list_line(&gc.draw_list, x, center_y, x + 2, center_y, ref_color);
     }
 }
 
 void render_mouse_stuff(void)
 {
-    draw_line(&gc.draw_buffer, gc.mouse_x-20, gc.mouse_y, gc.mouse_x+20, gc.mouse_y, gc.left_button_down?COLOR_RED:gc.right_button_down?COLOR_BLUE:COLOR_CYAN);
-    draw_line(&gc.draw_buffer, gc.mouse_x, gc.mouse_y-20, gc.mouse_x, gc.mouse_y+20, gc.left_button_down?COLOR_RED:gc.right_button_down?COLOR_BLUE:COLOR_CYAN);
-    // draw_circle_filled_aa(&gc.draw_buffer, gc.mouse_x, gc.mouse_y, 100, COLOR_CYAN);
-    // draw_circle_aa(&gc.draw_buffer, gc.mouse_x, gc.mouse_y, 100, COLOR_CYAN);
+    draw_list_line(&gc.draw_list, gc.mouse_x-20, gc.mouse_y, gc.mouse_x+20, gc.mouse_y, gc.left_button_down?COLOR_RED:gc.right_button_down?COLOR_BLUE:COLOR_CYAN);
+    draw_list_line(&gc.draw_list, gc.mouse_x, gc.mouse_y-20, gc.mouse_x, gc.mouse_y+20, gc.left_button_down?COLOR_RED:gc.right_button_down?COLOR_BLUE:COLOR_CYAN);
+    // draw_list_circle(&gc.draw_list, gc.mouse_x, gc.mouse_y, 100, COLOR_CYAN);
+    // draw_list_circle_outline(&gc.draw_list, gc.mouse_x, gc.mouse_y, 100, COLOR_CYAN);
     // draw_rounded_rectangle_filled_aa(&gc.draw_buffer, gc.mouse_x - 100, gc.mouse_y - 50, gc.mouse_x + 100, gc.mouse_y + 50, 20.0f, COLOR_CYAN);
 }
 
@@ -3906,7 +4241,7 @@ void render_debug_screen(void)
             .string = frametime
         };
         snprintf(frametime, BUFFER_SIZE, "%.2f ms", gc.average_frame_time*1000);
-        render_text_tt(&gc.draw_buffer, &frame_time);
+        draw_list_text(&gc.draw_list, &frame_time);
     
         if(gc.profile)
         {
@@ -3921,13 +4256,13 @@ void render_debug_screen(void)
             i32 screen_x = gc.ui_ctx->blocks[i]->abs_x;
             i32 screen_y = gc.ui_ctx->blocks[i]->abs_y;
 
-            draw_rect_outline_wh(&gc.draw_buffer, screen_x, screen_y, 
-                                 gc.ui_ctx->blocks[i]->w, gc.ui_ctx->blocks[i]->h, 
-                                (gc.ui_ctx->blocks[i]->id == gc.ui_ctx->interaction.active_id) ? COLOR_GREEN:COLOR_RED);
+            draw_list_rect_outline(&gc.draw_list, screen_x, screen_y, 
+                                   gc.ui_ctx->blocks[i]->w, gc.ui_ctx->blocks[i]->h, 
+                                  (gc.ui_ctx->blocks[i]->id == gc.ui_ctx->interaction.active_id) ? COLOR_GREEN:COLOR_RED);
 
-            draw_rect_outline_wh(&gc.draw_buffer, screen_x, screen_y, 
-                                  gc.ui_ctx->blocks[i]->scissor_region.w, gc.ui_ctx->blocks[i]->scissor_region.h,
-                                 (gc.ui_ctx->blocks[i]->id == gc.ui_ctx->interaction.active_id) ? COLOR_LIME:COLOR_YELLOW);
+            draw_list_rect_outline(&gc.draw_list, screen_x, screen_y, 
+                                    gc.ui_ctx->blocks[i]->scissor_region.w, gc.ui_ctx->blocks[i]->scissor_region.h,
+                                   (gc.ui_ctx->blocks[i]->id == gc.ui_ctx->interaction.active_id) ? COLOR_LIME:COLOR_YELLOW);
             // draw_aaline(&gc.draw_buffer, screen_x, screen_y, gc.mouse_x, gc.mouse_y, COLOR_GREEN);
             // draw_aaline(&gc.draw_buffer, screen_x+gc.ui_ctx->blocks[i]->w, screen_y+gc.ui_ctx->blocks[i]->h, gc.mouse_x, gc.mouse_y, COLOR_GREEN);
             // draw_aaline(&gc.draw_buffer, screen_x+gc.ui_ctx->blocks[i]->w, screen_y, gc.mouse_x, gc.mouse_y, COLOR_GREEN);
@@ -3941,8 +4276,8 @@ void render_debug_screen(void)
         {
             i32 screen_x = gc.ui_ctx->blocks[i]->abs_x;
             i32 screen_y = gc.ui_ctx->blocks[i]->abs_y;
-            draw_rect_outline_wh(&gc.draw_buffer, screen_x, screen_y,
-                                 gc.ui_ctx->blocks[i]->w, gc.ui_ctx->blocks[i]->h, COLOR_LIME);
+            draw_list_rect_outline(&gc.draw_list, screen_x, screen_y,
+                                   gc.ui_ctx->blocks[i]->w, gc.ui_ctx->blocks[i]->h, COLOR_LIME);
         }
     }
 
@@ -3983,8 +4318,8 @@ void render_interactive_texture(void)
 
     if(inside)
     {
-        draw_rect_outline_wh(&gc.draw_buffer, new_pos.x, new_pos.y, 
-                            new_pos.w, new_pos.h, HEX_TO_COLOR4(0x466472));
+        draw_list_rect_outline(&gc.draw_list, new_pos.x, new_pos.y, 
+                              new_pos.w, new_pos.h, HEX_TO_COLOR4(0x466472));
     }
 
     if (gc.left_button_down)
@@ -4000,8 +4335,8 @@ void render_interactive_texture(void)
         {
             new_pos.x = gc.mouse_x - drag_offset_x;
             new_pos.y = gc.mouse_y - drag_offset_y;
-            draw_rect_outline_wh(&gc.draw_buffer, new_pos.x, new_pos.y,
-                                 new_pos.w, new_pos.h, HEX_TO_COLOR4(0x61605e));
+            draw_list_rect_outline(&gc.draw_list, new_pos.x, new_pos.y,
+                                   new_pos.w, new_pos.h, HEX_TO_COLOR4(0x61605e));
         }
     }
     else
@@ -4009,22 +4344,38 @@ void render_interactive_texture(void)
         dragging = false;
     }
 
-    render_texture_to_buffer(&gc.draw_buffer, gc.my_texture, new_pos.x, new_pos.y, 5.0f, &new_pos);
+    draw_list_texture(&gc.draw_list, gc.my_texture, new_pos.x, new_pos.y, 5.0f, &new_pos);
 }
 
 void render_all(void)
 {
     gc.draw_buffer.height = gc.screen_height;
     gc.draw_buffer.width  = gc.screen_width;
+    gc.draw_buffer.premultiplied = true;
 
     u32 height  = gc.draw_buffer.height;
     u32 width   = gc.draw_buffer.width;
 
-    gc.draw_buffer.pixels = ARENA_ALLOC(gc.frame_arena, height * width * sizeof(color4_t));
+    // grown, never shrunk. The stride changes with the width, draw_list_damage
+    // sees the new size and repaints everything
+    if (height * width > gc.draw_buffer_capacity)
+    {
+        color4_t *pixels = realloc(gc.draw_buffer.pixels, height * width * sizeof(color4_t));
+        if (!pixels) {
+            fprintf(stderr, "Error : could not grow the draw buffer to %ux%u\n", width, height);
+            exit(EXIT_FAILURE);
+        }
+        gc.draw_buffer.pixels = pixels;
+        gc.draw_buffer_capacity = height * width;
+    }
+
+    // glyphs looked up from here on stay in their atlas page until the frame is drawn
+    glyph_cache_next_frame();
+    draw_list_begin(&gc.draw_list, width, height);
     
     PROFILE("Clearing the screen")
     {
-        clear_screen(&gc.draw_buffer, HEX_TO_COLOR4(0x282a36));
+        draw_list_clear(&gc.draw_list, HEX_TO_COLOR4(0x282a36));
         // clear_screen_radial_gradient(&gc.draw_buffer, HEX_TO_COLOR4(0x6272a4),HEX_TO_COLOR4(0x282a36));
     }
     
@@ -4053,6 +4404,11 @@ void render_all(void)
         }
     }
 
+    PROFILE("Executing draw list")
+    {
+        render_draw_list();
+    }
+
     prof_buf_count = 0;
     
     if(gc.capture)
@@ -4205,6 +4561,11 @@ bool init_all(u32 w, u32 h, char *title, char *icon)
 
     prof_init();
 
+    // workers for the tiled rasterizer, they live as long as the app.
+    // With one core binning is pure overhead, F6 still turns it on
+    gc.pool     = threadpool_create();
+    gc.parallel = gc.pool != NULL && get_core_count() > 1;
+
     gc.font = load_font_from_file("..\\Font\\Lato.ttf", 32.0f);
     gc.icon_font = load_font_from_file("..\\Font\\Icons.ttf", 32.0f);
 
@@ -4222,6 +4583,8 @@ bool init_all(u32 w, u32 h, char *title, char *icon)
     gc.resize      = true;
     gc.rescale     = true;
     gc.render      = true;
+    gc.idle        = true;
+    gc.wake_time   = max_f64;
     gc.dock        = false;
     gc.profile     = false;
     gc.changed     = true;
@@ -4257,6 +4620,19 @@ int main(void)
 
     while(!glfwWindowShouldClose((GLFWwindow*)gc.window))
     {
+        // nothing to show, skip the frame and its present until there is
+        if (!frame_needed())
+        {
+            wait_events();
+            continue;
+        }
+
+        // the UI answers input with a frame of delay here and there (hot
+        // and layout come from the last frame), give it one more to settle
+        gc.render    = gc.changed;
+        gc.changed   = false;
+        gc.wake_time = max_f64;
+
         double now = glfwGetTime();
         double dt = 0;
         if (prev_time != 0.0)
@@ -0,0 +1,208 @@
+#ifndef DRAW_LIST_H_
+#define DRAW_LIST_H_
+
+#include "util.h"
+#include "base_graphics.h"
+#include "font.h"
+
+/*
+    Draw command list
+
+    The UI does not touch pixels while it walks the block tree, it
+    records what it wants drawn into a list and the list is replayed
+    into an image afterwards:
+
+        draw_list_begin(&list, width, height);
+        draw_list_rect(&list, x, y, w, h, color);
+        draw_list_push_scissor(&list, x, y, w, h);
+            draw_list_text(&list, &text);
+        draw_list_pop_scissor(&list);
+        ...
+        draw_list_execute(&list, &image);
+
+    Replaying gives exactly what drawing right away would have, the
+    commands run in the order they were recorded and scissors apply
+    the same way. What the list adds is that the whole frame is known
+    before anything is rasterized, every command carries the screen
+    area it can touch (already clipped by the scissors around it and
+    the target) and that is what sorting, batching, culling, caching
+    or splitting the replay across threads work from.
+
+    Commands that end up outside the current scissor or the target
+    are dropped when recorded, nothing about them is kept.
+
+    A list can also be begun at an offset, draw_list_begin_at(&list,
+    x, y, w, h), for an image that stands for that part of the screen.
+    Commands are recorded in screen coordinates as always and moved
+    when replayed, that is how a block draws itself into a surface of
+    its own.
+
+    Strings are copied into the list, so the caller's buffer can be
+    a local. The arrays are kept from frame to frame, recording a
+    frame the size of the last one does not allocate.
+
+    Tiles
+
+    For a parallel replay the target is cut into square tiles and
+    every command is binned into the tiles its bounds overlap:
+
+        draw_list_bin(&list, &bins, 64);
+        ... on any thread, each tile once
+        draw_list_execute_tile(&list, &bins, tile, &image);
+
+    A tile replays its own commands in recorded order with the scissor
+    set to the tile, so tiles never write the same pixel and the
+    result is the same as draw_list_execute. Scissor pushes and pops
+    are not replayed per tile, every command carries the clip it was
+    recorded under instead.
+
+    Replay only reads the list and the fonts, glyphs are looked up
+    while recording (to measure the text) so they are cached by then.
+ */
+
+/*
+    Damage
+
+    The UI records the whole frame every time, yet most frames draw
+    what the last one did. Every tile gets a hash of the commands
+    binned into it, what they draw and the clip they get inside the
+    tile, and a tile that hashes the same as last frame already holds
+    the right pixels, as long as the target is kept between frames:
+
+        draw_list_bin(&list, &bins, 64);
+        draw_list_damage(&list, &bins, &damage);
+        ... replay damage.tiles, upload damage.rects
+
+    Anything that changes what is drawn is caught without the UI having
+    to report it, a blinking cursor dirties the tiles under the cursor
+    and nothing else. The frame has to start with a clear, a tile is
+    redrawn from scratch. Textures are hashed by pointer, changing the
+    pixels of one in place needs draw_damage_invalidate.
+
+    Bins and damage work on lists begun with draw_list_begin.
+ */
+
+typedef enum
+{
+    DRAW_CMD_CLEAR,
+    DRAW_CMD_RECT,
+    DRAW_CMD_RECT_OUTLINE,
+    DRAW_CMD_ROUNDED_RECT,
+    DRAW_CMD_LINE,
+    DRAW_CMD_CIRCLE,
+    DRAW_CMD_CIRCLE_OUTLINE,
+    DRAW_CMD_RADIAL_SEGMENT,
+    DRAW_CMD_TEXT,
+    DRAW_CMD_TEXT_UNICODE,
+    DRAW_CMD_TEXTURE,
+    DRAW_CMD_IMAGE,
+    DRAW_CMD_IMAGE_OPAQUE,
+    DRAW_CMD_PUSH_SCISSOR,
+    DRAW_CMD_POP_SCISSOR,
+    DRAW_CMD_COUNT,
+} draw_cmd_type_t;
+
+typedef struct
+{
+    u8          type;
+    color4_t    color;
+    u32         clip;       // into the list's clips, the scissor it was recorded under
+
+    // what the command can touch on screen, clipped. For a scissor push
+    // the region as it was given
+    rect_t      bounds;
+
+    union {
+        struct { i32 x, y, w, h; f32 radius; }          rect;
+        struct { i32 x0, y0, x1, y1; }                  line;
+        struct { i32 cx, cy; f32 radius; }              circle;
+        struct { font_tt *font; u32 offset; i32 x, y; } text;       // offset into the list's text
+        struct { image_view_t *image; i32 x, y; f32 scale; } texture;
+        struct { image_view_t const *image; i32 x, y; u64 version; } image;
+        struct { u32 index; }                           radial;     // into the list's radials
+    } as;
+} draw_cmd_t;
+
+typedef struct
+{
+    radial_layout_t     layout;
+    radial_segment_t    segment;
+} draw_radial_t;
+
+typedef struct
+{
+    draw_cmd_t      *cmds;
+    char            *text;
+    draw_radial_t   *radials;
+    rect_t          *clips;     // the effective scissor each time it changed, the target first
+
+    i32             x, y;       // where the target's top left corner is, in recorded coordinates
+    i32             width, height;
+
+    // the scissors as they will be when the commands run, for culling
+    rect_t          clip_stack[MAX_SCISSOR_STACK];
+    u32             clip_depth;
+    rect_t          clip;
+    u32             clip_index;
+} draw_list_t;
+
+typedef struct
+{
+    i32     tile_size;
+    i32     tiles_x, tiles_y;
+    i32     tile_count;
+
+    // tile t replays cmds[start[t]] up to cmds[start[t + 1]], indices into the list
+    u32     *start;
+    u32     *cmds;
+} draw_bins_t;
+
+typedef struct
+{
+    i32     tile_size;
+    i32     tiles_x, tiles_y;
+    i32     width, height;
+    bool    invalid;    // repaint everything next frame
+
+    u64     *hashes;    // per tile, as of the last frame
+    u32     *tiles;     // the tiles that changed this frame
+    rect_t  *rects;     // the same tiles merged into rectangles, in pixels
+    i32     area;       // pixels in tiles
+} draw_damage_t;
+
+void draw_list_begin(draw_list_t *list, i32 width, i32 height);
+void draw_list_begin_at(draw_list_t *list, i32 x, i32 y, i32 width, i32 height);
+void draw_list_free(draw_list_t *list);
+
+void draw_list_clear(draw_list_t *list, color4_t color);
+void draw_list_rect(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, color4_t color);
+void draw_list_rect_outline(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, color4_t color);
+void draw_list_rounded_rect(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, f32 radius, color4_t color);
+void draw_list_line(draw_list_t *list, i32 x0, i32 y0, i32 x1, i32 y1, color4_t color);
+void draw_list_circle(draw_list_t *list, i32 cx, i32 cy, f32 radius, color4_t color);
+void draw_list_circle_outline(draw_list_t *list, i32 cx, i32 cy, f32 radius, color4_t color);
+void draw_list_radial_segment(draw_list_t *list, radial_layout_t const *layout, radial_segment_t const *segment, color4_t color);
+void draw_list_text(draw_list_t *list, rendered_text_tt const *text);
+void draw_list_text_unicode(draw_list_t *list, rendered_text_tt const *text);
+
+// out_rect gets the part of the target the texture covers, as render_texture_to_buffer gives it
+void draw_list_texture(draw_list_t *list, image_view_t *texture, i32 x, i32 y, f32 scale, rect_t *out_rect);
+
+// composite_image at x, y. version changes whenever the pixels do, damage tracking only sees that
+void draw_list_image(draw_list_t *list, image_view_t const *image, i32 x, i32 y, bool opaque, u64 version);
+
+bool draw_list_push_scissor(draw_list_t *list, i32 x, i32 y, i32 w, i32 h);
+bool draw_list_pop_scissor(draw_list_t *list);
+
+void draw_list_execute(draw_list_t const *list, image_view_t *img);
+void draw_list_execute_cmd(draw_list_t const *list, draw_cmd_t const *cmd, image_view_t *img);
+
+void draw_list_bin(draw_list_t const *list, draw_bins_t *bins, i32 tile_size);
+void draw_list_execute_tile(draw_list_t const *list, draw_bins_t const *bins, i32 tile, image_view_t *img);
+void draw_bins_free(draw_bins_t *bins);
+
+void draw_list_damage(draw_list_t const *list, draw_bins_t const *bins, draw_damage_t *damage);
+void draw_damage_invalidate(draw_damage_t *damage);
+void draw_damage_free(draw_damage_t *damage);
+
+#endif // DRAW_LIST_H_
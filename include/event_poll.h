@@ -2,10 +2,20 @@
 #define EVENT_POLL_H
 
 #include "socket.h"
+#include "timer_wheel.h"
+
+#ifndef _WIN32
+    #include <pthread.h>
+    #include <time.h>
+#endif
 
 #define MAX_EVENTS      64
 #define EV_BUF_SIZE     8192
 
+#define EV_MAX_WAIT_MS              1000
+#define EV_IDLE_TIMEOUT_MS          60000   // connection sent nothing for this long
+#define EV_HANDSHAKE_TIMEOUT_MS     10000   // connected but never sent a single byte
+
 #define EVENT_READ      0x01
 #define EVENT_WRITE     0x02
 #define EVENT_ET        0x04
@@ -16,6 +26,9 @@ typedef void (*on_receive_cb)(void *user_data, socket_handle fd, const char *buf
 typedef void (*on_send_cb)(void *user_data, socket_handle fd, size_t bytes_sent);
 typedef void (*on_disconnect_cb)(void *user_data, socket_handle fd);
 typedef void (*on_error_cb)(void *user_data, socket_handle fd, int error_code);
+typedef void (*on_writable_cb)(void *user_data, socket_handle fd);
+typedef void (*on_ready_cb)(void *user_data, socket_handle fd);
+typedef void (*on_loop_end_cb)(void *user_data);
 
 typedef struct {
     on_accept_cb        on_accept;
@@ -23,6 +36,8 @@ typedef struct {
     on_send_cb          on_send;
     on_disconnect_cb    on_disconnect;
     on_error_cb         on_error;
+    on_writable_cb      on_writable;            // after event_poll_want_write, socket has room again
+    on_loop_end_cb      on_loop_end;            // once per wakeup, after every event in it was handled
 } event_callbacks_t;
 
 #ifdef _WIN32
@@ -30,20 +45,143 @@ typedef struct {
     extern LPFN_GETACCEPTEXSOCKADDRS g_GetAcceptExSockaddrs;
 #endif
 
+struct event_ctx_t;
+struct event_uring_t;
+struct event_shm_t;
+struct thread_pool_t;
+struct iovec;
+
+typedef enum
+{
+    EVENT_BACKEND_EPOLL,
+    EVENT_BACKEND_URING,        // linux io_uring, falls back to epoll when unavailable
+} event_backend_t;
+
+typedef struct { socket_handle key; struct event_ctx_t *value; } event_conn_map_t;
+
+#ifndef _WIN32
+
+typedef enum
+{
+    EVENT_CB_ACCEPT,
+    EVENT_CB_RECEIVE,
+    EVENT_CB_WRITABLE,
+    EVENT_CB_DISCONNECT,
+    EVENT_CB_ERROR,
+    EVENT_CB_READY,             // event_poll_watch owners, includes what they dispatch themselves (shm)
+    EVENT_CB_LOOP_END,
+    EVENT_CB_COUNT,
+} event_cb_kind;
+
+/*
+    Loop counters. Bumped with relaxed atomics from the loop and the
+    pool workers alike, read them through event_poll_get_stats.
+
+    Together they split a slow request into its parts: syscalls and
+    eagain say how much time goes to the kernel, cb_ns[RECEIVE] is
+    everything the owner does with the bytes (parsing and handling),
+    the owner's own counters split that further.
+ */
+typedef struct
+{
+    uint64_t    started_ms;
+    uint64_t    bytes_in;
+    uint64_t    bytes_out;              // event_poll_send, event_poll_note_send and shm writes
+    uint64_t    accepts;
+    uint64_t    closes;
+    uint64_t    wakeups;                // epoll_wait / io_uring_enter returned
+    uint64_t    events;                 // ready fds / completions handled
+    uint64_t    syscalls;               // recv, send, accept, epoll_wait, epoll_ctl, io_uring_enter
+    uint64_t    eagain;
+    uint64_t    pool_pending;           // connections handed to a worker, not back yet
+    uint64_t    throttles;              // reads stopped because a token bucket ran dry
+    uint64_t    read_pauses;            // reads stopped by the owner, see event_poll_pause_read
+    uint64_t    cb_calls[EVENT_CB_COUNT];
+    uint64_t    cb_ns[EVENT_CB_COUNT];  // time spent inside each kind of callback
+} event_poll_stats_t;
+
+// one connection, the owner of each field is the one thread touching its side of the ctx
+typedef struct
+{
+    uint64_t    bytes_in;
+    uint64_t    bytes_out;
+    uint64_t    recv_calls;
+    uint64_t    send_calls;
+    uint64_t    eagain_in;
+    uint64_t    eagain_out;
+    uint64_t    connected_ms;           // since accept
+    uint64_t    idle_ms;                // since the last byte came in
+} event_conn_stats_t;
+
+#define EVENT_STAT_ADD(ep, field, n)    __atomic_fetch_add(&(ep)->stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+#define EVENT_STAT_SUB(ep, field, n)    __atomic_fetch_sub(&(ep)->stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+
+static inline uint64_t event_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// runs call and books its time under kind
+#define EVENT_TIMED_CB(ep, kind, call)                                  \
+    do {                                                                \
+        uint64_t cb_start_ = event_now_ns();                            \
+        call;                                                           \
+        EVENT_STAT_ADD(ep, cb_calls[kind], 1);                          \
+        EVENT_STAT_ADD(ep, cb_ns[kind], event_now_ns() - cb_start_);    \
+    } while (0)
+
+/*
+    Token bucket, the tokens are input bytes. rate refills it per second
+    up to burst. A recv takes whatever it read so the count can go below
+    zero, reading resumes once the debt is paid back.
+ */
+typedef struct
+{
+    uint32_t    rate;                   // bytes per second, 0 = unlimited
+    uint32_t    burst;
+    int64_t     tokens;
+    uint64_t    last_ms;
+} event_bucket_t;
+
+#endif
+
 typedef struct  
 {
 #ifdef _WIN32
     HANDLE              iocp;
 #else
     int                 epoll_fd;
+    event_backend_t     backend;
+    struct event_uring_t *uring;
+    struct event_ctx_t  *listener_ctx;
+    event_conn_map_t    *conns;                 // fd -> ctx
+    timer_wheel_t       timers;
+    uint64_t            now_ms;                 // cached once per loop iteration
+    uint32_t            idle_timeout_ms;
+    uint32_t            handshake_timeout_ms;
+    struct thread_pool_t *pool;                 // set -> reads run on worker threads
+    struct event_ctx_t  *wake_ctx;              // eventfd, workers hand drained connections back
+    pthread_mutex_t     done_lock;
+    struct event_ctx_t  **done;                 // drained by a worker, waiting to be re-armed / closed
+    struct event_ctx_t  **rearm;                // write interest changed from a worker
+    struct event_ctx_t  **watched;              // event_poll_watch, freed with ep
+    struct event_shm_t  *shm;                   // local clients over shared memory, see event_poll_listen_shm
+    event_poll_stats_t  stats;
+    event_bucket_t      conn_limit;             // template for every new connection's bucket
+    event_bucket_t      global_bucket;          // shared by all connections
+    pthread_mutex_t     bucket_lock;            // global_bucket, workers read concurrently
+    pthread_t           loop_thread;
 #endif
     Socket              listener;
     socket_handle       *sockets;
     bool                running;
     event_callbacks_t   *callbacks;
+    void                *user_data;             // the one handed to event_poll_loop
 }event_poll_t;
 
-typedef struct 
+typedef struct event_ctx_t
 {
 #ifdef _WIN32
     // IOCPContext
@@ -52,6 +190,33 @@ typedef struct
     char            buffer[EV_BUF_SIZE];
     size_t          send_len;
     int             operation_type;         // 0 = recv, 1 = send, 2 = accept
+#else
+    timer_node_t    idle_timer;
+    uint64_t        accepted_ms;
+    uint64_t        last_active_ms;
+    uint64_t        read_deadline_ms;       // 0 = none, armed by the protocol while a frame is incomplete
+    uint64_t        bytes_in;
+    uint64_t        bytes_out;
+    uint64_t        recv_calls;
+    uint64_t        send_calls;
+    uint64_t        eagain_in;
+    uint64_t        eagain_out;
+    bool            recv_armed;             // io_uring: a multishot recv still references this ctx
+    bool            closing;                // io_uring: freed once the pending recv completes
+    bool            in_worker;              // queued on the pool, the loop wont free it meanwhile
+    bool            armed;                  // sitting in epoll, ONESHOT not fired yet
+    bool            want_write;             // re arm with EVENT_WRITE, any thread sets it, see event_ctx_want_write
+    bool            read_throttled;         // out of tokens, EVENT_READ is off until resume_timer
+    bool            read_paused;            // the owner asked, see event_poll_pause_read, any thread sets it
+    event_bucket_t  bucket;
+    timer_node_t    resume_timer;
+    uint64_t        throttled_ms;           // when read_throttled was set, its deadlines move by the stall
+    char            *held;                  // io_uring: stb array, received while reading was off
+    bool            delivering;             // io_uring: handing out held, a remove leaves the free to that
+    int             worker_rc;              // event_poll_drain result handed back by the worker
+    bool            deadline_requested;     // by on_receive on the worker, applied once the ctx is back
+    uint32_t        deadline_request_ms;
+    on_ready_cb     on_ready;               // set -> not a connection, see event_poll_watch
 #endif
     socket_handle   fd;
     event_poll_t    *ep;
@@ -65,10 +230,60 @@ event_poll_t *event_poll_create(const char *ip, const char *port);
 void event_poll_destroy(event_poll_t *ep);
 int post_recv(event_ctx_t *ctx);
 int post_accept(event_poll_t *ep, void *user_data);
+#else
+event_poll_t *event_poll_create(const char *ip, const char *port);
+event_poll_t *event_poll_create_ex(const char *ip, const char *port, event_backend_t backend);
+void event_poll_destroy(event_poll_t *ep);
+int event_poll_register(event_poll_t *ep, socket_handle fd, uint32_t events);
+int event_poll_register_ctx(event_poll_t *ep, event_ctx_t *ctx, uint32_t events);
+int event_poll_modify(event_poll_t *ep, socket_handle fd, uint32_t events);
+int event_poll_modify_ctx(event_poll_t *ep, event_ctx_t *ctx, uint32_t events);
+int event_poll_remove(event_poll_t *ep, socket_handle fd);
+int event_poll_remove_ctx(event_poll_t *ep, event_ctx_t *ctx);
+event_ctx_t *event_poll_get_ctx(event_poll_t *ep, socket_handle fd);
+void event_poll_set_timeouts(event_poll_t *ep, uint32_t idle_ms, uint32_t handshake_ms);
+int event_poll_set_read_deadline(event_poll_t *ep, socket_handle fd, uint32_t timeout_ms);
+int event_poll_set_read_deadline_ctx(event_poll_t *ep, event_ctx_t *ctx, uint32_t timeout_ms);
+event_ctx_t *event_poll_track_connection(event_poll_t *ep, socket_handle fd, void *user_data);
+void event_poll_release_ctx(event_poll_t *ep, event_ctx_t *ctx);
+bool event_poll_charge_read(event_poll_t *ep, event_ctx_t *ctx, size_t n);
+void event_poll_update_reading(event_poll_t *ep, event_ctx_t *ctx);
+int event_poll_set_thread_pool(event_poll_t *ep, struct thread_pool_t *pool);
+int event_poll_want_write(event_poll_t *ep, event_ctx_t *ctx, bool on);
+int event_poll_pause_read(event_poll_t *ep, event_ctx_t *ctx, bool paused);
+void event_poll_set_rate_limit(event_poll_t *ep, uint32_t conn_rate, uint32_t conn_burst, uint32_t global_rate, uint32_t global_burst);
+event_ctx_t *event_poll_watch(event_poll_t *ep, socket_handle fd, on_ready_cb on_ready, void *user_data);
+void event_poll_get_stats(event_poll_t *ep, event_poll_stats_t *out);
+void event_poll_get_conn_stats(event_poll_t *ep, event_ctx_t *ctx, event_conn_stats_t *out);
+void event_poll_note_send(event_poll_t *ep, event_ctx_t *ctx, ssize_t n);
+extern const char *event_cb_names[EVENT_CB_COUNT];
+int event_poll_unwatch(event_poll_t *ep, event_ctx_t *ctx);
 
+// want_write and read_paused are set by workers too, every read goes through these
+static inline bool event_ctx_want_write(event_ctx_t *ctx)  { return __atomic_load_n(&ctx->want_write, __ATOMIC_ACQUIRE); }
+static inline bool event_ctx_read_paused(event_ctx_t *ctx) { return __atomic_load_n(&ctx->read_paused, __ATOMIC_ACQUIRE); }
 
+/* io_uring backend, see event_poll_uring.c */
+bool event_uring_supported(void);
+int event_uring_init(event_poll_t *ep);
+void event_uring_destroy(event_poll_t *ep);
+void event_uring_loop(event_poll_t *ep, void *user_data);
+int event_uring_send(event_poll_t *ep, socket_handle fd, const char *data, size_t len);
+int event_uring_remove_ctx(event_poll_t *ep, event_ctx_t *ctx);
+int event_uring_watch(event_poll_t *ep, event_ctx_t *ctx);
+int event_uring_unwatch(event_poll_t *ep, event_ctx_t *ctx);
+int event_uring_set_reading(event_poll_t *ep, event_ctx_t *ctx, bool on);
 
-
+/* shared memory transport for local clients, see event_poll_shm.c */
+int event_poll_listen_shm(event_poll_t *ep, const char *path);
+bool event_poll_is_shm(event_poll_t *ep, socket_handle fd);
+ssize_t event_poll_shm_writev(event_poll_t *ep, socket_handle fd, const struct iovec *iov, int count);
+void event_shm_destroy(event_poll_t *ep);
 #endif
 
+int event_poll_send(event_poll_t *ep, socket_handle fd, const char *data, size_t len);
+
+void event_poll_loop(event_poll_t *ep, event_callbacks_t *callbacks, void *user_data);
+void event_poll_stop(event_poll_t *ep);
+
 #endif // EVENT_POLL_H
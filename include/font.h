@@ -10,6 +10,7 @@
 #include "base_graphics.h"
 #include "util.h"
 
+#include "stb_rect_pack.h"
 #include "stb_truetype.h"
 
 #define STAR_ICON           u8"\uf005"
@@ -28,25 +29,145 @@
 #define RIGHT_CIRCLE_ARROW  u8"\uf0a9"
 #define DOWN_CIRCLE_ARROW   u8"\uf0ab"
 
-#define GLYPH_CACHE_SIZE    120
+/*
+    Glyph atlas
+
+    Every font (a font_tt is one size) rasterizes its glyphs into
+    square coverage pages packed with stb_rect_pack, and finds them
+    again through an open addressing table keyed by codepoint. A
+    glyph's bitmap points into its page, rows are stride bytes apart.
+
+    Packed rects can't be freed one by one, so eviction works on whole
+    pages: once GLYPH_ATLAS_MAX_PAGES are in use and a glyph fits in
+    none of them, the page drawn from least recently is cleared and
+    its glyphs are forgotten. Recency is counted in frames,
+    glyph_cache_next_frame() starts one. A page used this frame is
+    never evicted, so every bitmap a frame looked up stays put until
+    the next one. The atlas never grows past the cap, a glyph that
+    finds every page in use this frame is drawn without a bitmap and
+    rasterized again when a later frame looks it up. The glyph_info_t
+    itself may move on the next lookup that misses, copy what you need
+    out of it.
+
+    Only a lookup that misses writes to the atlas. Once a frame has
+    looked its text up (a draw list does while recording), replaying
+    it from several threads only reads.
+ */
+#define GLYPH_ATLAS_SIZE        512
+#define GLYPH_ATLAS_MAX_PAGES   4
 
 typedef struct 
 {
-    u32 x, y, w, h;            
+    u32 x, y, w, h;             // where in the page
     i32 bearing_x, bearing_y;
     f32 advance;
-    u8 *bitmap;
+    u8 *bitmap;                 // into the page, NULL for blank glyphs
+    u32 stride;
+    u32 codepoint;
+    i32 page;                   // -1 for none, -2 while the atlas had no room for it
 } glyph_info_t;
 
+typedef struct
+{
+    u8              *pixels;
+    stbrp_context   packer;
+    stbrp_node      nodes[GLYPH_ATLAS_SIZE];
+    u64             last_used;  // frame it was last looked up in
+} glyph_page_t;
+
+typedef struct
+{
+    glyph_page_t    **pages;    // never moved, the packer points into itself
+    glyph_info_t    *glyphs;
+    u32             *table;     // glyph index + 1, 0 is an empty slot
+    u32             table_bits;
+    u64             full_frame; // last frame a glyph found no room, those retry in a later one
+} glyph_atlas_t;
+
+/*
+    Text measurement cache
+
+    Layout measures the same labels every frame. measure_text keeps,
+    per font, the width of a string's first line and the pen x before
+    each of its bytes, keyed by a hash of that line, so a string is
+    walked glyph by glyph once and then only hashed and compared with
+    the copy the entry keeps. get_string_width goes through it.
+
+    Entries not asked for this frame or the last are dropped whenever
+    the cache has doubled since it was last swept, a list that shows
+    the same 10k labels every frame keeps all of them. Main thread
+    only, the entry returned holds until the next measure_text.
+ */
+typedef struct
+{
+    u64     key;
+    char    *text;      // copy of the line, a hit has to match it and not just the hash
+    f32     width;
+    u32     count;      // bytes up to the first newline
+    f32     *x;         // pen x before each of them, x[count] is the width
+    u64     last_used;  // glyph frame
+} text_measure_t;
+
+/*
+    Wrap cache
+
+    wrap_text splits a text into tokens once, words with their width,
+    single spaces and newlines, and keeps them per font keyed by a hash
+    of the text, with a copy of the text a hit is compared against.
+    Wrapping at a width is then one pass over the tokens with no glyph
+    lookups, and the result of the last wrap is kept too, a label
+    wrapped at the same width again is only copied out. Resizing
+    a panel of notes re-wraps each note in a linear pass, measuring
+    nothing.
+
+    Swept like the measurement cache, main thread only.
+ */
+typedef enum
+{
+    WRAP_TOKEN_WORD,
+    WRAP_TOKEN_SPACE,       // a space that doesn't follow a word
+    WRAP_TOKEN_NEWLINE,
+} wrap_token_kind_t;
+
+typedef struct
+{
+    u32     start, length;  // into the text
+    f32     width;
+    u8      kind;
+    bool    space_after;    // a word and the one space after it
+} wrap_token_t;
+
+typedef struct
+{
+    u64             key;
+    char            *text;          // copy, a hit has to match it and not just the hash
+    u32             length;         // of the text
+    wrap_token_t    *tokens;
+
+    // the last wrap
+    f32             max_width;
+    char            *out;           // with its terminator
+    i32             line_count;
+    f32             max_line_width;
+
+    u64             last_used;
+} text_wrap_t;
+
 typedef struct 
 {
     stbtt_fontinfo info;
     u8 *font_buffer;
     f32 scale;
     i32 ascent, descent, line_gap;
+    i32 line_height;
     
-    glyph_info_t glyph_cache[GLYPH_CACHE_SIZE];
-    u8 cache_valid[GLYPH_CACHE_SIZE];
+    glyph_atlas_t atlas;
+
+    text_measure_t *measures;
+    i32 measures_swept;     // entries left by the last sweep
+
+    text_wrap_t *wraps;
+    i32 wraps_swept;
 } font_tt;
 
 typedef struct 
@@ -67,12 +188,15 @@ font_tt* load_font_from_file(const char *filename, f32 font_size);
 font_tt* init_font_tt(u8 *font_buffer, f32 font_size);
 void free_font(font_tt *font);
 glyph_info_t* get_glyph(font_tt *font, u32 codepoint);
+void glyph_cache_next_frame(void);
 glyph_info_t * render_glyph_to_buffer_tt(font_tt *font, u32 codepoint, 
                            image_view_t const *color_buf,
                            u32 dst_x, u32 dst_y, color4_t color);
+text_measure_t const *measure_text(font_tt *font, const char *text);
 float get_string_width(font_tt *font, const char *text);
 float get_char_width(font_tt *font, char c);
 int get_line_height(font_tt *font);
+text_wrap_t const *wrap_text_cached(font_tt *font, const char *text, f32 max_width);
 void wrap_text(font_tt *font, const char *text, float max_width, char *out, size_t out_len, int *line_n, float *max_line_w);
 
 void render_text_tt(image_view_t *color_buf, rendered_text_tt *text);
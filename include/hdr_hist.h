@@ -0,0 +1,36 @@
+#ifndef HDR_HIST_H_
+#define HDR_HIST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define HDR_HIST_SUB_BITS       8                               // 256 linear steps per power of two
+#define HDR_HIST_SUB_COUNT      (1u << HDR_HIST_SUB_BITS)
+#define HDR_HIST_HALF_COUNT     (HDR_HIST_SUB_COUNT / 2)
+#define HDR_HIST_BUCKETS        (HDR_HIST_SUB_COUNT + (64 - HDR_HIST_SUB_BITS) * HDR_HIST_HALF_COUNT)
+
+/*
+    Fixed size log-linear histogram, HdrHistogram style. Every value
+    lands in a counter, there is no sampling, and any percentile is
+    read back with a relative error below 1 / HDR_HIST_HALF_COUNT
+    (< 0.8%) whether it is 3 or 3 billion.
+ */
+typedef struct
+{
+    uint64_t    counts[HDR_HIST_BUCKETS];
+    uint64_t    total;
+    uint64_t    min;
+    uint64_t    max;
+    double      sum;
+} hdr_hist_t;
+
+void hdr_hist_init(hdr_hist_t *h);
+void hdr_hist_record(hdr_hist_t *h, uint64_t value);
+void hdr_hist_merge(hdr_hist_t *dst, const hdr_hist_t *src);
+
+// highest value that is equivalent to the one at percentile (0 - 100)
+uint64_t hdr_hist_percentile(const hdr_hist_t *h, double percentile);
+double hdr_hist_mean(const hdr_hist_t *h);
+
+#endif // HDR_HIST_H_
@@ -0,0 +1,95 @@
+#ifndef HTTP_H_
+#define HTTP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define HTTP_MAX_HEADERS    32
+#define HTTP_MAX_HEAD       (16u << 10)         // request line and headers
+#define HTTP_MAX_BODY       (64u << 10)
+#define HTTP_CHUNK_SIZE     (16u << 10)         // what writers aim for per chunk
+
+/*
+    Minimal HTTP/1.1
+
+    The parser never copies: a request is a set of slices into the
+    bytes it was parsed from, the receive buffer itself as long as the
+    request arrived whole in it. They are only good until that buffer
+    is handed back, so handle the request right away.
+
+    Request bodies need a Content-Length, a chunked one is answered
+    with 501. Responses are written into stb_ds char arrays like the
+    frames of todo_proto.h, with a Content-Length when the body is known
+    up front or chunked when it is produced as it goes:
+
+        http_begin_response(&buf, 200, "application/json", true, -1);
+        size_t at = http_begin_chunk(&buf);
+        ... body bytes
+        http_end_chunk(&buf, at);
+        http_end_chunked(&buf);
+ */
+
+typedef struct
+{
+    const char  *p;
+    size_t      len;
+} http_slice_t;
+
+typedef struct
+{
+    http_slice_t    name;
+    http_slice_t    value;
+} http_header_t;
+
+typedef struct
+{
+    http_slice_t    method;
+    http_slice_t    path;           // target up to the '?'
+    http_slice_t    query;          // after it, without it
+    int             minor;          // HTTP/1.<minor>
+    http_header_t   headers[HTTP_MAX_HEADERS];
+    size_t          header_count;
+    http_slice_t    body;
+    bool            keep_alive;
+} http_request_t;
+
+/*
+    Size of the first complete request in data (head and body), 0 if
+    more bytes are needed, or minus the status to answer with before
+    closing the connection (-400, -413, -431, -501)
+ */
+int64_t http_parse_request(const char *data, size_t len, http_request_t *req);
+
+/*
+    Size of the first complete response in data, 0 if more bytes are
+    needed, -1 if it is malformed. body is the raw body, still chunk
+    encoded if it was sent that way. For clients.
+ */
+int64_t http_parse_response(const char *data, size_t len, int *status, http_slice_t *body);
+
+bool http_slice_eq(http_slice_t s, const char *text);
+bool http_slice_ieq(http_slice_t s, const char *text);
+http_slice_t http_get_header(const http_request_t *req, const char *name);
+
+/*
+    Value of key in a query string or form body, %XX and + decoded and
+    NUL terminated into out (cut to fit). False if key is not there.
+ */
+bool http_form_value(http_slice_t form, const char *key, char *out, size_t out_size);
+
+const char *http_status_text(int status);
+
+// content_length -1 -> chunked
+void http_begin_response(char **buf, int status, const char *content_type, bool keep_alive, int64_t content_length);
+void http_put_response(char **buf, int status, const char *content_type, bool keep_alive, const char *body, size_t len);
+
+size_t http_begin_chunk(char **buf);
+void http_end_chunk(char **buf, size_t chunk_start);
+void http_end_chunked(char **buf);
+
+void http_put(char **buf, const char *data, size_t len);
+void http_putf(char **buf, const char *fmt, ...);
+void http_put_json_str(char **buf, const char *str, size_t len);
+
+#endif // HTTP_H_
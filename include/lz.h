@@ -0,0 +1,46 @@
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define LZ_HASH_BITS        14                  // 16k positions remembered
+#define LZ_MIN_MATCH        4
+#define LZ_MAX_OFFSET       65535
+
+// worst case output for len bytes of input, nothing matched
+#define LZ_BOUND(len)       ((len) + (len) / 255 + 16)
+
+/*
+    Small LZ77 codec, LZ4 style block format. A block is a run of
+    sequences:
+
+        u8  token       literal count << 4 | (match length - 4)
+        ... more literal count, when the nibble is 15: bytes added up
+            until one is below 255
+        ... the literals
+        u16 offset      back from the current output position, 1 - 65535
+        ... more match length, same as the literal count
+
+    The last sequence stops after its literals, that is how the decoder
+    knows it. Hashing 4 byte groups with greedy matches, no entropy
+    stage: it is here for speed on repetitive text (item fields, list
+    names, the same note pasted many times), not for ratio.
+
+    The context is the hash table, reused from block to block so a
+    compression does not allocate. Every block is independent, anything
+    can be decompressed on its own.
+ */
+typedef struct
+{
+    uint32_t    table[1u << LZ_HASH_BITS];
+} lz_ctx_t;
+
+// bytes written to dst, 0 when it didn't fit in cap
+size_t lz_compress(lz_ctx_t *ctx, const void *src, size_t len, void *dst, size_t cap);
+
+// bytes written to dst, -1 when src is malformed or would not fit in cap
+int64_t lz_decompress(const void *src, size_t len, void *dst, size_t cap);
+
+#endif // LZ_H_
@@ -0,0 +1,107 @@
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE     // memfd_create
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+    Shared memory byte rings
+
+    A local client and the server share one memfd holding two single
+    producer / single consumer rings, client -> server and server ->
+    client. A byte stream goes through them exactly like through a
+    socket, same frames, but a write is a memcpy and a store.
+
+    Positions are free running u32 counters, masked by the size on
+    access, so head - tail is always the fill level. The producer owns
+    head, the consumer owns tail.
+
+    Nobody spins. Before going to sleep a side sets its *_waiting flag
+    and looks at the ring once more, the other side checks the flag
+    after publishing and only then rings the doorbell (an eventfd):
+
+        sleeper                         other side
+        waiting = 1                     head = h + n
+        fence                           fence
+        still empty? -> sleep           waiting? -> waiting = 0, write eventfd
+
+    One of the two always sees the other's store, so no wakeup is lost,
+    and while both are busy there is no syscall at all.
+
+    Handshake: the client connects to a unix socket, the server answers
+    with the ring size and three fds (memfd, server doorbell, client
+    doorbell) in SCM_RIGHTS. The socket then just stays open, its EOF is
+    how either side notices the other went away.
+ */
+
+#define SHM_RING_SIZE           (1u << 20)          // per direction, must be a power of two
+#define SHM_RING_TO_SERVER      0
+#define SHM_RING_TO_CLIENT      1
+
+typedef struct
+{
+    uint32_t    head;               // producer
+    uint32_t    writer_waiting;     // producer found it full and sleeps
+    char        pad0[56];
+    uint32_t    tail;               // consumer
+    uint32_t    reader_waiting;     // consumer found it empty and sleeps
+    char        pad1[56];
+} shm_ring_shared_t;
+
+// memfd layout: both headers, then both data areas
+#define SHM_RING_MAP_SIZE(size)     (2 * sizeof(shm_ring_shared_t) + 2 * (size_t)(size))
+
+// one side's view of one ring
+typedef struct
+{
+    shm_ring_shared_t   *shared;
+    char                *data;
+    uint32_t            size;
+    int                 wake_fd;    // the other side's doorbell
+} shm_ring_t;
+
+typedef struct
+{
+    int         sock;               // unix socket of the handshake, EOF = server gone
+    int         bell;               // our doorbell, the server rings it
+    int         server_bell;
+    void        *map;
+    size_t      map_size;
+    shm_ring_t  tx;                 // client -> server
+    shm_ring_t  rx;                 // server -> client
+} shm_client_t;
+
+void shm_ring_attach(shm_ring_t *r, void *map, int index, uint32_t size, int wake_fd);
+void shm_ring_wake(int fd);
+
+// producer side, copies what fits and returns how much that was, -1 when the consumer's tail is corrupt
+ssize_t shm_ring_writev(shm_ring_t *r, const struct iovec *iov, int count);
+ssize_t shm_ring_space(shm_ring_t *r);
+bool shm_ring_sleep_write(shm_ring_t *r);
+
+// consumer side, contiguous readable bytes, consume once done with them
+size_t shm_ring_peek(shm_ring_t *r, const char **data);
+void shm_ring_consume(shm_ring_t *r, size_t n);
+bool shm_ring_sleep_read(shm_ring_t *r);
+
+int shm_send_fds(int sock, uint32_t size, const int *fds, int count);
+
+// blocking client, for local tools
+shm_client_t *shm_client_connect(const char *path);
+void shm_client_close(shm_client_t *c);
+int shm_client_send(shm_client_t *c, const void *data, size_t len);
+ssize_t shm_client_recv(shm_client_t *c, void *buf, size_t cap, int timeout_ms);
+
+#endif
+
+#endif // SHM_RING_H_
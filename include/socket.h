@@ -1,5 +1,9 @@
 #pragma once
 
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE     // sendmmsg / recvmmsg
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -27,9 +31,12 @@
     #include <fcntl.h>
     #include <ifaddrs.h>
     #include <netdb.h>
+    #include <netinet/udp.h>
 #endif
 
 #define BACKLOG SOMAXCONN  // how many pending connections queue will hold
+#define SOCKET_UDP_BATCH 64 // datagrams per recvmmsg / sendmmsg
+#define SOCKET_UDP_MAX_SEGMENTS 64 // kernel limit for one GSO send (UDP_MAX_SEGMENTS)
 #define PORT_BUFFER_SIZE 64
 #define HOSTNAME_BUFFER_SIZE 256
 
@@ -44,6 +51,24 @@ socket_handle create_overlapped_socket(int family, int socktype, int protocol);
 int load_winsock_extensions(socket_handle s);
 #endif
 
+typedef struct {
+    uint32_t ip;        // host byte order
+    uint16_t port;
+} SocketAddress;
+
+/*
+    One datagram of a batch. Sending, length is what goes out.
+    Receiving, length is the room in data and gets replaced by
+    what arrived, segment_size is set when GRO coalesced several
+    datagrams of that size (last one may be shorter) into data.
+ */
+typedef struct {
+    SocketAddress address;
+    void *data;
+    int length;
+    int segment_size;
+} socket_datagram_t;
+
 typedef struct Socket {
     socket_handle sockfd;
     char port[PORT_BUFFER_SIZE];
@@ -57,8 +82,16 @@ void socket_close(Socket *sock);
 int socket_tcp_socket(Socket *sock, const char *ip, const char *port);
 int socket_listen_connection(Socket *sock);
 socket_handle socket_accept_connection(Socket *sock);
+socket_handle socket_connect(const char *ip, const char *port);
 socket_handle socket_get_handle(const Socket *sock);
 
+int socket_udp_socket(Socket *sock, const char *ip, const char *port);
+int socket_send_to(socket_handle sockfd, const SocketAddress *address, const void *data, int length);
+int socket_recv_from(socket_handle sockfd, SocketAddress *address, void *data, int length);
+int socket_send_batch(socket_handle sockfd, const socket_datagram_t *datagrams, int count);
+int socket_recv_batch(socket_handle sockfd, socket_datagram_t *datagrams, int count);
+int socket_send_segmented(socket_handle sockfd, const SocketAddress *address, const void *data, int length, int segment_size);
+
 char* socket_get_host_ip_addr(char *buffer, size_t bufsize);
 char* socket_get_host_name(char *buffer, size_t bufsize);
 char* socket_get_ip_addr(struct sockaddr *sa, char *buffer, size_t bufsize);
@@ -68,7 +101,11 @@ void socket_set_opt_reuse_addr(socket_handle sockfd, int on);
 void socket_set_opt_keep_alive(socket_handle sockfd, int on);
 void socket_set_opt_tcp_no_delay(socket_handle sockfd, int on);
 void socket_set_opt_tcp_quick_ack(socket_handle sockfd, int on);
+void socket_set_opt_tcp_cork(socket_handle sockfd, int on);
 void socket_set_opt_tcp_fast_open(socket_handle sockfd, int qlen);
 void socket_set_opt_linger(socket_handle sockfd);
 void socket_set_opt_rcvbuf(socket_handle sockfd, int bufsize);
-void socket_set_opt_sndbuf(socket_handle sockfd, int bufsize);
\ No newline at end of file
+void socket_set_opt_sndbuf(socket_handle sockfd, int bufsize);
+void socket_set_opt_broadcast(socket_handle sockfd, int on);
+int socket_set_opt_udp_gro(socket_handle sockfd, int on);
+bool socket_udp_gso_supported(socket_handle sockfd);
@@ -0,0 +1,47 @@
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TIMER_WHEEL_SLOTS       1024    // must be a power of two
+#define TIMER_WHEEL_TICK_MS     100     // one full revolution ~ 102 seconds
+
+typedef struct timer_node_t timer_node_t;
+
+typedef void (*timer_expire_cb)(void *user_data, timer_node_t *node);
+
+/*
+    Intrusive node, embed it in whatever you want to expire
+    so scheduling never allocates.
+ */
+struct timer_node_t
+{
+    timer_node_t    *next;
+    timer_node_t    *prev;
+    uint64_t        deadline_ms;
+    uint32_t        slot;           // late timers land in the current slot, not their own
+    timer_expire_cb on_expire;
+    void            *user_data;
+    bool            armed;
+};
+
+typedef struct
+{
+    timer_node_t    slots[TIMER_WHEEL_SLOTS];   // sentinel heads of circular lists
+    uint64_t        occupied[TIMER_WHEEL_SLOTS / 64];
+    uint64_t        current_tick;
+    size_t          count;
+} timer_wheel_t;
+
+uint64_t timer_now_ms(void);
+
+void timer_wheel_init(timer_wheel_t *tw, uint64_t now_ms);
+void timer_node_init(timer_node_t *node, timer_expire_cb on_expire, void *user_data);
+void timer_wheel_schedule(timer_wheel_t *tw, timer_node_t *node, uint64_t deadline_ms);
+void timer_wheel_cancel(timer_wheel_t *tw, timer_node_t *node);
+size_t timer_wheel_advance(timer_wheel_t *tw, uint64_t now_ms);
+int timer_wheel_next_timeout(timer_wheel_t *tw, uint64_t now_ms, int max_ms);
+
+#endif // TIMER_WHEEL_H_
@@ -0,0 +1,94 @@
+#ifndef TODO_LAN_H_
+#define TODO_LAN_H_
+
+#include "event_poll.h"
+#include "util.h"
+
+/*
+    LAN presence and change broadcast
+
+    Every instance sends a presence datagram now and then (which lists
+    it has and how far each one's feed is) and broadcasts the DELTA
+    frames of its own changes as they happen. Peers apply what they
+    hear, anything that gets lost or is too big for one datagram shows
+    up as a seq gap in the next presence, a TCP GET repairs it.
+
+    Datagram:
+
+        u32 magic, u32 node, u8 kind, u16 length, length bytes of payload
+
+    length makes trailing padding harmless, GSO sends pad every
+    datagram of a run to the same size.
+
+        PRESENCE    u16 tcp port, u32 list count, u64 seq * count
+        DELTA       u32 list, u64 seq, the TODO_MSG_DELTA frame exactly
+                    as subscribers get it
+
+    seq here counts what this node broadcast for the list, not the
+    feed seq inside the frame, changes a node applied from its peers
+    are not broadcast again and must not look like gaps.
+ */
+
+#define TODO_LAN_PORT               "9400"
+#define TODO_LAN_MAGIC              0x4C4F4454u     // "TDOL"
+#define TODO_LAN_HEADER_SIZE        11
+#define TODO_LAN_MAX_DATAGRAM       1400            // below a typical MTU, no IP fragments
+#define TODO_LAN_PRESENCE_MS        2000
+#define TODO_LAN_PEER_TIMEOUT_MS    7000
+#define TODO_LAN_RECV_SLOTS         32
+#define TODO_LAN_GRO_SLOT_SIZE      65536           // one slot may hold a whole coalesced run
+
+typedef enum
+{
+    TODO_LAN_PRESENCE = 1,
+    TODO_LAN_DELTA,
+} todo_lan_kind;
+
+typedef struct
+{
+    uint32_t        node;
+    SocketAddress   address;
+    uint16_t        tcp_port;
+    uint64_t        last_seen_ms;
+    uint64_t        *seqs;          // stb array, per list, highest seq heard of
+    uint64_t        missed;         // deltas that never arrived
+} todo_lan_peer_t;
+
+typedef void (*todo_lan_delta_cb)(void *user_data, todo_lan_peer_t *peer, const char *frame, size_t len);
+
+typedef struct
+{
+    Socket              sock;
+    event_poll_t        *ep;
+    SocketAddress       target;         // broadcast address, or one peer when testing on loopback
+    uint32_t            node;           // random, tells our own broadcasts apart
+    uint16_t            tcp_port;
+    bool                gso;
+    bool                gro;
+
+    mutex_handle_t      lock;           // out queue and seqs, deltas may be queued from pool workers
+    char                *out;           // stb array, queued datagrams back to back
+    int                 *out_lengths;   // stb array
+    char                *gso_buf;       // stb array, padded run for one GSO send
+    uint64_t            *seqs;          // stb array, per list, deltas we broadcast
+
+    char                *slots;         // receive buffers, slot_size each
+    int                 slot_size;
+    todo_lan_peer_t     *peers;         // stb array, loop thread only
+    timer_node_t        presence_timer;
+
+    todo_lan_delta_cb   on_delta;
+    void                *user_data;
+
+    uint64_t            datagrams_out;
+    uint64_t            datagrams_in;
+} todo_lan_t;
+
+todo_lan_t *todo_lan_create(event_poll_t *ep, const char *port, const char *target_ip, const char *target_port,
+                            uint16_t tcp_port, size_t list_count, todo_lan_delta_cb on_delta, void *user_data);
+void todo_lan_destroy(todo_lan_t *lan);
+
+void todo_lan_queue_delta(todo_lan_t *lan, uint32_t list_id, const char *frame, size_t len);
+void todo_lan_flush(todo_lan_t *lan);
+
+#endif // TODO_LAN_H_
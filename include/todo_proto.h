@@ -0,0 +1,144 @@
+#ifndef TODO_PROTO_H_
+#define TODO_PROTO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "todo.h"
+#include "lz.h"
+
+/*
+    Wire format of the todo server
+
+    Every message is a frame:
+
+        u32 length      bytes that follow (type + payload), little endian
+        u8  type        todo_msg_type
+        ... payload
+
+    Integers are little endian, strings are u16 length + bytes (no NUL).
+    An item on the wire is
+
+        i64 created, i64 deadline, i32 priority, u8 completed, str todo, str note
+
+    Every request gets exactly one reply frame, subscribers additionally
+    receive unsolicited DELTA frames for the lists they follow.
+
+    FOLLOW turns the connection into a replication stream instead: the
+    server's journal (every DELTA it applied, numbered from 1) is shipped
+    in JOURNAL batches for as long as the connection lives. from is the
+    next index the follower needs, 0 for "I have nothing", epoch the one
+    of the journal it came from (a restarted server numbers from 1
+    again). If the server can't continue from there it first sends a
+    SNAPSHOT of every list, the JOURNAL after them says where the stream
+    picks up.
+
+    A SNAPSHOT cut short by a dropped connection can be resumed: the
+    client keeps the bytes it got, reads seq out of them and sends
+    FETCH with that seq and how many bytes it has. The CHUNK carries
+    the rest of the very same frame, or the current one from offset 0
+    when the list changed in the meantime (seq tells which).
+
+    STATS answers with the server's counters as name / value pairs,
+    loop and server totals first, with the flag set one group per
+    connection after them (conn.<fd>.*). New names can show up at any
+    time, readers skip the ones they don't know.
+
+    COMPRESS opts a connection in to PACKED replies: from the OK on,
+    any whole frame of at least threshold bytes the server sends it may
+    come as a PACKED frame instead, the original frame (header and all)
+    compressed with lz.h. Only when that made it smaller, small frames
+    always go as they are so the common case pays nothing. Threshold 0
+    turns it off again. A PACKED frame is unpacked whole before it means
+    anything, a resume with FETCH of one cut short starts at offset 0.
+    Requests are never packed.
+ */
+
+#define TODO_PROTO_HEADER_SIZE  5
+#define TODO_PROTO_MAX_FRAME    (16u << 20)
+
+typedef enum
+{
+    // client -> server
+    TODO_MSG_SUBSCRIBE = 1,     // u32 list                               -> SNAPSHOT
+    TODO_MSG_UNSUBSCRIBE,       // u32 list                               -> OK
+    TODO_MSG_GET,               // u32 list                               -> SNAPSHOT
+    TODO_MSG_ADD,               // u32 list, item                         -> DELTA
+    TODO_MSG_REMOVE,            // u32 list, i64 created                  -> DELTA
+    TODO_MSG_COMPLETE,          // u32 list, i64 created, u8 completed    -> DELTA
+    TODO_MSG_SEARCH,            // u32 list, str text                     -> RESULT
+    TODO_MSG_FETCH,             // u32 list, u64 seq, u64 offset          -> CHUNK
+    TODO_MSG_FOLLOW,            // u32 epoch, u64 from                    -> [SNAPSHOT * lists], JOURNAL ...
+    TODO_MSG_STATS,             // u8 per connection                      -> COUNTERS
+    TODO_MSG_COMPRESS,          // u32 threshold                          -> OK
+
+    // server -> client
+    TODO_MSG_DELTA = 64,        // u32 list, u64 seq, u8 op, op payload
+    TODO_MSG_SNAPSHOT,          // u32 list, u64 seq, u32 count, item * count
+    TODO_MSG_RESULT,            // u32 list, u32 count, item * count
+    TODO_MSG_OK,                // u8 request type
+    TODO_MSG_ERROR,             // str message
+    TODO_MSG_CHUNK,             // u32 list, u64 seq, u64 offset, u64 total, bytes of the SNAPSHOT frame from offset
+    TODO_MSG_JOURNAL,           // u32 epoch, u64 first, u32 count, count DELTA frames back to back
+    TODO_MSG_COUNTERS,          // u32 count, (str name, u64 value) * count
+    TODO_MSG_PACKED,            // u32 size, lz block of a size byte frame
+} todo_msg_type;
+
+typedef enum
+{
+    TODO_DELTA_ADD = 1,         // item
+    TODO_DELTA_REMOVE,          // i64 created
+    TODO_DELTA_COMPLETE,        // i64 created, u8 completed
+} todo_delta_op;
+
+/*
+    Writing goes into an stb_ds char array so frames can be
+    built back to back, begin returns the offset end needs
+ */
+size_t proto_begin_frame(char **buf, uint8_t type);
+void proto_end_frame(char **buf, size_t frame_start);
+void proto_end_frame_ex(char **buf, size_t frame_start, uint64_t trailing);
+
+void proto_put_u8(char **buf, uint8_t v);
+void proto_put_u16(char **buf, uint16_t v);
+void proto_put_u32(char **buf, uint32_t v);
+void proto_put_u64(char **buf, uint64_t v);
+void proto_put_str(char **buf, const char *str, size_t len);
+void proto_put_item(char **buf, const todo_item *item);
+
+/*
+    Reading never goes past end, any short read flips error
+    and every later get returns zero
+ */
+typedef struct
+{
+    const char  *p;
+    const char  *end;
+    bool        error;
+} proto_reader_t;
+
+void proto_reader_init(proto_reader_t *r, const char *data, size_t len);
+uint8_t proto_get_u8(proto_reader_t *r);
+uint16_t proto_get_u16(proto_reader_t *r);
+uint32_t proto_get_u32(proto_reader_t *r);
+uint64_t proto_get_u64(proto_reader_t *r);
+size_t proto_get_str(proto_reader_t *r, char *out, size_t out_size);
+bool proto_get_item(proto_reader_t *r, todo_item *item);
+
+/*
+    Length of the first complete frame in data (header included),
+    0 if more bytes are needed, -1 if the frame is oversized
+ */
+int64_t proto_frame_size(const char *data, size_t len);
+
+/*
+    Appends frame as a PACKED frame, false (and nothing appended) if
+    compressing didn't make it smaller
+ */
+bool proto_pack_frame(char **buf, lz_ctx_t *ctx, const char *frame, size_t len);
+
+// body of a PACKED frame (after the type) -> the frame in it appended to out, -1 if malformed
+int64_t proto_unpack_frame(char **out, const char *body, size_t len);
+
+#endif // TODO_PROTO_H_
@@ -0,0 +1,188 @@
+#ifndef TODO_SERVER_H_
+#define TODO_SERVER_H_
+
+#include "event_poll.h"
+#include "todo.h"
+#include "todo_proto.h"
+#include "todo_lan.h"
+#include "http.h"
+
+#define TODO_SERVER_MAX_LAG_BYTES   (256u << 10)    // queued deltas before a subscriber gets resynced
+#define TODO_SERVER_OUT_HIGH_BYTES  (1u << 20)      // queued output that stops reading the client's requests
+#define TODO_SERVER_OUT_LOW_BYTES   (256u << 10)    // and where reading picks up again
+#define TODO_SERVER_RING_WINDOW     (256u << 10)    // io_uring, handed to the ring and not sent yet before the rest waits in the queue
+#define TODO_SERVER_READ_TIMEOUT_MS 5000            // to finish a frame once it started arriving
+#define TODO_SERVER_MAX_IOV         64
+#define TODO_SERVER_SENDFILE_MIN    (64u << 10)     // snapshots this big are sent from a file
+#define TODO_SERVER_SNAPSHOT_DIR    "/tmp"
+#define TODO_SERVER_SHM_PATH        "/tmp/todo_server.sock"
+#define TODO_SERVER_JOURNAL_MAX     65536           // deltas kept for followers to catch up from
+#define TODO_SERVER_JOURNAL_BATCH   512             // deltas per JOURNAL frame
+#define TODO_SERVER_FOLLOW_RETRY_MS 1000
+#define TODO_SERVER_NAGLE_WINDOW_MS 100             // traffic sample the Nagle choice is made on
+#define TODO_SERVER_NAGLE_FLUSHES   16              // pushes per window that make a connection a stream
+#define TODO_SERVER_NAGLE_SMALL     1024            // average push below this is worth letting the kernel coalesce
+#define TODO_SERVER_PACK_MIN        256             // smallest COMPRESS threshold, below it packing costs more than it saves
+#define TODO_SERVER_HTTP_PATH_MAX   256
+
+/*
+    Encoded once, shared by every queue it sits in. Only touched
+    under the server lock so the count is a plain int. The PACKED
+    version is made the first time a compressing connection gets it
+    and shared the same way.
+ */
+typedef struct todo_buf_t
+{
+    int                 refs;
+    uint32_t            len;
+    struct todo_buf_t   *packed;
+    bool                pack_tried;     // packed stays NULL if it didn't get smaller
+    char                data[];
+} todo_buf_t;
+
+todo_buf_t *todo_buf_create(const char *data, size_t len);
+todo_buf_t *todo_buf_retain(todo_buf_t *buf);
+void todo_buf_release(todo_buf_t *buf);
+
+/*
+    The SNAPSHOT frame of one list at one seq, encoded once and shared
+    by every subscribe, resync and resume until the list changes. Big
+    ones are written to an unlinked file and go to the sockets with
+    sendfile, page cache to socket without passing through us again.
+ */
+typedef struct
+{
+    int         refs;
+    uint64_t    seq;
+    uint64_t    size;
+    todo_buf_t  *buf;           // small, kept in memory
+    int         fd;             // big, -1 when buf is used
+    todo_buf_t  *packed;        // of a file one, in memory, see todo_buf_t for the rest
+    bool        pack_tried;
+} todo_snapshot_t;
+
+typedef struct
+{
+    todo_buf_t      *buf;
+    todo_snapshot_t *file;          // set instead of buf, the bytes come from file->fd
+    uint64_t        off;            // already written, a resume starts part way in
+    uint64_t        len;
+    bool            droppable;      // a delta, a resync snapshot covers it
+} todo_out_t;
+
+typedef struct todo_conn_t
+{
+    socket_handle   fd;
+    event_ctx_t     *ctx;           // NULL for shm clients, their ring calls on_writable itself
+    bool            shm;            // local client, output goes to its ring not the socket
+    char            *in;            // stb array, start of a frame still missing bytes
+    todo_out_t      *out;           // stb array used as a queue starting at out_head
+    size_t          out_head;
+    size_t          out_bytes;      // queued and not written yet
+    size_t          delta_bytes;    // part of the queue that are deltas, what max_lag_bytes bounds
+    uint32_t        *subs;          // list ids it follows
+    bool            resync;         // fell behind, deltas are dropped until the queue drains
+    bool            read_paused;    // queue past out_high_bytes, we stopped reading its requests
+    bool            corked;         // TCP_CORK held for the flush in progress
+    bool            nodelay;        // TCP_NODELAY as last set, see server_tune_nagle
+    uint64_t        window_ms;      // start of the current traffic sample
+    uint32_t        window_flushes; // flushes in it
+    uint32_t        window_frames;  // requests it sent us in it
+    uint64_t        window_bytes;   // bytes those flushes had queued
+    uint32_t        pack_min;       // COMPRESS threshold, 0 = everything goes raw
+    bool            follower;       // sent FOLLOW, gets the journal instead of deltas
+    bool            follow_reset;   // needs every list's snapshot before the journal continues
+    uint64_t        follow_pos;     // next journal index to ship
+    bool            sniffed;        // saw enough of the first bytes to tell frames from HTTP
+    bool            http;           // speaks HTTP/1.1, see server_consume_http
+    bool            http_close;     // answered without keep-alive, FIN once the queue is out
+    size_t          ring_bytes;     // handed to the io_uring and not confirmed sent yet
+} todo_conn_t;
+
+typedef struct { socket_handle key; todo_conn_t *value; } todo_conn_map_t;
+
+// one per list in main_list
+typedef struct
+{
+    uint64_t        seq;            // bumped by every mutation
+    todo_conn_t     **subs;
+    todo_snapshot_t *snapshot;      // latest one built, stale once seq moved past it
+    todo_buf_t      *json;          // same for HTTP, the chunked body of GET /lists/<id>
+    uint64_t        json_seq;
+} todo_feed_t;
+
+/*
+    Our side of a FOLLOW stream to the leader. The follower applies what
+    it is shipped and otherwise only answers reads.
+ */
+typedef struct
+{
+    char            ip[64];
+    char            port[16];
+    socket_handle   fd;             // -1 while disconnected
+    event_ctx_t     *watch;
+    char            *in;            // stb array, a frame still missing bytes
+    uint64_t        next;           // journal index we need next, 0 before the first sync
+    uint32_t        epoch;          // of the leader's journal next counts in
+    timer_node_t    retry_timer;
+    uint64_t        batches;
+    uint64_t        applied;
+} todo_follow_t;
+
+/*
+    What the server itself adds to the loop's counters, only touched
+    under the server lock. handle_ns is parsing and handling frames,
+    flush_ns writing the queues out, together they split the loop's
+    receive callback time.
+ */
+typedef struct
+{
+    uint64_t    frames_in;
+    uint64_t    frames_out;
+    uint64_t    handle_ns;
+    uint64_t    flush_ns;
+    uint64_t    resyncs;            // subscribers that fell behind
+    uint64_t    deltas_dropped;     // queued deltas a resync made pointless
+    uint64_t    bytes_queued_max;   // deepest a single output queue got
+    uint64_t    corks;              // flushes that needed TCP_CORK to leave as full segments
+    uint64_t    nagle_toggles;      // TCP_NODELAY flips, see server_tune_nagle
+    uint64_t    packed;             // frames that went out PACKED
+    uint64_t    packed_raw_bytes;   // their size before
+    uint64_t    packed_bytes;       // and after
+    uint64_t    http_requests;      // also in frames_in
+    uint64_t    http_errors;        // answered 4xx / 5xx
+} todo_server_stats_t;
+
+typedef struct
+{
+    event_poll_t        *ep;
+    event_callbacks_t   callbacks;
+    mutex_handle_t      lock;           // on_receive may run on pool workers
+    rwlock_handle_t     lists_lock;     // main_list, taken before lock, exclusive only to change it
+    todo_conn_map_t     *conns;
+    todo_feed_t         *feeds;
+    todo_conn_t         **dirty;         // have queued output, flushed once per loop wakeup
+    time_t              last_created;   // created doubles as the item id, keep it unique
+    size_t              max_lag_bytes;
+    size_t              out_high_bytes;
+    size_t              out_low_bytes;
+    todo_lan_t          *lan;           // optional, see todo_server_enable_lan
+    const char          *snapshot_dir;  // where big snapshots are spooled
+    lz_ctx_t            *lz;            // packing scratch, made when the first connection sends COMPRESS
+
+    todo_buf_t          **journal;      // stb array, DELTA frames in the order they were applied
+    uint64_t            journal_base;   // index of journal[0]
+    uint32_t            journal_epoch;  // random, tells followers the numbering restarted
+    todo_conn_t         **followers;
+    todo_follow_t       *follow;        // set -> we are a read only follower, see todo_server_follow
+    todo_server_stats_t stats;
+} todo_server_t;
+
+todo_server_t *todo_server_create(const char *ip, const char *port, event_backend_t backend);
+int todo_server_enable_lan(todo_server_t *server, const char *port, const char *target_ip, const char *target_port);
+int todo_server_enable_shm(todo_server_t *server, const char *path);
+int todo_server_follow(todo_server_t *server, const char *leader_ip, const char *leader_port);
+void todo_server_run(todo_server_t *server);
+void todo_server_destroy(todo_server_t *server);
+
+#endif // TODO_SERVER_H_
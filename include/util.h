@@ -1,6 +1,11 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+// strcasestr & co, only helps when util.h is the first include
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32
     #include <windows.h>
     #include <winnt.h>
@@ -13,6 +18,13 @@
     #include <sys/wait.h>
     #include <fcntl.h>
     #include <errno.h>
+    #include <stdatomic.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+
+    typedef unsigned char byte;     // comes with windows.h on the other side
 #endif
 
 #include <stdio.h>
@@ -26,6 +38,7 @@
 #include <math.h>
 #include <time.h>
 #include <float.h>
+#include <ctype.h>
 
 #include <immintrin.h> 
 
@@ -537,6 +550,7 @@ typedef double      f64;
     typedef DWORD thread_func_ret_t;
     typedef CONDITION_VARIABLE cond_handle_t;
     typedef CRITICAL_SECTION mutex_handle_t;
+    typedef SRWLOCK rwlock_handle_t;
     typedef HANDLE pipe_handle;
     typedef HANDLE event_handle;
     typedef volatile LONG atomic_int_t;
@@ -546,6 +560,7 @@ typedef double      f64;
     typedef void* thread_func_param_t;
     typedef void* thread_func_ret_t;
     typedef pthread_mutex_t mutex_handle_t;
+    typedef pthread_rwlock_t rwlock_handle_t;
     typedef pthread_cond_t cond_handle_t;
     typedef int pipe_handle;
     typedef struct {
@@ -717,8 +732,8 @@ extern i32 animation_item_count;
 extern anim_chain_t anim_chains[32];
 extern i32 anim_chain_count;
 
-anim_rank_t anim_ranks[ANIM_RANK_MAX];
-i32         anim_rank_count;
+extern anim_rank_t anim_ranks[ANIM_RANK_MAX];
+extern i32         anim_rank_count;
 
 typedef void (*job_func_t)(void* data);
 
@@ -728,7 +743,7 @@ typedef struct
     void* data;
 }job_t;
 
-typedef struct 
+typedef struct thread_pool_t
 {
     thread_handle_t* threads;      
 
@@ -777,6 +792,10 @@ u32 unhash(u32 x);
 u32 djb2_hash(const char *str);
 u32 djb2_hash_append(u32 seed, const char *str);
 u32 fnv1a_hash(const char *str);
+
+// 64 bit FNV-1a over any bytes, chain calls by passing the last result as seed
+#define FNV1A_SEED64 0xcbf29ce484222325ull
+u64 fnv1a_hash64(u64 seed, void const *data, size_t size);
 u64 arith_mod(u64 x, u64 y);
 f32 d_sqrt(f32 number);
 f32 smoothstep(f32 edge0, f32 edge1, f32 x); 
@@ -862,6 +881,10 @@ void morph_stop(poly_morph_t *m);
 f64 get_time_difference(void *last_time);
 void get_time(void *time);
 
+int atomic_inc(atomic_int_t* var);
+int atomic_dec(atomic_int_t* var);
+int atomic_load_int(atomic_int_t* var);
+void atomic_store_int(atomic_int_t* var, int value);
 thread_handle_t create_thread(thread_func_t func, thread_func_param_t data);
 void join_thread(thread_handle_t thread);
 int get_core_count(void);
@@ -869,6 +892,12 @@ void mutex_init(mutex_handle_t* mutex);
 void mutex_destroy(mutex_handle_t* mutex);
 void mutex_lock(mutex_handle_t* mutex);
 void mutex_unlock(mutex_handle_t* mutex);
+void rwlock_init(rwlock_handle_t* lock);
+void rwlock_destroy(rwlock_handle_t* lock);
+void rwlock_read_lock(rwlock_handle_t* lock);
+void rwlock_read_unlock(rwlock_handle_t* lock);
+void rwlock_write_lock(rwlock_handle_t* lock);
+void rwlock_write_unlock(rwlock_handle_t* lock);
 void cond_init(cond_handle_t* cond);
 void cond_destroy(cond_handle_t* cond);
 void cond_wait(cond_handle_t* cond, mutex_handle_t* mutex);
@@ -1,10 +1,11 @@
 #include "base_graphics.h"
 #include "util.h"
+#include "simd.c"
 
-scissor_region_t scissor_stack[MAX_SCISSOR_STACK];
-u32 scissor_stack_size;
-rect_t current_scissor;
-bool scissor_enabled;
+THREAD_LOCAL scissor_region_t scissor_stack[MAX_SCISSOR_STACK];
+THREAD_LOCAL u32 scissor_stack_size;
+THREAD_LOCAL rect_t current_scissor;
+THREAD_LOCAL bool scissor_enabled;
 
 /* -------------------- Color stuff -------------------- */
 
@@ -385,21 +386,71 @@ static inline color4_t blend_pixel(color4_t dst, color4_t src)
     //     .a = src.a + (dst.a * inv_alpha) * INV_255
     // };
 
-    // 1/256 but much faster
+    // 1/256 but much faster. The + 1 on alpha keeps an opaque dst opaque
     color4_t result = {
         .r = (src.r * src.a + dst.r * inv_alpha) >> 8,
         .g = (src.g * src.a + dst.g * inv_alpha) >> 8,
         .b = (src.b * src.a + dst.b * inv_alpha) >> 8,
-        .a = src.a + ((dst.a * inv_alpha) >> 8)
+        .a = src.a + (((dst.a + 1) * inv_alpha) >> 8)
     };
 
     return result;
 }
 
+// x / 255 rounded, exact for anything a product of two bytes can be
+static inline u32 div_255(u32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+color4_t premultiply_color(color4_t color)
+{
+    return (color4_t){
+        .r = div_255(color.r * color.a),
+        .g = div_255(color.g * color.a),
+        .b = div_255(color.b * color.a),
+        .a = color.a,
+    };
+}
+
+void premultiply_image(image_view_t *img)
+{
+    if (img->premultiplied) {
+        return;
+    }
+
+    for (u32 i = 0; i < img->width * img->height; i++) {
+        img->pixels[i] = premultiply_color(img->pixels[i]);
+    }
+    img->premultiplied = true;
+}
+
+/* 
+    premultiplied src over dst, no branches, every channel the same 
+    multiply-add. The span kernels' over does exactly this 
+ */
+static inline color4_t blend_pixel_premul(color4_t dst, color4_t src)
+{
+    u32 inv_alpha = 255 - src.a;
+
+    return (color4_t){
+        .r = src.r + div_255(dst.r * inv_alpha),
+        .g = src.g + div_255(dst.g * inv_alpha),
+        .b = src.b + div_255(dst.b * inv_alpha),
+        .a = src.a + div_255(dst.a * inv_alpha),
+    };
+}
+
 /* Get existing color in the frame buffer and blend it witht the new color */
 static inline void set_pixel_blend(image_view_t const *img, i32 x, i32 y, color4_t color) 
 {
-    if (IS_OPAQUE(color)) 
+    if (img->premultiplied)
+    {
+        color4_t dst = get_pixel(img, x, y);
+        set_pixel(img, x, y, blend_pixel_premul(dst, premultiply_color(color)));
+    }
+    else if (IS_OPAQUE(color)) 
     {
         set_pixel(img, x, y,color);
     } 
@@ -458,7 +509,90 @@ static void plot_4_points(image_view_t *img, i32 cx, i32 cy, i32 x, i32 y, f32 o
     }
 }
 
-static inline void emit_span(image_view_t *img, i32 y, i32 x0, i32 x1, color4_t color)
+/* -------------------- Spans -------------------- */
+
+/*
+    Runs of one color are where the pixels go: panel backgrounds, rects,
+    the insides of rounded rects and circles. They go through the
+    simd.c span kernels, picked for this cpu the first time one is
+    drawn, 8 pixels at a time and with the same bytes blend_pixel would
+    give.
+ */
+static simd_span_kernels_t span_kernels;
+
+/*
+    Picked on first use, which is fine from one thread. Call it before
+    rasterizing from several, two threads racing through the first use
+    could see the table half written.
+ */
+void init_span_kernels(void)
+{
+    if (!span_kernels.fill)
+    {
+        SIMD_Caps caps = simd_query_caps();
+        span_kernels = simd_span_kernels(&caps);
+    }
+}
+
+static inline simd_span_kernels_t const *get_span_kernels(void)
+{
+    if (!span_kernels.fill)
+    {
+        init_span_kernels();
+    }
+    return &span_kernels;
+}
+
+// count pixels from row on, no clipping here
+static inline void put_span(color4_t *row, i32 count, color4_t color, bool premultiplied)
+{
+    if (count <= 0 || IS_INVIS(color)) return;
+
+    if (premultiplied) {
+        color = premultiply_color(color);
+    }
+
+    u32 packed;
+    memcpy(&packed, &color, sizeof(packed));
+
+    if (IS_OPAQUE(color)) {
+        get_span_kernels()->fill((u32 *)row, packed, (size_t)count);
+    } else if (premultiplied) {
+        get_span_kernels()->blend_premul((u32 *)row, packed, (size_t)count);
+    } else {
+        get_span_kernels()->blend((u32 *)row, packed, (size_t)count);
+    }
+}
+
+/*
+    count pixels of row y from x on, each gets color at the coverage
+    given, which replaces the color's own alpha. No clipping here.
+    Premultiplied targets go through the mask kernel, straight ones
+    blend a pixel at a time like draw_pixel.
+ */
+void blend_coverage_span(image_view_t const *img, i32 x, i32 y, u8 const *coverage, i32 count, color4_t color)
+{
+    color4_t *row = &img->pixels[y * img->width + x];
+
+    if (img->premultiplied)
+    {
+        color.a = 255;
+        u32 packed;
+        memcpy(&packed, &color, sizeof(packed));
+        get_span_kernels()->mask((u32 *)row, packed, coverage, (size_t)count);
+        return;
+    }
+
+    for (i32 i = 0; i < count; i++)
+    {
+        if (coverage[i] == 0) continue;
+
+        color.a = coverage[i];
+        row[i]  = IS_OPAQUE(color) ? color : blend_pixel(row[i], color);
+    }
+}
+
+static inline void emit_span(image_view_t const *img, i32 y, i32 x0, i32 x1, color4_t color)
 {
     if (y < 0 || y >= (i32)img->height) return;
 
@@ -470,20 +604,11 @@ static inline void emit_span(image_view_t *img, i32 y, i32 x0, i32 x1, color4_t
         x1 = MIN(x1, current_scissor.x + current_scissor.w - 1);
     }
 
+    x0 = MAX(x0, 0);
+    x1 = MIN(x1, (i32)img->width - 1);
     if (x0 > x1) return;
 
-    // Solid color fast path
-    if (IS_OPAQUE(color)) {
-        color4_t *row = &img->pixels[y * img->width];
-        for (i32 x = x0; x <= x1; x++)
-            row[x] = color;
-        return;
-    }
-
-    // Blend path
-    color4_t *row = &img->pixels[y * img->width];
-    for (i32 x = x0; x <= x1; x++)
-        row[x] = blend_pixel(row[x], color);
+    put_span(&img->pixels[y * img->width + x0], x1 - x0 + 1, color, img->premultiplied);
 }
 
 void clear_screen(image_view_t const *color_buf, color4_t const color)
@@ -498,13 +623,30 @@ void clear_screen(image_view_t const *color_buf, color4_t const color)
         } 
     */
 
-    // test if faster ?
-    membroadcast(
-        color_buf->pixels,
-        &color,
-        sizeof(color4_t),
-        color_buf->width * color_buf->height
-    );
+    // one span over the whole buffer, rows are contiguous
+    color4_t fill = color_buf->premultiplied ? premultiply_color(color) : color;
+    u32 packed;
+    memcpy(&packed, &fill, sizeof(packed));
+    get_span_kernels()->fill((u32 *)color_buf->pixels, packed, (size_t)color_buf->width * color_buf->height);
+}
+
+// clear_screen for part of the buffer, no blending and no scissor either
+void clear_rect(image_view_t const *color_buf, i32 x, i32 y, i32 w, i32 h, color4_t const color)
+{
+    rect_t r = intersect_rects(&(rect_t){x, y, w, h}, &(rect_t){0, 0, (i32)color_buf->width, (i32)color_buf->height});
+    if (r.w <= 0 || r.h <= 0) {
+        return;
+    }
+
+    color4_t fill = color_buf->premultiplied ? premultiply_color(color) : color;
+    u32 packed;
+    memcpy(&packed, &fill, sizeof(packed));
+
+    u32 *row = (u32 *)&color_buf->pixels[r.y * color_buf->width + r.x];
+    for (i32 j = 0; j < r.h; ++j, row += color_buf->width)
+    {
+        get_span_kernels()->fill(row, packed, (size_t)r.w);
+    }
 }
 
 void clear_screen_radial_gradient(image_view_t const *color_buf,
@@ -526,7 +668,8 @@ void clear_screen_radial_gradient(image_view_t const *color_buf,
             
             f32 t = Clamp(0.0f, dist_sq / max_dist_sq, 1.0f);
             
-            BUF_AT(color_buf, x, y) = color4_lerp(color0, color1, t);
+            color4_t color = color4_lerp(color0, color1, t);
+            BUF_AT(color_buf, x, y) = color_buf->premultiplied ? premultiply_color(color) : color;
         }
     }
 }
@@ -541,12 +684,7 @@ void draw_hline(image_view_t const *color_buf, i32 y, i32 x0, i32 x1, color4_t c
         SWAP(x0, x1, i32);
     }
 
-    x0 = MAX(0, x0);
-    x1 = MIN((i32)color_buf->width - 1, x1);
-    
-    for (i32 x = x0; x <= x1; x++) {
-        draw_pixel(color_buf, x, y, color);
-    }
+    emit_span(color_buf, y, x0, x1, color);
 }
 
 void draw_vline(image_view_t const *color_buf, i32 x, i32 y0, i32 y1, color4_t const color)
@@ -727,13 +865,19 @@ void draw_rect_outline(image_view_t const *color_buf, i32 x0, i32 y0, i32 x1, i3
 
 void draw_rect_solid_wh(image_view_t const *color_buf, i32 x0, i32 y0, i32 w , i32 h , color4_t const color)
 {
-    if (w > 0) 
-    {   
-        i32 j, x1 = x0 + w - 1;
-        for (j=0; j < h; ++j)
-        {
-            draw_hline(color_buf, y0+j, x0, x1, color);
-        }
+    // clipped once against the buffer and the scissor, then a span per row
+    rect_t r = intersect_rects(&(rect_t){x0, y0, w, h}, &(rect_t){0, 0, (i32)color_buf->width, (i32)color_buf->height});
+    if (scissor_enabled) {
+        r = intersect_rects(&r, &current_scissor);
+    }
+    if (r.w <= 0 || r.h <= 0) {
+        return;
+    }
+
+    color4_t *row = &color_buf->pixels[r.y * color_buf->width + r.x];
+    for (i32 j = 0; j < r.h; ++j, row += color_buf->width)
+    {
+        put_span(row, r.w, color, color_buf->premultiplied);
     }
 }
   
@@ -2316,8 +2460,8 @@ void draw_radial_segment_filled(image_view_t *img,
         polar_to_cartesian((polar_t){seg->outer_radius, angle}, 
                           layout->center_x, layout->center_y,
                           layout->scale_x, layout->scale_y, &x, &y);
-        vx[vertex_count] = (i32)x;
-        vy[vertex_count] = (i32)y;
+        vx[vertex_count] = (i32)floorf(x);
+        vy[vertex_count] = (i32)floorf(y);
         vertex_count++;
     }
     
@@ -2328,8 +2472,8 @@ void draw_radial_segment_filled(image_view_t *img,
         polar_to_cartesian((polar_t){seg->inner_radius, angle},
                           layout->center_x, layout->center_y,
                           layout->scale_x, layout->scale_y, &x, &y);
-        vx[vertex_count] = (i32)x;
-        vy[vertex_count] = (i32)y;
+        vx[vertex_count] = (i32)floorf(x);
+        vy[vertex_count] = (i32)floorf(y);
         vertex_count++;
     }
     
@@ -3137,6 +3281,10 @@ image_view_t* load_texture(const char *filepath)
     }
     
     stbi_image_free(img_data);
+
+    // only ever blitted, blending straight from premultiplied is one kernel
+    texture->premultiplied = false;
+    premultiply_image(texture);
     return texture;
 }
 
@@ -3150,6 +3298,57 @@ void free_texture(image_view_t *texture)
     }
 }
 
+/*
+    Premultiplied textures go over the buffer a row at a time with the
+    span kernels. Unscaled rows are read straight from the texture,
+    scaled ones are sampled into a small buffer first, same nearest
+    sampling as the straight path.
+ */
+#define TEXTURE_ROW_CHUNK 256
+
+static void render_texture_rows_premul(image_view_t const *color_buf, image_view_t const *texture,
+                                       u32 dst_x, u32 dst_y, u32 x_start, u32 y_start, u32 x_end, u32 y_end,
+                                       f32 x_scale, f32 y_scale)
+{
+    simd_span_kernels_t const *kernels = get_span_kernels();
+    bool unscaled = x_scale == 1.0f;
+
+    for (u32 y = y_start; y < y_end; y++)
+    {
+        u32 src_y = (u32)((f32)(y - dst_y) * y_scale);
+        if (src_y >= texture->height) {
+            continue;
+        }
+
+        color4_t const *src_row = &texture->pixels[src_y * texture->width];
+        u32            *dst_row = (u32 *)&color_buf->pixels[y * color_buf->width];
+
+        if (unscaled)
+        {
+            u32 count = MIN(x_end, dst_x + texture->width) - x_start;
+            kernels->over(dst_row + x_start, (u32 const *)(src_row + (x_start - dst_x)), count);
+            continue;
+        }
+
+        u32 samples[TEXTURE_ROW_CHUNK];
+        for (u32 x = x_start; x < x_end; x += TEXTURE_ROW_CHUNK)
+        {
+            u32 count = MIN(TEXTURE_ROW_CHUNK, x_end - x);
+            u32 n = 0;
+
+            for (; n < count; n++)
+            {
+                u32 src_x = (u32)((f32)(x + n - dst_x) * x_scale);
+                if (src_x >= texture->width) {
+                    break;
+                }
+                memcpy(&samples[n], &src_row[src_x], sizeof(u32));
+            }
+            kernels->over(dst_row + x, samples, n);
+        }
+    }
+}
+
 void render_texture_to_buffer(image_view_t const *color_buf, image_view_t const *texture,  
                                u32 dst_x, u32 dst_y, f32 scale, rect_t *out_rect) 
 {
@@ -3184,6 +3383,23 @@ void render_texture_to_buffer(image_view_t const *color_buf, image_view_t const
         out_rect->h = y_end - y_start;
     }
 
+    // the placement above is what callers hit test against, the scissor only limits the pixels
+    if (scissor_enabled)
+    {
+        rect_t drawn = {(i32)x_start, (i32)y_start, (i32)(x_end - x_start), (i32)(y_end - y_start)};
+        drawn = intersect_rects(&drawn, &current_scissor);
+        x_start = drawn.x;
+        y_start = drawn.y;
+        x_end   = drawn.x + drawn.w;
+        y_end   = drawn.y + drawn.h;
+    }
+
+    if (texture->premultiplied)
+    {
+        render_texture_rows_premul(color_buf, texture, dst_x, dst_y, x_start, y_start, x_end, y_end, x_scale, y_scale);
+        return;
+    }
+
     for (u32 y = y_start; y < y_end; y++) 
     {
         for (u32 x = x_start; x < x_end; x++) 
@@ -3205,3 +3421,36 @@ void render_texture_to_buffer(image_view_t const *color_buf, image_view_t const
         }
     }
 }
+
+/*
+    Puts image at dst_x, dst_y pixel for pixel, respecting the scissor.
+    The image is taken as premultiplied, which is what drawing onto a
+    transparent buffer leaves, and goes over the buffer with the span
+    kernels' over. Opaque images are copied a row at a time.
+ */
+void composite_image(image_view_t const *color_buf, image_view_t const *image, i32 dst_x, i32 dst_y, bool opaque)
+{
+    rect_t drawn  = {dst_x, dst_y, (i32)image->width, (i32)image->height};
+    rect_t target = {0, 0, (i32)color_buf->width, (i32)color_buf->height};
+    drawn = intersect_rects(&drawn, &target);
+
+    if (scissor_enabled) {
+        drawn = intersect_rects(&drawn, &current_scissor);
+    }
+
+    if (drawn.w <= 0 || drawn.h <= 0) {
+        return;
+    }
+
+    for (i32 y = drawn.y; y < drawn.y + drawn.h; y++)
+    {
+        color4_t const *src = &image->pixels[(y - dst_y) * image->width + (drawn.x - dst_x)];
+        color4_t       *dst = &color_buf->pixels[y * color_buf->width + drawn.x];
+
+        if (opaque) {
+            memcpy(dst, src, drawn.w * sizeof(color4_t));
+        } else {
+            get_span_kernels()->over((u32 *)dst, (u32 const *)src, drawn.w);
+        }
+    }
+}
@@ -0,0 +1,823 @@
+#include "draw_list.h"
+
+/* -------------------- Recording -------------------- */
+
+void draw_list_begin(draw_list_t *list, i32 width, i32 height)
+{
+    draw_list_begin_at(list, 0, 0, width, height);
+}
+
+void draw_list_begin_at(draw_list_t *list, i32 x, i32 y, i32 width, i32 height)
+{
+    arrsetlen(list->cmds, 0);
+    arrsetlen(list->text, 0);
+    arrsetlen(list->radials, 0);
+    arrsetlen(list->clips, 0);
+
+    list->x          = x;
+    list->y          = y;
+    list->width      = width;
+    list->height     = height;
+    list->clip_depth = 0;
+    list->clip       = (rect_t){x, y, width, height};
+    list->clip_index = 0;
+    arrput(list->clips, list->clip);
+}
+
+void draw_list_free(draw_list_t *list)
+{
+    arrfree(list->cmds);
+    arrfree(list->text);
+    arrfree(list->radials);
+    arrfree(list->clips);
+    memset(list, 0, sizeof(*list));
+}
+
+/*
+    the same nesting update_current_scissor does, every region on the
+    stack intersected, plus the target itself
+ */
+static void draw_list_update_clip(draw_list_t *list)
+{
+    list->clip = (rect_t){list->x, list->y, list->width, list->height};
+
+    for (u32 i = 0; i < list->clip_depth; i++) {
+        list->clip = intersect_rects(&list->clip, &list->clip_stack[i]);
+    }
+
+    list->clip_index = (u32)arrlen(list->clips);
+    arrput(list->clips, list->clip);
+}
+
+/*
+    clips bounds to what will be drawable when the command runs, false
+    when nothing is and the command can be dropped
+ */
+static bool draw_list_cull(draw_list_t const *list, rect_t *bounds)
+{
+    *bounds = intersect_rects(bounds, &list->clip);
+    return bounds->w > 0 && bounds->h > 0;
+}
+
+static draw_cmd_t *draw_list_push(draw_list_t *list, draw_cmd_type_t type, color4_t color, rect_t bounds)
+{
+    draw_cmd_t cmd = { .type = (u8)type, .color = color, .clip = list->clip_index, .bounds = bounds };
+    arrput(list->cmds, cmd);
+    return &arrlast(list->cmds);
+}
+
+void draw_list_clear(draw_list_t *list, color4_t color)
+{
+    // a clear ignores scissors, so does its footprint
+    rect_t bounds = {list->x, list->y, list->width, list->height};
+
+    // nothing recorded before a clear can show, the clips stay for the commands after it
+    if (list->clip_depth == 0) {
+        arrsetlen(list->cmds, 0);
+        arrsetlen(list->text, 0);
+        arrsetlen(list->radials, 0);
+    }
+
+    draw_list_push(list, DRAW_CMD_CLEAR, color, bounds);
+}
+
+void draw_list_rect(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, color4_t color)
+{
+    rect_t bounds = {x, y, w, h};
+    if (IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_RECT, color, bounds);
+    cmd->as.rect.x = x;
+    cmd->as.rect.y = y;
+    cmd->as.rect.w = w;
+    cmd->as.rect.h = h;
+}
+
+void draw_list_rect_outline(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, color4_t color)
+{
+    rect_t bounds = {x, y, w, h};
+    if (IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_RECT_OUTLINE, color, bounds);
+    cmd->as.rect.x = x;
+    cmd->as.rect.y = y;
+    cmd->as.rect.w = w;
+    cmd->as.rect.h = h;
+}
+
+void draw_list_rounded_rect(draw_list_t *list, i32 x, i32 y, i32 w, i32 h, f32 radius, color4_t color)
+{
+    // the rasterizer swaps the corners of a negative size, and includes
+    // both, the antialiased edge can reach a pixel further
+    rect_t bounds = {MIN(x, x + w) - 1, MIN(y, y + h) - 1, abs(w) + 3, abs(h) + 3};
+    if (IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_ROUNDED_RECT, color, bounds);
+    cmd->as.rect.x      = x;
+    cmd->as.rect.y      = y;
+    cmd->as.rect.w      = w;
+    cmd->as.rect.h      = h;
+    cmd->as.rect.radius = radius;
+}
+
+void draw_list_line(draw_list_t *list, i32 x0, i32 y0, i32 x1, i32 y1, color4_t color)
+{
+    rect_t bounds = {MIN(x0, x1), MIN(y0, y1), abs(x1 - x0) + 1, abs(y1 - y0) + 1};
+    if (IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_LINE, color, bounds);
+    cmd->as.line.x0 = x0;
+    cmd->as.line.y0 = y0;
+    cmd->as.line.x1 = x1;
+    cmd->as.line.y1 = y1;
+}
+
+static void draw_list_add_circle(draw_list_t *list, draw_cmd_type_t type, i32 cx, i32 cy, f32 radius, color4_t color)
+{
+    i32 r = (i32)ceilf(radius) + 2;
+    rect_t bounds = {cx - r, cy - r, 2 * r + 1, 2 * r + 1};
+    if (radius <= 0 || IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, type, color, bounds);
+    cmd->as.circle.cx     = cx;
+    cmd->as.circle.cy     = cy;
+    cmd->as.circle.radius = radius;
+}
+
+void draw_list_circle(draw_list_t *list, i32 cx, i32 cy, f32 radius, color4_t color)
+{
+    draw_list_add_circle(list, DRAW_CMD_CIRCLE, cx, cy, radius, color);
+}
+
+void draw_list_circle_outline(draw_list_t *list, i32 cx, i32 cy, f32 radius, color4_t color)
+{
+    draw_list_add_circle(list, DRAW_CMD_CIRCLE_OUTLINE, cx, cy, radius, color);
+}
+
+void draw_list_radial_segment(draw_list_t *list, radial_layout_t const *layout, radial_segment_t const *segment, color4_t color)
+{
+    // the whole ring, not just the segment, arcs are cheap to overestimate
+    f32 rx = segment->outer_radius * layout->scale_x;
+    f32 ry = segment->outer_radius * layout->scale_y;
+    rect_t bounds = {
+        (i32)floorf(layout->center_x - rx) - 1,
+        (i32)floorf(layout->center_y - ry) - 1,
+        (i32)ceilf(2 * rx) + 3,
+        (i32)ceilf(2 * ry) + 3,
+    };
+    if (IS_INVIS(color) || !draw_list_cull(list, &bounds)) return;
+
+    draw_radial_t radial = { .layout = *layout, .segment = *segment };
+    arrput(list->radials, radial);
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_RADIAL_SEGMENT, color, bounds);
+    cmd->as.radial.index = (u32)arrlen(list->radials) - 1;
+}
+
+/*
+    Text has to be measured to be culled, walking it the way
+    render_text_tt and render_string_unicode do. Glyphs hang a little
+    past their advance and line, hence the margin.
+ */
+static rect_t draw_list_text_bounds(rendered_text_tt const *text, bool unicode)
+{
+    font_tt *font        = text->font;
+    i32     line_height  = get_line_height(font);
+    glyph_info_t *space  = get_glyph(font, ' ');
+    f32     tab_width    = space ? space->advance * TAB_SIZE : 0;
+
+    f32 x = 0, max_x = 0;
+    i32 lines = 1;
+
+    utf8_decoder_t decoder;
+    utf8_decoder_init(&decoder, text->string);
+
+    for (;;)
+    {
+        u32 c;
+        if (unicode) {
+            if (!utf8_decode_next(&decoder, &c)) break;
+        } else {
+            if (!text->string[decoder.pos]) break;
+            c = (u8)text->string[decoder.pos++];
+        }
+
+        if (c == '\n') {
+            max_x = MAX(max_x, x);
+            x = 0;
+            lines++;
+            continue;
+        }
+        if (c == '\t') {
+            x += tab_width;
+            continue;
+        }
+
+        glyph_info_t *glyph = get_glyph(font, c);
+        if (glyph) {
+            x += glyph->advance;
+        }
+    }
+    max_x = MAX(max_x, x);
+
+    i32 margin = line_height / 2 + 1;
+    return (rect_t){
+        text->pos.x - margin,
+        text->pos.y - margin,
+        (i32)ceilf(max_x) + 2 * margin,
+        lines * line_height + 2 * margin,
+    };
+}
+
+static void draw_list_add_text(draw_list_t *list, draw_cmd_type_t type, rendered_text_tt const *text)
+{
+    // no alpha test, glyph coverage replaces the color's alpha
+    if (!text || !text->string || !text->font || !*text->string) return;
+
+    rect_t bounds = draw_list_text_bounds(text, type == DRAW_CMD_TEXT_UNICODE);
+    if (!draw_list_cull(list, &bounds)) return;
+
+    size_t len    = strlen(text->string);
+    u32    offset = (u32)arrlen(list->text);
+    memcpy(arraddnptr(list->text, len + 1), text->string, len + 1);
+
+    draw_cmd_t *cmd = draw_list_push(list, type, text->color, bounds);
+    cmd->as.text.font   = text->font;
+    cmd->as.text.offset = offset;
+    cmd->as.text.x      = text->pos.x;
+    cmd->as.text.y      = text->pos.y;
+}
+
+void draw_list_text(draw_list_t *list, rendered_text_tt const *text)
+{
+    draw_list_add_text(list, DRAW_CMD_TEXT, text);
+}
+
+void draw_list_text_unicode(draw_list_t *list, rendered_text_tt const *text)
+{
+    draw_list_add_text(list, DRAW_CMD_TEXT_UNICODE, text);
+}
+
+void draw_list_texture(draw_list_t *list, image_view_t *texture, i32 x, i32 y, f32 scale, rect_t *out_rect)
+{
+    if (!texture) return;
+
+    // same placement as render_texture_to_buffer, which the caller may hit test against
+    u32 dst_w = texture->width * scale;
+    u32 dst_h = texture->height * scale;
+
+    u32 tx = (u32)(x - list->x);
+    u32 ty = (u32)(y - list->y);
+    if (tx >= (u32)list->width || ty >= (u32)list->height) return;
+
+    rect_t bounds = {x, y, (i32)MIN((u32)list->width - tx, dst_w), (i32)MIN((u32)list->height - ty, dst_h)};
+
+    if (out_rect) {
+        *out_rect = bounds;
+    }
+
+    if (!draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, DRAW_CMD_TEXTURE, COLOR_WHITE, bounds);
+    cmd->as.texture.image = texture;
+    cmd->as.texture.x     = x;
+    cmd->as.texture.y     = y;
+    cmd->as.texture.scale = scale;
+}
+
+void draw_list_image(draw_list_t *list, image_view_t const *image, i32 x, i32 y, bool opaque, u64 version)
+{
+    if (!image || !image->pixels) return;
+
+    rect_t bounds = {x, y, (i32)image->width, (i32)image->height};
+    if (!draw_list_cull(list, &bounds)) return;
+
+    draw_cmd_t *cmd = draw_list_push(list, opaque ? DRAW_CMD_IMAGE_OPAQUE : DRAW_CMD_IMAGE, COLOR_WHITE, bounds);
+    cmd->as.image.image   = image;
+    cmd->as.image.x       = x;
+    cmd->as.image.y       = y;
+    cmd->as.image.version = version;
+}
+
+bool draw_list_push_scissor(draw_list_t *list, i32 x, i32 y, i32 w, i32 h)
+{
+    // push_scissor would refuse it the same way when the list runs
+    if (list->clip_depth >= MAX_SCISSOR_STACK) {
+        return false;
+    }
+
+    rect_t region = {x, y, w, h};
+    list->clip_stack[list->clip_depth++] = region;
+    draw_list_update_clip(list);
+
+    draw_list_push(list, DRAW_CMD_PUSH_SCISSOR, COLOR_TRANSPARENT, region);
+    return true;
+}
+
+bool draw_list_pop_scissor(draw_list_t *list)
+{
+    if (list->clip_depth == 0) {
+        return false;
+    }
+
+    list->clip_depth--;
+    draw_list_update_clip(list);
+
+    // a push with nothing drawn under it cancels out
+    if (arrlen(list->cmds) && arrlast(list->cmds).type == DRAW_CMD_PUSH_SCISSOR) {
+        arrsetlen(list->cmds, arrlen(list->cmds) - 1);
+        return true;
+    }
+
+    draw_list_push(list, DRAW_CMD_POP_SCISSOR, COLOR_TRANSPARENT, (rect_t){0});
+    return true;
+}
+
+/* -------------------- Replay -------------------- */
+
+// for a list begun at an offset, the command as it lands in the target
+static void draw_cmd_translate(draw_cmd_t *cmd, i32 dx, i32 dy)
+{
+    switch (cmd->type)
+    {
+        case DRAW_CMD_RECT:
+        case DRAW_CMD_RECT_OUTLINE:
+        case DRAW_CMD_ROUNDED_RECT:
+        {
+            cmd->as.rect.x += dx;
+            cmd->as.rect.y += dy;
+            break;
+        }
+
+        case DRAW_CMD_LINE:
+        {
+            cmd->as.line.x0 += dx;
+            cmd->as.line.y0 += dy;
+            cmd->as.line.x1 += dx;
+            cmd->as.line.y1 += dy;
+            break;
+        }
+
+        case DRAW_CMD_CIRCLE:
+        case DRAW_CMD_CIRCLE_OUTLINE:
+        {
+            cmd->as.circle.cx += dx;
+            cmd->as.circle.cy += dy;
+            break;
+        }
+
+        case DRAW_CMD_TEXT:
+        case DRAW_CMD_TEXT_UNICODE:
+        {
+            cmd->as.text.x += dx;
+            cmd->as.text.y += dy;
+            break;
+        }
+
+        case DRAW_CMD_TEXTURE:
+        {
+            cmd->as.texture.x += dx;
+            cmd->as.texture.y += dy;
+            break;
+        }
+
+        case DRAW_CMD_IMAGE:
+        case DRAW_CMD_IMAGE_OPAQUE:
+        {
+            cmd->as.image.x += dx;
+            cmd->as.image.y += dy;
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+    }
+
+    // radials move where they are replayed, the list keeps them
+    cmd->bounds.x += dx;
+    cmd->bounds.y += dy;
+}
+
+void draw_list_execute_cmd(draw_list_t const *list, draw_cmd_t const *cmd, image_view_t *img)
+{
+    draw_cmd_t moved;
+    if (list->x || list->y)
+    {
+        moved = *cmd;
+        draw_cmd_translate(&moved, -list->x, -list->y);
+        cmd = &moved;
+    }
+
+    switch (cmd->type)
+    {
+        case DRAW_CMD_CLEAR:
+        {
+            clear_screen(img, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_RECT:
+        {
+            draw_rect_solid_wh(img, cmd->as.rect.x, cmd->as.rect.y, cmd->as.rect.w, cmd->as.rect.h, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_RECT_OUTLINE:
+        {
+            draw_rect_outline_wh(img, cmd->as.rect.x, cmd->as.rect.y, cmd->as.rect.w, cmd->as.rect.h, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_ROUNDED_RECT:
+        {
+            draw_rounded_rectangle_filled_aa_wh(img, cmd->as.rect.x, cmd->as.rect.y, cmd->as.rect.w, cmd->as.rect.h,
+                                                cmd->as.rect.radius, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_LINE:
+        {
+            draw_line(img, cmd->as.line.x0, cmd->as.line.y0, cmd->as.line.x1, cmd->as.line.y1, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_CIRCLE:
+        {
+            draw_circle_filled_aa(img, cmd->as.circle.cx, cmd->as.circle.cy, cmd->as.circle.radius, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_CIRCLE_OUTLINE:
+        {
+            draw_circle_aa(img, cmd->as.circle.cx, cmd->as.circle.cy, cmd->as.circle.radius, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_RADIAL_SEGMENT:
+        {
+            draw_radial_t radial = list->radials[cmd->as.radial.index];
+            radial.layout.center_x -= list->x;
+            radial.layout.center_y -= list->y;
+            draw_radial_segment_filled(img, &radial.layout, &radial.segment, cmd->color);
+            break;
+        }
+
+        case DRAW_CMD_TEXT:
+        case DRAW_CMD_TEXT_UNICODE:
+        {
+            rendered_text_tt text = {
+                .font   = cmd->as.text.font,
+                .string = list->text + cmd->as.text.offset,
+                .pos    = {cmd->as.text.x, cmd->as.text.y},
+                .color  = cmd->color,
+            };
+            if (cmd->type == DRAW_CMD_TEXT) {
+                render_text_tt(img, &text);
+            } else {
+                render_string_unicode(img, &text);
+            }
+            break;
+        }
+
+        case DRAW_CMD_TEXTURE:
+        {
+            render_texture_to_buffer(img, cmd->as.texture.image, cmd->as.texture.x, cmd->as.texture.y,
+                                     cmd->as.texture.scale, NULL);
+            break;
+        }
+
+        case DRAW_CMD_IMAGE:
+        case DRAW_CMD_IMAGE_OPAQUE:
+        {
+            composite_image(img, cmd->as.image.image, cmd->as.image.x, cmd->as.image.y,
+                            cmd->type == DRAW_CMD_IMAGE_OPAQUE);
+            break;
+        }
+
+        case DRAW_CMD_PUSH_SCISSOR:
+        {
+            push_scissor(cmd->bounds.x, cmd->bounds.y, cmd->bounds.w, cmd->bounds.h);
+            break;
+        }
+
+        case DRAW_CMD_POP_SCISSOR:
+        {
+            pop_scissor();
+            break;
+        }
+
+        default:
+        {
+            fprintf(stderr, "Error : unknown draw command %d\n", cmd->type);
+            break;
+        }
+    }
+}
+
+void draw_list_execute(draw_list_t const *list, image_view_t *img)
+{
+    clear_scissor_stack();
+
+    for (i32 i = 0; i < arrlen(list->cmds); i++) {
+        draw_list_execute_cmd(list, &list->cmds[i], img);
+    }
+
+    clear_scissor_stack();
+}
+
+/* -------------------- Tiles -------------------- */
+
+void draw_list_bin(draw_list_t const *list, draw_bins_t *bins, i32 tile_size)
+{
+    bins->tile_size  = tile_size;
+    bins->tiles_x    = CEIL_DIV(list->width, tile_size);
+    bins->tiles_y    = CEIL_DIV(list->height, tile_size);
+    bins->tile_count = bins->tiles_x * bins->tiles_y;
+
+    // tiles run on other threads, that must not be the first use
+    init_span_kernels();
+
+    arrsetlen(bins->start, bins->tile_count + 1);
+    memset(bins->start, 0, (bins->tile_count + 1) * sizeof(*bins->start));
+
+    /*
+        counting sort, one pass to size every bin and one to fill them,
+        so the commands of a tile end up in recorded order
+     */
+    for (i32 pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1)
+        {
+            u32 total = 0;
+            for (i32 t = 0; t <= bins->tile_count; t++) {
+                u32 count = bins->start[t];
+                bins->start[t] = total;
+                total += count;
+            }
+            arrsetlen(bins->cmds, total);
+        }
+
+        for (i32 i = 0; i < arrlen(list->cmds); i++)
+        {
+            draw_cmd_t const *cmd = &list->cmds[i];
+            if (cmd->type == DRAW_CMD_PUSH_SCISSOR || cmd->type == DRAW_CMD_POP_SCISSOR) {
+                continue;
+            }
+
+            i32 tx0 = cmd->bounds.x / tile_size;
+            i32 ty0 = cmd->bounds.y / tile_size;
+            i32 tx1 = (cmd->bounds.x + cmd->bounds.w - 1) / tile_size;
+            i32 ty1 = (cmd->bounds.y + cmd->bounds.h - 1) / tile_size;
+
+            for (i32 ty = ty0; ty <= ty1; ty++) {
+                for (i32 tx = tx0; tx <= tx1; tx++) {
+                    i32 t = ty * bins->tiles_x + tx;
+                    if (pass == 0) {
+                        bins->start[t]++;
+                    } else {
+                        bins->cmds[bins->start[t]++] = (u32)i;
+                    }
+                }
+            }
+        }
+    }
+
+    // filling moved every start to where the next bin begins
+    for (i32 t = bins->tile_count; t > 0; t--) {
+        bins->start[t] = bins->start[t - 1];
+    }
+    bins->start[0] = 0;
+}
+
+void draw_list_execute_tile(draw_list_t const *list, draw_bins_t const *bins, i32 tile, image_view_t *img)
+{
+    i32 tx = tile % bins->tiles_x;
+    i32 ty = tile / bins->tiles_x;
+
+    rect_t tile_rect = {tx * bins->tile_size, ty * bins->tile_size, bins->tile_size, bins->tile_size};
+    rect_t target    = {0, 0, list->width, list->height};
+    tile_rect = intersect_rects(&tile_rect, &target);
+
+    u32 clip = UINT32_MAX;
+    clear_scissor_stack();
+
+    for (u32 i = bins->start[tile]; i < bins->start[tile + 1]; i++)
+    {
+        draw_cmd_t const *cmd = &list->cmds[bins->cmds[i]];
+
+        if (cmd->type == DRAW_CMD_CLEAR) {
+            clear_rect(img, tile_rect.x, tile_rect.y, tile_rect.w, tile_rect.h, cmd->color);
+            continue;
+        }
+
+        if (cmd->clip != clip)
+        {
+            clip = cmd->clip;
+            rect_t region = intersect_rects(&list->clips[clip], &tile_rect);
+            clear_scissor_stack();
+            push_scissor(region.x, region.y, region.w, region.h);
+        }
+
+        draw_list_execute_cmd(list, cmd, img);
+    }
+
+    clear_scissor_stack();
+}
+
+void draw_bins_free(draw_bins_t *bins)
+{
+    arrfree(bins->start);
+    arrfree(bins->cmds);
+    memset(bins, 0, sizeof(*bins));
+}
+
+/* -------------------- Damage -------------------- */
+
+#define DAMAGE_HASH_VALUE(h, v) fnv1a_hash64((h), &(v), sizeof(v))
+
+/*
+    what a command puts in a tile, field by field so padding and the
+    unused part of the union never count
+ */
+static u64 damage_hash_cmd(draw_list_t const *list, draw_cmd_t const *cmd, rect_t const *tile_rect, u64 h)
+{
+    h = DAMAGE_HASH_VALUE(h, cmd->type);
+    h = DAMAGE_HASH_VALUE(h, cmd->color);
+
+    if (cmd->type == DRAW_CMD_CLEAR) {
+        return h;
+    }
+
+    // the index moves when a scissor is added anywhere earlier, what it clips to here does not
+    rect_t region = intersect_rects(&list->clips[cmd->clip], tile_rect);
+    h = DAMAGE_HASH_VALUE(h, region);
+
+    switch (cmd->type)
+    {
+        case DRAW_CMD_RECT:
+        case DRAW_CMD_RECT_OUTLINE:
+        case DRAW_CMD_ROUNDED_RECT:
+        {
+            h = DAMAGE_HASH_VALUE(h, cmd->as.rect.x);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.rect.y);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.rect.w);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.rect.h);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.rect.radius);
+            break;
+        }
+
+        case DRAW_CMD_LINE:
+        {
+            h = DAMAGE_HASH_VALUE(h, cmd->as.line);
+            break;
+        }
+
+        case DRAW_CMD_CIRCLE:
+        case DRAW_CMD_CIRCLE_OUTLINE:
+        {
+            h = DAMAGE_HASH_VALUE(h, cmd->as.circle.cx);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.circle.cy);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.circle.radius);
+            break;
+        }
+
+        case DRAW_CMD_RADIAL_SEGMENT:
+        {
+            h = DAMAGE_HASH_VALUE(h, list->radials[cmd->as.radial.index]);
+            break;
+        }
+
+        case DRAW_CMD_TEXT:
+        case DRAW_CMD_TEXT_UNICODE:
+        {
+            char const *string = list->text + cmd->as.text.offset;
+            h = DAMAGE_HASH_VALUE(h, cmd->as.text.font);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.text.x);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.text.y);
+            h = fnv1a_hash64(h, string, strlen(string) + 1);
+            break;
+        }
+
+        case DRAW_CMD_TEXTURE:
+        {
+            h = DAMAGE_HASH_VALUE(h, cmd->as.texture.image);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.texture.x);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.texture.y);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.texture.scale);
+            break;
+        }
+
+        case DRAW_CMD_IMAGE:
+        case DRAW_CMD_IMAGE_OPAQUE:
+        {
+            h = DAMAGE_HASH_VALUE(h, cmd->as.image.image);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.image.x);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.image.y);
+            h = DAMAGE_HASH_VALUE(h, cmd->as.image.version);
+            break;
+        }
+
+        default:
+        {
+            break;
+        }
+    }
+    return h;
+}
+
+/*
+    adds a run of dirty tiles on one row, growing the rect right above
+    it when that spans exactly the same columns
+ */
+static void damage_add_run(draw_damage_t *damage, rect_t run)
+{
+    for (i32 i = 0; i < arrlen(damage->rects); i++)
+    {
+        rect_t *r = &damage->rects[i];
+        if (r->x == run.x && r->w == run.w && r->y + r->h == run.y) {
+            r->h += run.h;
+            return;
+        }
+    }
+    arrput(damage->rects, run);
+}
+
+void draw_list_damage(draw_list_t const *list, draw_bins_t const *bins, draw_damage_t *damage)
+{
+    bool resized = damage->tile_size != bins->tile_size ||
+                   damage->tiles_x   != bins->tiles_x   ||
+                   damage->tiles_y   != bins->tiles_y   ||
+                   damage->width     != list->width     ||
+                   damage->height    != list->height;
+
+    if (resized || damage->invalid)
+    {
+        damage->tile_size = bins->tile_size;
+        damage->tiles_x   = bins->tiles_x;
+        damage->tiles_y   = bins->tiles_y;
+        damage->width     = list->width;
+        damage->height    = list->height;
+        damage->invalid   = false;
+
+        arrsetlen(damage->hashes, bins->tile_count);
+        memset(damage->hashes, 0, bins->tile_count * sizeof(*damage->hashes));
+        resized = true;
+    }
+
+    arrsetlen(damage->tiles, 0);
+    arrsetlen(damage->rects, 0);
+    damage->area = 0;
+
+    rect_t target = {0, 0, list->width, list->height};
+
+    for (i32 ty = 0; ty < bins->tiles_y; ty++)
+    {
+        rect_t run = {0};
+
+        for (i32 tx = 0; tx < bins->tiles_x; tx++)
+        {
+            i32 tile = ty * bins->tiles_x + tx;
+
+            rect_t tile_rect = {tx * bins->tile_size, ty * bins->tile_size, bins->tile_size, bins->tile_size};
+            tile_rect = intersect_rects(&tile_rect, &target);
+
+            u64 h = FNV1A_SEED64;
+            for (u32 i = bins->start[tile]; i < bins->start[tile + 1]; i++) {
+                h = damage_hash_cmd(list, &list->cmds[bins->cmds[i]], &tile_rect, h);
+            }
+
+            bool dirty = resized || h != damage->hashes[tile];
+            damage->hashes[tile] = h;
+
+            if (dirty)
+            {
+                arrput(damage->tiles, tile);
+                damage->area += tile_rect.w * tile_rect.h;
+
+                if (run.w && run.x + run.w == tile_rect.x) {
+                    run.w += tile_rect.w;
+                } else {
+                    if (run.w) damage_add_run(damage, run);
+                    run = tile_rect;
+                }
+            }
+        }
+
+        if (run.w) damage_add_run(damage, run);
+    }
+}
+
+void draw_damage_invalidate(draw_damage_t *damage)
+{
+    damage->invalid = true;
+}
+
+void draw_damage_free(draw_damage_t *damage)
+{
+    arrfree(damage->hashes);
+    arrfree(damage->tiles);
+    arrfree(damage->rects);
+    memset(damage, 0, sizeof(*damage));
+}
@@ -1,6 +1,7 @@
 
 #include "socket.h"
 #include "event_poll.h"
+#include "util.h"
 
 #define STB_DS_IMPLEMENTATION
 #include "../external/include/stb_ds.h"
@@ -452,7 +453,14 @@ void event_poll_stop(event_poll_t *ep)
 
 #else
 
+#include <sys/eventfd.h>
+
 event_poll_t *event_poll_create(const char *ip, const char *port) 
+{
+    return event_poll_create_ex(ip, port, EVENT_BACKEND_EPOLL);
+}
+
+event_poll_t *event_poll_create_ex(const char *ip, const char *port, event_backend_t backend) 
 {
     event_poll_t *ep = malloc(sizeof(event_poll_t)); 
     if (!ep) {
@@ -490,11 +498,11 @@ event_poll_t *event_poll_create(const char *ip, const char *port)
         return NULL;
     }
     memset(listener_ctx, 0, sizeof(event_ctx_t));
-    listener_ctx->fd = socket_get_socket(&ep->listener);
+    listener_ctx->fd = socket_get_handle(&ep->listener);
     listener_ctx->ep = ep;
-    listener_ctx->callback = NULL;
     listener_ctx->user_data = NULL;
     listener_ctx->events = 0;
+    timer_node_init(&listener_ctx->idle_timer, NULL, NULL);
 
     // Add listener to epoll interest list, register it in edge triggered mode 
     if(event_poll_register_ctx(ep, listener_ctx, EVENT_READ | EVENT_ET) < 0)
@@ -507,6 +515,31 @@ event_poll_t *event_poll_create(const char *ip, const char *port)
         return NULL;
     } 
 
+    ep->listener_ctx = listener_ctx;
+    ep->conns = NULL;
+    ep->now_ms = timer_now_ms();
+    ep->idle_timeout_ms = EV_IDLE_TIMEOUT_MS;
+    ep->handshake_timeout_ms = EV_HANDSHAKE_TIMEOUT_MS;
+    ep->stats.started_ms = ep->now_ms;
+    pthread_mutex_init(&ep->bucket_lock, NULL);
+    timer_wheel_init(&ep->timers, ep->now_ms);
+
+    /*
+        io_uring is opt-in, if the kernel is too old or the ring cant be
+        set up (seccomp, memlock limits ...) just stay on epoll, the
+        callbacks dont care which one drives them
+     */
+    ep->backend = EVENT_BACKEND_EPOLL;
+    if (backend == EVENT_BACKEND_URING)
+    {
+        if (event_uring_supported() && event_uring_init(ep) == 0) {
+            ep->backend = EVENT_BACKEND_URING;
+            printf("event_poll: using io_uring backend\n");
+        } else {
+            fprintf(stderr, "event_poll: io_uring unavailable, falling back to epoll\n");
+        }
+    }
+
     ep->running = true;
     return ep;
 }
@@ -517,10 +550,47 @@ void event_poll_destroy(event_poll_t *ep)
 
     ep->running = false;
 
+    // workers may still hold contexts, let them finish before freeing anything
+    if (ep->pool) {
+        threadpool_wait(ep->pool);
+        arrfree(ep->done);
+        arrfree(ep->rearm);
+        pthread_mutex_destroy(&ep->done_lock);
+    }
+
+    // whoever is still connected gets closed, no callbacks at this point
+    for (ptrdiff_t i = 0; i < hmlen(ep->conns); i++) 
+    {
+        event_ctx_t *ctx = ep->conns[i].value;
+        close(ctx->fd);
+        arrfree(ctx->held);
+        free(ctx);
+    }
+    hmfree(ep->conns);
+
+    if (ep->backend == EVENT_BACKEND_URING) {
+        event_uring_destroy(ep);
+    }
+
     if (ep->epoll_fd >= 0) {
         close(ep->epoll_fd);
     }
 
+    if (ep->wake_ctx) {
+        close(ep->wake_ctx->fd);
+        free(ep->wake_ctx);
+    }
+
+    // its fds are watched, gone before the watches are
+    event_shm_destroy(ep);
+
+    for (ptrdiff_t i = 0; i < arrlen(ep->watched); i++) {
+        free(ep->watched[i]);
+    }
+    arrfree(ep->watched);
+
+    pthread_mutex_destroy(&ep->bucket_lock);
+    free(ep->listener_ctx);
     socket_close(&ep->listener);
     free(ep);
 }
@@ -572,6 +642,7 @@ int event_poll_register_ctx(event_poll_t *ep, event_ctx_t*ctx, uint32_t events)
 
     ev.data.ptr = ctx;
 
+    EVENT_STAT_ADD(ep, syscalls, 1);
     if (epoll_ctl(ep->epoll_fd, EPOLL_CTL_ADD, ctx->fd, &ev) < 0) 
     {
         fprintf(stderr, "epoll_ctl ADD failed: %s\n", strerror(errno));
@@ -623,6 +694,7 @@ int event_poll_modify_ctx(event_poll_t *ep, event_ctx_t*ctx, uint32_t events)
 
     ev.data.ptr = ctx;
 
+    EVENT_STAT_ADD(ep, syscalls, 1);
     if (epoll_ctl(ep->epoll_fd, EPOLL_CTL_MOD, ctx->fd, &ev) < 0) 
     {
         fprintf(stderr, "epoll_ctl MOD failed: %s\n", strerror(errno));
@@ -651,17 +723,429 @@ int event_poll_remove_ctx(event_poll_t *ep, event_ctx_t*ctx)
 {
     if (!ep || ep->epoll_fd < 0 || !ctx) return -1;
 
+    if (ep->backend == EVENT_BACKEND_URING) {
+        return event_uring_remove_ctx(ep, ctx);
+    }
+
     if (epoll_ctl(ep->epoll_fd, EPOLL_CTL_DEL, ctx->fd, NULL) < 0) {
         // if fd already closed, ignore specific errors
         if (errno != ENOENT && errno != EBADF)
             perror("epoll_ctl DEL failed");
     }
 
+    // a worker may have asked to re arm it in the meantime
+    if (ep->pool) 
+    {
+        mutex_lock(&ep->done_lock);
+        for (ptrdiff_t i = arrlen(ep->rearm) - 1; i >= 0; i--) {
+            if (ep->rearm[i] == ctx) arrdelswap(ep->rearm, i);
+        }
+        mutex_unlock(&ep->done_lock);
+    }
+
+    event_poll_release_ctx(ep, ctx);
+
     close(ctx->fd);
     free(ctx);
     return 0;
 }
 
+/*
+    Stop tracking a connection (timer + fd map) without closing it,
+    shared by both backends
+ */
+void event_poll_release_ctx(event_poll_t *ep, event_ctx_t *ctx)
+{
+    timer_wheel_cancel(&ep->timers, &ctx->idle_timer);
+    timer_wheel_cancel(&ep->timers, &ctx->resume_timer);
+    (void)hmdel(ep->conns, ctx->fd);
+    EVENT_STAT_ADD(ep, closes, 1);
+}
+
+event_ctx_t *event_poll_get_ctx(event_poll_t *ep, socket_handle fd)
+{
+    if (!ep) return NULL;
+    return hmget(ep->conns, fd);
+}
+
+/* -------------------- Idle / slow connection reaping -------------------- */
+
+/*
+    Every connection owns one timer in the wheel, it points at the earliest of
+        - handshake deadline : accepted but never sent anything
+        - idle deadline      : nothing received for idle_timeout_ms
+        - read deadline      : armed by the protocol while a frame is half
+                               received, catches slow-loris clients that keep
+                               the connection alive by trickling bytes
+    
+    Receiving data does NOT touch the wheel, it only stamps last_active_ms.
+    When the timer fires we recompute the deadline and either reap the
+    connection or push the timer forward, so busy connections cost one
+    reschedule per timeout period instead of one per recv.
+ */
+static uint64_t ctx_deadline(event_poll_t *ep, event_ctx_t *ctx)
+{
+    uint64_t deadline;
+
+    if (ctx->bytes_in == 0) {
+        deadline = ctx->accepted_ms + ep->handshake_timeout_ms;
+    } else {
+        deadline = ctx->last_active_ms + ep->idle_timeout_ms;
+    }
+
+    if (ctx->read_deadline_ms && ctx->read_deadline_ms < deadline) {
+        deadline = ctx->read_deadline_ms;
+    }
+
+    return deadline;
+}
+
+static void on_idle_timer_expired(void *user_data, timer_node_t *node)
+{
+    (void)node;
+    event_ctx_t  *ctx = (event_ctx_t *)user_data;
+    event_poll_t *ep  = ctx->ep;
+
+    // a worker is reading it right now, cant free it from under it, look again next tick.
+    // throttled: the bytes are there, we just don't read them yet
+    if (ctx->in_worker || ctx->read_throttled) 
+    {
+        timer_wheel_schedule(&ep->timers, &ctx->idle_timer, ep->now_ms + TIMER_WHEEL_TICK_MS);
+        return;
+    }
+
+    uint64_t deadline = ctx_deadline(ep, ctx);
+
+    // saw traffic since the timer was armed, just move it forward
+    if (deadline > ep->now_ms) 
+    {
+        timer_wheel_schedule(&ep->timers, &ctx->idle_timer, deadline);
+        return;
+    }
+
+    printf("Reaping %s connection (fd: %d)\n", 
+           ctx->bytes_in == 0 ? "silent" : (ctx->read_deadline_ms ? "slow" : "idle"), ctx->fd);
+
+    if (ep->callbacks && ep->callbacks->on_disconnect) {
+        EVENT_TIMED_CB(ep, EVENT_CB_DISCONNECT, ep->callbacks->on_disconnect(ctx->user_data, ctx->fd));
+    }
+    event_poll_remove_ctx(ep, ctx);
+}
+
+void event_poll_set_timeouts(event_poll_t *ep, uint32_t idle_ms, uint32_t handshake_ms)
+{
+    if (!ep) return;
+
+    ep->idle_timeout_ms = idle_ms;
+    ep->handshake_timeout_ms = handshake_ms;
+
+    // shorter timeouts have to take effect now not after the old deadline
+    for (ptrdiff_t i = 0; i < hmlen(ep->conns); i++) 
+    {
+        event_ctx_t *ctx = ep->conns[i].value;
+        timer_wheel_schedule(&ep->timers, &ctx->idle_timer, ctx_deadline(ep, ctx));
+    }
+}
+
+/*
+    The protocol layer knows where its frames start and end, the loop doesnt.
+    Arm a deadline when a frame is half way through and clear it (timeout 0)
+    once it completes.
+ */
+int event_poll_set_read_deadline(event_poll_t *ep, socket_handle fd, uint32_t timeout_ms)
+{
+    event_ctx_t *ctx = event_poll_get_ctx(ep, fd);
+    if (!ctx) return -1;
+
+    return event_poll_set_read_deadline_ctx(ep, ctx, timeout_ms);
+}
+
+/*
+    Same for a ctx, and the one to use from on_receive on a worker: the
+    conns map and the timer wheel are the loop's, so the worker only
+    leaves the request on the ctx it drains and event_poll_handle_done
+    applies it when the ctx comes back.
+ */
+int event_poll_set_read_deadline_ctx(event_poll_t *ep, event_ctx_t *ctx, uint32_t timeout_ms)
+{
+    if (!ep || !ctx) return -1;
+
+    if (ep->pool && !pthread_equal(pthread_self(), ep->loop_thread))
+    {
+        ctx->deadline_requested = true;
+        ctx->deadline_request_ms = timeout_ms;
+        return 0;
+    }
+
+    if (timeout_ms == 0) 
+    {
+        // the timer may now fire early, that is fine it just reschedules itself
+        ctx->read_deadline_ms = 0;
+        return 0;
+    }
+
+    // keep the first deadline, re arming on every chunk would defeat the point
+    if (ctx->read_deadline_ms) {
+        return 0;
+    }
+
+    ctx->read_deadline_ms = ep->now_ms + timeout_ms;
+
+    if (!ctx->idle_timer.armed || ctx->read_deadline_ms < ctx->idle_timer.deadline_ms) {
+        timer_wheel_schedule(&ep->timers, &ctx->idle_timer, ctx->read_deadline_ms);
+    }
+    return 0;
+}
+
+/* -------------------- Rate limiting -------------------- */
+
+/*
+    Every connection has its own bucket and all of them share the global
+    one, a recv is charged to both. Once either is empty the connection
+    stops reading: epoll re arms it without EVENT_READ, io_uring cancels
+    its multishot recv. resume_timer turns reading back on when the
+    buckets should be positive again, the bytes meanwhile wait in the
+    kernel and TCP flow control pushes back on the client.
+
+    The timer wheel ticks at TIMER_WHEEL_TICK_MS so a resume can be
+    that much late, a burst of at least rate / 10 keeps that from
+    costing throughput.
+ */
+
+static void event_poll_rearm(event_poll_t *ep, event_ctx_t *ctx);
+
+static void bucket_refill(event_bucket_t *b, uint64_t now_ms)
+{
+    if (now_ms <= b->last_ms) return;
+
+    int64_t add = (int64_t)((now_ms - b->last_ms) * b->rate / 1000);
+    if (add == 0) return;       // leave last_ms, slow rates still add up
+
+    b->tokens += add;
+    if (b->tokens > (int64_t)b->burst) b->tokens = b->burst;
+    b->last_ms = now_ms;
+}
+
+// how long until the bucket is above zero again
+static uint64_t bucket_wait_ms(const event_bucket_t *b)
+{
+    if (b->rate == 0 || b->tokens > 0) return 0;
+    return ((uint64_t)(-b->tokens) + 1) * 1000 / b->rate + 1;
+}
+
+/*
+    Charge n bytes just read, false once a bucket ran dry. That sets
+    read_throttled and the drain stops, re arming does the rest. Called
+    by whoever holds the ctx, the loop or the worker draining it.
+ */
+bool event_poll_charge_read(event_poll_t *ep, event_ctx_t *ctx, size_t n)
+{
+    bool ok = true;
+    uint64_t now = ep->pool ? timer_now_ms() : ep->now_ms;
+
+    if (ctx->bucket.rate)
+    {
+        bucket_refill(&ctx->bucket, now);
+        ctx->bucket.tokens -= (int64_t)n;
+        ok = ctx->bucket.tokens > 0;
+    }
+
+    if (ep->global_bucket.rate)
+    {
+        mutex_lock(&ep->bucket_lock);
+        bucket_refill(&ep->global_bucket, now);
+        ep->global_bucket.tokens -= (int64_t)n;
+        ok = ok && ep->global_bucket.tokens > 0;
+        mutex_unlock(&ep->bucket_lock);
+    }
+
+    if (!ok && !ctx->read_throttled) {
+        ctx->read_throttled = true;
+        ctx->throttled_ms = now;
+        EVENT_STAT_ADD(ep, throttles, 1);
+    }
+    return ok;
+}
+
+// loop thread only, the ctx is not in a worker
+static void event_poll_schedule_resume(event_poll_t *ep, event_ctx_t *ctx)
+{
+    if (ctx->resume_timer.armed) return;
+
+    bucket_refill(&ctx->bucket, ep->now_ms);
+    uint64_t wait = bucket_wait_ms(&ctx->bucket);
+
+    if (ep->global_bucket.rate)
+    {
+        mutex_lock(&ep->bucket_lock);
+        bucket_refill(&ep->global_bucket, ep->now_ms);
+        uint64_t global_wait = bucket_wait_ms(&ep->global_bucket);
+        mutex_unlock(&ep->bucket_lock);
+
+        if (global_wait > wait) wait = global_wait;
+    }
+
+    timer_wheel_schedule(&ep->timers, &ctx->resume_timer, ep->now_ms + wait);
+}
+
+/*
+    Apply read_throttled / read_paused to the backend, loop thread
+    only. A ctx held by a worker picks it up when it is re armed.
+ */
+void event_poll_update_reading(event_poll_t *ep, event_ctx_t *ctx)
+{
+    if (ep->backend == EVENT_BACKEND_URING)
+    {
+        if (ctx->read_throttled) {
+            event_poll_schedule_resume(ep, ctx);
+        }
+        event_uring_set_reading(ep, ctx, !ctx->read_throttled && !event_ctx_read_paused(ctx));
+        return;
+    }
+
+    if (ctx->armed) {
+        event_poll_rearm(ep, ctx);
+    }
+}
+
+static void on_resume_timer_expired(void *user_data, timer_node_t *node)
+{
+    (void)node;
+    event_ctx_t  *ctx = (event_ctx_t *)user_data;
+    event_poll_t *ep  = ctx->ep;
+
+    // we were the ones not reading, that time doesn't count against the client
+    uint64_t stalled = ep->now_ms > ctx->throttled_ms ? ep->now_ms - ctx->throttled_ms : 0;
+    if (ctx->read_deadline_ms) {
+        ctx->read_deadline_ms += stalled;
+    }
+    ctx->last_active_ms = ep->now_ms;
+
+    // a bucket still in the red stops it again after one more read
+    ctx->read_throttled = false;
+    event_poll_update_reading(ep, ctx);
+}
+
+/*
+    Limit what every connection (conn_*) and all of them together
+    (global_*) may read, in bytes per second, 0 = no limit. A burst of
+    0 means one second worth of rate. Loop thread, or before the loop.
+ */
+void event_poll_set_rate_limit(event_poll_t *ep, uint32_t conn_rate, uint32_t conn_burst, uint32_t global_rate, uint32_t global_burst)
+{
+    if (!ep) return;
+
+    ep->conn_limit.rate    = conn_rate;
+    ep->conn_limit.burst   = conn_burst ? conn_burst : conn_rate;
+    ep->conn_limit.tokens  = ep->conn_limit.burst;
+    ep->conn_limit.last_ms = ep->now_ms;
+
+    mutex_lock(&ep->bucket_lock);
+    ep->global_bucket.rate    = global_rate;
+    ep->global_bucket.burst   = global_burst ? global_burst : global_rate;
+    ep->global_bucket.tokens  = ep->global_bucket.burst;
+    ep->global_bucket.last_ms = ep->now_ms;
+    mutex_unlock(&ep->bucket_lock);
+
+    for (ptrdiff_t i = 0; i < hmlen(ep->conns); i++) {
+        ep->conns[i].value->bucket = ep->conn_limit;
+    }
+}
+
+static void event_poll_start_tracking(event_poll_t *ep, event_ctx_t *ctx)
+{
+    ctx->accepted_ms = ep->now_ms;
+    ctx->last_active_ms = ep->now_ms;
+    timer_node_init(&ctx->idle_timer, on_idle_timer_expired, ctx);
+    timer_node_init(&ctx->resume_timer, on_resume_timer_expired, ctx);
+
+    ctx->bucket = ep->conn_limit;
+    ctx->bucket.tokens = ep->conn_limit.burst;
+    ctx->bucket.last_ms = ep->now_ms;
+
+    hmput(ep->conns, ctx->fd, ctx);
+    timer_wheel_schedule(&ep->timers, &ctx->idle_timer, ctx_deadline(ep, ctx));
+    EVENT_STAT_ADD(ep, accepts, 1);
+}
+
+/*
+    Allocate and track a context for an already accepted socket,
+    used by backends that accept on their own (io_uring)
+ */
+event_ctx_t *event_poll_track_connection(event_poll_t *ep, socket_handle fd, void *user_data)
+{
+    event_ctx_t *ctx = calloc(1, sizeof(event_ctx_t));
+    if (!ctx) return NULL;
+
+    ctx->fd = fd;
+    ctx->ep = ep;
+    ctx->user_data = user_data;
+
+    event_poll_start_tracking(ep, ctx);
+    return ctx;
+}
+
+/*
+    Some other fd the loop should look after, a UDP socket say.
+    Level triggered reads, no idle timer, no recv done for it,
+    on_ready is called on the loop thread whenever it is readable
+    and has to read until EAGAIN itself. The fd stays owned by the
+    caller, the watch lives until event_poll_unwatch or
+    event_poll_destroy.
+ */
+event_ctx_t *event_poll_watch(event_poll_t *ep, socket_handle fd, on_ready_cb on_ready, void *user_data)
+{
+    if (!ep || !on_ready) return NULL;
+
+    event_ctx_t *ctx = calloc(1, sizeof(event_ctx_t));
+    if (!ctx) {
+        fprintf(stderr, "Failed to allocate watch context\n");
+        return NULL;
+    }
+
+    ctx->fd = fd;
+    ctx->ep = ep;
+    ctx->on_ready = on_ready;
+    ctx->user_data = user_data;
+    timer_node_init(&ctx->idle_timer, NULL, NULL);
+
+    int rc = (ep->backend == EVENT_BACKEND_URING)
+           ? event_uring_watch(ep, ctx)
+           : event_poll_register_ctx(ep, ctx, EVENT_READ);
+
+    if (rc < 0) {
+        free(ctx);
+        return NULL;
+    }
+
+    arrput(ep->watched, ctx);
+    return ctx;
+}
+
+/*
+    Loop thread only, on_ready may unwatch its own ctx. The fd is
+    left open, close it afterwards.
+ */
+int event_poll_unwatch(event_poll_t *ep, event_ctx_t *ctx)
+{
+    if (!ep || !ctx) return -1;
+
+    for (ptrdiff_t i = 0; i < arrlen(ep->watched); i++) {
+        if (ep->watched[i] == ctx) {
+            arrdelswap(ep->watched, i);
+            break;
+        }
+    }
+
+    if (ep->backend == EVENT_BACKEND_URING) {
+        return event_uring_unwatch(ep, ctx);
+    }
+
+    epoll_ctl(ep->epoll_fd, EPOLL_CTL_DEL, ctx->fd, NULL);
+    free(ctx);
+    return 0;
+}
+
 void event_poll_handle_new_connection(event_poll_t *ep, void *user_data)
 {
     // call accept as many times as we can
@@ -672,6 +1156,7 @@ void event_poll_handle_new_connection(event_poll_t *ep, void *user_data)
             for each client that connects to the server. 
         */
         socket_handle new_fd = socket_accept_connection(&ep->listener);
+        EVENT_STAT_ADD(ep, syscalls, 1);
 
         if (new_fd < 0){
             break;
@@ -681,7 +1166,7 @@ void event_poll_handle_new_connection(event_poll_t *ep, void *user_data)
         socket_set_non_blocking(new_fd);
 
         event_ctx_t*ctx = malloc(sizeof(event_ctx_t));
-         if (!client_ctx) {
+        if (!ctx) {
             close(new_fd);
             continue;
         }
@@ -708,11 +1193,375 @@ void event_poll_handle_new_connection(event_poll_t *ep, void *user_data)
             free(ctx);
             continue;
         }
+        ctx->armed = true;
+
+        event_poll_start_tracking(ep, ctx);
 
         if (ep->callbacks->on_accept) {
-            ep->callbacks->on_accept(user_data, new_fd);
+            EVENT_TIMED_CB(ep, EVENT_CB_ACCEPT, ep->callbacks->on_accept(user_data, new_fd));
+        }
+    }
+}
+
+/*
+    Drain an edge triggered connection, returns 0 once recv hits EAGAIN,
+    -1 on EOF or the errno of a real error. Does not close anything so
+    it can run on a worker thread.
+ */
+static int event_poll_drain(event_poll_t *ep, event_ctx_t *ctx)
+{
+    char buffer[4096];
+
+    for (;;) 
+    {
+        // out of budget, the rest waits in the socket buffer
+        if (ctx->read_throttled || event_ctx_read_paused(ctx)) {
+            return 0;
+        }
+
+        ssize_t n = recv(ctx->fd, buffer, sizeof(buffer), 0);
+        ctx->recv_calls++;
+        EVENT_STAT_ADD(ep, syscalls, 1);
+
+        if (n > 0) 
+        {
+            ctx->bytes_in += (uint64_t)n;
+            ctx->last_active_ms = ep->pool ? timer_now_ms() : ep->now_ms;
+            EVENT_STAT_ADD(ep, bytes_in, n);
+
+            if (ep->callbacks->on_receive) {
+                EVENT_TIMED_CB(ep, EVENT_CB_RECEIVE, ep->callbacks->on_receive(ctx->user_data, ctx->fd, buffer, n));
+            }
+            event_poll_charge_read(ep, ctx, (size_t)n);
+        } 
+        else if (n == 0) 
+        {
+            // EOF encountered
+            return -1;
+        } 
+        else 
+        {
+            /*
+                With EPOLLET When you get EPOLLIN, you must read until EAGAIN. 
+                If you leave unread data You will not get another event.
+                With EPOLLONESHOT after callback finishes handling the event 
+                (reading everything until EAGAIN), epoll will not send any 
+                more events, we need to rearm it manually its used mainly to
+                make it thread safe and no two threads can handle same fd at 
+                same time, ONESHO ensures only one thread handles the event.
+             */
+            if (errno == EAGAIN || errno == EWOULDBLOCK) 
+            {
+                // read end normally
+                // drained -> ok to re-arm
+                ctx->eagain_in++;
+                EVENT_STAT_ADD(ep, eagain, 1);
+                return 0;
+            } 
+            else if (errno == EINTR)
+            {
+                continue;
+            }
+            else 
+            {
+                // real error
+                return errno;
+            }
+        }
+    }
+}
+
+/*
+    Tear down a connection that drain reported as closed,
+    loop thread only
+ */
+static void event_poll_handle_closed(event_poll_t *ep, event_ctx_t *ctx, int rc)
+{
+    if (rc < 0) 
+    {
+        printf("Client disconnected (fd: %d)\n", ctx->fd);
+
+        if (ep->callbacks->on_disconnect) {
+            EVENT_TIMED_CB(ep, EVENT_CB_DISCONNECT, ep->callbacks->on_disconnect(ctx->user_data, ctx->fd));
+        }
+    } 
+    else 
+    {
+        fprintf(stderr, "recv failed (fd: %d): %s\n", ctx->fd, strerror(rc));
+        if (ep->callbacks->on_error) {
+            EVENT_TIMED_CB(ep, EVENT_CB_ERROR, ep->callbacks->on_error(ctx->user_data, ctx->fd, rc));
+        }
+    }
+    event_poll_remove_ctx(ep, ctx);
+}
+
+/*
+    returns false if the connection got closed
+    and ctx must not be touched anymore
+ */
+static bool event_poll_handle_read(event_poll_t *ep, event_ctx_t *ctx)
+{
+    int rc = event_poll_drain(ep, ctx);
+    if (rc == 0) {
+        return true;
+    }
+
+    event_poll_handle_closed(ep, ctx, rc);
+    return false;
+}
+
+/*
+    Queue a ctx for the loop thread and poke it through the eventfd
+ */
+static void event_poll_hand_back(event_poll_t *ep, event_ctx_t ***list, event_ctx_t *ctx)
+{
+    mutex_lock(&ep->done_lock);
+    bool was_empty = arrlen(ep->done) == 0 && arrlen(ep->rearm) == 0;
+    arrput(*list, ctx);
+    mutex_unlock(&ep->done_lock);
+
+    // the loop takes the whole list per wake up, one poke is enough
+    if (was_empty) 
+    {
+        uint64_t one = 1;
+        if (write(ep->wake_ctx->fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("eventfd write");
+        }
+    }
+}
+
+/*
+    Put a ONESHOT client back into epoll with whatever interest it has
+    right now, loop thread only
+ */
+static void event_poll_rearm(event_poll_t *ep, event_ctx_t *ctx)
+{
+    uint32_t events = EVENT_ET | EVENT_ONESHOT;
+    if (!ctx->read_throttled && !event_ctx_read_paused(ctx)) {
+        events |= EVENT_READ;
+    }
+    if (event_ctx_want_write(ctx)) {
+        events |= EVENT_WRITE;
+    }
+    if (ctx->read_throttled) {
+        event_poll_schedule_resume(ep, ctx);
+    }
+
+    ctx->armed = true;
+    event_poll_modify_ctx(ep, ctx, events);
+}
+
+/*
+    Ask for on_writable once the socket buffer has room again (after a
+    send hit EAGAIN), and turn it off once the output is flushed.
+
+    ONESHOT means the interest can only be changed while the ctx sits
+    idle in epoll, if the loop or a worker holds it the new interest is
+    picked up when it gets re armed. Workers cant touch epoll for a ctx
+    they dont own so they hand it to the loop instead. The flag is set
+    atomically, the loop may be reading it for that very ctx meanwhile.
+ */
+int event_poll_want_write(event_poll_t *ep, event_ctx_t *ctx, bool on)
+{
+    if (!ep || !ctx) return -1;
+
+    // io_uring sends complete on their own, nothing to wait for
+    if (ep->backend != EVENT_BACKEND_EPOLL) return 0;
+
+    if (__atomic_exchange_n(&ctx->want_write, on, __ATOMIC_ACQ_REL) == on) return 0;
+
+    if (ep->pool && !pthread_equal(pthread_self(), ep->loop_thread)) 
+    {
+        event_poll_hand_back(ep, &ep->rearm, ctx);
+        return 0;
+    }
+
+    if (ctx->armed) {
+        event_poll_rearm(ep, ctx);
+    }
+    return 0;
+}
+
+/*
+    Backpressure from the owner, typically its output queue for this
+    connection went past a high watermark: stop reading until it says
+    otherwise. Same threading rules as event_poll_want_write.
+ */
+int event_poll_pause_read(event_poll_t *ep, event_ctx_t *ctx, bool paused)
+{
+    if (!ep || !ctx) return -1;
+
+    if (__atomic_exchange_n(&ctx->read_paused, paused, __ATOMIC_ACQ_REL) == paused) return 0;
+    if (paused) EVENT_STAT_ADD(ep, read_pauses, 1);
+
+    if (ep->pool && !pthread_equal(pthread_self(), ep->loop_thread)) 
+    {
+        event_poll_hand_back(ep, &ep->rearm, ctx);
+        return 0;
+    }
+
+    event_poll_update_reading(ep, ctx);
+    return 0;
+}
+
+/* -------------------- Thread pool dispatch -------------------- */
+
+/*
+    Every client is armed EPOLLET | EPOLLONESHOT, once an event fired the
+    fd stays disarmed until someone re-arms it, so at most one thread
+    ever reads a given connection. That lets the loop hand ready contexts
+    to the pool and go straight back to epoll_wait, a slow on_receive
+    (full text search ...) only stalls its own connection.
+
+    The worker only drains the socket. Everything else about the ctx
+    (re-arming, the conns map, the timer wheel, free) stays on the loop
+    thread: finished contexts are queued back through an eventfd and the
+    loop re-arms or closes them in one batch. Re-arming from the worker
+    would save that hop but then a HUP could free the ctx while the
+    worker is still inside epoll_ctl.
+
+    on_receive runs on worker threads, concurrently for different fds.
+ */
+static void event_poll_worker_job(void *data)
+{
+    event_ctx_t  *ctx = (event_ctx_t *)data;
+    event_poll_t *ep  = ctx->ep;
+
+    ctx->worker_rc = event_poll_drain(ep, ctx);
+
+    event_poll_hand_back(ep, &ep->done, ctx);
+}
+
+static void event_poll_handle_done(event_poll_t *ep)
+{
+    uint64_t count;
+    while (read(ep->wake_ctx->fd, &count, sizeof(count)) > 0) {}
+
+    mutex_lock(&ep->done_lock);
+    event_ctx_t **done = ep->done;
+    event_ctx_t **rearm = ep->rearm;
+    ep->done = NULL;
+    ep->rearm = NULL;
+    mutex_unlock(&ep->done_lock);
+
+    EVENT_STAT_SUB(ep, pool_pending, arrlen(done));
+
+    // write interest changed by a worker, only matters if nobody else holds the ctx
+    for (ptrdiff_t i = 0; i < arrlen(rearm); i++) 
+    {
+        if (rearm[i]->armed) {
+            event_poll_rearm(ep, rearm[i]);
+        }
+    }
+    arrfree(rearm);
+
+    for (ptrdiff_t i = 0; i < arrlen(done); i++) 
+    {
+        event_ctx_t *ctx = done[i];
+        ctx->in_worker = false;
+
+        if (ctx->deadline_requested) {
+            ctx->deadline_requested = false;
+            event_poll_set_read_deadline_ctx(ep, ctx, ctx->deadline_request_ms);
+        }
+
+        if (ctx->worker_rc == 0) {
+            // drained -> re arm again
+            event_poll_rearm(ep, ctx);
+        } else {
+            event_poll_handle_closed(ep, ctx, ctx->worker_rc);
         }
     }
+    arrfree(done);
+}
+
+/*
+    Run reads on the pool instead of the loop thread. Call before
+    event_poll_loop, the pool is not owned and has to outlive ep.
+    epoll only, io_uring already completes reads without blocking.
+ */
+int event_poll_set_thread_pool(event_poll_t *ep, struct thread_pool_t *pool)
+{
+    if (!ep || !pool) return -1;
+
+    if (ep->backend != EVENT_BACKEND_EPOLL) {
+        fprintf(stderr, "event_poll_set_thread_pool: only supported on the epoll backend\n");
+        return -1;
+    }
+
+    if (ep->pool) return 0;
+
+    event_ctx_t *wake_ctx = calloc(1, sizeof(event_ctx_t));
+    if (!wake_ctx) {
+        fprintf(stderr, "Failed to allocate wake context\n");
+        return -1;
+    }
+
+    wake_ctx->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_ctx->fd < 0) {
+        fprintf(stderr, "eventfd failed: %s\n", strerror(errno));
+        free(wake_ctx);
+        return -1;
+    }
+    wake_ctx->ep = ep;
+    timer_node_init(&wake_ctx->idle_timer, NULL, NULL);
+
+    if (event_poll_register_ctx(ep, wake_ctx, EVENT_READ) < 0) {
+        close(wake_ctx->fd);
+        free(wake_ctx);
+        return -1;
+    }
+
+    pthread_mutex_init(&ep->done_lock, NULL);
+    ep->done = NULL;
+    ep->rearm = NULL;
+    ep->wake_ctx = wake_ctx;
+    ep->pool = pool;
+    return 0;
+}
+
+/*
+    Best effort non-blocking send, returns how much actually made it
+    into the socket buffer
+ */
+int event_poll_send(event_poll_t *ep, socket_handle fd, const char *data, size_t len)
+{
+    if (!ep || !data || len == 0) return -1;
+
+    if (ep->shm && event_poll_is_shm(ep, fd)) {
+        struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+        return (int)event_poll_shm_writev(ep, fd, &iov, 1);
+    }
+
+    if (ep->backend == EVENT_BACKEND_URING) {
+        return event_uring_send(ep, fd, data, len);
+    }
+
+    size_t sent = 0;
+    while (sent < len)
+    {
+        ssize_t n = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+        event_poll_note_send(ep, NULL, n);
+        if (n > 0) {
+            sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "event_poll_send: send failed: %s\n", strerror(errno));
+            return -1;
+        }
+        break;
+    }
+
+    // no ctx lookup, this may run on a worker while the loop mutates the map
+    if (sent > 0 && ep->callbacks && ep->callbacks->on_send) {
+        ep->callbacks->on_send(ep->user_data, fd, sent);
+    }
+
+    return (int)sent;
 }
 
 void event_poll_loop(event_poll_t *ep ,event_callbacks_t *callbacks, void *user_data) 
@@ -720,6 +1569,17 @@ void event_poll_loop(event_poll_t *ep ,event_callbacks_t *callbacks, void *user_
     if(!ep || !callbacks)
         return;
 
+    ep->callbacks = callbacks;
+    ep->user_data = user_data;
+    ep->loop_thread = pthread_self();
+
+    if (ep->backend == EVENT_BACKEND_URING)
+    {
+        event_uring_loop(ep, user_data);
+        event_poll_destroy(ep);
+        return;
+    }
+
     /*
         typedef union epoll_data {
             void    *ptr;           // Pointer to user-defined data 
@@ -748,9 +1608,18 @@ void event_poll_loop(event_poll_t *ep ,event_callbacks_t *callbacks, void *user_
               monitored becomes ready for I/O.
             - can unblock if interrupted by a signal
             - can unblock if timeout parameter is not set to -1
-            - TODO: set timeout, now its blocking forever
+            - sleep exactly until the next timer in the wheel is due,
+              capped so event_poll_stop is noticed in reasonable time
         */
-        int nfds = epoll_wait(ep->epoll_fd, events, MAX_EVENTS, 1000);
+        ep->now_ms = timer_now_ms();
+        int timeout = timer_wheel_next_timeout(&ep->timers, ep->now_ms, EV_MAX_WAIT_MS);
+
+        int nfds = epoll_wait(ep->epoll_fd, events, MAX_EVENTS, timeout);
+
+        ep->now_ms = timer_now_ms();
+        EVENT_STAT_ADD(ep, syscalls, 1);
+        EVENT_STAT_ADD(ep, wakeups, 1);
+        if (nfds > 0) EVENT_STAT_ADD(ep, events, nfds);
 
         if (nfds < 0) 
         {
@@ -763,12 +1632,6 @@ void event_poll_loop(event_poll_t *ep ,event_callbacks_t *callbacks, void *user_
             fprintf(stderr, "epoll_wait error: %s\n", strerror(errno));
             break;
         }
-        else if (nfds == 0)
-        {
-            // timed out no idea what to do ??
-            // ideas : keep alive sweep periodically
-            continue;
-        }
 
         // one or more file descriptors in the interest list became ready
         for (int i = 0; i < nfds; i++) 
@@ -778,86 +1641,124 @@ void event_poll_loop(event_poll_t *ep ,event_callbacks_t *callbacks, void *user_
             if (!ctx) continue;
 
             // New connection on listener
-            if (ctx->fd == socket_get_socket(&ep->listener)) 
+            if (ctx == ep->listener_ctx) 
             {
                 event_poll_handle_new_connection(ep, user_data);
             }
+            // Workers finished draining some connections
+            else if (ctx == ep->wake_ctx)
+            {
+                event_poll_handle_done(ep);
+            }
+            // Watched fd, its owner does the reading
+            else if (ctx->on_ready)
+            {
+                EVENT_TIMED_CB(ep, EVENT_CB_READY, ctx->on_ready(ctx->user_data, ctx->fd));
+            }
             // Existing connection
             else 
             {
+                // ONESHOT fired, it stays disarmed until event_poll_rearm
+                ctx->armed = false;
+
                 if (events[i].events & (EPOLLHUP | EPOLLERR)) 
                 {
                     if (ep->callbacks->on_error) {
-                        ep->callbacks->on_error(ctx->user_data, ctx->fd, errno);
+                        EVENT_TIMED_CB(ep, EVENT_CB_ERROR, ep->callbacks->on_error(ctx->user_data, ctx->fd, errno));
                     }
                     event_poll_remove_ctx(ep, ctx);
                     continue;
                 }
 
+                // room in the socket buffer again, let the owner flush its output
+                if ((events[i].events & EPOLLOUT) && ep->callbacks->on_writable) 
+                {
+                    EVENT_TIMED_CB(ep, EVENT_CB_WRITABLE, ep->callbacks->on_writable(ctx->user_data, ctx->fd));
+                }
+
+                if ((events[i].events & EPOLLIN) && ep->pool) 
+                {
+                    // re armed in event_poll_handle_done once the worker drained it
+                    ctx->in_worker = true;
+                    EVENT_STAT_ADD(ep, pool_pending, 1);
+                    threadpool_queue_job(ep->pool, event_poll_worker_job, ctx);
+                    continue;
+                }
+
                 if (events[i].events & EPOLLIN) 
                 {
-                    char buffer[4096];
-
-                    for (;;) 
-                    {
-                        // ---
-                        ssize_t n = recv(ctx->fd, buf, sizeof(buf), 0);
-
-                        if (n > 0) 
-                        {
-                            if (ep->callbacks->on_receive) {
-                                ep->callbacks->on_receive(ctx->user_data, ctx->fd, buffer, n);
-                            }
-                        } 
-                        else if (n == 0) 
-                        {
-                             // EOF encountered
-                            printf("Client disconnected (fd: %d)\n", ctx->fd);
-                            
-                            if (ep->callbacks->on_disconnect) {
-                                ep->callbacks->on_disconnect(ctx->user_data, ctx->fd);
-                            }
-                            event_poll_remove_ctx(ctx->ep, ctx);
-                            return;
-                        } 
-                        else 
-                        {
-                            /*
-                                With EPOLLET When you get EPOLLIN, you must read until EAGAIN. 
-                                If you leave unread data You will not get another event.
-                                With EPOLLONESHOT after callback finishes handling the event 
-                                (reading everything until EAGAIN), epoll will not send any 
-                                more events, we need to rearm it manually its used mainly to
-                                make it thread safe and no two threads can handle same fd at 
-                                same time, ONESHO ensures only one thread handles the event.
-                             */
-                            if (errno == EAGAIN || errno == EWOULDBLOCK) 
-                            {
-                                // read end normally
-                                // drained -> ok to re-arm
-                                break;
-                            } 
-                            else 
-                            {
-                                // real error
-                                perror("read");
-                                if (ep->callbacks->on_error) {
-                                    ep->callbacks->on_error(ctx->user_data, ctx->fd, errno);
-                                }
-                                event_poll_remove_ctx(ctx->ep, ctx);
-                                return;
-                            }
-                        }
+                    if (!event_poll_handle_read(ep, ctx)) {
+                        continue;
                     }
                 }
                 // re arm again
-                event_poll_modify_ctx(ctx->ep, ctx, EVENT_READ | EVENT_ET | EVENT_ONESHOT);
+                event_poll_rearm(ep, ctx);
             }
         }
+
+        // expire idle / slow connections, only touches the ones that are due
+        timer_wheel_advance(&ep->timers, ep->now_ms);
+
+        // everything this wakeup produced is queued, the owner writes it out in one go
+        if (ep->callbacks->on_loop_end) {
+            EVENT_TIMED_CB(ep, EVENT_CB_LOOP_END, ep->callbacks->on_loop_end(user_data));
+        }
     }
     event_poll_destroy(ep);
 }
 
+/* -------------------- Stats -------------------- */
+
+const char *event_cb_names[EVENT_CB_COUNT] = { "accept", "receive", "writable", "disconnect", "error", "ready", "loop_end" };
+
+// every counter is loaded once, callable from any thread
+void event_poll_get_stats(event_poll_t *ep, event_poll_stats_t *out)
+{
+    const uint64_t *src = (const uint64_t *)&ep->stats;
+    uint64_t       *dst = (uint64_t *)out;
+
+    for (size_t i = 0; i < sizeof(event_poll_stats_t) / sizeof(uint64_t); i++) {
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+void event_poll_get_conn_stats(event_poll_t *ep, event_ctx_t *ctx, event_conn_stats_t *out)
+{
+    uint64_t now = timer_now_ms();
+
+    (void)ep;
+    memset(out, 0, sizeof(*out));
+    if (!ctx) return;
+
+    out->bytes_in     = __atomic_load_n(&ctx->bytes_in, __ATOMIC_RELAXED);
+    out->bytes_out    = __atomic_load_n(&ctx->bytes_out, __ATOMIC_RELAXED);
+    out->recv_calls   = __atomic_load_n(&ctx->recv_calls, __ATOMIC_RELAXED);
+    out->send_calls   = __atomic_load_n(&ctx->send_calls, __ATOMIC_RELAXED);
+    out->eagain_in    = __atomic_load_n(&ctx->eagain_in, __ATOMIC_RELAXED);
+    out->eagain_out   = __atomic_load_n(&ctx->eagain_out, __ATOMIC_RELAXED);
+    out->connected_ms = now - ctx->accepted_ms;
+    out->idle_ms      = now - __atomic_load_n(&ctx->last_active_ms, __ATOMIC_RELAXED);
+}
+
+/*
+    Owners that write to their sockets themselves (sendmsg, sendfile)
+    report each call here so the counters see it. n is what the call
+    returned, errno is only looked at when it is negative.
+ */
+void event_poll_note_send(event_poll_t *ep, event_ctx_t *ctx, ssize_t n)
+{
+    EVENT_STAT_ADD(ep, syscalls, 1);
+    if (ctx) ctx->send_calls++;
+
+    if (n > 0) {
+        EVENT_STAT_ADD(ep, bytes_out, n);
+        if (ctx) ctx->bytes_out += (uint64_t)n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        EVENT_STAT_ADD(ep, eagain, 1);
+        if (ctx) ctx->eagain_out++;
+    }
+}
+
 void event_poll_stop(event_poll_t *ep) 
 {
     if (ep) {
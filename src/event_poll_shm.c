@@ -0,0 +1,403 @@
+#include "socket.h"
+#include "event_poll.h"
+#include "shm_ring.h"
+
+#ifndef _WIN32
+
+#include "../external/include/stb_ds.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+
+/*
+    Shared memory transport
+
+    Local clients (CLI, editor plugins, the GUI) skip TCP: they connect
+    to a unix socket, get a pair of shm rings (shm_ring.h) and from then
+    on a request is a memcpy into the ring and, only if the loop is
+    asleep, one eventfd write.
+
+    To the owner of the poller such a client is just another connection,
+    on_accept / on_receive / on_writable / on_disconnect fire with the
+    unix socket as its handle. Only writing differs, there is no socket
+    buffer behind that handle, event_poll_shm_writev fills the ring.
+
+    One doorbell eventfd for the whole server, every client rings the
+    same one and the loop looks at all rings when it goes off. There
+    are a handful of local clients, not thousands, a scan is cheaper
+    than a watch per client. The unix socket of each client is watched
+    for its EOF only.
+ */
+
+#define EVENT_SHM_DRAIN_BYTES   (256u << 10)    // per client per wakeup, then the others get a turn
+
+typedef struct
+{
+    socket_handle   sock;               // the handle the callbacks get
+    event_ctx_t     *watch;             // EOF on sock
+    void            *map;
+    size_t          map_size;
+    int             bell;               // the client's doorbell
+    shm_ring_t      rx;                 // client -> server
+    shm_ring_t      tx;                 // server -> client
+    bool            want_write;         // tx was full, on_writable once it has room
+    bool            corrupt;            // the client broke its ring, waiting for the loop to drop it
+} event_shm_conn_t;
+
+typedef struct { socket_handle key; event_shm_conn_t *value; } event_shm_map_t;
+
+typedef struct event_shm_t
+{
+    char                path[108];
+    int                 listen_fd;
+    int                 bell;           // every client rings this one
+    pthread_mutex_t     lock;           // conns, pool workers look their connection up to write
+    event_shm_map_t     *conns;
+} event_shm_t;
+
+static event_shm_conn_t *shm_lookup(event_shm_t *shm, socket_handle fd)
+{
+    pthread_mutex_lock(&shm->lock);
+    event_shm_conn_t *conn = hmget(shm->conns, fd);
+    pthread_mutex_unlock(&shm->lock);
+    return conn;
+}
+
+static void shm_conn_free(event_poll_t *ep, event_shm_conn_t *conn)
+{
+    event_shm_t *shm = ep->shm;
+
+    if (conn->watch) {
+        event_poll_unwatch(ep, conn->watch);
+    }
+
+    pthread_mutex_lock(&shm->lock);
+    (void)hmdel(shm->conns, conn->sock);
+    pthread_mutex_unlock(&shm->lock);
+
+    munmap(conn->map, conn->map_size);
+    close(conn->bell);
+    close(conn->sock);
+    free(conn);
+}
+
+/*
+    The client moved the tail of our ring somewhere it can't be. Nothing
+    more gets written, and shutting the socket down makes its watch fire
+    with EOF, so the loop tears the connection down on its own thread
+    like any other disconnect. Any thread.
+ */
+static void shm_conn_corrupt(event_shm_conn_t *conn)
+{
+    if (__atomic_exchange_n(&conn->corrupt, true, __ATOMIC_ACQ_REL)) return;
+
+    fprintf(stderr, "event_poll_shm: corrupt ring from local client (fd: %d), dropping it\n", conn->sock);
+    shutdown(conn->sock, SHUT_RDWR);
+}
+
+/*
+    The client never writes to the socket, readable means it closed it
+    (or died, the kernel closes it for us then)
+ */
+static void shm_on_sock(void *user_data, socket_handle fd)
+{
+    event_poll_t *ep = (event_poll_t *)user_data;
+    char buf[64];
+
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR))) {
+        return;
+    }
+
+    event_shm_conn_t *conn = shm_lookup(ep->shm, fd);
+    if (!conn) return;
+
+    printf("Local client disconnected (fd: %d)\n", fd);
+
+    if (ep->callbacks && ep->callbacks->on_disconnect) {
+        EVENT_TIMED_CB(ep, EVENT_CB_DISCONNECT, ep->callbacks->on_disconnect(ep->user_data, fd));
+    }
+    EVENT_STAT_ADD(ep, closes, 1);
+    shm_conn_free(ep, conn);
+}
+
+static event_shm_conn_t *shm_conn_create(event_poll_t *ep, int sock)
+{
+    event_shm_conn_t *conn = calloc(1, sizeof(event_shm_conn_t));
+    if (!conn) {
+        fprintf(stderr, "event_poll_shm: Failed to allocate connection\n");
+        return NULL;
+    }
+    conn->sock = sock;
+    conn->bell = -1;
+    conn->map_size = SHM_RING_MAP_SIZE(SHM_RING_SIZE);
+
+    // fresh memfd pages are zero, both rings start empty
+    int memfd = memfd_create("todo_shm", MFD_CLOEXEC);
+    if (memfd < 0 || ftruncate(memfd, (off_t)conn->map_size) < 0) {
+        fprintf(stderr, "event_poll_shm: memfd failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    conn->map = mmap(NULL, conn->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (conn->map == MAP_FAILED) {
+        fprintf(stderr, "event_poll_shm: mmap failed: %s\n", strerror(errno));
+        conn->map = NULL;
+        goto fail;
+    }
+
+    conn->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (conn->bell < 0) {
+        fprintf(stderr, "event_poll_shm: eventfd failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    shm_ring_attach(&conn->rx, conn->map, SHM_RING_TO_SERVER, SHM_RING_SIZE, conn->bell);
+    shm_ring_attach(&conn->tx, conn->map, SHM_RING_TO_CLIENT, SHM_RING_SIZE, conn->bell);
+
+    // asleep before the client can write anything, its first request rings
+    (void)shm_ring_sleep_read(&conn->rx);
+
+    int fds[3] = { memfd, ep->shm->bell, conn->bell };
+    if (shm_send_fds(sock, SHM_RING_SIZE, fds, 3) < 0) {
+        goto fail;
+    }
+    close(memfd);
+    return conn;
+
+fail:
+    if (memfd >= 0) close(memfd);
+    if (conn->map) munmap(conn->map, conn->map_size);
+    if (conn->bell >= 0) close(conn->bell);
+    free(conn);
+    return NULL;
+}
+
+static void shm_on_accept(void *user_data, socket_handle fd)
+{
+    event_poll_t *ep  = (event_poll_t *)user_data;
+    event_shm_t  *shm = ep->shm;
+
+    for (;;)
+    {
+        int sock = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "event_poll_shm: accept failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+
+        event_shm_conn_t *conn = shm_conn_create(ep, sock);
+        if (!conn) {
+            close(sock);
+            continue;
+        }
+
+        pthread_mutex_lock(&shm->lock);
+        hmput(shm->conns, sock, conn);
+        pthread_mutex_unlock(&shm->lock);
+
+        conn->watch = event_poll_watch(ep, sock, shm_on_sock, ep);
+        if (!conn->watch) {
+            shm_conn_free(ep, conn);
+            continue;
+        }
+
+        printf("Local client connected (fd: %d)\n", sock);
+        EVENT_STAT_ADD(ep, accepts, 1);
+
+        if (ep->callbacks && ep->callbacks->on_accept) {
+            EVENT_TIMED_CB(ep, EVENT_CB_ACCEPT, ep->callbacks->on_accept(ep->user_data, sock));
+        }
+    }
+}
+
+/*
+    Someone rang, read every ring that has something. The data is handed
+    to on_receive straight out of the shared mapping, a frame split by
+    the end of the ring arrives in two calls just like over TCP.
+ */
+static void shm_on_bell(void *user_data, socket_handle fd)
+{
+    event_poll_t *ep  = (event_poll_t *)user_data;
+    event_shm_t  *shm = ep->shm;
+
+    uint64_t count;
+    (void)!read(fd, &count, sizeof(count));
+
+    // only the loop thread adds or removes, no lock needed to walk them
+    for (ptrdiff_t i = 0; i < hmlen(shm->conns); i++)
+    {
+        event_shm_conn_t *conn = shm->conns[i].value;
+        size_t drained = 0;
+
+        if (__atomic_load_n(&conn->corrupt, __ATOMIC_ACQUIRE)) continue;
+
+        for (;;)
+        {
+            const char *data;
+            size_t n = shm_ring_peek(&conn->rx, &data);
+
+            if (n == 0) {
+                if (shm_ring_sleep_read(&conn->rx)) break;
+                continue;
+            }
+
+            if (drained >= EVENT_SHM_DRAIN_BYTES) {
+                // come back after everyone else had a go
+                shm_ring_wake(shm->bell);
+                break;
+            }
+
+            if (ep->callbacks && ep->callbacks->on_receive) {
+                EVENT_TIMED_CB(ep, EVENT_CB_RECEIVE, ep->callbacks->on_receive(ep->user_data, conn->sock, data, n));
+            }
+            shm_ring_consume(&conn->rx, n);
+            drained += n;
+            EVENT_STAT_ADD(ep, bytes_in, n);
+        }
+
+        if (!__atomic_load_n(&conn->want_write, __ATOMIC_ACQUIRE)) continue;
+
+        ssize_t space = shm_ring_space(&conn->tx);
+        if (space < 0) {
+            shm_conn_corrupt(conn);
+        }
+        else if (space > 0)
+        {
+            __atomic_store_n(&conn->want_write, false, __ATOMIC_RELEASE);
+            if (ep->callbacks && ep->callbacks->on_writable) {
+                EVENT_TIMED_CB(ep, EVENT_CB_WRITABLE, ep->callbacks->on_writable(ep->user_data, conn->sock));
+            }
+        }
+    }
+}
+
+/*
+    Accept local clients on a unix socket at path, next to the TCP
+    listener. Call before event_poll_loop.
+ */
+int event_poll_listen_shm(event_poll_t *ep, const char *path)
+{
+    if (!ep || !path || ep->shm) return -1;
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "event_poll_listen_shm: path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    event_shm_t *shm = calloc(1, sizeof(event_shm_t));
+    if (!shm) {
+        fprintf(stderr, "event_poll_listen_shm: Failed to allocate event_shm_t\n");
+        return -1;
+    }
+    strcpy(shm->path, path);
+    shm->bell = -1;
+
+    shm->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (shm->listen_fd < 0) {
+        fprintf(stderr, "event_poll_listen_shm: socket failed: %s\n", strerror(errno));
+        free(shm);
+        return -1;
+    }
+
+    // left over from a previous run
+    unlink(path);
+
+    if (bind(shm->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(shm->listen_fd, BACKLOG) < 0) {
+        fprintf(stderr, "event_poll_listen_shm: Failed to listen on %s: %s\n", path, strerror(errno));
+        close(shm->listen_fd);
+        free(shm);
+        return -1;
+    }
+
+    shm->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pthread_mutex_init(&shm->lock, NULL);
+    ep->shm = shm;
+
+    if (shm->bell < 0 || !event_poll_watch(ep, shm->listen_fd, shm_on_accept, ep)
+                      || !event_poll_watch(ep, shm->bell, shm_on_bell, ep))
+    {
+        fprintf(stderr, "event_poll_listen_shm: Failed to watch %s\n", path);
+        event_shm_destroy(ep);
+        return -1;
+    }
+
+    printf("Local clients on %s\n", path);
+    return 0;
+}
+
+// after the loop stopped, the watches themselves go with ep->watched
+void event_shm_destroy(event_poll_t *ep)
+{
+    event_shm_t *shm = ep->shm;
+    if (!shm) return;
+
+    for (ptrdiff_t i = 0; i < hmlen(shm->conns); i++)
+    {
+        event_shm_conn_t *conn = shm->conns[i].value;
+        munmap(conn->map, conn->map_size);
+        close(conn->bell);
+        close(conn->sock);
+        free(conn);
+    }
+    hmfree(shm->conns);
+
+    close(shm->listen_fd);
+    unlink(shm->path);
+    if (shm->bell >= 0) close(shm->bell);
+    pthread_mutex_destroy(&shm->lock);
+    free(shm);
+    ep->shm = NULL;
+}
+
+bool event_poll_is_shm(event_poll_t *ep, socket_handle fd)
+{
+    return ep && ep->shm && shm_lookup(ep->shm, fd) != NULL;
+}
+
+/*
+    sendmsg for a local client: copies what fits into its ring and
+    returns that, -1 with EAGAIN when the ring is full (on_writable
+    follows once the client made room). Any thread, as long as the
+    caller serializes writes per connection like it would for a socket.
+ */
+ssize_t event_poll_shm_writev(event_poll_t *ep, socket_handle fd, const struct iovec *iov, int count)
+{
+    event_shm_conn_t *conn = ep->shm ? shm_lookup(ep->shm, fd) : NULL;
+    if (!conn) {
+        errno = EBADF;
+        return -1;
+    }
+
+    for (;;)
+    {
+        ssize_t n = __atomic_load_n(&conn->corrupt, __ATOMIC_ACQUIRE) ? -1 : shm_ring_writev(&conn->tx, iov, count);
+        if (n < 0) {
+            // like a socket whose peer went away, the disconnect follows from the loop
+            shm_conn_corrupt(conn);
+            errno = EPIPE;
+            return -1;
+        }
+        if (n > 0) {
+            EVENT_STAT_ADD(ep, bytes_out, n);
+            return (ssize_t)n;
+        }
+
+        // flag first, the client's ring of the bell must find it set
+        __atomic_store_n(&conn->want_write, true, __ATOMIC_RELEASE);
+        if (shm_ring_sleep_write(&conn->tx)) {
+            EVENT_STAT_ADD(ep, eagain, 1);
+            errno = EAGAIN;
+            return -1;
+        }
+        __atomic_store_n(&conn->want_write, false, __ATOMIC_RELEASE);
+    }
+}
+
+#endif
@@ -0,0 +1,948 @@
+#include "socket.h"
+#include "event_poll.h"
+
+#ifndef _WIN32
+
+#include "../external/include/stb_ds.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+
+/*
+    io_uring backend
+
+    Same callbacks and same timer wheel as the epoll loop, but instead of
+    "tell me when the fd is ready, then I do the syscall" the kernel does
+    the IO itself and posts completions:
+
+    - ONE multishot accept on the listener, every new connection is a CQE
+    - ONE multishot recv per connection, data lands straight in a
+      provided buffer ring so no memory is pinned per idle connection
+    - sends are queued SQEs, partial sends get resubmitted. One fd has
+      at most one send in flight, the rest wait behind it: two SENDs to
+      the same socket can complete in any order and a resubmitted tail
+      would land after the next frame. Whatever piles up meanwhile is
+      appended to the waiting send, up to URING_SEND_BATCH, and goes
+      out as one
+
+    Everything queued during an iteration is published with a single
+    store to the SQ tail and handed to the kernel by the same
+    io_uring_enter that waits for the next completions, so a busy loop is
+    one syscall per iteration instead of one per event + one per recv.
+
+    No liburing on purpose, the three syscalls and the ring layout are all
+    we need and it keeps the build free of extra deps.
+ */
+
+#define URING_ENTRIES       256
+#define URING_BUF_COUNT     256         // must be a power of two
+#define URING_BUF_SIZE      EV_BUF_SIZE
+#define URING_BGID          0
+#define URING_SEND_BATCH    (16 * 1024) // room a waiting send is allocated with for the ones after it
+
+/*
+    user_data of every SQE is a pointer with the op in the low bits,
+    all of them come from malloc so they are at least 8 aligned
+ */
+#define URING_OP_ACCEPT     1u
+#define URING_OP_RECV       2u
+#define URING_OP_SEND       3u
+#define URING_OP_CANCEL     4u
+#define URING_OP_POLL       5u      // event_poll_watch
+#define URING_OP_MASK       7u
+
+typedef struct uring_send_t
+{
+    struct uring_send_t *prev;
+    struct uring_send_t *next;
+    struct uring_send_t *after;         // next send to the same fd, submitted once this one is done
+    socket_handle       fd;
+    void                *user_data;     // copied, the ctx may be gone when the CQE arrives
+    bool                waiting;        // behind another send, not submitted yet, more can be appended
+    bool                orphaned;       // its connection is gone and the fd number may be someone else's
+    size_t              cap;
+    size_t              len;
+    size_t              off;
+    char                data[];
+} uring_send_t;
+
+typedef struct event_uring_t
+{
+    int                     ring_fd;
+
+    // submission queue
+    void                    *sq_ring;
+    size_t                  sq_ring_size;
+    unsigned                *sq_head;
+    unsigned                *sq_tail;
+    unsigned                sq_mask;
+    unsigned                sq_entries;
+    unsigned                sq_local_tail;      // filled but not published yet
+    struct io_uring_sqe     *sqes;
+    size_t                  sqes_size;
+
+    // completion queue
+    void                    *cq_ring;
+    size_t                  cq_ring_size;
+    unsigned                *cq_head;
+    unsigned                *cq_tail;
+    unsigned                cq_mask;
+    struct io_uring_cqe     *cqes;
+
+    // provided receive buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t                  buf_ring_size;
+    char                    *buf_base;
+    uint16_t                buf_tail;
+    uint16_t                buf_pending;        // recycled but not published yet
+
+    event_ctx_t             **closing;          // waiting for their recv to complete
+    event_ctx_t             **resumed;          // reading back on, held bytes go out at the end of the iteration
+    uring_send_t            sends;              // sentinel of in flight sends
+    struct { socket_handle key; uring_send_t *value; } *send_tails;     // fd -> its last queued send
+} event_uring_t;
+
+static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                                     unsigned flags, const void *arg, size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+    multishot recv + provided buffer rings are 6.0, the syscall
+    existing is not enough so look at the version first
+ */
+bool event_uring_supported(void)
+{
+    struct utsname uts;
+    if (uname(&uts) < 0) return false;
+
+    int major = 0, minor = 0;
+    if (sscanf(uts.release, "%d.%d", &major, &minor) != 2) return false;
+
+    return major > 6 || (major == 6 && minor >= 0);
+}
+
+/* -------------------- ring plumbing -------------------- */
+
+static unsigned uring_sq_pending(event_uring_t *ur)
+{
+    return ur->sq_local_tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static void uring_publish(event_uring_t *ur)
+{
+    __atomic_store_n(ur->sq_tail, ur->sq_local_tail, __ATOMIC_RELEASE);
+
+    if (ur->buf_pending) {
+        ur->buf_tail += ur->buf_pending;
+        ur->buf_pending = 0;
+        __atomic_store_n(&ur->buf_ring->tail, ur->buf_tail, __ATOMIC_RELEASE);
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(event_uring_t *ur)
+{
+    // queue full, flush what we have without waiting
+    if (uring_sq_pending(ur) >= ur->sq_entries)
+    {
+        uring_publish(ur);
+        if (sys_io_uring_enter(ur->ring_fd, uring_sq_pending(ur), 0, 0, NULL, 0) < 0) {
+            fprintf(stderr, "io_uring_enter submit failed: %s\n", strerror(errno));
+            return NULL;
+        }
+        if (uring_sq_pending(ur) >= ur->sq_entries) {
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ur->sqes[ur->sq_local_tail & ur->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ur->sq_local_tail++;
+    return sqe;
+}
+
+static void uring_recycle_buffer(event_uring_t *ur, uint16_t bid)
+{
+    unsigned mask = URING_BUF_COUNT - 1;
+    struct io_uring_buf *buf = &ur->buf_ring->bufs[(ur->buf_tail + ur->buf_pending) & mask];
+
+    buf->addr = (uint64_t)(uintptr_t)(ur->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len  = URING_BUF_SIZE;
+    buf->bid  = bid;
+    ur->buf_pending++;
+}
+
+static int uring_arm_accept(event_poll_t *ep)
+{
+    event_uring_t *ur = ep->uring;
+    struct io_uring_sqe *sqe = uring_get_sqe(ur);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = socket_get_handle(&ep->listener);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uint64_t)(uintptr_t)ep->listener_ctx | URING_OP_ACCEPT;
+    return 0;
+}
+
+static int uring_arm_recv(event_poll_t *ep, event_ctx_t *ctx)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ep->uring);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ctx->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = (uint64_t)(uintptr_t)ctx | URING_OP_RECV;
+
+    ctx->recv_armed = true;
+    return 0;
+}
+
+static int uring_arm_poll(event_poll_t *ep, event_ctx_t *ctx)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ep->uring);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = ctx->fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = (uint64_t)(uintptr_t)ctx | URING_OP_POLL;
+    return 0;
+}
+
+static int uring_queue_send(event_uring_t *ur, uring_send_t *req)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ur);
+    if (!sqe) return -1;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = req->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(req->data + req->off);
+    sqe->len = (uint32_t)(req->len - req->off);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)req | URING_OP_SEND;
+    return 0;
+}
+
+static void uring_send_unlink(uring_send_t *req)
+{
+    req->prev->next = req->next;
+    req->next->prev = req->prev;
+}
+
+/*
+    The connection on fd is going away and the next accept can hand out
+    the same number. Sends still waiting are freed, the one in flight
+    can't be recalled but is orphaned: its completion neither resubmits
+    a short send nor starts anything after it, nor touches send_tails.
+ */
+static void uring_drop_sends(event_uring_t *ur, socket_handle fd)
+{
+    if (hmgeti(ur->send_tails, fd) < 0) return;
+    (void)hmdel(ur->send_tails, fd);
+
+    for (uring_send_t *req = ur->sends.next; req != &ur->sends;)
+    {
+        uring_send_t *next = req->next;
+        if (req->fd == fd && !req->orphaned)
+        {
+            if (req->waiting) {
+                uring_send_unlink(req);
+                free(req);
+            } else {
+                req->orphaned = true;
+                req->after = NULL;
+            }
+        }
+        req = next;
+    }
+}
+
+/* -------------------- setup / teardown -------------------- */
+
+static void uring_unmap(event_uring_t *ur)
+{
+    if (ur->buf_ring) munmap(ur->buf_ring, ur->buf_ring_size);
+    if (ur->sqes) munmap(ur->sqes, ur->sqes_size);
+    if (ur->cq_ring && ur->cq_ring != ur->sq_ring) munmap(ur->cq_ring, ur->cq_ring_size);
+    if (ur->sq_ring) munmap(ur->sq_ring, ur->sq_ring_size);
+    if (ur->ring_fd >= 0) close(ur->ring_fd);
+    free(ur->buf_base);
+}
+
+int event_uring_init(event_poll_t *ep)
+{
+    event_uring_t *ur = calloc(1, sizeof(event_uring_t));
+    if (!ur) {
+        fprintf(stderr, "event_uring_init: Failed to allocate event_uring_t\n");
+        return -1;
+    }
+    ur->sends.next = ur->sends.prev = &ur->sends;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;     // multishot ops produce many CQEs per SQE
+
+    ur->ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if (ur->ring_fd < 0) {
+        fprintf(stderr, "io_uring_setup failed: %s\n", strerror(errno));
+        free(ur);
+        return -1;
+    }
+
+    // EXT_ARG lets io_uring_enter take a timeout, without it we cant drive the timer wheel
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        fprintf(stderr, "event_uring_init: kernel lacks EXT_ARG / NODROP\n");
+        uring_unmap(ur);
+        free(ur);
+        return -1;
+    }
+
+    ur->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ur->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ur->cq_ring_size > ur->sq_ring_size) ur->sq_ring_size = ur->cq_ring_size;
+        ur->cq_ring_size = ur->sq_ring_size;
+    }
+
+    ur->sq_ring = mmap(NULL, ur->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+    if (ur->sq_ring == MAP_FAILED) {
+        ur->sq_ring = NULL;
+        goto fail_errno;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ur->cq_ring = ur->sq_ring;
+    } else {
+        ur->cq_ring = mmap(NULL, ur->cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_CQ_RING);
+        if (ur->cq_ring == MAP_FAILED) {
+            ur->cq_ring = NULL;
+            goto fail_errno;
+        }
+    }
+
+    ur->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = mmap(NULL, ur->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQES);
+    if (ur->sqes == MAP_FAILED) {
+        ur->sqes = NULL;
+        goto fail_errno;
+    }
+
+    char *sq = (char *)ur->sq_ring;
+    ur->sq_head    = (unsigned *)(sq + params.sq_off.head);
+    ur->sq_tail    = (unsigned *)(sq + params.sq_off.tail);
+    ur->sq_mask    = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ur->sq_entries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    ur->sq_local_tail = *ur->sq_tail;
+
+    // sqe index == array slot, set once and never touched again
+    unsigned *sq_array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < ur->sq_entries; i++) {
+        sq_array[i] = i;
+    }
+
+    char *cq = (char *)ur->cq_ring;
+    ur->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ur->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ur->cq_mask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ur->cqes    = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    /*
+        Provided buffer ring, the kernel picks a buffer only when data is
+        actually there, so 10k idle connections cost nothing and the
+        buffer goes back to the ring right after on_receive returns
+     */
+    ur->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ur->buf_ring = mmap(NULL, ur->buf_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ur->buf_ring == MAP_FAILED) {
+        ur->buf_ring = NULL;
+        goto fail_errno;
+    }
+
+    ur->buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!ur->buf_base) {
+        fprintf(stderr, "event_uring_init: Failed to allocate receive buffers\n");
+        goto fail;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ur->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BGID;
+
+    if (sys_io_uring_register(ur->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        goto fail_errno;
+    }
+
+    for (uint16_t bid = 0; bid < URING_BUF_COUNT; bid++) {
+        uring_recycle_buffer(ur, bid);
+    }
+
+    ep->uring = ur;
+
+    if (uring_arm_accept(ep) < 0) {
+        ep->uring = NULL;
+        goto fail;
+    }
+
+    uring_publish(ur);
+    return 0;
+
+fail_errno:
+    fprintf(stderr, "event_uring_init failed: %s\n", strerror(errno));
+fail:
+    uring_unmap(ur);
+    free(ur);
+    return -1;
+}
+
+static void uring_finalize_ctx(event_uring_t *ur, event_ctx_t *ctx)
+{
+    for (ptrdiff_t i = 0; i < arrlen(ur->closing); i++) {
+        if (ur->closing[i] == ctx) {
+            arrdelswap(ur->closing, i);
+            break;
+        }
+    }
+    uring_drop_sends(ur, ctx->fd);
+    close(ctx->fd);
+    arrfree(ctx->held);
+    free(ctx);
+}
+
+/*
+    Live connections are closed by event_poll_destroy, this only cleans up
+    what the kernel still had references to. Closing the ring fd cancels
+    whatever is in flight so nothing touches the memory after this.
+ */
+void event_uring_destroy(event_poll_t *ep)
+{
+    event_uring_t *ur = ep->uring;
+    if (!ur) return;
+
+    uring_unmap(ur);
+
+    for (ptrdiff_t i = 0; i < arrlen(ur->closing); i++) {
+        close(ur->closing[i]->fd);
+        free(ur->closing[i]);
+    }
+    arrfree(ur->closing);
+
+    while (ur->sends.next != &ur->sends) {
+        uring_send_t *req = ur->sends.next;
+        uring_send_unlink(req);
+        free(req);
+    }
+    hmfree(ur->send_tails);
+    arrfree(ur->resumed);
+
+    free(ur);
+    ep->uring = NULL;
+}
+
+/* -------------------- operations -------------------- */
+
+/*
+    The recv may still be in flight, so the ctx cant be freed here.
+    Stop tracking it right away (no more callbacks, fd no longer
+    findable), cancel the recv and free it once its last CQE arrives.
+ */
+int event_uring_remove_ctx(event_poll_t *ep, event_ctx_t *ctx)
+{
+    event_uring_t *ur = ep->uring;
+
+    if (ctx->closing) return 0;
+    ctx->closing = true;
+
+    event_poll_release_ctx(ep, ctx);
+    uring_drop_sends(ur, ctx->fd);
+
+    if (!ctx->recv_armed && !ctx->delivering) {
+        close(ctx->fd);
+        arrfree(ctx->held);
+        free(ctx);
+        return 0;
+    }
+
+    arrput(ur->closing, ctx);
+
+    // uring_deliver_held finalizes it once on_receive returned
+    if (!ctx->recv_armed) {
+        return 0;
+    }
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ur);
+    if (!sqe) {
+        // no room to cancel, shutting the socket down ends the recv just as well
+        shutdown(ctx->fd, SHUT_RDWR);
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)ctx | URING_OP_RECV;
+    sqe->user_data = URING_OP_CANCEL;
+    return 0;
+}
+
+/*
+    Multishot poll, one CQE every time the fd turns readable. The ctx
+    is only freed by event_poll_destroy after the ring is gone.
+ */
+int event_uring_watch(event_poll_t *ep, event_ctx_t *ctx)
+{
+    if (uring_arm_poll(ep, ctx) < 0) {
+        fprintf(stderr, "event_uring_watch: submission queue full\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    The poll may still post a CQE for ctx, it is freed once the kernel
+    says the poll is gone. If the remove can't even be queued the ctx
+    goes back to ep->watched, muted, and event_poll_destroy frees it.
+ */
+int event_uring_unwatch(event_poll_t *ep, event_ctx_t *ctx)
+{
+    if (ctx->closing) return 0;
+    ctx->closing = true;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ep->uring);
+    if (!sqe) {
+        arrput(ep->watched, ctx);
+        return 0;
+    }
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->addr = (uint64_t)(uintptr_t)ctx | URING_OP_POLL;
+    sqe->user_data = URING_OP_CANCEL;
+    return 0;
+}
+
+static void uring_deliver(event_poll_t *ep, event_ctx_t *ctx, const char *data, size_t len)
+{
+    if (ep->callbacks->on_receive) {
+        EVENT_TIMED_CB(ep, EVENT_CB_RECEIVE, ep->callbacks->on_receive(ctx->user_data, ctx->fd, data, len));
+    }
+
+    // over budget, stop the multishot recv
+    if (!ctx->closing && !event_poll_charge_read(ep, ctx, len)) {
+        event_poll_update_reading(ep, ctx);
+    }
+}
+
+// a resumed ctx, from the loop: what was held first (the budget may turn reading off again half way), then the recv
+static void uring_deliver_held(event_poll_t *ep, event_ctx_t *ctx)
+{
+    size_t done = 0;
+    while (done < arrlenu(ctx->held) && !ctx->closing && !ctx->read_throttled && !event_ctx_read_paused(ctx))
+    {
+        size_t len = arrlenu(ctx->held) - done;
+        if (len > URING_BUF_SIZE) len = URING_BUF_SIZE;
+
+        uring_deliver(ep, ctx, ctx->held + done, len);
+        done += len;
+    }
+    ctx->delivering = false;
+
+    if (ctx->closing) {
+        if (!ctx->recv_armed) uring_finalize_ctx(ep->uring, ctx);
+        return;
+    }
+
+    if (done > 0) arrdeln(ctx->held, 0, done);
+    if (ctx->read_throttled || event_ctx_read_paused(ctx)) return;
+
+    if (!ctx->recv_armed) uring_arm_recv(ep, ctx);
+}
+
+/*
+    Reading on or off for a rate limited / paused connection. Off
+    cancels the multishot recv, its last CQE leaves it unarmed. The
+    kernel may have filled buffers before the cancel got there, those
+    bytes are held on the ctx. On queues the ctx for uring_deliver_held
+    when there are any, the owner may well be calling from inside its
+    own callback with its locks taken, else arms the recv again unless
+    one is still there (maybe being cancelled, its last CQE re arms it
+    then).
+ */
+int event_uring_set_reading(event_poll_t *ep, event_ctx_t *ctx, bool on)
+{
+    if (ctx->closing) return 0;
+
+    if (on)
+    {
+        // already queued, or being handed out and the loop there looks at the flags again
+        if (ctx->delivering) return 0;
+
+        if (arrlenu(ctx->held) > 0) {
+            ctx->delivering = true;
+            arrput(ep->uring->resumed, ctx);
+            return 0;
+        }
+        return ctx->recv_armed ? 0 : uring_arm_recv(ep, ctx);
+    }
+
+    if (!ctx->recv_armed) return 0;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(ep->uring);
+    if (!sqe) return -1;
+
+    // a second cancel for the same recv just gets ENOENT
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = (uint64_t)(uintptr_t)ctx | URING_OP_RECV;
+    sqe->user_data = URING_OP_CANCEL;
+    return 0;
+}
+
+/*
+    Copies the data, the caller buffer is free to go as soon as this
+    returns. Returns the number of bytes queued, on_send fires once all
+    of it is on the wire. Sends merged while waiting behind another one
+    are reported together.
+ */
+int event_uring_send(event_poll_t *ep, socket_handle fd, const char *data, size_t len)
+{
+    event_uring_t *ur = ep->uring;
+
+    uring_send_t *tail = hmget(ur->send_tails, fd);
+
+    // not submitted yet, ride along instead of queueing one more behind it
+    if (tail && tail->waiting && tail->cap - tail->len >= len) {
+        memcpy(tail->data + tail->len, data, len);
+        tail->len += len;
+        return (int)len;
+    }
+
+    size_t cap = tail && len < URING_SEND_BATCH ? URING_SEND_BATCH : len;
+
+    uring_send_t *req = malloc(sizeof(uring_send_t) + cap);
+    if (!req) {
+        fprintf(stderr, "event_uring_send: Failed to allocate send request\n");
+        return -1;
+    }
+
+    req->fd = fd;
+    req->user_data = ep->user_data;
+    req->waiting = tail != NULL;
+    req->orphaned = false;
+    req->cap = cap;
+    req->len = len;
+    req->off = 0;
+    req->after = NULL;
+    memcpy(req->data, data, len);
+
+    if (tail) {
+        tail->after = req;
+    } else if (uring_queue_send(ur, req) < 0) {
+        free(req);
+        return -1;
+    }
+    hmput(ur->send_tails, fd, req);
+
+    req->next = &ur->sends;
+    req->prev = ur->sends.prev;
+    ur->sends.prev->next = req;
+    ur->sends.prev = req;
+
+    return (int)len;
+}
+
+/* -------------------- completions -------------------- */
+
+static void uring_handle_accept(event_poll_t *ep, struct io_uring_cqe *cqe)
+{
+    if (cqe->res >= 0)
+    {
+        socket_handle new_fd = cqe->res;
+
+        event_ctx_t *ctx = event_poll_track_connection(ep, new_fd, ep->user_data);
+        if (!ctx) {
+            close(new_fd);
+        } else if (uring_arm_recv(ep, ctx) < 0) {
+            event_poll_release_ctx(ep, ctx);
+            close(new_fd);
+            free(ctx);
+        } else if (ep->callbacks->on_accept) {
+            EVENT_TIMED_CB(ep, EVENT_CB_ACCEPT, ep->callbacks->on_accept(ep->user_data, new_fd));
+        }
+    }
+    else if (cqe->res != -ECANCELED)
+    {
+        fprintf(stderr, "io_uring accept failed: %s\n", strerror(-cqe->res));
+    }
+
+    // multishot got terminated (error, overflow ...), put it back
+    if (!(cqe->flags & IORING_CQE_F_MORE) && ep->running) {
+        uring_arm_accept(ep);
+    }
+}
+
+static void uring_handle_recv(event_poll_t *ep, event_ctx_t *ctx, struct io_uring_cqe *cqe)
+{
+    event_uring_t *ur = ep->uring;
+
+    /*
+        recv_armed stays set while the callbacks run even if this is the
+        last CQE, so a remove_ctx from inside on_receive defers the free
+        to the end of this function instead of pulling ctx from under us
+     */
+    if (cqe->res > 0)
+    {
+        uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+        const char *buffer = ur->buf_base + (size_t)bid * URING_BUF_SIZE;
+
+        if (!ctx->closing)
+        {
+            ctx->bytes_in += (uint64_t)cqe->res;
+            ctx->recv_calls++;
+            ctx->last_active_ms = ep->now_ms;
+            EVENT_STAT_ADD(ep, bytes_in, cqe->res);
+        }
+
+        if (ctx->closing) {
+            // nobody to hand it to
+        } else if (ctx->read_throttled || event_ctx_read_paused(ctx) || arrlenu(ctx->held) > 0) {
+            // received after reading was turned off, kept until it is back on (and behind what is kept already)
+            memcpy(arraddnptr(ctx->held, cqe->res), buffer, (size_t)cqe->res);
+        } else {
+            uring_deliver(ep, ctx, buffer, (size_t)cqe->res);
+        }
+        uring_recycle_buffer(ur, bid);
+    }
+    else if (cqe->res == 0)
+    {
+        if (!ctx->closing)
+        {
+            printf("Client disconnected (fd: %d)\n", ctx->fd);
+
+            if (ep->callbacks->on_disconnect) {
+                EVENT_TIMED_CB(ep, EVENT_CB_DISCONNECT, ep->callbacks->on_disconnect(ctx->user_data, ctx->fd));
+            }
+            event_poll_remove_ctx(ep, ctx);
+        }
+    }
+    else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+    {
+        if (!ctx->closing)
+        {
+            if (ep->callbacks->on_error) {
+                EVENT_TIMED_CB(ep, EVENT_CB_ERROR, ep->callbacks->on_error(ctx->user_data, ctx->fd, -cqe->res));
+            }
+            event_poll_remove_ctx(ep, ctx);
+        }
+    }
+
+    // multishot ended, either the kernel is done with ctx or it needs re arming
+    // (ENOBUFS: the buffers come back at the end of this batch)
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        ctx->recv_armed = false;
+
+        // a ctx queued in resumed is finalized / re armed by uring_deliver_held
+        if (ctx->delivering) {
+            return;
+        }
+        if (ctx->closing) {
+            uring_finalize_ctx(ur, ctx);
+        } else if (!ctx->read_throttled && !event_ctx_read_paused(ctx)) {
+            uring_arm_recv(ep, ctx);
+        }
+    }
+}
+
+static void uring_handle_send(event_poll_t *ep, uring_send_t *req, struct io_uring_cqe *cqe)
+{
+    event_uring_t *ur = ep->uring;
+
+    // whatever is left of it must not go to whoever has the fd number now
+    if (req->orphaned) {
+        uring_send_unlink(req);
+        free(req);
+        return;
+    }
+
+    if (cqe->res > 0)
+    {
+        req->off += (size_t)cqe->res;
+        EVENT_STAT_ADD(ep, bytes_out, cqe->res);
+
+        // short send, the rest goes out as a new SQE
+        if (req->off < req->len && uring_queue_send(ur, req) == 0) {
+            return;
+        }
+
+        if (req->off == req->len && ep->callbacks->on_send) {
+            ep->callbacks->on_send(req->user_data, req->fd, req->len);
+        }
+    }
+    else if (cqe->res != -ECANCELED)
+    {
+        fprintf(stderr, "io_uring send failed (fd: %d): %s\n", req->fd, strerror(-cqe->res));
+    }
+
+    // the next one in line for this fd, a dead socket fails it quickly too
+    if (req->after) {
+        req->after->waiting = false;
+    }
+    if (req->after && uring_queue_send(ur, req->after) < 0)
+    {
+        // cant keep the order without it, drop the rest for this fd
+        fprintf(stderr, "io_uring send dropped (fd: %d): submission queue full\n", req->fd);
+        while (req->after) {
+            uring_send_t *next = req->after;
+            req->after = next->after;
+            uring_send_unlink(next);
+            free(next);
+        }
+    }
+    if (!req->after) {
+        (void)hmdel(ur->send_tails, req->fd);
+    }
+
+    uring_send_unlink(req);
+    free(req);
+}
+
+static void uring_free_watch(event_poll_t *ep, event_ctx_t *ctx)
+{
+    for (ptrdiff_t i = 0; i < arrlen(ep->watched); i++) {
+        if (ep->watched[i] == ctx) {
+            arrdelswap(ep->watched, i);
+            break;
+        }
+    }
+    free(ctx);
+}
+
+static void uring_handle_poll(event_poll_t *ep, event_ctx_t *ctx, struct io_uring_cqe *cqe)
+{
+    bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+
+    if (cqe->res > 0 && !ctx->closing) {
+        EVENT_TIMED_CB(ep, EVENT_CB_READY, ctx->on_ready(ctx->user_data, ctx->fd));
+    }
+
+    // unwatched (maybe just now by on_ready), the last CQE of the poll is the one without F_MORE
+    if (ctx->closing) {
+        if (!more) uring_free_watch(ep, ctx);
+        return;
+    }
+
+    // the kernel dropped the multishot (overflow, error), ask again
+    if (!more && ep->running) {
+        uring_arm_poll(ep, ctx);
+    }
+}
+
+void event_uring_loop(event_poll_t *ep, void *user_data)
+{
+    (void)user_data;     // already in ep->user_data
+    event_uring_t *ur = ep->uring;
+
+    while (ep->running)
+    {
+        ep->now_ms = timer_now_ms();
+        int timeout = timer_wheel_next_timeout(&ep->timers, ep->now_ms, EV_MAX_WAIT_MS);
+
+        // resumed in on_loop_end, don't sleep on their held bytes
+        if (arrlenu(ur->resumed) > 0) timeout = 0;
+
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+
+        // one syscall, submit everything queued last iteration and wait
+        uring_publish(ur);
+        int ret = sys_io_uring_enter(ur->ring_fd, uring_sq_pending(ur), 1,
+                                     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                     &arg, sizeof(arg));
+
+        ep->now_ms = timer_now_ms();
+        EVENT_STAT_ADD(ep, syscalls, 1);
+        EVENT_STAT_ADD(ep, wakeups, 1);
+
+        if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+        {
+            fprintf(stderr, "io_uring_enter error: %s\n", strerror(errno));
+            break;
+        }
+
+        unsigned head = *ur->cq_head;
+        unsigned tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail)
+        {
+            // copy it out, handlers may queue more work but the slot goes back to the kernel now
+            struct io_uring_cqe cqe = ur->cqes[head & ur->cq_mask];
+            head++;
+            __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+            EVENT_STAT_ADD(ep, events, 1);
+
+            uintptr_t tag = (uintptr_t)(cqe.user_data & URING_OP_MASK);
+            void     *ptr = (void *)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_OP_MASK);
+
+            switch (tag)
+            {
+                case URING_OP_ACCEPT: uring_handle_accept(ep, &cqe); break;
+                case URING_OP_RECV:   uring_handle_recv(ep, (event_ctx_t *)ptr, &cqe); break;
+                case URING_OP_SEND:   uring_handle_send(ep, (uring_send_t *)ptr, &cqe); break;
+                case URING_OP_POLL:   uring_handle_poll(ep, (event_ctx_t *)ptr, &cqe); break;
+                default: break;     // cancel results, nothing to do
+            }
+
+            if (head == tail) {
+                tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+            }
+        }
+
+        // expire idle / slow connections, only touches the ones that are due
+        timer_wheel_advance(&ep->timers, ep->now_ms);
+
+        // delivering can resume others, the array may grow while it is walked
+        for (size_t i = 0; i < arrlenu(ur->resumed); i++) {
+            uring_deliver_held(ep, ur->resumed[i]);
+        }
+        arrsetlen(ur->resumed, 0);
+
+        // sends queued here go out with the next io_uring_enter
+        if (ep->callbacks->on_loop_end) {
+            EVENT_TIMED_CB(ep, EVENT_CB_LOOP_END, ep->callbacks->on_loop_end(ep->user_data));
+        }
+    }
+}
+
+#endif
@@ -1,5 +1,9 @@
 #include "font.h"
 
+// before stb_truetype, it only brings its own packer when there is none
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "stb_rect_pack.h"
+
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
 
@@ -31,6 +35,8 @@ font_tt* init_font_tt(u8 *font_buffer, f32 font_size)
     font->ascent    = (int)(font->ascent * font->scale);
     font->descent   = (int)(font->descent * font->scale);
     font->line_gap  = (int)(font->line_gap * font->scale);
+
+    font->line_height = font->ascent - font->descent + font->line_gap;
     
     return font;
 }
@@ -39,11 +45,26 @@ void free_font(font_tt *font)
 {
     if (!font) return;
     
-    for (int i = 0; i < GLYPH_CACHE_SIZE; i++) {
-        if (font->cache_valid[i] && font->glyph_cache[i].bitmap) {
-            free(font->glyph_cache[i].bitmap);
-        }
+    for (i32 i = 0; i < arrlen(font->atlas.pages); i++) {
+        free(font->atlas.pages[i]->pixels);
+        free(font->atlas.pages[i]);
+    }
+    arrfree(font->atlas.pages);
+    arrfree(font->atlas.glyphs);
+    free(font->atlas.table);
+
+    for (i32 i = 0; i < hmlen(font->measures); i++) {
+        free(font->measures[i].text);
+        free(font->measures[i].x);
     }
+    hmfree(font->measures);
+
+    for (i32 i = 0; i < hmlen(font->wraps); i++) {
+        free(font->wraps[i].text);
+        arrfree(font->wraps[i].tokens);
+        arrfree(font->wraps[i].out);
+    }
+    hmfree(font->wraps);
     
     if (font->font_buffer) {
         free(font->font_buffer);
@@ -52,57 +73,235 @@ void free_font(font_tt *font)
     free(font);
 }
 
-glyph_info_t* get_glyph(font_tt *font, u32 codepoint)
+// one pixel of space between glyphs, so sampling never bleeds into the next
+#define GLYPH_PADDING 1
+
+// no room in the atlas when it was looked up, tried again in a later frame
+#define GLYPH_PAGE_PENDING -2
+
+static u64 glyph_frame = 1;
+
+void glyph_cache_next_frame(void)
 {
-    int cache_index = codepoint % GLYPH_CACHE_SIZE;
-    // check if it exists in the cache first
-    if (font->cache_valid[cache_index]) {
-        return &font->glyph_cache[cache_index];
+    glyph_frame++;
+}
+
+static inline u32 glyph_slot(glyph_atlas_t const *atlas, u32 codepoint)
+{
+    return (codepoint * 2654435761u) >> (32 - atlas->table_bits);
+}
+
+static glyph_info_t *glyph_atlas_find(glyph_atlas_t const *atlas, u32 codepoint)
+{
+    if (!atlas->table) return NULL;
+
+    u32 mask = (1u << atlas->table_bits) - 1;
+    for (u32 i = glyph_slot(atlas, codepoint);; i = (i + 1) & mask)
+    {
+        u32 entry = atlas->table[i];
+        if (entry == 0) {
+            return NULL;
+        }
+        if (atlas->glyphs[entry - 1].codepoint == codepoint) {
+            return &atlas->glyphs[entry - 1];
+        }
     }
-    
-    glyph_info_t *glyph = &font->glyph_cache[cache_index];
-    
-    if (glyph->bitmap) {
-        free(glyph->bitmap);
-        glyph->bitmap = NULL;
+}
+
+// the table is kept at most half full, rebuilt when it grows or glyphs are dropped
+static void glyph_atlas_rehash(glyph_atlas_t *atlas, u32 table_bits)
+{
+    free(atlas->table);
+    atlas->table_bits = table_bits;
+    atlas->table      = CHECK_PTR(calloc((size_t)1 << table_bits, sizeof(u32)));
+
+    u32 mask = (1u << table_bits) - 1;
+    for (u32 g = 0; g < (u32)arrlen(atlas->glyphs); g++)
+    {
+        u32 i = glyph_slot(atlas, atlas->glyphs[g].codepoint);
+        while (atlas->table[i]) {
+            i = (i + 1) & mask;
+        }
+        atlas->table[i] = g + 1;
     }
+}
 
-    int glyph_index = stbtt_FindGlyphIndex(&font->info, codepoint);
-    // Returns 0 if the character codepoint is not defined in the font.
-    if (glyph_index == 0) {
-        codepoint = '?';
-        glyph_index = stbtt_FindGlyphIndex(&font->info, codepoint);
+static glyph_page_t *glyph_page_new(void)
+{
+    glyph_page_t *page = CHECK_PTR(malloc(sizeof(glyph_page_t)));
+    page->pixels = CHECK_PTR(calloc(GLYPH_ATLAS_SIZE * GLYPH_ATLAS_SIZE, 1));
+    stbrp_init_target(&page->packer, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, page->nodes, GLYPH_ATLAS_SIZE);
+    page->last_used = glyph_frame;
+    return page;
+}
+
+// forgets every glyph on the page and starts packing it from scratch
+static void glyph_atlas_evict(glyph_atlas_t *atlas, i32 page_index)
+{
+    i32 kept = 0;
+    for (i32 g = 0; g < arrlen(atlas->glyphs); g++) {
+        if (atlas->glyphs[g].page != page_index) {
+            atlas->glyphs[kept++] = atlas->glyphs[g];
+        }
     }
-    
+    arrsetlen(atlas->glyphs, kept);
+    glyph_atlas_rehash(atlas, atlas->table_bits);
+
+    glyph_page_t *page = atlas->pages[page_index];
+    stbrp_init_target(&page->packer, GLYPH_ATLAS_SIZE, GLYPH_ATLAS_SIZE, page->nodes, GLYPH_ATLAS_SIZE);
+    page->last_used = glyph_frame;
+}
+
+static bool glyph_page_pack(glyph_atlas_t *atlas, i32 p, stbrp_rect *rect, glyph_info_t *glyph)
+{
+    glyph_page_t *page = atlas->pages[p];
+
+    stbrp_pack_rects(&page->packer, rect, 1);
+    if (!rect->was_packed) {
+        return false;
+    }
+
+    glyph->page     = p;
+    glyph->x        = rect->x;
+    glyph->y        = rect->y;
+    glyph->stride   = GLYPH_ATLAS_SIZE;
+    glyph->bitmap   = &page->pixels[rect->y * GLYPH_ATLAS_SIZE + rect->x];
+    page->last_used = glyph_frame;
+    return true;
+}
+
+// finds a spot for a w x h bitmap, glyph gets its page and position
+static bool glyph_atlas_pack(glyph_atlas_t *atlas, i32 w, i32 h, glyph_info_t *glyph)
+{
+    stbrp_rect rect = { .w = w + GLYPH_PADDING, .h = h + GLYPH_PADDING };
+    if (rect.w > GLYPH_ATLAS_SIZE || rect.h > GLYPH_ATLAS_SIZE) {
+        return false;
+    }
+
+    // newest pages first, they have the most room left
+    for (i32 p = (i32)arrlen(atlas->pages) - 1; p >= 0; p--) {
+        if (glyph_page_pack(atlas, p, &rect, glyph)) {
+            return true;
+        }
+    }
+
+    // none had room, another page while under the cap, else the least
+    // recently used one goes. If every page is in use this frame the
+    // glyph goes without until the next one
+    i32 oldest = -1;
+    for (i32 p = 0; p < arrlen(atlas->pages); p++) {
+        u64 last_used = atlas->pages[p]->last_used;
+        if (last_used < glyph_frame && (oldest < 0 || last_used < atlas->pages[oldest]->last_used)) {
+            oldest = p;
+        }
+    }
+
+    i32 target = oldest;
+    if (arrlen(atlas->pages) < GLYPH_ATLAS_MAX_PAGES) {
+        arrput(atlas->pages, glyph_page_new());
+        target = (i32)arrlen(atlas->pages) - 1;
+    } else if (oldest >= 0) {
+        glyph_atlas_evict(atlas, oldest);
+    } else {
+        glyph->page = GLYPH_PAGE_PENDING;
+        atlas->full_frame = glyph_frame;
+        return false;
+    }
+    return glyph_page_pack(atlas, target, &rect, glyph);
+}
+
+// metrics of glyph_index, its bitmap packed into the font's atlas
+static void glyph_atlas_rasterize(font_tt *font, int glyph_index, glyph_info_t *glyph)
+{
     int advance, left_bearing;
     stbtt_GetGlyphHMetrics(&font->info, glyph_index, &advance, &left_bearing); 
     
     glyph->advance = advance * font->scale;
     
-    int w, h, xoff, yoff;
-    u8 *bitmap = stbtt_GetGlyphBitmap(&font->info, 0, font->scale,
-                                    glyph_index, &w, &h, &xoff, &yoff);
+    int x0, y0, x1, y1;
+    stbtt_GetGlyphBitmapBox(&font->info, glyph_index, font->scale, font->scale, &x0, &y0, &x1, &y1);
 
-    if (bitmap == NULL) {
-        glyph->w = glyph->h = 0;
-        glyph->bitmap = NULL;
-        glyph->bearing_x = 0;
-        glyph->bearing_y = 0;
-        font->cache_valid[cache_index] = 1; 
-        return glyph;
+    if (x1 <= x0 || y1 <= y0 || stbtt_IsGlyphEmpty(&font->info, glyph_index)) {
+        return;
     }
 
-    glyph->w = w;
-    glyph->h = h;
-    glyph->bearing_x = xoff;
-    glyph->bearing_y = yoff;
-    glyph->bitmap = bitmap;
-    
-    font->cache_valid[cache_index] = 1;
-    
+    if (!glyph_atlas_pack(&font->atlas, x1 - x0, y1 - y0, glyph)) {
+        if (glyph->page != GLYPH_PAGE_PENDING) {
+            fprintf(stderr, "Error : glyph %u is %dx%d, too big for the glyph atlas\n", glyph->codepoint, x1 - x0, y1 - y0);
+        }
+        return;
+    }
+
+    glyph->w = x1 - x0;
+    glyph->h = y1 - y0;
+    glyph->bearing_x = x0;
+    glyph->bearing_y = y0;
+    stbtt_MakeGlyphBitmap(&font->info, glyph->bitmap, glyph->w, glyph->h, glyph->stride,
+                          font->scale, font->scale, glyph_index);
+}
+
+static glyph_info_t glyph_load(font_tt *font, u32 codepoint)
+{
+    glyph_info_t glyph = { .codepoint = codepoint, .page = -1 };
+
+    int glyph_index = stbtt_FindGlyphIndex(&font->info, codepoint);
+    // Returns 0 if the character codepoint is not defined in the font.
+    // Those all share the entry of '?', bitmap included
+    if (glyph_index == 0 && codepoint != '?')
+    {
+        glyph = *get_glyph(font, '?');
+        glyph.codepoint = codepoint;
+    }
+    else
+    {
+        glyph_atlas_rasterize(font, glyph_index, &glyph);
+    }
     return glyph;
 }
 
+glyph_info_t* get_glyph(font_tt *font, u32 codepoint)
+{
+    glyph_atlas_t *atlas = &font->atlas;
+
+    glyph_info_t *cached = glyph_atlas_find(atlas, codepoint);
+    if (cached)
+    {
+        // the checks keep lookups during a replay from writing, the
+        // frame's recording already did whatever this one would
+        if (cached->page >= 0 && atlas->pages[cached->page]->last_used != glyph_frame) {
+            atlas->pages[cached->page]->last_used = glyph_frame;
+        }
+        else if (cached->page == GLYPH_PAGE_PENDING && atlas->full_frame != glyph_frame)
+        {
+            glyph_info_t glyph = glyph_load(font, codepoint);
+            // packing it may have evicted a page and moved the entry
+            cached  = glyph_atlas_find(atlas, codepoint);
+            *cached = glyph;
+        }
+        return cached;
+    }
+
+    glyph_info_t glyph = glyph_load(font, codepoint);
+
+    arrput(atlas->glyphs, glyph);
+
+    if ((u64)arrlen(atlas->glyphs) * 2 > ((u64)1 << atlas->table_bits))
+    {
+        glyph_atlas_rehash(atlas, atlas->table_bits ? atlas->table_bits + 1 : 8);
+    }
+    else
+    {
+        u32 mask = (1u << atlas->table_bits) - 1;
+        u32 i = glyph_slot(atlas, codepoint);
+        while (atlas->table[i]) {
+            i = (i + 1) & mask;
+        }
+        atlas->table[i] = (u32)arrlen(atlas->glyphs);
+    }
+
+    return &arrlast(atlas->glyphs);
+}
+
 glyph_info_t* render_glyph_to_buffer_tt(font_tt *font, u32 codepoint, 
                                          image_view_t  const *color_buf,
                                          u32 dst_x, u32 dst_y, color4_t color)
@@ -127,32 +326,113 @@ glyph_info_t* render_glyph_to_buffer_tt(font_tt *font, u32 codepoint,
         clipped = intersect_rects(&clipped, &current_scissor);
     }
 
+    // still hand back the glyph, the caller advances by it whether or
+    // not any of it was visible
     if (clipped.w <= 0 || clipped.h <= 0)
-        return NULL;
+        return glyph;
 
-    int x_start = clipped.x;
-    int y_start = clipped.y;
+    for (int y = clipped.y; y < clipped.y + clipped.h; y++)
+    {
+        u8 const *coverage = &glyph->bitmap[(y - render_y) * glyph->stride + (clipped.x - render_x)];
+        blend_coverage_span(color_buf, clipped.x, y, coverage, clipped.w, color);
+    }
+    return glyph;
+}
+
+/*
+    Strings are drawn a run at a time, up to GLYPH_RUN_MAX glyphs. The
+    run is clipped against the target and the scissor once, then the
+    coverage of all its glyphs is gathered into one buffer and every
+    row of that is a single blend_coverage_span, long enough for the
+    kernels to take 16 pixels at a time and skip the gaps. Where glyphs
+    overlap their coverage combines the way drawing one after the other
+    would. A run bigger than the buffer is done a band of rows at a time.
+ */
+#define GLYPH_RUN_MAX       64
+#define GLYPH_RUN_COVERAGE  (16 * 1024)
+
+typedef struct
+{
+    // copies, looking up the next glyph can move the cached ones, their bitmaps stay
+    glyph_info_t    glyphs[GLYPH_RUN_MAX];
+    i32             x[GLYPH_RUN_MAX], y[GLYPH_RUN_MAX];    // where each bitmap's top left lands
+    i32             count;
+    rect_t          bounds;
+} glyph_run_t;
+
+static void glyph_run_flush(image_view_t const *color_buf, glyph_run_t *run, color4_t color)
+{
+    if (run->count == 0) return;
+
+    rect_t target = { 0, 0, (i32)color_buf->width, (i32)color_buf->height };
+    rect_t clip   = intersect_rects(&run->bounds, &target);
+    if (scissor_enabled) {
+        clip = intersect_rects(&clip, &current_scissor);
+    }
 
-    int x_end = clipped.x + clipped.w;
-    int y_end = clipped.y + clipped.h;
+    u8  coverage[GLYPH_RUN_COVERAGE];
+    i32 band_w = MIN(clip.w, GLYPH_RUN_COVERAGE);
+    i32 band_h = band_w > 0 ? GLYPH_RUN_COVERAGE / band_w : 0;
 
-    for (int y = y_start; y < y_end; y++)
+    for (i32 band_x = clip.x; band_x < clip.x + clip.w; band_x += band_w)
+    for (i32 band_y = clip.y; band_y < clip.y + clip.h; band_y += band_h)
     {
-        int src_y = (y - render_y);
-        for (int x = x_start; x < x_end; x++)
+        rect_t band = { band_x, band_y, MIN(band_w, clip.x + clip.w - band_x), MIN(band_h, clip.y + clip.h - band_y) };
+        memset(coverage, 0, (size_t)band.w * band.h);
+
+        for (i32 g = 0; g < run->count; g++)
         {
-            int src_x = (x - render_x);
+            glyph_info_t const *glyph = &run->glyphs[g];
+            rect_t glyph_rect = { run->x[g], run->y[g], (i32)glyph->w, (i32)glyph->h };
+            rect_t r = intersect_rects(&glyph_rect, &band);
 
-            u8 alpha = glyph->bitmap[src_y * glyph->w + src_x];
-            
-            if (alpha > 0) 
+            for (i32 y = r.y; y < r.y + r.h; y++)
             {
-                color.a = alpha;
-                draw_pixel(color_buf, x, y, color);
+                u8 const *src = &glyph->bitmap[(y - run->y[g]) * glyph->stride + (r.x - run->x[g])];
+                u8       *dst = &coverage[(y - band.y) * band.w + (r.x - band.x)];
+
+                // a + b - a * b / 255, one over the other
+                for (i32 i = 0; i < r.w; i++) {
+                    u32 t  = dst[i] * src[i] + 128;
+                    dst[i] = dst[i] + src[i] - ((t + (t >> 8)) >> 8);
+                }
             }
         }
+
+        for (i32 y = 0; y < band.h; y++) {
+            blend_coverage_span(color_buf, band.x, band.y + y, &coverage[y * band.w], band.w, color);
+        }
     }
-    return glyph;
+
+    run->count = 0;
+}
+
+// the glyph at pen x, y, same placement as render_glyph_to_buffer_tt
+static void glyph_run_add(image_view_t const *color_buf, glyph_run_t *run, font_tt *font,
+                          glyph_info_t const *glyph, f32 x, f32 y, color4_t color)
+{
+    if (!glyph->bitmap) return;
+
+    if (run->count == GLYPH_RUN_MAX) {
+        glyph_run_flush(color_buf, run, color);
+    }
+
+    // floor, not a cast, the pen lands on the same pixel wherever the text is moved
+    i32 gx = (i32)floorf(x) + glyph->bearing_x;
+    i32 gy = (i32)floorf(y) + font->ascent + glyph->bearing_y;
+    rect_t glyph_rect = { gx, gy, (i32)glyph->w, (i32)glyph->h };
+
+    if (run->count == 0) {
+        run->bounds = glyph_rect;
+    } else {
+        i32 x0 = MIN(run->bounds.x, gx), x1 = MAX(run->bounds.x + run->bounds.w, gx + glyph_rect.w);
+        i32 y0 = MIN(run->bounds.y, gy), y1 = MAX(run->bounds.y + run->bounds.h, gy + glyph_rect.h);
+        run->bounds = (rect_t){ x0, y0, x1 - x0, y1 - y0 };
+    }
+    run->glyphs[run->count] = *glyph;
+    run->x[run->count] = gx;
+    run->y[run->count] = gy;
+    run->count++;
 }
 
 void render_text_tt(image_view_t *color_buf, rendered_text_tt *text)
@@ -168,8 +448,13 @@ void render_text_tt(image_view_t *color_buf, rendered_text_tt *text)
     
     i32 line_height = get_line_height(text->font);
 
+    // copied out, looking up the other glyphs can move the space glyph
     glyph_info_t *space_glyph = get_glyph(text->font, ' ');
-    f32 tab_width = space_glyph ? space_glyph->advance * TAB_SIZE : 0;
+    f32 space_width = space_glyph ? space_glyph->advance : 0;
+    f32 tab_width   = space_width * TAB_SIZE;
+
+    glyph_run_t run;
+    run.count = 0;
     
     while (*string) 
     {
@@ -177,6 +462,8 @@ void render_text_tt(image_view_t *color_buf, rendered_text_tt *text)
 
         if (c == '\n') 
         {
+            // a line at a time keeps the run's bounds tight
+            glyph_run_flush(color_buf, &run, text->color);
             y += line_height;
             x = original_x;
             continue;
@@ -190,16 +477,17 @@ void render_text_tt(image_view_t *color_buf, rendered_text_tt *text)
 
         if (c == ' ') 
         {
-            x += space_glyph->advance;
+            x += space_width;
             continue;
         }
         
-        glyph_info_t *glyph = render_glyph_to_buffer_tt(text->font, c, color_buf, (u32)x, (u32)y, text->color);
-        
-        if (glyph) {
-            x += glyph->advance ;
+        glyph_info_t *glyph = get_glyph(text->font, c);
+        if (glyph->bitmap) {
+            glyph_run_add(color_buf, &run, text->font, glyph, x, y, text->color);
+            x += glyph->advance;
         }
     }
+    glyph_run_flush(color_buf, &run, text->color);
 }
 
 void render_text_simple(image_view_t *color_buf, font_tt *font, 
@@ -225,356 +513,271 @@ float get_char_width(font_tt *font, char c)
     return glyph->advance;
 }
 
-float get_string_width(font_tt *font, const char *text)
+// no sweep below this many entries
+#define TEXT_CACHE_SWEEP_MIN 1024
+
+// drops what wasn't measured this frame or the last
+static void text_measure_sweep(font_tt *font)
 {
-    if (!text || !font) return 0.0f;
-    
-    float width = 0.0f;
-    const char *p = text;
-    
-    while (*p) 
+    // hmdel moves the last entry into the hole, walking down never skips one
+    for (i32 i = (i32)hmlen(font->measures) - 1; i >= 0; i--)
     {
-        if (*p == '\n') {
-            break; // Only measure until newline
+        if (font->measures[i].last_used + 1 < glyph_frame)
+        {
+            u64 key = font->measures[i].key;
+            free(font->measures[i].text);
+            free(font->measures[i].x);
+            (void)hmdel(font->measures, key);
         }
-        
-        width += get_char_width(font, *p);
-        p++;
     }
-    
-    return width;
+    font->measures_swept = (i32)hmlen(font->measures);
+}
+
+text_measure_t const *measure_text(font_tt *font, const char *text)
+{
+    // Only measure until newline
+    size_t len = strcspn(text, "\n");
+    u64    key = fnv1a_hash64(FNV1A_SEED64, text, len);
+
+    text_measure_t *measure = hmgetp_null(font->measures, key);
+    if (measure && measure->count == len && memcmp(measure->text, text, len) == 0) {
+        measure->last_used = glyph_frame;
+        return measure;
+    }
+
+    if (!measure)
+    {
+        if (hmlen(font->measures) >= MAX(TEXT_CACHE_SWEEP_MIN, 2 * font->measures_swept)) {
+            text_measure_sweep(font);
+        }
+
+        text_measure_t entry = { .key = key };
+        hmputs(font->measures, entry);
+        measure = hmgetp_null(font->measures, key);
+    }
+
+    // new, or a hash collision and the other string gets measured over
+    measure->text = CHECK_PTR(realloc(measure->text, len + 1));
+    measure->x    = CHECK_PTR(realloc(measure->x, (len + 1) * sizeof(f32)));
+    memcpy(measure->text, text, len);
+
+    f32 x = 0.0f;
+    for (size_t i = 0; i < len; i++) {
+        measure->x[i] = x;
+        x += get_char_width(font, text[i]);
+    }
+    measure->x[len]     = x;
+    measure->width      = x;
+    measure->count      = (u32)len;
+    measure->last_used  = glyph_frame;
+    return measure;
+}
+
+float get_string_width(font_tt *font, const char *text)
+{
+    if (!text || !font) return 0.0f;
+
+    return measure_text(font, text)->width;
 }
 
 int get_line_height(font_tt *font)
 {
-    return font->ascent - font->descent + font->line_gap;
+    return font->line_height;
 }
 
-static inline void copy_text_segment(char* dest, size_t* dest_idx, 
-                                     const char* src, size_t src_len) 
+// drops what wasn't wrapped this frame or the last, as text_measure_sweep
+static void text_wrap_sweep(font_tt *font)
 {
-    if (src_len > 0) {
-        memcpy(dest + *dest_idx, src, src_len);
-        *dest_idx += src_len;
+    for (i32 i = (i32)hmlen(font->wraps) - 1; i >= 0; i--)
+    {
+        if (font->wraps[i].last_used + 1 < glyph_frame)
+        {
+            u64 key = font->wraps[i].key;
+            free(font->wraps[i].text);
+            arrfree(font->wraps[i].tokens);
+            arrfree(font->wraps[i].out);
+            (void)hmdel(font->wraps, key);
+        }
     }
+    font->wraps_swept = (i32)hmlen(font->wraps);
 }
 
 /*
-    The basic idea is very simple just tokenize your string into words 
-    and calculate the size of each word and accumulate the line width
-    if adding the word exceeds the max width push newline character 
+    The words are measured here and only here. A word takes the one
+    space after it along, any other space is a token of its own
  */
-void wrap_text(font_tt *font, const char *text, float max_width, char *out, size_t out_len, int *line_n, float *max_line_w)
+static void text_wrap_tokenize(font_tt *font, const char *text, text_wrap_t *wrap)
 {
-    if (!font || !text || max_width <= 0) 
-    {
-        snprintf(out, out_len, "(null)");
-    }
-    
-    // size_t text_len = strlen(text);
-    // out_len = text_len * 2 + 1
-    
-    size_t out_idx = 0;
-    float current_line_width = 0.0f;
-    float max_line_width_used = 0.0f;
-    int line_count = 1;
-    
-    float space_width = get_char_width(font, ' ');
-    
-    const char *word_start = text;
+    arrsetlen(wrap->tokens, 0);
+
     const char *ptr = text;
-    
-    while (*ptr) 
+    while (*ptr)
     {
-        /*
-            When encountering a newline 
-            Copy everything up to and including the newline
-        */
-        if (*ptr == '\n') 
+        wrap_token_t token = { .start = (u32)(ptr - text) };
+
+        if (*ptr == '\n' || *ptr == ' ')
         {
-            size_t len = LEN_BETWEEN(word_start, ptr, true); // newline is included
-            copy_text_segment(out, &out_idx, word_start, len);
-            
-            if (current_line_width > max_line_width_used) 
-            {
-                max_line_width_used = current_line_width;
+            token.kind   = *ptr == '\n' ? WRAP_TOKEN_NEWLINE : WRAP_TOKEN_SPACE;
+            token.length = 1;
+            ptr++;
+        }
+        else
+        {
+            const char *word_end = ptr;
+            while (*word_end && *word_end != ' ' && *word_end != '\n') {
+                token.width += get_char_width(font, *word_end);
+                word_end++;
+            }
+
+            token.kind   = WRAP_TOKEN_WORD;
+            token.length = (u32)(word_end - ptr);
+            ptr = word_end;
+
+            if (*ptr == ' ') {
+                token.space_after = true;
+                ptr++;
             }
+        }
+        arrput(wrap->tokens, token);
+    }
+}
+
+/*
+    The basic idea is very simple, go over the words accumulating the
+    line width and when adding the next one exceeds the max width push
+    a newline. Spaces count the way they always have: a space that
+    doesn't follow a word is worth two space widths and one character,
+    a space that doesn't fit is dropped.
+ */
+static void text_wrap_lines(text_wrap_t *wrap, font_tt *font, const char *text, f32 max_width)
+{
+    f32 space_width = get_char_width(font, ' ');
+    f32 current_line_width  = 0.0f;
+    f32 max_line_width_used = 0.0f;
+    i32 line_count = 1;
+
+    arrsetlen(wrap->out, 0);
+
+    for (i32 i = 0; i < arrlen(wrap->tokens); i++)
+    {
+        wrap_token_t const *token = &wrap->tokens[i];
 
+        if (token->kind == WRAP_TOKEN_NEWLINE)
+        {
+            arrput(wrap->out, '\n');
+            max_line_width_used = MAX(max_line_width_used, current_line_width);
             current_line_width = 0.0f;
             line_count++;
-            
-            ptr++;
-            word_start = ptr;
             continue;
         }
-        
-        // Get the next word
-        const char *word_end = ptr;
-        while (*word_end && 
-               *word_end != ' ' &&
-               *word_end != '\n') 
-        {
-            word_end++;
-        }
-        
-        // get its width
-        float word_width = 0.0f;
-        for (const char *c = ptr; c < word_end; c++) {
-            word_width += get_char_width(font, *c);
-        }
-        
-        float test_width = current_line_width;
-        /*
-            if not at line start then account for space width 
-         */
+
+        f32 test_width = current_line_width;
         if (current_line_width > 0) {
-            test_width += space_width; 
+            test_width += space_width;
         }
-        test_width += word_width;
-        
+        test_width += token->width;
+
         // it doesnt fit in current line
-        if (test_width > max_width &&
-            current_line_width > 0) 
+        if (test_width > max_width && current_line_width > 0)
         {
             // trailing space
-            if (out_idx > 0 &&
-                out[out_idx - 1] == ' ') 
-            {
-                out_idx--;
-            }
-            
-            // force newline
-            out[out_idx++] = '\n';
-            
-            if (current_line_width > max_line_width_used) {
-                max_line_width_used = current_line_width;
+            if (arrlen(wrap->out) > 0 && arrlast(wrap->out) == ' ') {
+                arrpop(wrap->out);
             }
+            arrput(wrap->out, '\n');
+
+            max_line_width_used = MAX(max_line_width_used, current_line_width);
             current_line_width = 0.0f;
             line_count++;
-            
-            // Skip the space that would have preceded this word
-            if (*word_start == ' ') {
-                word_start++;
-                ptr = word_start;
+
+            if (token->kind == WRAP_TOKEN_SPACE) {
                 continue;
             }
         }
 
-        size_t len = LEN_BETWEEN(word_start, word_end, false); // dont include space
-        copy_text_segment(out, &out_idx, word_start, len);
-
-        // Update line width
-        if (current_line_width > 0 &&
-            *word_start == ' ') 
+        if (token->kind == WRAP_TOKEN_WORD)
         {
-            current_line_width += space_width;
-        } 
+            memcpy(arraddnptr(wrap->out, token->length), text + token->start, token->length);
+            current_line_width += token->width;
 
-        current_line_width += word_width;
-        
-        ptr = word_end;
-        
-        // Handle space after word
-        if (*ptr == ' ') 
+            if (token->space_after) {
+                arrput(wrap->out, ' ');
+                current_line_width += space_width;
+            }
+        }
+        else
         {
-            out[out_idx++] = ' ';
-            current_line_width += space_width; 
-            ptr++;
+            if (current_line_width > 0) {
+                current_line_width += space_width;
+            }
+            arrput(wrap->out, ' ');
+            current_line_width += space_width;
         }
-        
-        word_start = ptr;
-    }
-    
-    out[out_idx] = '\0';
-    
-    if (current_line_width > max_line_width_used) 
-    {
-        max_line_width_used = current_line_width;
     }
-    
-    *line_n = line_count;
-    *max_line_w = max_line_width_used;
-}
+    arrput(wrap->out, '\0');
 
-typedef struct 
-{
-    int start_idx; 
-    int length;    
-    float width;   
-    int is_newline;
-} word_info_t;
+    wrap->max_width      = max_width;
+    wrap->line_count     = line_count;
+    wrap->max_line_width = MAX(max_line_width_used, current_line_width);
+}
 
-typedef struct 
+text_wrap_t const *wrap_text_cached(font_tt *font, const char *text, f32 max_width)
 {
-    char *original_text;
-    word_info_t *words; 
-    int word_count;     
-    float space_width;  
-} text_layout_t;
+    size_t len = strlen(text);
+    u64    key = fnv1a_hash64(FNV1A_SEED64, text, len);
 
-/*
-    If the text never changes we can precompute the width of each word
- */
-text_layout_t* create_text_layout(font_tt *font, const char *text)
-{
-    if (!font || !text) return NULL;
-    
-    text_layout_t *layout = malloc(sizeof(text_layout_t));
-    if (!layout) return NULL;
-    
-    // Copy original text
-    layout->original_text = strdup(text);
-    if (!layout->original_text) {
-        free(layout);
-        return NULL;
-    }
-    
-    // Cache space width
-    layout->space_width = get_char_width(font, ' ');
-    
-    // Count words (rough estimate)
-    int estimated_words = 1;
-    for (const char *p = text; *p; p++) {
-        if (*p == ' ' || *p == '\n') estimated_words++;
-    }
-    
-    layout->words = malloc(sizeof(word_info_t) * estimated_words);
-    if (!layout->words) {
-        free(layout->original_text);
-        free(layout);
-        return NULL;
-    }
-    
-    layout->word_count = 0;
-    int idx = 0;
-    
-    while (text[idx]) {
-        // Handle explicit newline
-        if (text[idx] == '\n') {
-            // Store newline as special word
-            layout->words[layout->word_count].start_idx = idx;
-            layout->words[layout->word_count].length = 1;
-            layout->words[layout->word_count].width = 0.0f;
-            layout->words[layout->word_count].is_newline = 1;
-            layout->word_count++;
-            
-            idx++;
-            continue;
-        }
-        
-        // Find end of word
-        int word_start = idx;
-        while (text[idx] && text[idx] != ' ' && text[idx] != '\n') {
-            idx++;
-        }
-        
-        // Calculate and store word info
-        if (idx > word_start) {
-            float word_width = 0.0f;
-            for (int i = word_start; i < idx; i++) {
-                word_width += get_char_width(font, text[i]);
-            }
-            
-            layout->words[layout->word_count].start_idx = word_start;
-            layout->words[layout->word_count].length = idx - word_start;
-            layout->words[layout->word_count].width = word_width;
-            layout->words[layout->word_count].is_newline = 0;
-            layout->word_count++;
+    text_wrap_t *wrap = hmgetp_null(font->wraps, key);
+    if (wrap && wrap->length == len && memcmp(wrap->text, text, len) == 0)
+    {
+        wrap->last_used = glyph_frame;
+        if (wrap->max_width != max_width) {
+            text_wrap_lines(wrap, font, text, max_width);
         }
-        
-        // Skip spaces (don't store them as words)
-        while (text[idx] == ' ') idx++;
+        return wrap;
     }
-    
-    return layout;
-}
 
-void wrap_text_const(text_layout_t *layout, float max_width, char *out, size_t out_len, int *line_n, float *max_line_w)
-{
-    
-    if (!layout || max_width <= 0) {
-        snprintf(out, out_len, "(null)");
-    }
-    
-    // Allocate output buffer (worst case: newline after every word)
-    //size_t max_size = strlen(layout->original_text) + layout->word_count + 1;
-    
-    size_t out_idx = 0;
-    float current_line_width = 0.0f;
-    float max_line_width_used = 0.0f;
-    int line_count = 1;
-    int at_line_start = 1;
-    
-    for (int i = 0; i < layout->word_count; i++) 
+    if (!wrap)
     {
-        word_info_t *word = &layout->words[i];
-        
-        // Handle explicit newlines
-        if (word->is_newline) 
-        {
-            out[out_idx++] = '\n';
-            
-            if (current_line_width > max_line_width_used) {
-                max_line_width_used = current_line_width;
-            }
-            current_line_width = 0.0f;
-            line_count++;
-            at_line_start = 1;
-            continue;
-        }
-        
-        // Calculate width with this word
-        float test_width = current_line_width;
-        if (!at_line_start) {
-            test_width += layout->space_width;
+        if (hmlen(font->wraps) >= MAX(TEXT_CACHE_SWEEP_MIN, 2 * font->wraps_swept)) {
+            text_wrap_sweep(font);
         }
-        test_width += word->width;
-        
-        // Need to wrap?
-        if (test_width > max_width && !at_line_start) {
-            out[out_idx++] = '\n';
-            
-            if (current_line_width > max_line_width_used) {
-                max_line_width_used = current_line_width;
-            }
-            current_line_width = 0.0f;
-            line_count++;
-            at_line_start = 1;
-        }
-        
-        // Add space before word if not at line start
-        if (!at_line_start) {
-            out[out_idx++] = ' ';
-            current_line_width += layout->space_width;
-        }
-        
-        // Copy word using index
-        copy_text_segment(out, &out_idx, layout->original_text + word->start_idx, word->length);
-        current_line_width += word->width;
-        at_line_start = 0;
-    }
-    
-    out[out_idx] = '\0';
-    
-    if (current_line_width > max_line_width_used) {
-        max_line_width_used = current_line_width;
+
+        text_wrap_t entry = { .key = key };
+        hmputs(font->wraps, entry);
+        wrap = hmgetp_null(font->wraps, key);
     }
-    
-    *line_n = line_count;
-    *max_line_w = max_line_width_used;
+
+    // new, or a hash collision and the other text gets wrapped over
+    wrap->text = CHECK_PTR(realloc(wrap->text, len + 1));
+    memcpy(wrap->text, text, len);
+    wrap->length    = (u32)len;
+    wrap->last_used = glyph_frame;
+    text_wrap_tokenize(font, text, wrap);
+    text_wrap_lines(wrap, font, text, max_width);
+    return wrap;
 }
 
-void free_text_layout(text_layout_t *layout)
+void wrap_text(font_tt *font, const char *text, float max_width, char *out, size_t out_len, int *line_n, float *max_line_w)
 {
-    if (!layout) return;
-    
-    if (layout->original_text) {
-        free(layout->original_text);
+    if (!font || !text) 
+    {
+        snprintf(out, out_len, "(null)");
+        *line_n = 1;
+        *max_line_w = 0.0f;
+        return;
     }
-    if (layout->words) {
-        free(layout->words);
+
+    text_wrap_t const *wrap = wrap_text_cached(font, text, max_width);
+
+    // cut short rather than overrun out
+    if (out_len > 0) {
+        size_t len = MIN((size_t)arrlen(wrap->out), out_len);
+        memcpy(out, wrap->out, len);
+        out[len - 1] = '\0';
     }
-    free(layout);
+    
+    *line_n = wrap->line_count;
+    *max_line_w = wrap->max_line_width;
 }
 
 void utf8_decoder_init(utf8_decoder_t *decoder, const char *str)
@@ -696,11 +899,15 @@ void render_string_unicode(image_view_t const *color_buf, rendered_text_tt *text
     int line_height = get_line_height(text->font);
     utf8_decoder_t decoder;
     utf8_decoder_init(&decoder, utf8_str);
+
+    glyph_run_t run;
+    run.count = 0;
     
     u32 wc;
     while (utf8_decode_next(&decoder, &wc)) 
     {
         if (wc == '\n') {
+            glyph_run_flush(color_buf, &run, text->color);
             y += line_height;
             x = original_x;
             continue;
@@ -714,14 +921,11 @@ void render_string_unicode(image_view_t const *color_buf, rendered_text_tt *text
             continue;
         }
         
-        render_glyph_to_buffer_tt(text->font, wc, color_buf, 
-                                 (u32)x, (u32)y, text->color);
-        
         glyph_info_t *glyph = get_glyph(text->font, wc);
-        if (glyph) {
-            x += glyph->advance;
-        }
+        glyph_run_add(color_buf, &run, text->font, glyph, x, y, text->color);
+        x += glyph->advance;
     }
+    glyph_run_flush(color_buf, &run, text->color);
 }
 
 size_t utf8_strlen(const char *utf8_str)
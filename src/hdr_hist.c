@@ -0,0 +1,106 @@
+#include "hdr_hist.h"
+
+#include <string.h>
+
+/*
+    Values below HDR_HIST_SUB_COUNT get a counter each. Above that a
+    value is shifted right until it falls in [HALF_COUNT, SUB_COUNT),
+    the shift picks the power of two and what is left the linear step
+    inside it:
+
+        shift = msb - (SUB_BITS - 1)
+        index = SUB_COUNT + (shift - 1) * HALF_COUNT + (value >> shift) - HALF_COUNT
+
+    So every power of two above the first gets HALF_COUNT counters and
+    the width of a counter grows with the values it holds.
+ */
+
+static inline int hdr_msb(uint64_t v)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline size_t hdr_index(uint64_t value)
+{
+    if (value < HDR_HIST_SUB_COUNT) {
+        return (size_t)value;
+    }
+
+    int shift = hdr_msb(value) - (HDR_HIST_SUB_BITS - 1);
+    return HDR_HIST_SUB_COUNT + (size_t)(shift - 1) * HDR_HIST_HALF_COUNT
+         + (size_t)(value >> shift) - HDR_HIST_HALF_COUNT;
+}
+
+// largest value that maps to index
+static inline uint64_t hdr_highest_at(size_t index)
+{
+    if (index < HDR_HIST_SUB_COUNT) {
+        return (uint64_t)index;
+    }
+
+    size_t   rel   = index - HDR_HIST_SUB_COUNT;
+    int      shift = (int)(rel / HDR_HIST_HALF_COUNT) + 1;
+    uint64_t step  = (uint64_t)(rel % HDR_HIST_HALF_COUNT) + HDR_HIST_HALF_COUNT;
+
+    return ((step + 1) << shift) - 1;
+}
+
+void hdr_hist_init(hdr_hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hdr_hist_record(hdr_hist_t *h, uint64_t value)
+{
+    h->counts[hdr_index(value)]++;
+    h->total++;
+    h->sum += (double)value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void hdr_hist_merge(hdr_hist_t *dst, const hdr_hist_t *src)
+{
+    for (size_t i = 0; i < HDR_HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+uint64_t hdr_hist_percentile(const hdr_hist_t *h, double percentile)
+{
+    if (h->total == 0) return 0;
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+
+    // rank of the value we want, 1 based so p0 is the smallest recorded
+    uint64_t rank = (uint64_t)((percentile / 100.0) * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HDR_HIST_BUCKETS; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = hdr_highest_at(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+double hdr_hist_mean(const hdr_hist_t *h)
+{
+    return h->total ? h->sum / (double)h->total : 0.0;
+}
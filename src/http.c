@@ -0,0 +1,409 @@
+#include "http.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../external/include/stb_ds.h"
+
+/* -------------------- Parsing -------------------- */
+
+// offset just past the blank line that ends the head, 0 if it isn't in yet
+static size_t http_head_end(const char *data, size_t len)
+{
+    for (size_t i = 0; i + 3 < len; i++)
+    {
+        const char *cr = memchr(data + i, '\r', len - 3 - i);
+        if (!cr) return 0;
+        i = (size_t)(cr - data);
+        if (cr[1] == '\n' && cr[2] == '\r' && cr[3] == '\n') return i + 4;
+    }
+    return 0;
+}
+
+static http_slice_t http_trim(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    return (http_slice_t){ p, (size_t)(end - p) };
+}
+
+// -1 if s isn't all digits or doesn't fit
+static int64_t http_parse_uint(http_slice_t s)
+{
+    if (!s.len || s.len > 18) return -1;
+    int64_t v = 0;
+    for (size_t i = 0; i < s.len; i++) {
+        if (s.p[i] < '0' || s.p[i] > '9') return -1;
+        v = v * 10 + (s.p[i] - '0');
+    }
+    return v;
+}
+
+// a comma separated header value like Connection has token among its elements
+static bool http_has_token(http_slice_t s, const char *token)
+{
+    const char *p = s.p, *end = s.p + s.len;
+    while (p < end)
+    {
+        const char *comma = memchr(p, ',', (size_t)(end - p));
+        if (!comma) comma = end;
+        if (http_slice_ieq(http_trim(p, comma), token)) return true;
+        p = comma + 1;
+    }
+    return false;
+}
+
+int64_t http_parse_request(const char *data, size_t len, http_request_t *req)
+{
+    size_t head = http_head_end(data, len < HTTP_MAX_HEAD ? len : HTTP_MAX_HEAD);
+    if (!head) return len >= HTTP_MAX_HEAD ? -431 : 0;
+
+    const char *p   = data;
+    const char *end = data + head - 2;          // the last CRLF ends the header lines
+
+    // request line: method SP target SP HTTP/1.x
+    const char *eol = memchr(p, '\r', (size_t)(end - p));
+    const char *sp1 = memchr(p, ' ', (size_t)(eol - p));
+    if (!sp1 || sp1 == p) return -400;
+    const char *sp2 = memchr(sp1 + 1, ' ', (size_t)(eol - sp1 - 1));
+    if (!sp2 || sp2 == sp1 + 1 || eol - sp2 != 9 || memcmp(sp2 + 1, "HTTP/1.", 7) || !isdigit((unsigned char)sp2[8])) {
+        return -400;
+    }
+    for (const char *m = p; m < sp1; m++) {
+        if (*m < 'A' || *m > 'Z') return -400;
+    }
+
+    req->method = (http_slice_t){ p, (size_t)(sp1 - p) };
+    req->minor  = sp2[8] - '0';
+
+    const char *target = sp1 + 1;
+    const char *q = memchr(target, '?', (size_t)(sp2 - target));
+    if (q) {
+        req->path  = (http_slice_t){ target, (size_t)(q - target) };
+        req->query = (http_slice_t){ q + 1, (size_t)(sp2 - q - 1) };
+    } else {
+        req->path  = (http_slice_t){ target, (size_t)(sp2 - target) };
+        req->query = (http_slice_t){ sp2, 0 };
+    }
+
+    // header lines
+    req->header_count = 0;
+    bool    has_close = false, has_keep_alive = false;
+    int64_t content_length = 0;
+
+    for (p = eol + 2; p < end; p = eol + 2)
+    {
+        eol = memchr(p, '\r', (size_t)(end - p));
+        if (!eol || eol[1] != '\n') return -400;
+
+        // folded lines are obsolete, and a name can't have spaces
+        const char *colon = memchr(p, ':', (size_t)(eol - p));
+        if (!colon || colon == p || *p == ' ' || *p == '\t' || colon[-1] == ' ') return -400;
+        if (req->header_count == HTTP_MAX_HEADERS) return -431;
+
+        http_header_t *h = &req->headers[req->header_count++];
+        h->name  = (http_slice_t){ p, (size_t)(colon - p) };
+        h->value = http_trim(colon + 1, eol);
+
+        if (http_slice_ieq(h->name, "content-length")) {
+            content_length = http_parse_uint(h->value);
+            if (content_length < 0) return -400;
+        } else if (http_slice_ieq(h->name, "transfer-encoding")) {
+            return -501;
+        } else if (http_slice_ieq(h->name, "connection")) {
+            has_close      |= http_has_token(h->value, "close");
+            has_keep_alive |= http_has_token(h->value, "keep-alive");
+        }
+    }
+
+    if (content_length > (int64_t)HTTP_MAX_BODY) return -413;
+
+    // 1.1 stays open unless told otherwise, 1.0 closes unless asked not to
+    req->keep_alive = req->minor >= 1 ? !has_close : has_keep_alive && !has_close;
+
+    if (len - head < (size_t)content_length) return 0;
+    req->body = (http_slice_t){ data + head, (size_t)content_length };
+    return (int64_t)(head + (size_t)content_length);
+}
+
+int64_t http_parse_response(const char *data, size_t len, int *status, http_slice_t *body)
+{
+    size_t head = http_head_end(data, len);
+    if (!head) return len >= HTTP_MAX_HEAD ? -1 : 0;
+
+    if (head < 14 || memcmp(data, "HTTP/1.", 7) || data[8] != ' ') return -1;
+    *status = 0;
+    for (int i = 9; i < 12; i++) {
+        if (!isdigit((unsigned char)data[i])) return -1;
+        *status = *status * 10 + (data[i] - '0');
+    }
+
+    bool    chunked = false;
+    int64_t content_length = -1;
+
+    const char *end = data + head - 2;
+    const char *eol = memchr(data, '\r', (size_t)(end - data));
+    for (const char *p = eol + 2; p < end; p = eol + 2)
+    {
+        eol = memchr(p, '\r', (size_t)(end - p));
+        const char *colon = eol ? memchr(p, ':', (size_t)(eol - p)) : NULL;
+        if (!colon) return -1;
+
+        http_slice_t name  = { p, (size_t)(colon - p) };
+        http_slice_t value = http_trim(colon + 1, eol);
+        if (http_slice_ieq(name, "content-length")) {
+            if ((content_length = http_parse_uint(value)) < 0) return -1;
+        } else if (http_slice_ieq(name, "transfer-encoding")) {
+            chunked = http_has_token(value, "chunked");
+        }
+    }
+
+    body->p = data + head;
+
+    if (*status == 204 || *status == 304 || (*status >= 100 && *status < 200)) {
+        body->len = 0;
+        return (int64_t)head;
+    }
+
+    if (!chunked) {
+        // no length and not chunked would mean up to the close, not something to pipeline behind
+        if (content_length < 0) return -1;
+        if (len - head < (size_t)content_length) return 0;
+        body->len = (size_t)content_length;
+        return (int64_t)(head + (size_t)content_length);
+    }
+
+    // walk the chunks: hex size, extensions, CRLF, data, CRLF, until the 0 one and its trailers
+    size_t at = head;
+    for (;;)
+    {
+        const char *line = data + at;
+        const char *lf   = memchr(line, '\n', len - at);
+        if (!lf) return 0;
+
+        size_t size = 0;
+        const char *h = line;
+        for (; isxdigit((unsigned char)*h); h++) {
+            if (size >> 56) return -1;
+            size = size * 16 + (size_t)(isdigit((unsigned char)*h) ? *h - '0' : (tolower((unsigned char)*h) - 'a' + 10));
+        }
+        if (h == line) return -1;
+        at = (size_t)(lf - data) + 1;
+
+        if (!size) break;
+        if (len - at < size + 2) return 0;
+        at += size + 2;
+    }
+    for (;;)
+    {
+        const char *lf = memchr(data + at, '\n', len - at);
+        if (!lf) return 0;
+        bool blank = lf == data + at || (lf == data + at + 1 && data[at] == '\r');
+        at = (size_t)(lf - data) + 1;
+        if (blank) break;
+    }
+
+    body->len = at - head;
+    return (int64_t)at;
+}
+
+bool http_slice_eq(http_slice_t s, const char *text)
+{
+    size_t n = strlen(text);
+    return s.len == n && !memcmp(s.p, text, n);
+}
+
+bool http_slice_ieq(http_slice_t s, const char *text)
+{
+    size_t n = strlen(text);
+    if (s.len != n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)s.p[i]) != tolower((unsigned char)text[i])) return false;
+    }
+    return true;
+}
+
+http_slice_t http_get_header(const http_request_t *req, const char *name)
+{
+    for (size_t i = 0; i < req->header_count; i++) {
+        if (http_slice_ieq(req->headers[i].name, name)) return req->headers[i].value;
+    }
+    return (http_slice_t){ "", 0 };
+}
+
+static int http_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+bool http_form_value(http_slice_t form, const char *key, char *out, size_t out_size)
+{
+    size_t      key_len = strlen(key);
+    const char  *p = form.p, *end = form.p + form.len;
+
+    while (p < end)
+    {
+        const char *amp = memchr(p, '&', (size_t)(end - p));
+        if (!amp) amp = end;
+        const char *eq = memchr(p, '=', (size_t)(amp - p));
+        const char *name_end = eq ? eq : amp;
+
+        if ((size_t)(name_end - p) == key_len && !memcmp(p, key, key_len))
+        {
+            size_t n = 0;
+            for (const char *v = eq ? eq + 1 : amp; v < amp && n + 1 < out_size; v++)
+            {
+                int hi, lo;
+                if (*v == '+') {
+                    out[n++] = ' ';
+                } else if (*v == '%' && amp - v > 2 && (hi = http_hex(v[1])) >= 0 && (lo = http_hex(v[2])) >= 0) {
+                    out[n++] = (char)(hi << 4 | lo);
+                    v += 2;
+                } else {
+                    out[n++] = *v;
+                }
+            }
+            if (out_size) out[n] = '\0';
+            return true;
+        }
+        p = amp + 1;
+    }
+    return false;
+}
+
+/* -------------------- Writing -------------------- */
+
+const char *http_status_text(int status)
+{
+    switch (status)
+    {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+    }
+}
+
+void http_put(char **buf, const char *data, size_t len)
+{
+    size_t at = arrlenu(*buf);
+    arrsetlen(*buf, at + len);
+    memcpy(*buf + at, data, len);
+}
+
+void http_putf(char **buf, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (n <= 0) return;
+
+    // room for the NUL vsnprintf insists on, dropped again after
+    size_t at = arrlenu(*buf);
+    arrsetlen(*buf, at + (size_t)n + 1);
+    va_start(args, fmt);
+    vsnprintf(*buf + at, (size_t)n + 1, fmt, args);
+    va_end(args);
+    arrsetlen(*buf, at + (size_t)n);
+}
+
+void http_begin_response(char **buf, int status, const char *content_type, bool keep_alive, int64_t content_length)
+{
+    http_putf(buf, "HTTP/1.1 %d %s\r\n", status, http_status_text(status));
+    if (content_type) http_putf(buf, "Content-Type: %s\r\n", content_type);
+    http_putf(buf, "Connection: %s\r\n", keep_alive ? "keep-alive" : "close");
+
+    // no body at all for these, not even a length of it
+    if (status != 204 && status != 304) {
+        if (content_length < 0) {
+            http_putf(buf, "Transfer-Encoding: chunked\r\n");
+        } else {
+            http_putf(buf, "Content-Length: %lld\r\n", (long long)content_length);
+        }
+    }
+    http_put(buf, "\r\n", 2);
+}
+
+void http_put_response(char **buf, int status, const char *content_type, bool keep_alive, const char *body, size_t len)
+{
+    http_begin_response(buf, status, content_type, keep_alive, (int64_t)len);
+    if (len && status != 204 && status != 304) http_put(buf, body, len);
+}
+
+/*
+    The size line is reserved as 8 hex digits and patched when the
+    chunk ends. Leading zeros are fine in a chunk size.
+ */
+#define HTTP_CHUNK_LINE     10
+
+size_t http_begin_chunk(char **buf)
+{
+    size_t at = arrlenu(*buf);
+    arrsetlen(*buf, at + HTTP_CHUNK_LINE);
+    return at;
+}
+
+void http_end_chunk(char **buf, size_t chunk_start)
+{
+    size_t len = arrlenu(*buf) - chunk_start - HTTP_CHUNK_LINE;
+
+    // an empty chunk would be the last one
+    if (!len) {
+        arrsetlen(*buf, chunk_start);
+        return;
+    }
+
+    // a chunk is never near 4GB, writers end one every HTTP_CHUNK_SIZE
+    char *line = *buf + chunk_start;
+    for (int i = 7; i >= 0; i--, len >>= 4) {
+        line[i] = "0123456789abcdef"[len & 15];
+    }
+    line[8] = '\r';
+    line[9] = '\n';
+    http_put(buf, "\r\n", 2);
+}
+
+void http_end_chunked(char **buf)
+{
+    http_put(buf, "0\r\n\r\n", 5);
+}
+
+void http_put_json_str(char **buf, const char *str, size_t len)
+{
+    arrput(*buf, '"');
+    size_t plain = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        http_put(buf, str + plain, i - plain);
+        plain = i + 1;
+        switch (c)
+        {
+            case '"':  http_put(buf, "\\\"", 2); break;
+            case '\\': http_put(buf, "\\\\", 2); break;
+            case '\n': http_put(buf, "\\n", 2);  break;
+            case '\r': http_put(buf, "\\r", 2);  break;
+            case '\t': http_put(buf, "\\t", 2);  break;
+            default:   http_putf(buf, "\\u%04x", c); break;
+        }
+    }
+    http_put(buf, str + plain, len - plain);
+    arrput(*buf, '"');
+}
@@ -0,0 +1,160 @@
+#include "lz.h"
+
+#include <string.h>
+
+static inline uint32_t lz_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// the part of a count past the nibble, NULL when dst is full
+static uint8_t *lz_put_length(uint8_t *op, uint8_t *oend, size_t n)
+{
+    for (; n >= 255; n -= 255) {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// match_len 0 is the last sequence, literals only
+static uint8_t *lz_put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    if (op >= oend) return NULL;
+
+    size_t   extra = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t  *token = op++;
+    *token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (extra < 15 ? extra : 15));
+
+    if (lit_len >= 15 && !(op = lz_put_length(op, oend, lit_len - 15))) return NULL;
+    if ((size_t)(oend - op) < lit_len) return NULL;
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (!match_len) return op;
+
+    if (oend - op < 2) return NULL;
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+
+    if (extra >= 15 && !(op = lz_put_length(op, oend, extra - 15))) return NULL;
+    return op;
+}
+
+size_t lz_compress(lz_ctx_t *ctx, const void *src_, size_t len, void *dst_, size_t cap)
+{
+    const uint8_t *src = (const uint8_t *)src_;
+    uint8_t       *dst = (uint8_t *)dst_;
+    uint8_t       *op  = dst;
+    uint8_t       *oend = dst + cap;
+
+    // stale entries are harmless, every candidate is compared before it is used
+    memset(ctx->table, 0, sizeof(ctx->table));
+
+    size_t ip = 0, anchor = 0;
+
+    while (ip + LZ_MIN_MATCH <= len)
+    {
+        uint32_t seq  = lz_read32(src + ip);
+        uint32_t h    = lz_hash(seq);
+        size_t   cand = ctx->table[h];
+        ctx->table[h] = (uint32_t)ip;
+
+        if (cand >= ip || ip - cand > LZ_MAX_OFFSET || lz_read32(src + cand) != seq) {
+            // the longer nothing matched the bigger the steps, incompressible input goes by fast
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        size_t match_len = LZ_MIN_MATCH;
+        while (ip + match_len < len && src[cand + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+        // the match may have started before the 4 bytes that were hashed
+        while (ip > anchor && cand > 0 && src[ip - 1] == src[cand - 1]) {
+            ip--;
+            cand--;
+            match_len++;
+        }
+
+        op = lz_put_sequence(op, oend, src + anchor, ip - anchor, ip - cand, match_len);
+        if (!op) return 0;
+
+        ip += match_len;
+        anchor = ip;
+
+        // a repeat usually continues right after the last one ended
+        if (ip - 2 + LZ_MIN_MATCH <= len) {
+            ctx->table[lz_hash(lz_read32(src + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+
+    op = lz_put_sequence(op, oend, src + anchor, len - anchor, 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static bool lz_get_length(const uint8_t **ip, const uint8_t *iend, size_t *n)
+{
+    for (;;)
+    {
+        if (*ip >= iend || *n > ((size_t)1 << 40)) return false;
+        uint8_t b = *(*ip)++;
+        *n += b;
+        if (b < 255) return true;
+    }
+}
+
+int64_t lz_decompress(const void *src_, size_t len, void *dst_, size_t cap)
+{
+    const uint8_t *ip   = (const uint8_t *)src_;
+    const uint8_t *iend = ip + len;
+    uint8_t       *dst  = (uint8_t *)dst_;
+    uint8_t       *op   = dst;
+    uint8_t       *oend = dst + cap;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !lz_get_length(&ip, iend, &lit_len)) return -1;
+        if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len) return -1;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        // only the last sequence ends with its literals
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !lz_get_length(&ip, iend, &match_len)) return -1;
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < match_len) return -1;
+
+        const uint8_t *match = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            // overlapping, a short pattern repeated
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int64_t)(op - dst);
+}
@@ -0,0 +1,322 @@
+#include "shm_ring.h"
+
+#ifndef _WIN32
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* -------------------- Rings -------------------- */
+
+void shm_ring_attach(shm_ring_t *r, void *map, int index, uint32_t size, int wake_fd)
+{
+    r->shared  = (shm_ring_shared_t *)map + index;
+    r->data    = (char *)map + 2 * sizeof(shm_ring_shared_t) + (size_t)index * size;
+    r->size    = size;
+    r->wake_fd = wake_fd;
+}
+
+void shm_ring_wake(int fd)
+{
+    uint64_t one = 1;
+
+    // EAGAIN means the counter is already way past zero, it's ringing anyway
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+}
+
+/*
+    tail lives in the shared mapping and the other process writes it, it
+    is read once and checked before anything is derived from it. A tail
+    past head or more than a ring behind it is a corrupt (or hostile)
+    peer, -1 then, and the caller drops the connection.
+ */
+ssize_t shm_ring_space(shm_ring_t *r)
+{
+    uint32_t head = __atomic_load_n(&r->shared->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&r->shared->tail, __ATOMIC_ACQUIRE);
+    if (head - tail > r->size) return -1;
+
+    return (ssize_t)(r->size - (head - tail));
+}
+
+ssize_t shm_ring_writev(shm_ring_t *r, const struct iovec *iov, int count)
+{
+    shm_ring_shared_t *s = r->shared;
+
+    uint32_t head  = __atomic_load_n(&s->head, __ATOMIC_RELAXED);
+    uint32_t tail  = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+    if (head - tail > r->size) return -1;
+
+    size_t   room  = r->size - (head - tail);
+    size_t   total = 0;
+
+    for (int i = 0; i < count && room > 0; i++)
+    {
+        const char *src = (const char *)iov[i].iov_base;
+        size_t len   = iov[i].iov_len < room ? iov[i].iov_len : room;
+        size_t at    = head & (r->size - 1);
+        size_t first = len < r->size - at ? len : r->size - at;
+
+        // may wrap around the end once
+        memcpy(r->data + at, src, first);
+        memcpy(r->data, src + first, len - first);
+
+        head  += (uint32_t)len;
+        room  -= len;
+        total += len;
+    }
+    if (total == 0) return 0;
+
+    __atomic_store_n(&s->head, head, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&s->reader_waiting, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&s->reader_waiting, 0, __ATOMIC_RELAXED);
+        shm_ring_wake(r->wake_fd);
+    }
+    return (ssize_t)total;
+}
+
+// true -> still full, writer_waiting is set and the consumer will ring
+bool shm_ring_sleep_write(shm_ring_t *r)
+{
+    __atomic_store_n(&r->shared->writer_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // corrupt counts as not full, the next writev reports it
+    if (shm_ring_space(r) != 0) {
+        __atomic_store_n(&r->shared->writer_waiting, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+size_t shm_ring_peek(shm_ring_t *r, const char **data)
+{
+    uint32_t head = __atomic_load_n(&r->shared->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&r->shared->tail, __ATOMIC_RELAXED);
+    size_t   at   = tail & (r->size - 1);
+    size_t   n    = head - tail;
+
+    *data = r->data + at;
+    return n < r->size - at ? n : r->size - at;
+}
+
+void shm_ring_consume(shm_ring_t *r, size_t n)
+{
+    shm_ring_shared_t *s = r->shared;
+
+    uint32_t tail = __atomic_load_n(&s->tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->tail, tail + (uint32_t)n, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&s->writer_waiting, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&s->writer_waiting, 0, __ATOMIC_RELAXED);
+        shm_ring_wake(r->wake_fd);
+    }
+}
+
+// true -> still empty, reader_waiting is set and the producer will ring
+bool shm_ring_sleep_read(shm_ring_t *r)
+{
+    __atomic_store_n(&r->shared->reader_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint32_t head = __atomic_load_n(&r->shared->head, __ATOMIC_ACQUIRE);
+    if (head != __atomic_load_n(&r->shared->tail, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&r->shared->reader_waiting, 0, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+/* -------------------- Handshake -------------------- */
+
+int shm_send_fds(int sock, uint32_t size, const int *fds, int count)
+{
+    union {
+        struct cmsghdr  align;
+        char            buf[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+
+    if (count > 3) return -1;
+
+    struct iovec iov = { .iov_base = &size, .iov_len = sizeof(size) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)count);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * (size_t)count);
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(size)) {
+        fprintf(stderr, "shm_send_fds: sendmsg failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* -------------------- Client -------------------- */
+
+shm_client_t *shm_client_connect(const char *path)
+{
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "shm_client_connect: path too long: %s\n", path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "shm_client_connect: Failed to connect to %s: %s\n", path, strerror(errno));
+        if (sock >= 0) close(sock);
+        return NULL;
+    }
+
+    union {
+        struct cmsghdr  align;
+        char            buf[CMSG_SPACE(sizeof(int) * 3)];
+    } control;
+
+    uint32_t size = 0;
+    struct iovec iov = { .iov_base = &size, .iov_len = sizeof(size) };
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    struct cmsghdr *cmsg = n == (ssize_t)sizeof(size) ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
+        fprintf(stderr, "shm_client_connect: bad handshake from %s\n", path);
+        close(sock);
+        return NULL;
+    }
+
+    int fds[3];
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    shm_client_t *c = calloc(1, sizeof(shm_client_t));
+    void *map = MAP_FAILED;
+
+    // size comes from the other process, it has to be sane before we map by it
+    if (c && size >= 4096 && size <= (1u << 30) && (size & (size - 1)) == 0) {
+        map = mmap(NULL, SHM_RING_MAP_SIZE(size), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    }
+    close(fds[0]);
+
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "shm_client_connect: Failed to map the rings (size %u)\n", size);
+        close(fds[1]);
+        close(fds[2]);
+        close(sock);
+        free(c);
+        return NULL;
+    }
+
+    c->sock        = sock;
+    c->server_bell = fds[1];
+    c->bell        = fds[2];
+    c->map         = map;
+    c->map_size    = SHM_RING_MAP_SIZE(size);
+    shm_ring_attach(&c->tx, map, SHM_RING_TO_SERVER, size, c->server_bell);
+    shm_ring_attach(&c->rx, map, SHM_RING_TO_CLIENT, size, c->server_bell);
+    return c;
+}
+
+void shm_client_close(shm_client_t *c)
+{
+    if (!c) return;
+
+    munmap(c->map, c->map_size);
+    close(c->bell);
+    close(c->server_bell);
+    close(c->sock);
+    free(c);
+}
+
+// 1 rung, 0 timed out, -1 the server is gone
+static int shm_client_wait(shm_client_t *c, int timeout_ms)
+{
+    struct pollfd fds[2] = {
+        { .fd = c->bell, .events = POLLIN },
+        { .fd = c->sock, .events = POLLIN },
+    };
+
+    int rc = poll(fds, 2, timeout_ms);
+    if (rc < 0) return errno == EINTR ? 1 : -1;
+    if (rc == 0) return 0;
+
+    // the server never writes to the socket, readable means EOF
+    if (fds[1].revents) return -1;
+
+    uint64_t count;
+    (void)!read(c->bell, &count, sizeof(count));
+    return 1;
+}
+
+// blocks until all of it is in the ring
+int shm_client_send(shm_client_t *c, const void *data, size_t len)
+{
+    size_t sent = 0;
+
+    while (sent < len)
+    {
+        struct iovec iov = { .iov_base = (char *)data + sent, .iov_len = len - sent };
+        ssize_t n = shm_ring_writev(&c->tx, &iov, 1);
+        if (n < 0) {
+            fprintf(stderr, "shm_client_send: the server's ring is corrupt\n");
+            return -1;
+        }
+        sent += (size_t)n;
+
+        if (n == 0 && shm_ring_sleep_write(&c->tx) && shm_client_wait(c, -1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// whatever is there up to cap, 0 on timeout, -1 once the server is gone
+ssize_t shm_client_recv(shm_client_t *c, void *buf, size_t cap, int timeout_ms)
+{
+    for (;;)
+    {
+        const char *data;
+        size_t n = shm_ring_peek(&c->rx, &data);
+
+        if (n > 0) {
+            if (n > cap) n = cap;
+            memcpy(buf, data, n);
+            shm_ring_consume(&c->rx, n);
+            return (ssize_t)n;
+        }
+
+        if (!shm_ring_sleep_read(&c->rx)) {
+            continue;
+        }
+
+        int rc = shm_client_wait(c, timeout_ms);
+        if (rc <= 0) return rc;
+    }
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <immintrin.h>  // AVX
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 
 typedef __m128  f32x4;
@@ -14,14 +15,28 @@ typedef __m256d f64x4;
 
 #if defined(_WIN32)
   #include <intrin.h>
-  #define cpuid(leaf, a, b, c, d) __cpuid((int[]){a,b,c,d}, leaf)
-  #define cpuid_count(leaf, sub, a, b, c, d) __cpuidex((int[]){a,b,c,d}, leaf, sub)
+  #define cpuid(leaf, a, b, c, d) \
+      do { int r_[4]; __cpuid(r_, leaf); a = r_[0]; b = r_[1]; c = r_[2]; d = r_[3]; } while (0)
+  #define cpuid_count(leaf, sub, a, b, c, d) \
+      do { int r_[4]; __cpuidex(r_, leaf, sub); a = r_[0]; b = r_[1]; c = r_[2]; d = r_[3]; } while (0)
 #else
   #include <cpuid.h>
   #define cpuid(leaf, a, b, c, d)            __get_cpuid(leaf, &a, &b, &c, &d)
   #define cpuid_count(leaf, sub, a, b, c, d) __get_cpuid_count(leaf, sub, &a, &b, &c, &d)
 #endif
 
+// XCR0, which register state the OS saves on a context switch
+static inline uint64_t simd_xgetbv(uint32_t index)
+{
+#if defined(_WIN32)
+    return _xgetbv(index);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
 typedef struct {
     // --- f32x4 (SSE / SSE2) ---
     int sse;
@@ -43,9 +58,13 @@ typedef struct {
 static inline SIMD_Caps simd_query_caps(void)
 {
     SIMD_Caps caps = {0};
-    uint32_t eax, ebx, ecx, edx;
+    uint32_t eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    cpuid(0, eax, ebx, ecx, edx);
+    uint32_t max_leaf = eax;
 
     // ── Leaf 1: SSE family + FMA ─────────────────────────────────────────────
+    eax = ebx = ecx = edx = 0;
     cpuid(1, eax, ebx, ecx, edx);
     caps.sse    = (edx >> 25) & 1;
     caps.sse2   = (edx >> 26) & 1;
@@ -55,10 +74,21 @@ static inline SIMD_Caps simd_query_caps(void)
     caps.fma    = (ecx >> 12) & 1;
     caps.avx    = (ecx >> 28) & 1;
 
+    // the cpu having AVX is not enough, the OS has to save the ymm registers (XCR0 bits 1, 2)
+    // and zmm ones (bits 5..7) too, otherwise the first AVX instruction faults
+    uint64_t xcr0 = ((ecx >> 27) & 1) ? simd_xgetbv(0) : 0;
+    int os_ymm = (xcr0 & 0x06) == 0x06;
+    int os_zmm = (xcr0 & 0xE6) == 0xE6;
+    caps.avx = caps.avx && os_ymm;
+    caps.fma = caps.fma && os_ymm;
+
     // ── Leaf 7: AVX2 / AVX-512 ───────────────────────────────────────────────
-    cpuid_count(7, 0, eax, ebx, ecx, edx);
-    caps.avx2    = (ebx >>  5) & 1;
-    caps.avx512f = (ebx >> 16) & 1;
+    if (max_leaf >= 7) {
+        eax = ebx = ecx = edx = 0;
+        cpuid_count(7, 0, eax, ebx, ecx, edx);
+        caps.avx2    = ((ebx >>  5) & 1) && os_ymm;
+        caps.avx512f = ((ebx >> 16) & 1) && os_zmm;
+    }
 
     return caps;
 }
@@ -1279,4 +1309,482 @@ static inline void f64x4_print_detailed(f64x4 v, const char *name)
     }
 }
 
-#endif // F64X4_H
\ No newline at end of file
+#endif // F64X4_H
+
+#ifndef PIXEL_SPAN_H
+#define PIXEL_SPAN_H
+
+// ============================================================================
+// Pixel Spans
+// ============================================================================
+
+/*
+    Kernels over runs of 32 bit pixels, 4 bytes r g b a in memory
+    (color4_t). Both fill and blend take 8 pixels per iteration, one
+    AVX2 register or two SSE2 ones, and finish the tail one pixel at a
+    time with the same math so every path gives the same bytes.
+
+    blend is a constant color over dst, straight alpha, the same
+    formula blend_pixel uses:
+
+        rgb = (src * a + dst * (255 - a)) >> 8
+        a   =  a + (((dst.a + 1) * (255 - a)) >> 8)
+            == (a * 256 + (255 - a) + dst.a * (255 - a)) >> 8
+
+    written the second way the alpha lane is the same multiply-add as
+    the others, src * a per channel is worked out once per span.
+    Opaque and invisible colors are for the caller to sort out: a fill
+    and nothing.
+
+    blend_premul and over are for premultiplied colors, src already
+    carries its alpha so every channel, alpha included, is the same
+    single multiply-add with an exact divide by 255:
+
+        out = src + div255(dst * (255 - src.a))
+        div255(x) = (x + 128 + ((x + 128) >> 8)) >> 8
+
+    no branches on alpha, opaque and invisible come out right by
+    themselves. blend_premul takes one color for the span, over a row
+    of them (texture blits, composited surfaces).
+
+    mask is one premultiplied color scaled by a coverage byte per pixel,
+    div255(color * coverage) per channel, then over. It is how glyphs
+    are drawn, coverage comes 16 bytes at a time and a block that is
+    all 0 is skipped, all 255 with an opaque color is a fill. Both are
+    exactly what the math gives, only cheaper.
+
+    Picked once from simd_query_caps with simd_span_kernels().
+ */
+
+#if defined(_MSC_VER)
+  #define SIMD_TARGET_AVX2
+#else
+  #define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+typedef void (*simd_span_fill_fn)(uint32_t *dst, uint32_t color, size_t count);
+typedef void (*simd_span_blend_fn)(uint32_t *dst, uint32_t color, size_t count);
+typedef void (*simd_span_over_fn)(uint32_t *dst, const uint32_t *src, size_t count);
+typedef void (*simd_span_mask_fn)(uint32_t *dst, uint32_t color, const uint8_t *coverage, size_t count);
+
+typedef struct {
+    simd_span_fill_fn   fill;
+    simd_span_blend_fn  blend;
+    simd_span_blend_fn  blend_premul;
+    simd_span_over_fn   over;
+    simd_span_mask_fn   mask;
+    const char          *name;
+} simd_span_kernels_t;
+
+// per channel src * a, alpha lane a * 256 + 255 - a, see above
+static inline void span_blend_terms(uint32_t color, uint16_t add[4], uint16_t *inv)
+{
+    uint32_t a = color >> 24;
+    add[0] = (uint16_t)(((color >>  0) & 0xFF) * a);
+    add[1] = (uint16_t)(((color >>  8) & 0xFF) * a);
+    add[2] = (uint16_t)(((color >> 16) & 0xFF) * a);
+    add[3] = (uint16_t)((a << 8) + 255 - a);
+    *inv   = (uint16_t)(255 - a);
+}
+
+static inline uint32_t span_blend_one(uint32_t dst, const uint16_t add[4], uint16_t inv)
+{
+    uint32_t out = 0;
+    for (int c = 0; c < 4; c++) {
+        uint32_t d = (dst >> (8 * c)) & 0xFF;
+        out |= ((add[c] + d * inv) >> 8) << (8 * c);
+    }
+    return out;
+}
+
+// one premultiplied pixel over another, see above
+static inline uint32_t span_over_one(uint32_t dst, uint32_t src)
+{
+    uint32_t inv = 255 - (src >> 24);
+    uint32_t out = 0;
+    for (int c = 0; c < 4; c++) {
+        uint32_t t = ((dst >> (8 * c)) & 0xFF) * inv + 128;
+        out |= (((src >> (8 * c)) & 0xFF) + ((t + (t >> 8)) >> 8)) << (8 * c);
+    }
+    return out;
+}
+
+// color scaled by coverage, then over, see above
+static inline uint32_t span_mask_one(uint32_t dst, uint32_t color, uint32_t coverage)
+{
+    uint32_t src = 0;
+    for (int c = 0; c < 4; c++) {
+        uint32_t t = ((color >> (8 * c)) & 0xFF) * coverage + 128;
+        src |= ((t + (t >> 8)) >> 8) << (8 * c);
+    }
+    return span_over_one(dst, src);
+}
+
+static void span_fill_scalar(uint32_t *dst, uint32_t color, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] = color;
+}
+
+static void span_blend_premul_scalar(uint32_t *dst, uint32_t color, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] = span_over_one(dst[i], color);
+}
+
+static void span_over_scalar(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    for (size_t i = 0; i < count; i++) dst[i] = span_over_one(dst[i], src[i]);
+}
+
+static void span_blend_scalar(uint32_t *dst, uint32_t color, size_t count)
+{
+    uint16_t add[4], inv;
+    span_blend_terms(color, add, &inv);
+    for (size_t i = 0; i < count; i++) dst[i] = span_blend_one(dst[i], add, inv);
+}
+
+static void span_mask_scalar(uint32_t *dst, uint32_t color, const uint8_t *coverage, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (coverage[i]) dst[i] = span_mask_one(dst[i], color, coverage[i]);
+    }
+}
+
+// ── SSE2 ─────────────────────────────────────────────────────────────────────
+
+static void span_fill_sse2(uint32_t *dst, uint32_t color, size_t count)
+{
+    __m128i c = _mm_set1_epi32((int)color);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128((__m128i *)(dst + i),     c);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), c);
+    }
+    for (; i < count; i++) dst[i] = color;
+}
+
+// 2 pixels widened to 16 bits a channel, times inv plus the constant terms, back to 8
+static inline __m128i span_blend_sse2_half(__m128i px, __m128i add, __m128i inv)
+{
+    px = _mm_mullo_epi16(px, inv);
+    px = _mm_add_epi16(px, add);
+    return _mm_srli_epi16(px, 8);
+}
+
+static inline __m128i span_blend_sse2_4(__m128i px, __m128i add, __m128i inv)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo   = span_blend_sse2_half(_mm_unpacklo_epi8(px, zero), add, inv);
+    __m128i hi   = span_blend_sse2_half(_mm_unpackhi_epi8(px, zero), add, inv);
+    return _mm_packus_epi16(lo, hi);
+}
+
+/*
+    2 pixels widened to 16 bits a channel: src + div255(dst * inv). The
+    sum stays within 255 for premultiplied colors, packing saturates
+    anyway
+ */
+static inline __m128i span_over_sse2_half(__m128i d, __m128i s, __m128i inv)
+{
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inv), _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    return _mm_add_epi16(s, t);
+}
+
+// 255 - alpha of each of the 2 pixels, in all 4 of its lanes
+static inline __m128i span_inv_alpha_sse2(__m128i s)
+{
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_sub_epi16(_mm_set1_epi16(255), a);
+}
+
+static inline __m128i span_over_sse2_4(__m128i d, __m128i s)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+    __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+    __m128i lo   = span_over_sse2_half(_mm_unpacklo_epi8(d, zero), s_lo, span_inv_alpha_sse2(s_lo));
+    __m128i hi   = span_over_sse2_half(_mm_unpackhi_epi8(d, zero), s_hi, span_inv_alpha_sse2(s_hi));
+    return _mm_packus_epi16(lo, hi);
+}
+
+static inline __m128i span_div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/*
+    4 pixels under the color c (widened, 2 pixels' worth), m holds each
+    pixel's coverage in all 4 of its bytes
+ */
+static inline __m128i span_mask_sse2_4(__m128i d, __m128i c, __m128i m)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i s_lo = span_div255_sse2(_mm_mullo_epi16(c, _mm_unpacklo_epi8(m, zero)));
+    __m128i s_hi = span_div255_sse2(_mm_mullo_epi16(c, _mm_unpackhi_epi8(m, zero)));
+    __m128i lo   = span_over_sse2_half(_mm_unpacklo_epi8(d, zero), s_lo, span_inv_alpha_sse2(s_lo));
+    __m128i hi   = span_over_sse2_half(_mm_unpackhi_epi8(d, zero), s_hi, span_inv_alpha_sse2(s_hi));
+    return _mm_packus_epi16(lo, hi);
+}
+
+// 4 coverage bytes, each spread over its pixel's 4 bytes
+static inline __m128i span_mask_spread_sse2(const uint8_t *coverage)
+{
+    int32_t bytes;
+    memcpy(&bytes, coverage, sizeof(bytes));
+    __m128i m = _mm_cvtsi32_si128(bytes);
+    m = _mm_unpacklo_epi8(m, m);
+    return _mm_unpacklo_epi16(m, m);
+}
+
+static void span_mask_sse2(uint32_t *dst, uint32_t color, const uint8_t *coverage, size_t count)
+{
+    __m128i zero   = _mm_setzero_si128();
+    __m128i full   = _mm_set1_epi8((char)0xFF);
+    __m128i solid  = _mm_set1_epi32((int)color);
+    __m128i c      = _mm_unpacklo_epi8(solid, zero);
+    int     opaque = (color >> 24) == 255;
+    size_t  i      = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i cv = _mm_loadu_si128((const __m128i *)(coverage + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(cv, zero)) == 0xFFFF) {
+            continue;
+        }
+        if (opaque && _mm_movemask_epi8(_mm_cmpeq_epi8(cv, full)) == 0xFFFF) {
+            for (int k = 0; k < 16; k += 4) _mm_storeu_si128((__m128i *)(dst + i + k), solid);
+            continue;
+        }
+
+        __m128i lo   = _mm_unpacklo_epi8(cv, cv);
+        __m128i hi   = _mm_unpackhi_epi8(cv, cv);
+        __m128i m[4] = { _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+                         _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi) };
+        for (int k = 0; k < 4; k++) {
+            __m128i px = _mm_loadu_si128((const __m128i *)(dst + i + 4 * k));
+            _mm_storeu_si128((__m128i *)(dst + i + 4 * k), span_mask_sse2_4(px, c, m[k]));
+        }
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), span_mask_sse2_4(px, c, span_mask_spread_sse2(coverage + i)));
+    }
+    for (; i < count; i++) {
+        if (coverage[i]) dst[i] = span_mask_one(dst[i], color, coverage[i]);
+    }
+}
+
+static void span_blend_premul_sse2(uint32_t *dst, uint32_t color, size_t count)
+{
+    __m128i c = _mm_set1_epi32((int)color);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(dst + i + 4));
+        _mm_storeu_si128((__m128i *)(dst + i),     span_over_sse2_4(p0, c));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), span_over_sse2_4(p1, c));
+    }
+    for (; i < count; i++) dst[i] = span_over_one(dst[i], color);
+}
+
+static void span_over_sse2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(dst + i + 4));
+        __m128i s0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i s1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        _mm_storeu_si128((__m128i *)(dst + i),     span_over_sse2_4(p0, s0));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), span_over_sse2_4(p1, s1));
+    }
+    for (; i < count; i++) dst[i] = span_over_one(dst[i], src[i]);
+}
+
+static void span_blend_sse2(uint32_t *dst, uint32_t color, size_t count)
+{
+    uint16_t a[4], inv16;
+    span_blend_terms(color, a, &inv16);
+
+    __m128i add = _mm_setr_epi16((short)a[0], (short)a[1], (short)a[2], (short)a[3],
+                                 (short)a[0], (short)a[1], (short)a[2], (short)a[3]);
+    __m128i inv = _mm_set1_epi16((short)inv16);
+    size_t  i   = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(dst + i + 4));
+        _mm_storeu_si128((__m128i *)(dst + i),     span_blend_sse2_4(p0, add, inv));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), span_blend_sse2_4(p1, add, inv));
+    }
+    for (; i < count; i++) dst[i] = span_blend_one(dst[i], a, inv16);
+}
+
+// ── AVX2 ─────────────────────────────────────────────────────────────────────
+
+SIMD_TARGET_AVX2
+static void span_fill_avx2(uint32_t *dst, uint32_t color, size_t count)
+{
+    __m256i c = _mm256_set1_epi32((int)color);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst + i), c);
+    }
+    for (; i < count; i++) dst[i] = color;
+}
+
+SIMD_TARGET_AVX2
+static void span_blend_avx2(uint32_t *dst, uint32_t color, size_t count)
+{
+    uint16_t a[4], inv16;
+    span_blend_terms(color, a, &inv16);
+
+    __m256i add  = _mm256_setr_epi16((short)a[0], (short)a[1], (short)a[2], (short)a[3],
+                                     (short)a[0], (short)a[1], (short)a[2], (short)a[3],
+                                     (short)a[0], (short)a[1], (short)a[2], (short)a[3],
+                                     (short)a[0], (short)a[1], (short)a[2], (short)a[3]);
+    __m256i inv  = _mm256_set1_epi16((short)inv16);
+    __m256i zero = _mm256_setzero_si256();
+    size_t  i    = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        // unpack and pack work within 128 bit lanes, so the pixel order comes back as it was
+        __m256i px = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i lo = _mm256_unpacklo_epi8(px, zero);
+        __m256i hi = _mm256_unpackhi_epi8(px, zero);
+
+        lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, inv), add), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, inv), add), 8);
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    for (; i < count; i++) dst[i] = span_blend_one(dst[i], a, inv16);
+}
+
+// the over of span_over_avx2_8 with the source already widened
+SIMD_TARGET_AVX2
+static inline __m256i span_over_avx2_wide(__m256i d, __m256i s_lo, __m256i s_hi)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i c128 = _mm256_set1_epi16(128);
+    __m256i c255 = _mm256_set1_epi16(255);
+
+    __m256i d_lo = _mm256_unpacklo_epi8(d, zero);
+    __m256i d_hi = _mm256_unpackhi_epi8(d, zero);
+
+    __m256i inv_lo = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+    __m256i inv_hi = _mm256_sub_epi16(c255, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s_hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+
+    __m256i t_lo = _mm256_add_epi16(_mm256_mullo_epi16(d_lo, inv_lo), c128);
+    __m256i t_hi = _mm256_add_epi16(_mm256_mullo_epi16(d_hi, inv_hi), c128);
+    t_lo = _mm256_srli_epi16(_mm256_add_epi16(t_lo, _mm256_srli_epi16(t_lo, 8)), 8);
+    t_hi = _mm256_srli_epi16(_mm256_add_epi16(t_hi, _mm256_srli_epi16(t_hi, 8)), 8);
+
+    return _mm256_packus_epi16(_mm256_add_epi16(s_lo, t_lo), _mm256_add_epi16(s_hi, t_hi));
+}
+
+SIMD_TARGET_AVX2
+static inline __m256i span_over_avx2_8(__m256i d, __m256i s)
+{
+    __m256i zero = _mm256_setzero_si256();
+    return span_over_avx2_wide(d, _mm256_unpacklo_epi8(s, zero), _mm256_unpackhi_epi8(s, zero));
+}
+
+SIMD_TARGET_AVX2
+static inline __m256i span_div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+SIMD_TARGET_AVX2
+static void span_mask_avx2(uint32_t *dst, uint32_t color, const uint8_t *coverage, size_t count)
+{
+    __m128i zero   = _mm_setzero_si128();
+    __m128i full   = _mm_set1_epi8((char)0xFF);
+    __m256i solid  = _mm256_set1_epi32((int)color);
+    __m256i zero8  = _mm256_setzero_si256();
+    __m256i c      = _mm256_unpacklo_epi8(solid, zero8);
+    int     opaque = (color >> 24) == 255;
+    size_t  i      = 0;
+
+    // each coverage byte to its pixel's 4 bytes, pixels 0-7 and 8-15, a 128 bit lane holds 4
+    __m256i spread0 = _mm256_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                       4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7);
+    __m256i spread1 = _mm256_add_epi8(spread0, _mm256_set1_epi8(8));
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i cv = _mm_loadu_si128((const __m128i *)(coverage + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(cv, zero)) == 0xFFFF) {
+            continue;
+        }
+        if (opaque && _mm_movemask_epi8(_mm_cmpeq_epi8(cv, full)) == 0xFFFF) {
+            _mm256_storeu_si256((__m256i *)(dst + i),     solid);
+            _mm256_storeu_si256((__m256i *)(dst + i + 8), solid);
+            continue;
+        }
+
+        __m256i both = _mm256_broadcastsi128_si256(cv);
+        __m256i m[2] = { _mm256_shuffle_epi8(both, spread0), _mm256_shuffle_epi8(both, spread1) };
+        for (int k = 0; k < 2; k++)
+        {
+            __m256i px   = _mm256_loadu_si256((const __m256i *)(dst + i + 8 * k));
+            __m256i s_lo = span_div255_avx2(_mm256_mullo_epi16(c, _mm256_unpacklo_epi8(m[k], zero8)));
+            __m256i s_hi = span_div255_avx2(_mm256_mullo_epi16(c, _mm256_unpackhi_epi8(m[k], zero8)));
+            _mm256_storeu_si256((__m256i *)(dst + i + 8 * k), span_over_avx2_wide(px, s_lo, s_hi));
+        }
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), span_mask_sse2_4(px, _mm256_castsi256_si128(c), span_mask_spread_sse2(coverage + i)));
+    }
+    for (; i < count; i++) {
+        if (coverage[i]) dst[i] = span_mask_one(dst[i], color, coverage[i]);
+    }
+}
+
+SIMD_TARGET_AVX2
+static void span_blend_premul_avx2(uint32_t *dst, uint32_t color, size_t count)
+{
+    __m256i c = _mm256_set1_epi32((int)color);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), span_over_avx2_8(px, c));
+    }
+    for (; i < count; i++) dst[i] = span_over_one(dst[i], color);
+}
+
+SIMD_TARGET_AVX2
+static void span_over_avx2(uint32_t *dst, const uint32_t *src, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i s  = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), span_over_avx2_8(px, s));
+    }
+    for (; i < count; i++) dst[i] = span_over_one(dst[i], src[i]);
+}
+
+static inline simd_span_kernels_t simd_span_kernels(const SIMD_Caps *c)
+{
+    if (simd_supports_avx2(c)) {
+        return (simd_span_kernels_t){ span_fill_avx2, span_blend_avx2, span_blend_premul_avx2, span_over_avx2, span_mask_avx2, "avx2" };
+    }
+    if (c->sse2) {
+        return (simd_span_kernels_t){ span_fill_sse2, span_blend_sse2, span_blend_premul_sse2, span_over_sse2, span_mask_sse2, "sse2" };
+    }
+    return (simd_span_kernels_t){ span_fill_scalar, span_blend_scalar, span_blend_premul_scalar, span_over_scalar, span_mask_scalar, "scalar" };
+}
+
+#endif // PIXEL_SPAN_H
@@ -737,11 +737,6 @@ char* socket_get_ip_addr(struct sockaddr *sa, char *buffer, size_t bufsize)
 #endif
 }
 
-typedef struct {
-    uint32_t ip;
-    uint16_t port;
-} SocketAddress;
-
 /* UDP */
 int socket_send_to(socket_handle sockfd, const SocketAddress *address, 
                    const void *data, int length) 
@@ -808,6 +803,363 @@ int socket_recv_from(socket_handle sockfd, SocketAddress *address, void *data, i
     return len;
 }
 
+/*
+    Bound non-blocking datagram socket. SocketAddress only carries
+    IPv4 so that is all the UDP side speaks.
+ */
+int socket_udp_socket(Socket *sock, const char *ip, const char *port)
+{
+    struct addrinfo hints, *res, *p;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    int err;
+    if ((err = getaddrinfo(ip, port, &hints, &res)) != 0) 
+    {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(err));
+        return -1;
+    }
+
+    char last_error[256] = {0};
+
+    for (p = res; p != NULL; p = p->ai_next) 
+    {
+        sock->sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+
+#ifdef _WIN32
+        if (sock->sockfd == INVALID_SOCKET) 
+        {
+            snprintf(last_error, sizeof(last_error), "Socket creation failed: %d", WSAGetLastError());
+            continue;
+        }
+#else
+        if (sock->sockfd < 0) 
+        {
+            snprintf(last_error, sizeof(last_error), "Socket creation failed: %s", strerror(errno));
+            continue;
+        }
+#endif
+
+        socket_set_non_blocking(sock->sockfd);
+
+        // several instances on one host all want the broadcast port
+        socket_set_opt_reuse_addr(sock->sockfd, 1);
+
+        if (bind(sock->sockfd, p->ai_addr, (int)p->ai_addrlen) != 0) 
+        {
+#ifdef _WIN32
+            snprintf(last_error, sizeof(last_error), "Binding failed: %d", WSAGetLastError());
+#else
+            snprintf(last_error, sizeof(last_error), "Binding failed: %s", strerror(errno));
+#endif
+            socket_close(sock);
+            continue;
+        }
+        break;
+    }
+
+    freeaddrinfo(res);
+
+    if (p == NULL) 
+    {
+        fprintf(stderr, "Failed to bind UDP socket. Last error: %s\n", last_error);
+        return -1;
+    }
+
+    snprintf(sock->port, PORT_BUFFER_SIZE, "%s", port);
+    return 0;
+}
+
+#ifndef _WIN32
+    // room for the one cmsg we care about (UDP_SEGMENT out, UDP_GRO in), aligned for cmsghdr
+    typedef union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } socket_cmsg_t;
+
+    static void socket_fill_sockaddr(struct sockaddr_in *addr_in, const SocketAddress *address)
+    {
+        memset(addr_in, 0, sizeof(*addr_in));
+        addr_in->sin_family = AF_INET;
+        addr_in->sin_port = htons(address->port);
+        addr_in->sin_addr.s_addr = htonl(address->ip);
+    }
+#endif
+
+/*
+    UDP, many datagrams per syscall
+
+    sendto / recvfrom cost a full kernel round trip per datagram, at
+    a few hundred thousand small messages a second that is all the
+    time there is. sendmmsg / recvmmsg move up to SOCKET_UDP_BATCH of
+    them per call.
+
+    Returns how many datagrams went out / came in, -1 if none did
+    (errno EAGAIN when the socket was just full / empty). A short
+    send means the socket buffer filled up, retry the rest later.
+    Windows has no mmsg calls, it loops over sendto / recvfrom.
+ */
+int socket_send_batch(socket_handle sockfd, const socket_datagram_t *datagrams, int count)
+{
+    if (sockfd < 0 || datagrams == NULL || count <= 0) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    int sent = 0;
+    while (sent < count) 
+    {
+        const socket_datagram_t *d = &datagrams[sent];
+        if (socket_send_to(sockfd, &d->address, d->data, d->length) < 0) {
+            break;
+        }
+        sent++;
+    }
+    return (sent > 0) ? sent : -1;
+#else
+    struct mmsghdr     msgs[SOCKET_UDP_BATCH];
+    struct iovec       iovs[SOCKET_UDP_BATCH];
+    struct sockaddr_in addrs[SOCKET_UDP_BATCH];
+
+    int sent = 0;
+    while (sent < count) 
+    {
+        int n = count - sent;
+        if (n > SOCKET_UDP_BATCH) n = SOCKET_UDP_BATCH;
+
+        memset(msgs, 0, sizeof(msgs[0]) * (size_t)n);
+        for (int i = 0; i < n; i++) 
+        {
+            const socket_datagram_t *d = &datagrams[sent + i];
+
+            socket_fill_sockaddr(&addrs[i], &d->address);
+            iovs[i].iov_base = d->data;
+            iovs[i].iov_len  = (size_t)d->length;
+
+            msgs[i].msg_hdr.msg_name    = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov     = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen  = 1;
+        }
+
+        int ret = sendmmsg(sockfd, msgs, (unsigned int)n, MSG_NOSIGNAL);
+
+        if (ret < 0) 
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fprintf(stderr, "sendmmsg() failed: %s\n", strerror(errno));
+            }
+            return (sent > 0) ? sent : -1;
+        }
+
+        sent += ret;
+
+        // stopped early, the next call would only hit the same error
+        if (ret < n) {
+            break;
+        }
+    }
+    return sent;
+#endif
+}
+
+int socket_recv_batch(socket_handle sockfd, socket_datagram_t *datagrams, int count)
+{
+    if (sockfd < 0 || datagrams == NULL || count <= 0) {
+        return 0;
+    }
+
+#ifdef _WIN32
+    int received = 0;
+    while (received < count) 
+    {
+        socket_datagram_t *d = &datagrams[received];
+        int len = socket_recv_from(sockfd, &d->address, d->data, d->length);
+        if (len < 0) {
+            break;
+        }
+        d->length = len;
+        d->segment_size = 0;
+        received++;
+    }
+    return (received > 0) ? received : -1;
+#else
+    struct mmsghdr     msgs[SOCKET_UDP_BATCH];
+    struct iovec       iovs[SOCKET_UDP_BATCH];
+    struct sockaddr_in addrs[SOCKET_UDP_BATCH];
+    socket_cmsg_t      control[SOCKET_UDP_BATCH];
+
+    if (count > SOCKET_UDP_BATCH) count = SOCKET_UDP_BATCH;
+
+    memset(msgs, 0, sizeof(msgs[0]) * (size_t)count);
+    for (int i = 0; i < count; i++) 
+    {
+        iovs[i].iov_base = datagrams[i].data;
+        iovs[i].iov_len  = (size_t)datagrams[i].length;
+
+        msgs[i].msg_hdr.msg_name       = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen    = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov        = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen     = 1;
+        msgs[i].msg_hdr.msg_control    = control[i].buf;
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+    }
+
+    int ret;
+    do {
+        // blocks for the first one at most, takes whatever else is already queued
+        ret = recvmmsg(sockfd, msgs, (unsigned int)count, MSG_WAITFORONE, NULL);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) 
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            fprintf(stderr, "recvmmsg() failed: %s\n", strerror(errno));
+        }
+        return -1;
+    }
+
+    for (int i = 0; i < ret; i++) 
+    {
+        socket_datagram_t *d = &datagrams[i];
+
+        d->address.ip   = ntohl(addrs[i].sin_addr.s_addr);
+        d->address.port = ntohs(addrs[i].sin_port);
+        d->length       = (int)msgs[i].msg_len;
+        d->segment_size = 0;
+
+    #ifdef UDP_GRO
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) 
+        {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                memcpy(&d->segment_size, CMSG_DATA(cm), sizeof(int));
+            }
+        }
+    #endif
+    }
+    return ret;
+#endif
+}
+
+/*
+    Send data to one address as consecutive datagrams of segment_size
+    bytes (the last one may be shorter). With UDP GSO the kernel gets
+    the whole run in one sendmsg and splits it as late as possible,
+    often in the NIC, so a run of N datagrams costs one trip through
+    the stack instead of N. Without it, or if the route refuses it,
+    the run is split here and goes out through socket_send_batch.
+
+    Returns the number of datagrams sent, -1 if none were.
+ */
+int socket_send_segmented(socket_handle sockfd, const SocketAddress *address, 
+                          const void *data, int length, int segment_size)
+{
+    if (sockfd < 0 || address == NULL || data == NULL || length <= 0) {
+        return 0;
+    }
+
+    if (segment_size <= 0 || length <= segment_size) {
+        return (socket_send_to(sockfd, address, data, length) < 0) ? -1 : 1;
+    }
+
+    const char *bytes = (const char *)data;
+    int sent_bytes = 0;
+    int sent = 0;
+
+#if !defined(_WIN32) && defined(UDP_SEGMENT)
+    // one GSO send is capped at 64 segments and one IP datagram worth of payload
+    int per_send = 65000 / segment_size;
+    if (per_send > SOCKET_UDP_MAX_SEGMENTS) per_send = SOCKET_UDP_MAX_SEGMENTS;
+
+    struct sockaddr_in addr_in;
+    socket_fill_sockaddr(&addr_in, address);
+
+    while (per_send > 1 && sent_bytes < length) 
+    {
+        int chunk = length - sent_bytes;
+        if (chunk > per_send * segment_size) chunk = per_send * segment_size;
+
+        struct iovec iov = { (void *)(bytes + sent_bytes), (size_t)chunk };
+        socket_cmsg_t control;
+        memset(&control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name       = &addr_in;
+        msg.msg_namelen    = sizeof(addr_in);
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type  = UDP_SEGMENT;
+        cm->cmsg_len   = CMSG_LEN(sizeof(uint16_t));
+        uint16_t gso_size = (uint16_t)segment_size;
+        memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+        ssize_t ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+
+        if (ret < 0) 
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return (sent > 0) ? sent : -1;
+            }
+            // no GSO on this kernel / route, do the rest the slow way
+            break;
+        }
+
+        sent_bytes += chunk;
+        sent += (chunk + segment_size - 1) / segment_size;
+    }
+#endif
+
+    socket_datagram_t batch[SOCKET_UDP_BATCH];
+
+    while (sent_bytes < length) 
+    {
+        int n = 0;
+        int batch_bytes = 0;
+
+        while (n < SOCKET_UDP_BATCH && sent_bytes + batch_bytes < length) 
+        {
+            int len = length - sent_bytes - batch_bytes;
+            if (len > segment_size) len = segment_size;
+
+            batch[n].address = *address;
+            batch[n].data = (void *)(bytes + sent_bytes + batch_bytes);
+            batch[n].length = len;
+            batch[n].segment_size = 0;
+
+            batch_bytes += len;
+            n++;
+        }
+
+        int ret = socket_send_batch(sockfd, batch, n);
+        if (ret <= 0) {
+            break;
+        }
+
+        sent += ret;
+        sent_bytes += (ret == n) ? batch_bytes : ret * segment_size;
+
+        if (ret < n) {
+            break;
+        }
+    }
+    return (sent > 0) ? sent : -1;
+}
+
 int socket_send(socket_handle sockfd, const void *data, size_t length) 
 {
     if (sockfd < 0 || length == 0 || data == NULL) {
@@ -970,6 +1322,20 @@ void socket_set_opt_tcp_quick_ack(socket_handle sockfd, int on)
 #endif
 }
 
+// holds partial segments back until uncorked, so several writes leave as full ones
+void socket_set_opt_tcp_cork(socket_handle sockfd, int on)
+{
+#ifdef _WIN32
+    (void)sockfd;
+    (void)on;
+#else
+    int cork = on ? 1 : 0;
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork)) < 0) {
+        fprintf(stderr, "setsockopt error : socket_set_opt_tcp_cork %s\n", strerror(errno));
+    }
+#endif
+}
+
 void socket_set_opt_linger(socket_handle sockfd)
 {
 #ifdef _WIN32
@@ -1012,3 +1378,51 @@ void socket_set_opt_sndbuf(socket_handle sockfd, int bufsize)
 #endif
 
 }
+
+void socket_set_opt_broadcast(socket_handle sockfd, int on)
+{
+#ifdef _WIN32
+    BOOL optval = on ? TRUE : FALSE;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, (const char*)&optval, sizeof(optval)) == SOCKET_ERROR) {
+        fprintf(stderr, "setsockopt error: socket_set_opt_broadcast %d\n", WSAGetLastError());
+    }
+#else
+    int optval = on ? 1 : 0;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_BROADCAST, &optval, sizeof(optval)) < 0) {
+        fprintf(stderr, "setsockopt error : socket_set_opt_broadcast %s\n", strerror(errno));
+    }
+#endif
+}
+
+/*
+    Let the kernel hand several datagrams from the same sender to one
+    recvmmsg slot, socket_recv_batch reports them through segment_size.
+    Slots need room for a coalesced run (up to 64KB) when this is on.
+ */
+int socket_set_opt_udp_gro(socket_handle sockfd, int on)
+{
+#if !defined(_WIN32) && defined(UDP_GRO)
+    int optval = on ? 1 : 0;
+    if (setsockopt(sockfd, SOL_UDP, UDP_GRO, &optval, sizeof(optval)) < 0) {
+        fprintf(stderr, "setsockopt error : socket_set_opt_udp_gro %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+#else
+    (void)sockfd;
+    (void)on;
+    return -1;
+#endif
+}
+
+bool socket_udp_gso_supported(socket_handle sockfd)
+{
+#if !defined(_WIN32) && defined(UDP_SEGMENT)
+    int optval = 0;
+    socklen_t optlen = sizeof(optval);
+    return getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &optval, &optlen) == 0;
+#else
+    (void)sockfd;
+    return false;
+#endif
+}
@@ -0,0 +1,281 @@
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/*
+    Hashed timer wheel (Varghese & Lauck)
+
+    Time is cut into ticks of TIMER_WHEEL_TICK_MS, each tick maps to
+    one slot of the wheel (tick & (SLOTS - 1)), every slot is a doubly
+    linked list of the timers that fall in it.
+
+    - scheduling / cancelling is O(1) unlink + link
+    - advancing only visits the slots between the last tick and now
+      and only touches the timers sitting in them, so the cost is
+      proportional to what actually expires instead of to the number
+      of timers alive.
+
+    Deadlines further than one revolution away just stay in their slot
+    and get skipped until their round comes, with idle timeouts shorter
+    than a revolution that never happens.
+ */
+
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+
+uint64_t timer_now_ms(void)
+{
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+#endif
+}
+
+static inline void slot_mark(timer_wheel_t *tw, size_t slot)
+{
+    tw->occupied[slot >> 6] |= (1ull << (slot & 63));
+}
+
+static inline void slot_unmark_if_empty(timer_wheel_t *tw, size_t slot)
+{
+    timer_node_t *head = &tw->slots[slot];
+    if (head->next == head) {
+        tw->occupied[slot >> 6] &= ~(1ull << (slot & 63));
+    }
+}
+
+static inline int count_trailing_zeros(uint64_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return (int)idx;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline void node_unlink(timer_node_t *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = node->prev = node;
+}
+
+void timer_wheel_init(timer_wheel_t *tw, uint64_t now_ms)
+{
+    for (size_t i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        tw->slots[i].next = &tw->slots[i];
+        tw->slots[i].prev = &tw->slots[i];
+        tw->slots[i].armed = false;
+    }
+    memset(tw->occupied, 0, sizeof(tw->occupied));
+
+    tw->current_tick = now_ms / TIMER_WHEEL_TICK_MS;
+    tw->count = 0;
+}
+
+void timer_node_init(timer_node_t *node, timer_expire_cb on_expire, void *user_data)
+{
+    node->next = node->prev = node;
+    node->deadline_ms = 0;
+    node->slot = 0;
+    node->on_expire = on_expire;
+    node->user_data = user_data;
+    node->armed = false;
+}
+
+void timer_wheel_schedule(timer_wheel_t *tw, timer_node_t *node, uint64_t deadline_ms)
+{
+    if (node->armed) {
+        timer_wheel_cancel(tw, node);
+    }
+
+    uint64_t tick = deadline_ms / TIMER_WHEEL_TICK_MS;
+
+    // already late, fire on the next advance
+    if (tick < tw->current_tick) {
+        tick = tw->current_tick;
+    }
+
+    size_t slot = (size_t)(tick & TIMER_WHEEL_MASK);
+    timer_node_t *head = &tw->slots[slot];
+
+    node->deadline_ms = deadline_ms;
+    node->slot = (uint32_t)slot;
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    node->armed = true;
+
+    slot_mark(tw, slot);
+    tw->count++;
+}
+
+void timer_wheel_cancel(timer_wheel_t *tw, timer_node_t *node)
+{
+    if (!node->armed) return;
+
+    node_unlink(node);
+    node->armed = false;
+
+    // still on the due list of an advance, no slot to update
+    if (node->slot < TIMER_WHEEL_SLOTS) {
+        slot_unmark_if_empty(tw, node->slot);
+    }
+    tw->count--;
+}
+
+/*
+    Expire everything that is due, returns how many timers fired.
+    Callbacks are free to reschedule or cancel any timer including
+    the one that fired.
+ */
+size_t timer_wheel_advance(timer_wheel_t *tw, uint64_t now_ms)
+{
+    uint64_t target_tick = now_ms / TIMER_WHEEL_TICK_MS;
+    size_t   fired = 0;
+
+    if (tw->count == 0) {
+        tw->current_tick = target_tick;
+        return 0;
+    }
+
+    // no point visiting the same slot twice if we slept for a whole revolution
+    uint64_t first_tick = tw->current_tick;
+    if (target_tick - first_tick >= TIMER_WHEEL_SLOTS) {
+        first_tick = target_tick - TIMER_WHEEL_SLOTS + 1;
+    }
+
+    for (uint64_t tick = first_tick; tick <= target_tick && tw->count > 0; tick++)
+    {
+        size_t slot = (size_t)(tick & TIMER_WHEEL_MASK);
+        timer_node_t *head = &tw->slots[slot];
+
+        /*
+            detach the due timers first so callbacks can
+            safely reschedule into this very slot. They stay
+            armed until they fire, a callback cancelling one
+            of the others (two timers of one connection) takes
+            it off the due list instead of leaving it to fire
+         */
+        timer_node_t due = { .next = &due, .prev = &due };
+
+        timer_node_t *node = head->next;
+        while (node != head)
+        {
+            timer_node_t *next = node->next;
+            if (node->deadline_ms <= now_ms)
+            {
+                node_unlink(node);
+                node->prev = due.prev;
+                node->next = &due;
+                due.prev->next = node;
+                due.prev = node;
+                node->slot = TIMER_WHEEL_SLOTS;
+            }
+            node = next;
+        }
+
+        slot_unmark_if_empty(tw, slot);
+
+        while (due.next != &due)
+        {
+            node = due.next;
+            node_unlink(node);
+            node->armed = false;
+            tw->count--;
+            fired++;
+            if (node->on_expire) {
+                node->on_expire(node->user_data, node);
+            }
+        }
+    }
+
+    // stay on the target tick, timers later in the same tick are still pending
+    tw->current_tick = target_tick;
+
+    return fired;
+}
+
+/*
+    How long can the poller sleep before the wheel needs attention,
+    returns max_ms when nothing is scheduled (max_ms < 0 means forever)
+ */
+int timer_wheel_next_timeout(timer_wheel_t *tw, uint64_t now_ms, int max_ms)
+{
+    if (tw->count == 0) {
+        return max_ms;
+    }
+
+    size_t start = (size_t)(tw->current_tick & TIMER_WHEEL_MASK);
+    size_t words = TIMER_WHEEL_SLOTS / 64;
+    size_t dist  = TIMER_WHEEL_SLOTS;
+
+    // find the first occupied slot at or after the current one
+    for (size_t i = 0; i <= words; i++)
+    {
+        size_t   word_idx = ((start >> 6) + i) % words;
+        uint64_t bits     = tw->occupied[word_idx];
+
+        if (i == 0) {
+            bits &= ~0ull << (start & 63);
+        } else if (i == words) {
+            // wrapped back to the starting word, only the bits before start are left
+            bits &= (start & 63) ? ((1ull << (start & 63)) - 1) : 0;
+        }
+
+        if (bits)
+        {
+            size_t slot = word_idx * 64 + (size_t)count_trailing_zeros(bits);
+            dist = (slot - start) & TIMER_WHEEL_MASK;
+            break;
+        }
+    }
+
+    uint64_t wake_ms;
+
+    if (dist == 0)
+    {
+        /*
+            the current slot still has timers, either later in this tick
+            or in a future round, so check the slot itself and otherwise
+            just come back on the next tick boundary
+         */
+        timer_node_t *head = &tw->slots[start];
+        for (timer_node_t *node = head->next; node != head; node = node->next) {
+            if (node->deadline_ms <= now_ms) {
+                return 0;
+            }
+        }
+        wake_ms = (tw->current_tick + 1) * TIMER_WHEEL_TICK_MS;
+    }
+    else if (dist < TIMER_WHEEL_SLOTS)
+    {
+        wake_ms = (tw->current_tick + dist) * TIMER_WHEEL_TICK_MS;
+    }
+    else
+    {
+        return max_ms;
+    }
+
+    uint64_t timeout = (wake_ms > now_ms) ? (wake_ms - now_ms) : 0;
+
+    if (max_ms >= 0 && timeout > (uint64_t)max_ms) {
+        return max_ms;
+    }
+
+    return (int)timeout;
+}
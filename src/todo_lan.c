@@ -0,0 +1,445 @@
+#include "todo_lan.h"
+#include "todo_proto.h"
+
+#ifndef _WIN32
+
+#include "../external/include/stb_ds.h"
+
+/*
+    Everything that goes out during one batch of server work is queued
+    and leaves with todo_lan_flush, so a burst of changes is one
+    sendmmsg (or one GSO send) instead of a sendto per change. The
+    receive side drains up to TODO_LAN_RECV_SLOTS datagrams per
+    recvmmsg, with GRO on a slot may carry a whole run from one sender.
+ */
+
+/* -------------------- Sending -------------------- */
+
+// caller holds lan->lock
+static void lan_queue(todo_lan_t *lan, todo_lan_kind kind, const char *payload, size_t len)
+{
+    proto_put_u32(&lan->out, TODO_LAN_MAGIC);
+    proto_put_u32(&lan->out, lan->node);
+    proto_put_u8(&lan->out, (uint8_t)kind);
+    proto_put_u16(&lan->out, (uint16_t)len);
+
+    size_t at = arrlenu(lan->out);
+    arrsetlen(lan->out, at + len);
+    memcpy(lan->out + at, payload, len);
+
+    arrput(lan->out_lengths, (int)(TODO_LAN_HEADER_SIZE + len));
+}
+
+// caller holds lan->lock
+static uint64_t *lan_seq(todo_lan_t *lan, uint32_t list_id)
+{
+    while (arrlenu(lan->seqs) <= list_id) {
+        arrput(lan->seqs, 0);
+    }
+    return &lan->seqs[list_id];
+}
+
+void todo_lan_queue_delta(todo_lan_t *lan, uint32_t list_id, const char *frame, size_t len)
+{
+    if (!lan || !frame) return;
+
+    char *payload = NULL;
+
+    mutex_lock(&lan->lock);
+    {
+        uint64_t seq = ++*lan_seq(lan, list_id);
+
+        // too big for one datagram, peers see the gap in our next presence
+        if (TODO_LAN_HEADER_SIZE + 12 + len <= TODO_LAN_MAX_DATAGRAM)
+        {
+            proto_put_u32(&payload, list_id);
+            proto_put_u64(&payload, seq);
+            arrsetlen(payload, 12 + len);
+            memcpy(payload + 12, frame, len);
+
+            lan_queue(lan, TODO_LAN_DELTA, payload, arrlenu(payload));
+        }
+    }
+    mutex_unlock(&lan->lock);
+
+    arrfree(payload);
+}
+
+static void lan_send_run(todo_lan_t *lan, int first, int count, size_t offset)
+{
+    socket_datagram_t batch[SOCKET_UDP_BATCH];
+
+    for (int i = 0; i < count; i++)
+    {
+        batch[i].address = lan->target;
+        batch[i].data = lan->out + offset;
+        batch[i].length = lan->out_lengths[first + i];
+        batch[i].segment_size = 0;
+        offset += (size_t)batch[i].length;
+    }
+
+    int sent = socket_send_batch(socket_get_handle(&lan->sock), batch, count);
+    if (sent > 0) {
+        lan->datagrams_out += (uint64_t)sent;
+    }
+}
+
+/*
+    Datagrams of about the same size are padded to the largest one and
+    go out as a single GSO send, the kernel cuts them apart again. The
+    padding is wasted bandwidth so that only happens while it stays
+    under a quarter, otherwise it is plain sendmmsg. Whatever the
+    socket has no room for is dropped, UDP would lose it just the same.
+ */
+void todo_lan_flush(todo_lan_t *lan)
+{
+    if (!lan) return;
+
+    mutex_lock(&lan->lock);
+
+    int count = (int)arrlen(lan->out_lengths);
+    if (count == 0) {
+        mutex_unlock(&lan->lock);
+        return;
+    }
+
+    int    max_len = 0;
+    size_t total   = 0;
+    for (int i = 0; i < count; i++) {
+        if (lan->out_lengths[i] > max_len) max_len = lan->out_lengths[i];
+        total += (size_t)lan->out_lengths[i];
+    }
+
+    if (lan->gso && count > 1 && (size_t)max_len * (size_t)count <= total + total / 4)
+    {
+        arrsetlen(lan->gso_buf, (size_t)max_len * (size_t)count);
+        memset(lan->gso_buf, 0, arrlenu(lan->gso_buf));
+
+        size_t offset = 0;
+        for (int i = 0; i < count; i++) {
+            memcpy(lan->gso_buf + (size_t)i * (size_t)max_len, lan->out + offset, (size_t)lan->out_lengths[i]);
+            offset += (size_t)lan->out_lengths[i];
+        }
+
+        int sent = socket_send_segmented(socket_get_handle(&lan->sock), &lan->target,
+                                         lan->gso_buf, (int)arrlenu(lan->gso_buf), max_len);
+        if (sent > 0) {
+            lan->datagrams_out += (uint64_t)sent;
+        }
+    }
+    else
+    {
+        size_t offset = 0;
+        for (int first = 0; first < count; first += SOCKET_UDP_BATCH)
+        {
+            int n = count - first;
+            if (n > SOCKET_UDP_BATCH) n = SOCKET_UDP_BATCH;
+
+            lan_send_run(lan, first, n, offset);
+            for (int i = 0; i < n; i++) {
+                offset += (size_t)lan->out_lengths[first + i];
+            }
+        }
+    }
+
+    arrsetlen(lan->out, 0);
+    arrsetlen(lan->out_lengths, 0);
+
+    mutex_unlock(&lan->lock);
+}
+
+static void lan_send_presence(todo_lan_t *lan)
+{
+    char *payload = NULL;
+
+    mutex_lock(&lan->lock);
+    {
+        uint32_t count = (uint32_t)arrlenu(lan->seqs);
+        uint32_t room  = (TODO_LAN_MAX_DATAGRAM - TODO_LAN_HEADER_SIZE - 6) / 8;
+        if (count > room) count = room;
+
+        proto_put_u16(&payload, lan->tcp_port);
+        proto_put_u32(&payload, count);
+        for (uint32_t i = 0; i < count; i++) {
+            proto_put_u64(&payload, lan->seqs[i]);
+        }
+        lan_queue(lan, TODO_LAN_PRESENCE, payload, arrlenu(payload));
+    }
+    mutex_unlock(&lan->lock);
+
+    arrfree(payload);
+    todo_lan_flush(lan);
+}
+
+/* -------------------- Receiving -------------------- */
+
+static todo_lan_peer_t *lan_get_peer(todo_lan_t *lan, uint32_t node, const SocketAddress *from)
+{
+    for (size_t i = 0; i < arrlenu(lan->peers); i++) {
+        if (lan->peers[i].node == node) return &lan->peers[i];
+    }
+
+    todo_lan_peer_t peer = {0};
+    peer.node = node;
+    peer.address = *from;
+    arrput(lan->peers, peer);
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr addr = { htonl(from->ip) };
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    printf("LAN peer %08x joined (%s:%u)\n", node, ip, from->port);
+
+    return &arrlast(lan->peers);
+}
+
+/*
+    delivered: seq itself just arrived, only what lies between the
+    last one and it went missing. The first seq heard of for a list
+    is where we start following it, nothing before counts as lost.
+ */
+static void lan_peer_saw_seq(todo_lan_peer_t *peer, uint32_t list_id, uint64_t seq, bool delivered)
+{
+    if (list_id >= arrlenu(peer->seqs))
+    {
+        size_t old = arrlenu(peer->seqs);
+        arrsetlen(peer->seqs, list_id + 1);
+        memset(peer->seqs + old, 0, sizeof(uint64_t) * (list_id + 1 - old));
+        peer->seqs[list_id] = delivered ? seq - 1 : seq;
+    }
+
+    uint64_t last = peer->seqs[list_id];
+    if (seq <= last) return;
+
+    uint64_t lost = seq - last - (delivered ? 1 : 0);
+    if (lost > 0) {
+        peer->missed += lost;
+        printf("LAN peer %08x: missed %llu change(s) on list %u\n",
+               peer->node, (unsigned long long)lost, list_id);
+    }
+    peer->seqs[list_id] = seq;
+}
+
+static void lan_handle_datagram(todo_lan_t *lan, const SocketAddress *from, const char *data, size_t len)
+{
+    proto_reader_t r;
+    proto_reader_init(&r, data, len);
+
+    uint32_t magic  = proto_get_u32(&r);
+    uint32_t node   = proto_get_u32(&r);
+    uint8_t  kind   = proto_get_u8(&r);
+    uint16_t length = proto_get_u16(&r);
+
+    if (r.error || magic != TODO_LAN_MAGIC || length > len - TODO_LAN_HEADER_SIZE) return;
+
+    // our own broadcast coming back
+    if (node == lan->node) return;
+
+    lan->datagrams_in++;
+
+    todo_lan_peer_t *peer = lan_get_peer(lan, node, from);
+    peer->address = *from;
+    peer->last_seen_ms = lan->ep->now_ms;
+
+    proto_reader_init(&r, data + TODO_LAN_HEADER_SIZE, length);
+
+    switch (kind)
+    {
+        case TODO_LAN_PRESENCE:
+        {
+            peer->tcp_port = proto_get_u16(&r);
+            uint32_t count = proto_get_u32(&r);
+
+            for (uint32_t i = 0; i < count; i++) {
+                uint64_t seq = proto_get_u64(&r);
+                if (r.error) break;
+                lan_peer_saw_seq(peer, i, seq, false);
+            }
+        } break;
+
+        case TODO_LAN_DELTA:
+        {
+            uint32_t list_id = proto_get_u32(&r);
+            uint64_t seq     = proto_get_u64(&r);
+            if (r.error) break;
+
+            lan_peer_saw_seq(peer, list_id, seq, true);
+
+            if (lan->on_delta) {
+                lan->on_delta(lan->user_data, peer, r.p, (size_t)(r.end - r.p));
+            }
+        } break;
+
+        default: break;
+    }
+}
+
+static void lan_on_ready(void *user_data, socket_handle fd)
+{
+    todo_lan_t *lan = (todo_lan_t *)user_data;
+    socket_datagram_t batch[TODO_LAN_RECV_SLOTS];
+
+    for (;;)
+    {
+        for (int i = 0; i < TODO_LAN_RECV_SLOTS; i++) {
+            batch[i].data = lan->slots + (size_t)i * (size_t)lan->slot_size;
+            batch[i].length = lan->slot_size;
+        }
+
+        int n = socket_recv_batch(fd, batch, TODO_LAN_RECV_SLOTS);
+        if (n <= 0) break;
+
+        for (int i = 0; i < n; i++)
+        {
+            const char *p   = (const char *)batch[i].data;
+            size_t     left = (size_t)batch[i].length;
+
+            // GRO glued several datagrams together, each segment is one of them
+            size_t step = batch[i].segment_size > 0 ? (size_t)batch[i].segment_size : left;
+
+            while (left > 0) {
+                size_t len = left < step ? left : step;
+                lan_handle_datagram(lan, &batch[i].address, p, len);
+                p += len;
+                left -= len;
+            }
+        }
+
+        // level triggered, a short batch means the queue is empty, skip the EAGAIN round trip
+        if (n < TODO_LAN_RECV_SLOTS) break;
+    }
+}
+
+static void lan_expire_peers(todo_lan_t *lan)
+{
+    for (size_t i = 0; i < arrlenu(lan->peers); )
+    {
+        todo_lan_peer_t *peer = &lan->peers[i];
+
+        if (lan->ep->now_ms - peer->last_seen_ms > TODO_LAN_PEER_TIMEOUT_MS) {
+            printf("LAN peer %08x left\n", peer->node);
+            arrfree(peer->seqs);
+            arrdelswap(lan->peers, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void lan_on_presence_timer(void *user_data, timer_node_t *node)
+{
+    todo_lan_t *lan = (todo_lan_t *)user_data;
+
+    lan_send_presence(lan);
+    lan_expire_peers(lan);
+
+    timer_wheel_schedule(&lan->ep->timers, node, lan->ep->now_ms + TODO_LAN_PRESENCE_MS);
+}
+
+/* -------------------- Lifetime -------------------- */
+
+/*
+    port is the UDP port to bind, datagrams go to target_ip:target_port
+    (defaults 255.255.255.255 and port). Two instances on one host can
+    point at each other's port through 127.0.0.1 instead.
+ */
+todo_lan_t *todo_lan_create(event_poll_t *ep, const char *port, const char *target_ip, const char *target_port,
+                            uint16_t tcp_port, size_t list_count, todo_lan_delta_cb on_delta, void *user_data)
+{
+    if (!ep) return NULL;
+
+    todo_lan_t *lan = calloc(1, sizeof(todo_lan_t));
+    if (!lan) {
+        fprintf(stderr, "todo_lan_create: Failed to allocate todo_lan_t\n");
+        return NULL;
+    }
+
+    if (!port) port = TODO_LAN_PORT;
+
+    if (socket_udp_socket(&lan->sock, NULL, port) < 0) {
+        free(lan);
+        return NULL;
+    }
+    socket_handle fd = socket_get_handle(&lan->sock);
+    socket_set_opt_broadcast(fd, 1);
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, target_ip ? target_ip : "255.255.255.255", &addr) != 1) {
+        fprintf(stderr, "todo_lan_create: bad target address %s\n", target_ip);
+        socket_close(&lan->sock);
+        free(lan);
+        return NULL;
+    }
+    lan->target.ip   = ntohl(addr.s_addr);
+    lan->target.port = (uint16_t)atoi(target_port ? target_port : port);
+
+    lan->ep        = ep;
+    lan->tcp_port  = tcp_port;
+    lan->on_delta  = on_delta;
+    lan->user_data = user_data;
+
+    // only has to differ between instances that hear each other
+    uint64_t seed = timer_now_ms() ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)lan;
+    seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+    seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+    lan->node = (uint32_t)(seed ^ (seed >> 31)) | 1u;
+
+    lan->gso = socket_udp_gso_supported(fd);
+    lan->gro = socket_set_opt_udp_gro(fd, 1) == 0;
+
+    lan->slot_size = lan->gro ? TODO_LAN_GRO_SLOT_SIZE : 2048;
+    lan->slots = malloc((size_t)lan->slot_size * TODO_LAN_RECV_SLOTS);
+    if (!lan->slots) {
+        fprintf(stderr, "todo_lan_create: Failed to allocate receive slots\n");
+        socket_close(&lan->sock);
+        free(lan);
+        return NULL;
+    }
+
+    arrsetlen(lan->seqs, list_count);
+    if (list_count) memset(lan->seqs, 0, sizeof(uint64_t) * list_count);
+
+    mutex_init(&lan->lock);
+
+    if (!event_poll_watch(ep, fd, lan_on_ready, lan)) {
+        todo_lan_destroy(lan);
+        return NULL;
+    }
+
+    // first presence right away so peers learn about us on startup
+    timer_node_init(&lan->presence_timer, lan_on_presence_timer, lan);
+    timer_wheel_schedule(&ep->timers, &lan->presence_timer, timer_now_ms());
+
+    char ip[INET_ADDRSTRLEN];
+    struct in_addr target = { htonl(lan->target.ip) };
+    inet_ntop(AF_INET, &target, ip, sizeof(ip));
+    printf("LAN sync on udp %s -> %s:%u (node %08x, gso %s, gro %s)\n",
+           port, ip, lan->target.port, lan->node, lan->gso ? "on" : "off", lan->gro ? "on" : "off");
+
+    return lan;
+}
+
+/*
+    The watch and the presence timer belong to the poller,
+    destroy the poller first
+ */
+void todo_lan_destroy(todo_lan_t *lan)
+{
+    if (!lan) return;
+
+    socket_close(&lan->sock);
+
+    for (size_t i = 0; i < arrlenu(lan->peers); i++) {
+        arrfree(lan->peers[i].seqs);
+    }
+    arrfree(lan->peers);
+    arrfree(lan->out);
+    arrfree(lan->out_lengths);
+    arrfree(lan->gso_buf);
+    arrfree(lan->seqs);
+    free(lan->slots);
+
+    mutex_destroy(&lan->lock);
+    free(lan);
+}
+
+#endif
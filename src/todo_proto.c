@@ -0,0 +1,219 @@
+#include "todo_proto.h"
+
+#include <string.h>
+
+#include "../external/include/stb_ds.h"
+
+/* -------------------- Writing -------------------- */
+
+static void proto_put_bytes(char **buf, const void *data, size_t len)
+{
+    size_t at = arrlenu(*buf);
+    arrsetlen(*buf, at + len);
+    memcpy(*buf + at, data, len);
+}
+
+void proto_put_u8(char **buf, uint8_t v)
+{
+    arrput(*buf, (char)v);
+}
+
+void proto_put_u16(char **buf, uint16_t v)
+{
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    proto_put_bytes(buf, b, sizeof(b));
+}
+
+void proto_put_u32(char **buf, uint32_t v)
+{
+    uint8_t b[4];
+    for (int i = 0; i < 4; i++) b[i] = (uint8_t)(v >> (8 * i));
+    proto_put_bytes(buf, b, sizeof(b));
+}
+
+void proto_put_u64(char **buf, uint64_t v)
+{
+    uint8_t b[8];
+    for (int i = 0; i < 8; i++) b[i] = (uint8_t)(v >> (8 * i));
+    proto_put_bytes(buf, b, sizeof(b));
+}
+
+void proto_put_str(char **buf, const char *str, size_t len)
+{
+    if (len > UINT16_MAX) len = UINT16_MAX;
+    proto_put_u16(buf, (uint16_t)len);
+    proto_put_bytes(buf, str, len);
+}
+
+void proto_put_item(char **buf, const todo_item *item)
+{
+    proto_put_u64(buf, (uint64_t)(int64_t)item->created);
+    proto_put_u64(buf, (uint64_t)(int64_t)item->deadline);
+    proto_put_u32(buf, (uint32_t)item->priority);
+    proto_put_u8(buf, item->completed ? 1 : 0);
+    proto_put_str(buf, item->todo, strnlen(item->todo, MAX_TODO_SIZE));
+    proto_put_str(buf, item->note, strnlen(item->note, MAX_NOTE_SIZE));
+}
+
+size_t proto_begin_frame(char **buf, uint8_t type)
+{
+    size_t start = arrlenu(*buf);
+    proto_put_u32(buf, 0);      // patched by proto_end_frame
+    proto_put_u8(buf, type);
+    return start;
+}
+
+void proto_end_frame(char **buf, size_t frame_start)
+{
+    proto_end_frame_ex(buf, frame_start, 0);
+}
+
+// trailing bytes belong to the frame but are sent from somewhere else right after it
+void proto_end_frame_ex(char **buf, size_t frame_start, uint64_t trailing)
+{
+    uint32_t len = (uint32_t)(arrlenu(*buf) - frame_start - 4 + trailing);
+    uint8_t *p = (uint8_t *)*buf + frame_start;
+
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(len >> (8 * i));
+}
+
+/* -------------------- Reading -------------------- */
+
+void proto_reader_init(proto_reader_t *r, const char *data, size_t len)
+{
+    r->p = data;
+    r->end = data + len;
+    r->error = false;
+}
+
+static const uint8_t *proto_take(proto_reader_t *r, size_t n)
+{
+    if (r->error || (size_t)(r->end - r->p) < n) {
+        r->error = true;
+        return NULL;
+    }
+    const uint8_t *at = (const uint8_t *)r->p;
+    r->p += n;
+    return at;
+}
+
+uint8_t proto_get_u8(proto_reader_t *r)
+{
+    const uint8_t *b = proto_take(r, 1);
+    return b ? b[0] : 0;
+}
+
+uint16_t proto_get_u16(proto_reader_t *r)
+{
+    const uint8_t *b = proto_take(r, 2);
+    return b ? (uint16_t)(b[0] | (b[1] << 8)) : 0;
+}
+
+uint32_t proto_get_u32(proto_reader_t *r)
+{
+    const uint8_t *b = proto_take(r, 4);
+    if (!b) return 0;
+
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)b[i] << (8 * i);
+    return v;
+}
+
+uint64_t proto_get_u64(proto_reader_t *r)
+{
+    const uint8_t *b = proto_take(r, 8);
+    if (!b) return 0;
+
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)b[i] << (8 * i);
+    return v;
+}
+
+/*
+    Copies at most out_size - 1 bytes and always terminates,
+    the rest of an oversized string is skipped
+ */
+size_t proto_get_str(proto_reader_t *r, char *out, size_t out_size)
+{
+    uint16_t len = proto_get_u16(r);
+    const uint8_t *b = proto_take(r, len);
+
+    if (!b) {
+        if (out_size) out[0] = '\0';
+        return 0;
+    }
+
+    size_t n = (len < out_size) ? len : out_size - 1;
+    memcpy(out, b, n);
+    out[n] = '\0';
+    return n;
+}
+
+bool proto_get_item(proto_reader_t *r, todo_item *item)
+{
+    item->created   = (time_t)(int64_t)proto_get_u64(r);
+    item->deadline  = (time_t)(int64_t)proto_get_u64(r);
+    item->priority  = (i32)proto_get_u32(r);
+    item->completed = proto_get_u8(r) != 0;
+    item->tags      = NULL;
+    proto_get_str(r, item->todo, sizeof(item->todo));
+    proto_get_str(r, item->note, sizeof(item->note));
+
+    return !r->error;
+}
+
+int64_t proto_frame_size(const char *data, size_t len)
+{
+    if (len < TODO_PROTO_HEADER_SIZE) return 0;
+
+    const uint8_t *b = (const uint8_t *)data;
+    uint32_t body = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+
+    if (body == 0 || body > TODO_PROTO_MAX_FRAME) return -1;
+    if (len - 4 < body) return 0;
+
+    return (int64_t)body + 4;
+}
+
+/* -------------------- Compression -------------------- */
+
+bool proto_pack_frame(char **buf, lz_ctx_t *ctx, const char *frame, size_t len)
+{
+    size_t start = proto_begin_frame(buf, TODO_MSG_PACKED);
+    proto_put_u32(buf, (uint32_t)len);
+
+    size_t at  = arrlenu(*buf);
+    size_t cap = LZ_BOUND(len);
+    arrsetlen(*buf, at + cap);
+
+    size_t n = lz_compress(ctx, frame, len, *buf + at, cap);
+    if (n == 0 || at + n - start >= len) {
+        arrsetlen(*buf, start);
+        return false;
+    }
+    arrsetlen(*buf, at + n);
+    proto_end_frame(buf, start);
+    return true;
+}
+
+int64_t proto_unpack_frame(char **out, const char *body, size_t len)
+{
+    proto_reader_t r;
+    proto_reader_init(&r, body, len);
+
+    uint32_t size = proto_get_u32(&r);
+    if (r.error || size < TODO_PROTO_HEADER_SIZE || size > TODO_PROTO_MAX_FRAME + 4) {
+        return -1;
+    }
+
+    size_t at = arrlenu(*out);
+    arrsetlen(*out, at + size);
+
+    // has to come out as exactly one frame of exactly that size
+    int64_t n = lz_decompress(r.p, (size_t)(r.end - r.p), *out + at, size);
+    if (n != (int64_t)size || proto_frame_size(*out + at, size) != (int64_t)size) {
+        arrsetlen(*out, at);
+        return -1;
+    }
+    return n;
+}
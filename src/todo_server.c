@@ -0,0 +1,2295 @@
+#include "todo_server.h"
+#include "util.h"
+
+#ifndef _WIN32
+
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+
+#include "../external/include/stb_ds.h"
+
+/*
+    Todo server
+
+    Speaks todo_proto.h over event_poll. Mutations go to main_list and
+    are fanned out to every connection subscribed to that list:
+
+    - a change is encoded ONCE into a refcounted todo_buf_t and the same
+      buffer is queued to every subscriber, nothing is copied per client
+    - every connection owns an output queue flushed with one sendmsg
+      (iovec per queued buffer) once per loop wakeup, after everything
+      that came in with it has been handled
+    - a subscriber that can't keep up is bounded to max_lag_bytes of
+      queued deltas, past that its deltas are dropped and once the queue
+      drains it gets a fresh snapshot of its lists instead (resync), so
+      a slow reader costs memory proportional to the limit not to the
+      write rate of everyone else
+    - snapshots are encoded once per list version, big ones spooled to
+      an unlinked file and sent with sendfile, a client that lost one
+      part way resumes it by offset with FETCH
+    - with todo_server_enable_lan our own changes are also broadcast to
+      other instances on the LAN and theirs are applied here (todo_lan.h)
+    - with todo_server_enable_shm local clients talk to us through shared
+      memory rings (shm_ring.h), same frames, same queues, only the
+      write at the end of server_flush goes to the ring
+    - every applied change also lands in a journal that FOLLOW
+      connections are fed from, another instance started with
+      todo_server_follow tails it, applies it in batches and serves
+      the read traffic (todo_proto.h)
+    - a connection that sent COMPRESS gets big frames PACKED, each
+      shared buffer is compressed once no matter how many compressing
+      connections it goes to
+    - HTTP/1.1 clients are served JSON on the same port, keep-alive and
+      pipelined, told apart by their first bytes (http.h)
+ */
+
+/* -------------------- Shared buffers -------------------- */
+
+todo_buf_t *todo_buf_create(const char *data, size_t len)
+{
+    todo_buf_t *buf = malloc(sizeof(todo_buf_t) + len);
+    if (!buf) {
+        fprintf(stderr, "todo_buf_create: Failed to allocate %zu bytes\n", len);
+        return NULL;
+    }
+    buf->refs = 1;
+    buf->len = (uint32_t)len;
+    buf->packed = NULL;
+    buf->pack_tried = false;
+    memcpy(buf->data, data, len);
+    return buf;
+}
+
+todo_buf_t *todo_buf_retain(todo_buf_t *buf)
+{
+    buf->refs++;
+    return buf;
+}
+
+void todo_buf_release(todo_buf_t *buf)
+{
+    if (buf && --buf->refs == 0) {
+        todo_buf_release(buf->packed);
+        free(buf);
+    }
+}
+
+/* -------------------- Snapshots -------------------- */
+
+static void server_snapshot_release(todo_snapshot_t *snap)
+{
+    if (!snap || --snap->refs > 0) return;
+
+    todo_buf_release(snap->buf);
+    todo_buf_release(snap->packed);
+    if (snap->fd >= 0) {
+        close(snap->fd);
+    }
+    free(snap);
+}
+
+/*
+    Unlinked from the start, the file is gone once the last connection
+    streaming from it lets go of the fd
+ */
+static int server_snapshot_spool(todo_server_t *server, const char *data, size_t len)
+{
+    int fd = -1;
+
+#ifdef O_TMPFILE
+    fd = open(server->snapshot_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+    if (fd < 0)
+    {
+        // no O_TMPFILE on this kernel or filesystem
+        char path[512];
+        snprintf(path, sizeof(path), "%s/todo_snapshot_XXXXXX", server->snapshot_dir);
+        fd = mkstemp(path);
+        if (fd < 0) {
+            fprintf(stderr, "todo_server: Failed to create snapshot file in %s: %s\n", server->snapshot_dir, strerror(errno));
+            return -1;
+        }
+        unlink(path);
+    }
+
+    size_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "todo_server: Failed to write snapshot file: %s\n", strerror(errno));
+            close(fd);
+            return -1;
+        }
+        written += (size_t)n;
+    }
+    return fd;
+}
+
+/*
+    The SNAPSHOT frame of a list as of now. Encoded once per seq, every
+    subscribe, resync and resume in between shares it. The feed holds
+    one reference, take another to keep it past the next change.
+ */
+static todo_snapshot_t *server_get_snapshot(todo_server_t *server, uint32_t list_id)
+{
+    todo_feed_t *feed = &server->feeds[list_id];
+
+    if (feed->snapshot && feed->snapshot->seq == feed->seq) {
+        return feed->snapshot;
+    }
+
+    todo_list *list = &main_list[list_id];
+    char *frame = NULL;
+
+    size_t start = proto_begin_frame(&frame, TODO_MSG_SNAPSHOT);
+    proto_put_u32(&frame, list_id);
+    proto_put_u64(&frame, feed->seq);
+    proto_put_u32(&frame, (uint32_t)arrlenu(list->todo_items));
+    for (size_t i = 0; i < arrlenu(list->todo_items); i++) {
+        proto_put_item(&frame, &list->todo_items[i]);
+    }
+    proto_end_frame(&frame, start);
+
+    todo_snapshot_t *snap = calloc(1, sizeof(todo_snapshot_t));
+    if (!snap) {
+        fprintf(stderr, "todo_server: Failed to allocate snapshot\n");
+        arrfree(frame);
+        return NULL;
+    }
+    snap->refs = 1;
+    snap->seq  = feed->seq;
+    snap->size = arrlenu(frame);
+    snap->fd   = -1;
+
+    if (snap->size >= TODO_SERVER_SENDFILE_MIN) {
+        snap->fd = server_snapshot_spool(server, frame, arrlenu(frame));
+    }
+    // small, or the file could not be made
+    if (snap->fd < 0) {
+        snap->buf = todo_buf_create(frame, arrlenu(frame));
+    }
+    arrfree(frame);
+
+    if (snap->fd < 0 && !snap->buf) {
+        free(snap);
+        return NULL;
+    }
+
+    server_snapshot_release(feed->snapshot);
+    feed->snapshot = snap;
+    return snap;
+}
+
+/* -------------------- Compression -------------------- */
+
+// NULL when it didn't get smaller
+static todo_buf_t *server_pack(todo_server_t *server, const char *frame, size_t len)
+{
+    if (!server->lz && !(server->lz = malloc(sizeof(lz_ctx_t)))) {
+        fprintf(stderr, "todo_server: Failed to allocate the compression context\n");
+        return NULL;
+    }
+
+    char *packed = NULL;
+    todo_buf_t *buf = NULL;
+
+    if (proto_pack_frame(&packed, server->lz, frame, len)) {
+        buf = todo_buf_create(packed, arrlenu(packed));
+    }
+    arrfree(packed);
+
+    // never packed twice
+    if (buf) buf->pack_tried = true;
+    return buf;
+}
+
+static todo_buf_t *server_pack_buf(todo_server_t *server, todo_buf_t *buf)
+{
+    if (!buf->pack_tried) {
+        buf->packed = server_pack(server, buf->data, buf->len);
+        buf->pack_tried = true;
+    }
+    return buf->packed;
+}
+
+// a spooled one is read back once, its packed version is small enough to keep in memory
+static todo_buf_t *server_pack_snapshot(todo_server_t *server, todo_snapshot_t *snap)
+{
+    if (snap->buf) {
+        return server_pack_buf(server, snap->buf);
+    }
+    if (snap->pack_tried) {
+        return snap->packed;
+    }
+    snap->pack_tried = true;
+
+    char *data = malloc((size_t)snap->size);
+    if (!data) {
+        fprintf(stderr, "todo_server: Failed to allocate %llu bytes to pack a snapshot\n", (unsigned long long)snap->size);
+        return NULL;
+    }
+
+    size_t got = 0;
+    while (got < snap->size)
+    {
+        ssize_t n = pread(snap->fd, data + got, (size_t)snap->size - got, (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            fprintf(stderr, "todo_server: snapshot read failed: %s\n", strerror(errno));
+            free(data);
+            return NULL;
+        }
+        got += (size_t)n;
+    }
+
+    snap->packed = server_pack(server, data, (size_t)snap->size);
+    free(data);
+    return snap->packed;
+}
+
+// what buf goes to conn as, itself unless the connection compresses and packing paid off
+static todo_buf_t *server_packed(todo_server_t *server, todo_conn_t *conn, todo_buf_t *buf)
+{
+    if (!buf || !conn->pack_min || buf->len < conn->pack_min) {
+        return buf;
+    }
+
+    todo_buf_t *packed = server_pack_buf(server, buf);
+    if (!packed) {
+        return buf;
+    }
+
+    server->stats.packed++;
+    server->stats.packed_raw_bytes += buf->len;
+    server->stats.packed_bytes += packed->len;
+    return packed;
+}
+
+/* -------------------- Output queues -------------------- */
+
+static void server_mark_dirty(todo_server_t *server, todo_conn_t *conn);
+
+static void server_out_release(todo_out_t *entry)
+{
+    todo_buf_release(entry->buf);
+    server_snapshot_release(entry->file);
+}
+
+/*
+    A client that doesn't read its replies doesn't get to send more
+    requests either, past the high watermark the loop stops reading it
+    until the queue is down to the low one. Deltas alone don't get that
+    far, max_lag_bytes resyncs first. shm clients are held back by their
+    ring already. On io_uring the ring only gets TODO_SERVER_RING_WINDOW
+    at a time, so the queue grows there just the same.
+ */
+static void server_check_watermarks(todo_server_t *server, todo_conn_t *conn)
+{
+    if (!conn->ctx) return;
+
+    if (!conn->read_paused && conn->out_bytes > server->out_high_bytes)
+    {
+        conn->read_paused = true;
+        event_poll_pause_read(server->ep, conn->ctx, true);
+    }
+    else if (conn->read_paused && conn->out_bytes <= server->out_low_bytes)
+    {
+        conn->read_paused = false;
+        event_poll_pause_read(server->ep, conn->ctx, false);
+    }
+}
+
+static void server_note_queued(todo_server_t *server, todo_conn_t *conn)
+{
+    if (conn->out_bytes > server->stats.bytes_queued_max) {
+        server->stats.bytes_queued_max = conn->out_bytes;
+    }
+    server_check_watermarks(server, conn);
+}
+
+static size_t server_drop_deltas(todo_conn_t *conn)
+{
+    size_t keep = conn->out_head;
+    size_t dropped = 0;
+
+    for (size_t i = conn->out_head; i < arrlenu(conn->out); i++)
+    {
+        todo_out_t entry = conn->out[i];
+
+        // half written frames have to finish or the stream loses its framing
+        if (entry.droppable && entry.off == 0) {
+            conn->out_bytes -= entry.len;
+            conn->delta_bytes -= entry.len;
+            server_out_release(&entry);
+            dropped++;
+        } else {
+            conn->out[keep++] = entry;
+        }
+    }
+    arrsetlen(conn->out, keep);
+    return dropped;
+}
+
+static void server_enqueue(todo_server_t *server, todo_conn_t *conn, todo_buf_t *buf, bool droppable)
+{
+    if (!buf) return;
+
+    if (droppable)
+    {
+        // a snapshot is coming anyway
+        if (conn->resync) return;
+
+        // only deltas count, a snapshot bigger than the limit must not trip it right away
+        if (conn->delta_bytes + buf->len > server->max_lag_bytes)
+        {
+            printf("Subscriber fell behind (fd: %d, %zu bytes queued), resyncing\n", conn->fd, conn->delta_bytes);
+            server->stats.deltas_dropped += server_drop_deltas(conn);
+            server->stats.resyncs++;
+            conn->resync = true;
+            server_mark_dirty(server, conn);
+            return;
+        }
+    }
+
+    todo_out_t entry = { .buf = todo_buf_retain(buf), .off = 0, .len = buf->len, .droppable = droppable };
+    arrput(conn->out, entry);
+    conn->out_bytes += buf->len;
+    if (droppable) conn->delta_bytes += buf->len;
+    server->stats.frames_out++;
+    server_note_queued(server, conn);
+
+    server_mark_dirty(server, conn);
+}
+
+static void server_enqueue_frame(todo_server_t *server, todo_conn_t *conn, char *frame)
+{
+    todo_buf_t *buf = todo_buf_create(frame, arrlenu(frame));
+
+    // a header whose payload is queued separately (CHUNK, JOURNAL) can't be packed on its own
+    bool whole = proto_frame_size(frame, arrlenu(frame)) == (int64_t)arrlenu(frame);
+
+    server_enqueue(server, conn, whole ? server_packed(server, conn, buf) : buf, false);
+    todo_buf_release(buf);
+}
+
+// snapshot bytes from offset on, a resume skips what the client already has
+static void server_enqueue_range(todo_server_t *server, todo_conn_t *conn, todo_snapshot_t *snap, uint64_t offset)
+{
+    if (offset >= snap->size) return;
+
+    todo_out_t entry = { .off = offset, .len = snap->size, .droppable = false };
+    if (snap->buf) {
+        entry.buf = todo_buf_retain(snap->buf);
+    } else {
+        entry.file = snap;
+        snap->refs++;
+    }
+    arrput(conn->out, entry);
+    conn->out_bytes += snap->size - offset;
+    server_note_queued(server, conn);
+
+    server_mark_dirty(server, conn);
+}
+
+static void server_enqueue_snapshot(todo_server_t *server, todo_conn_t *conn, uint32_t list_id)
+{
+    todo_snapshot_t *snap = server_get_snapshot(server, list_id);
+    if (!snap) return;
+
+    todo_buf_t *packed = NULL;
+    if (conn->pack_min && snap->size >= conn->pack_min) {
+        packed = server_pack_snapshot(server, snap);
+    }
+
+    if (packed) {
+        server->stats.packed++;
+        server->stats.packed_raw_bytes += snap->size;
+        server->stats.packed_bytes += packed->len;
+        server_enqueue(server, conn, packed, false);
+    } else {
+        server_enqueue_range(server, conn, snap, 0);
+        server->stats.frames_out++;
+    }
+}
+
+/*
+    The rest of a SNAPSHOT the client got part of, if it still is the
+    current one. Anything else (the list moved on, offset past the end)
+    gets the current snapshot from the top, the CHUNK header says which.
+ */
+static void server_enqueue_chunk(todo_server_t *server, todo_conn_t *conn, uint32_t list_id, uint64_t seq, uint64_t offset)
+{
+    todo_snapshot_t *snap = server_get_snapshot(server, list_id);
+    if (!snap) return;
+
+    if (seq != snap->seq || offset > snap->size) {
+        offset = 0;
+    }
+
+    char *frame = NULL;
+    size_t start = proto_begin_frame(&frame, TODO_MSG_CHUNK);
+    proto_put_u32(&frame, list_id);
+    proto_put_u64(&frame, snap->seq);
+    proto_put_u64(&frame, offset);
+    proto_put_u64(&frame, snap->size);
+    proto_end_frame_ex(&frame, start, snap->size - offset);
+
+    server_enqueue_frame(server, conn, frame);
+    server_enqueue_range(server, conn, snap, offset);
+    arrfree(frame);
+}
+
+static void server_send_error(todo_server_t *server, todo_conn_t *conn, const char *message)
+{
+    // a change from the LAN, nobody to tell
+    if (!conn) return;
+
+    char *frame = NULL;
+
+    size_t start = proto_begin_frame(&frame, TODO_MSG_ERROR);
+    proto_put_str(&frame, message, strlen(message));
+    proto_end_frame(&frame, start);
+
+    server_enqueue_frame(server, conn, frame);
+    arrfree(frame);
+}
+
+/*
+    Next batch of the journal for a follower, straight from the shared
+    buffers like deltas are. One that fell behind what the journal still
+    holds, or is new, gets every list in full first.
+ */
+static void server_enqueue_journal(todo_server_t *server, todo_conn_t *conn)
+{
+    uint64_t end = server->journal_base + arrlenu(server->journal);
+
+    if (conn->follow_reset || conn->follow_pos < server->journal_base)
+    {
+        for (uint32_t i = 0; i < (uint32_t)arrlenu(server->feeds); i++) {
+            server_enqueue_snapshot(server, conn, i);
+        }
+        conn->follow_pos = end;
+        conn->follow_reset = false;
+    }
+
+    uint64_t first = conn->follow_pos;
+    size_t   count = (size_t)(end - first);
+    if (count > TODO_SERVER_JOURNAL_BATCH) count = TODO_SERVER_JOURNAL_BATCH;
+
+    todo_buf_t **bufs  = server->journal + (first - server->journal_base);
+    uint64_t    bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        bytes += bufs[i]->len;
+    }
+
+    char *frame = NULL;
+    size_t start = proto_begin_frame(&frame, TODO_MSG_JOURNAL);
+    proto_put_u32(&frame, server->journal_epoch);
+    proto_put_u64(&frame, first);
+    proto_put_u32(&frame, (uint32_t)count);
+    proto_end_frame_ex(&frame, start, bytes);
+    server_enqueue_frame(server, conn, frame);
+    arrfree(frame);
+
+    for (size_t i = 0; i < count; i++) {
+        server_enqueue(server, conn, bufs[i], false);
+    }
+    conn->follow_pos = first + count;
+}
+
+static void server_release_queue(todo_conn_t *conn)
+{
+    for (size_t i = conn->out_head; i < arrlenu(conn->out); i++) {
+        server_out_release(&conn->out[i]);
+    }
+    arrsetlen(conn->out, 0);
+    conn->out_head = 0;
+    conn->out_bytes = 0;
+    conn->delta_bytes = 0;
+}
+
+// retire whatever n written bytes finished, the last one may be left part way
+static void server_advance_queue(todo_conn_t *conn, size_t n)
+{
+    conn->out_bytes -= n;
+
+    while (n > 0)
+    {
+        todo_out_t *entry = &conn->out[conn->out_head];
+        uint64_t remaining = entry->len - entry->off;
+
+        if (n >= remaining) {
+            n -= (size_t)remaining;
+            if (entry->droppable) conn->delta_bytes -= entry->len;
+            server_out_release(entry);
+            conn->out_head++;
+        } else {
+            entry->off += n;
+            n = 0;
+        }
+    }
+}
+
+/*
+    Bytes the ring didn't take can't be retired, the stream would lose its
+    framing part way through a reply. Nothing is sure to come back and
+    retry them either, so the connection goes, the loop sees the shutdown
+    and tears it down.
+ */
+static void server_uring_send_failed(todo_conn_t *conn, const char *what)
+{
+    fprintf(stderr, "todo_server: %s failed (fd: %d): %s\n", what, conn->fd, strerror(errno));
+    server_release_queue(conn);
+    shutdown(conn->fd, SHUT_RDWR);
+}
+
+// the ring has no sendfile, file entries are read in and copied like the rest
+static void server_flush_uring(todo_server_t *server, todo_conn_t *conn)
+{
+    todo_out_t *entry = &conn->out[conn->out_head];
+
+    if (entry->buf) {
+        int queued = event_poll_send(server->ep, conn->fd, entry->buf->data + entry->off, (size_t)(entry->len - entry->off));
+        if (queued < 0) {
+            server_uring_send_failed(conn, "io_uring send");
+            return;
+        }
+        conn->ring_bytes += (size_t)queued;
+        server_advance_queue(conn, (size_t)queued);
+        return;
+    }
+
+    char chunk[64 * 1024];
+    while (entry->off < entry->len && conn->ring_bytes < TODO_SERVER_RING_WINDOW)
+    {
+        uint64_t left = entry->len - entry->off;
+        size_t   want = left < sizeof(chunk) ? (size_t)left : sizeof(chunk);
+        ssize_t n = pread(entry->file->fd, chunk, want, (off_t)entry->off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            server_uring_send_failed(conn, "snapshot read");
+            return;
+        }
+        int queued = event_poll_send(server->ep, conn->fd, chunk, (size_t)n);
+        if (queued < 0) {
+            server_uring_send_failed(conn, "io_uring send");
+            return;
+        }
+        conn->ring_bytes += (size_t)queued;
+        // the last chunk retires the entry
+        bool last = entry->off + (uint64_t)queued == entry->len;
+        server_advance_queue(conn, (size_t)queued);
+        if (last) break;
+    }
+}
+
+// a file entry for a local client, no sendfile into a ring
+static ssize_t server_shm_send_file(todo_server_t *server, todo_conn_t *conn, todo_out_t *entry)
+{
+    char chunk[64 * 1024];
+
+    uint64_t left = entry->len - entry->off;
+    size_t   want = left < sizeof(chunk) ? (size_t)left : sizeof(chunk);
+    ssize_t  n    = pread(entry->file->fd, chunk, want, (off_t)entry->off);
+    if (n <= 0) {
+        if (n == 0) errno = EIO;
+        return -1;
+    }
+
+    // whatever didn't fit is read again next time
+    struct iovec iov = { .iov_base = chunk, .iov_len = (size_t)n };
+    return event_poll_shm_writev(server->ep, conn->fd, &iov, 1);
+}
+
+/*
+    Write as much of the queue as the socket takes. Runs of in memory
+    buffers go out with one sendmsg per TODO_SERVER_MAX_IOV of them, a
+    snapshot file with sendfile straight from the page cache. On EAGAIN
+    the loop calls back through on_writable once there is room and the
+    queue carries on where it stopped.
+
+    A write with more of the queue behind it says so, MSG_MORE on a
+    sendmsg, TCP_CORK around a sendfile (it takes no flags), so a flush
+    that needs several calls still leaves as full segments and not as a
+    short one per call. server_flush pulls the cork once it is done.
+ */
+static void server_flush_queue(todo_server_t *server, todo_conn_t *conn)
+{
+    for (;;)
+    {
+        while (conn->out_head < arrlenu(conn->out))
+        {
+            if (server->ep->backend == EVENT_BACKEND_URING && !conn->shm)
+            {
+                // the ring copies and completes on its own. A window at a time, the
+                // rest stays queued so the watermarks and max_lag_bytes see a client
+                // that doesn't read, server_on_send carries on
+                if (conn->ring_bytes >= TODO_SERVER_RING_WINDOW) {
+                    server_check_watermarks(server, conn);
+                    return;
+                }
+                server_flush_uring(server, conn);
+                continue;
+            }
+
+            todo_out_t *head = &conn->out[conn->out_head];
+            ssize_t n;
+
+            if (head->file && conn->shm)
+            {
+                n = server_shm_send_file(server, conn, head);
+            }
+            else if (head->file)
+            {
+                if (!conn->corked && conn->out_head + 1 < arrlenu(conn->out)) {
+                    socket_set_opt_tcp_cork(conn->fd, 1);
+                    conn->corked = true;
+                    server->stats.corks++;
+                }
+                off_t pos = (off_t)head->off;
+                n = sendfile(conn->fd, head->file->fd, &pos, (size_t)(head->len - head->off));
+                event_poll_note_send(server->ep, conn->ctx, n);
+            }
+            else
+            {
+                struct iovec iov[TODO_SERVER_MAX_IOV];
+                int iov_count = 0;
+                size_t next = conn->out_head;
+
+                // up to the next file entry, that one goes by sendfile
+                for (; next < arrlenu(conn->out) && iov_count < TODO_SERVER_MAX_IOV; next++) {
+                    if (conn->out[next].file) break;
+                    iov[iov_count].iov_base = conn->out[next].buf->data + conn->out[next].off;
+                    iov[iov_count].iov_len  = (size_t)(conn->out[next].len - conn->out[next].off);
+                    iov_count++;
+                }
+
+                struct msghdr msg = {0};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = (size_t)iov_count;
+
+                if (conn->shm) {
+                    n = event_poll_shm_writev(server->ep, conn->fd, iov, iov_count);
+                } else {
+                    int flags = MSG_NOSIGNAL | (next < arrlenu(conn->out) ? MSG_MORE : 0);
+                    n = sendmsg(conn->fd, &msg, flags);
+                    event_poll_note_send(server->ep, conn->ctx, n);
+                }
+            }
+
+            if (n < 0)
+            {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    event_poll_want_write(server->ep, conn->ctx, true);
+                    server_check_watermarks(server, conn);
+                    return;
+                }
+                // the loop sees the error on its own and tears the connection down
+                fprintf(stderr, "todo_server: send failed (fd: %d): %s\n", conn->fd, strerror(errno));
+                server_release_queue(conn);
+                return;
+            }
+
+            server_advance_queue(conn, (size_t)n);
+        }
+
+        // everything is out
+        arrsetlen(conn->out, 0);
+        conn->out_head = 0;
+        event_poll_want_write(server->ep, conn->ctx, false);
+        server_check_watermarks(server, conn);
+
+        // followers pull the next batch once the last one is gone
+        if (conn->follower && (conn->follow_reset || conn->follow_pos < server->journal_base + arrlenu(server->journal))) {
+            server_enqueue_journal(server, conn);
+            continue;
+        }
+
+        // the last answer is written, the FIN goes right behind it
+        if (conn->http_close && conn->ring_bytes == 0) {
+            shutdown(conn->fd, SHUT_WR);
+        }
+
+        if (!conn->resync) {
+            return;
+        }
+
+        // caught up, replace whatever deltas it missed with the current state
+        conn->resync = false;
+        for (size_t i = 0; i < arrlenu(conn->subs); i++) {
+            server_enqueue_snapshot(server, conn, conn->subs[i]);
+        }
+    }
+}
+
+/*
+    Adaptive Nagle. A flush already carries everything one wakeup
+    produced for a connection, so NODELAY is on by default and a reply
+    leaves the moment it is written. A connection that is mostly pushed
+    to instead (a subscriber getting a trickle of small deltas, one
+    flush per wakeup) would get a tiny segment for each, for those Nagle
+    goes back on and the kernel merges them while earlier ones are still
+    unacked. Decided every TODO_SERVER_NAGLE_WINDOW_MS from what the
+    connection did in the last window, one that starts asking again
+    gets NODELAY back at the end of the next.
+ */
+static void server_tune_nagle(todo_server_t *server, todo_conn_t *conn)
+{
+    uint64_t now = timer_now_ms();
+
+    conn->window_flushes++;
+    conn->window_bytes += conn->out_bytes;
+    if (now - conn->window_ms < TODO_SERVER_NAGLE_WINDOW_MS) return;
+
+    // pushed to often, in small pieces, hardly asking for any of it
+    bool stream = conn->window_flushes >= TODO_SERVER_NAGLE_FLUSHES
+               && conn->window_bytes / conn->window_flushes < TODO_SERVER_NAGLE_SMALL
+               && conn->window_frames * 2 < conn->window_flushes;
+
+    if (stream == conn->nodelay) {
+        conn->nodelay = !stream;
+        socket_set_opt_tcp_no_delay(conn->fd, conn->nodelay);
+        server->stats.nagle_toggles++;
+    }
+
+    conn->window_ms      = now;
+    conn->window_flushes = 0;
+    conn->window_frames  = 0;
+    conn->window_bytes   = 0;
+}
+
+static void server_flush(todo_server_t *server, todo_conn_t *conn)
+{
+    // shm clients have no socket to tune
+    if (conn->ctx && conn->out_head < arrlenu(conn->out)) {
+        server_tune_nagle(server, conn);
+    }
+
+    server_flush_queue(server, conn);
+
+    if (conn->corked) {
+        socket_set_opt_tcp_cork(conn->fd, 0);
+        conn->corked = false;
+    }
+}
+
+/*
+    Fan out touches many connections per request, each one is flushed
+    once per loop wakeup instead of once per frame, or per connection
+    that sent one
+ */
+static void server_mark_dirty(todo_server_t *server, todo_conn_t *conn)
+{
+    for (size_t i = 0; i < arrlenu(server->dirty); i++) {
+        if (server->dirty[i] == conn) return;
+    }
+    arrput(server->dirty, conn);
+}
+
+static void server_flush_dirty(todo_server_t *server)
+{
+    uint64_t start_ns = event_now_ns();
+
+    for (size_t i = 0; i < arrlenu(server->dirty); i++) {
+        server_flush(server, server->dirty[i]);
+    }
+    arrsetlen(server->dirty, 0);
+    server->stats.flush_ns += event_now_ns() - start_ns;
+
+    if (server->lan) {
+        todo_lan_flush(server->lan);
+    }
+}
+
+/* -------------------- Subscriptions -------------------- */
+
+static bool server_is_subscribed(todo_conn_t *conn, uint32_t list_id)
+{
+    for (size_t i = 0; i < arrlenu(conn->subs); i++) {
+        if (conn->subs[i] == list_id) return true;
+    }
+    return false;
+}
+
+static void server_unsubscribe(todo_server_t *server, todo_conn_t *conn, uint32_t list_id)
+{
+    todo_feed_t *feed = &server->feeds[list_id];
+
+    for (size_t i = 0; i < arrlenu(feed->subs); i++) {
+        if (feed->subs[i] == conn) {
+            arrdelswap(feed->subs, i);
+            break;
+        }
+    }
+    for (size_t i = 0; i < arrlenu(conn->subs); i++) {
+        if (conn->subs[i] == list_id) {
+            arrdelswap(conn->subs, i);
+            break;
+        }
+    }
+}
+
+static void server_journal_append(todo_server_t *server, todo_buf_t *buf)
+{
+    if (arrlenu(server->journal) >= TODO_SERVER_JOURNAL_MAX)
+    {
+        // the older half goes at once, a follower still back there starts over
+        size_t drop = TODO_SERVER_JOURNAL_MAX / 2;
+        for (size_t i = 0; i < drop; i++) {
+            todo_buf_release(server->journal[i]);
+        }
+        memmove(server->journal, server->journal + drop, (arrlenu(server->journal) - drop) * sizeof(todo_buf_t *));
+        arrsetlen(server->journal, arrlenu(server->journal) - drop);
+        server->journal_base += drop;
+    }
+    arrput(server->journal, todo_buf_retain(buf));
+
+    for (size_t i = 0; i < arrlenu(server->followers); i++) {
+        server_mark_dirty(server, server->followers[i]);
+    }
+}
+
+/*
+    Encode once, queue the same buffer to every subscriber. A binary
+    origin always gets it as its reply and never has it dropped. No origin
+    means the change came from a LAN peer, those are not broadcast again.
+ */
+static void server_publish(todo_server_t *server, todo_conn_t *origin, uint32_t list_id, char *frame)
+{
+    if (origin && server->lan) {
+        todo_lan_queue_delta(server->lan, list_id, frame, arrlenu(frame));
+    }
+
+    todo_feed_t *feed = &server->feeds[list_id];
+    todo_buf_t  *buf  = todo_buf_create(frame, arrlenu(frame));
+    if (!buf) return;
+
+    server_journal_append(server, buf);
+
+    for (size_t i = 0; i < arrlenu(feed->subs); i++) {
+        if (feed->subs[i] != origin) {
+            server_enqueue(server, feed->subs[i], server_packed(server, feed->subs[i], buf), true);
+        }
+    }
+    // an HTTP origin gets its answer as JSON instead
+    if (origin && !origin->http) {
+        server_enqueue(server, origin, server_packed(server, origin, buf), false);
+    }
+
+    todo_buf_release(buf);
+}
+
+static size_t server_begin_delta(todo_server_t *server, char **frame, uint32_t list_id, todo_delta_op op)
+{
+    size_t start = proto_begin_frame(frame, TODO_MSG_DELTA);
+    proto_put_u32(frame, list_id);
+    proto_put_u64(frame, ++server->feeds[list_id].seq);
+    proto_put_u8(frame, (uint8_t)op);
+    return start;
+}
+
+static bool server_item_matches(const todo_item *item, const char *text)
+{
+    return strstr(item->todo, text) || strstr(item->note, text);
+}
+
+static todo_item *server_find_item(todo_list *list, time_t created)
+{
+    for (size_t i = 0; i < arrlenu(list->todo_items); i++) {
+        if (list->todo_items[i].created == created) return &list->todo_items[i];
+    }
+    return NULL;
+}
+
+/*
+    The writes, shared by binary requests, HTTP ones and changes another
+    instance made (no origin). Each applies the change and publishes its
+    delta, answering the origin is up to the caller. The item returned
+    lives in the list, good until its next change.
+ */
+static todo_item *server_add_item(todo_server_t *server, todo_conn_t *origin, uint32_t list_id, todo_item *item)
+{
+    todo_list *list = &main_list[list_id];
+
+    // the peer picked the id already, a repeat of it is the same item
+    if (!origin && server_find_item(list, item->created)) {
+        return NULL;
+    }
+
+    todo_list_add(list, item);
+
+    // created is the item id, two adds in the same second must not collide
+    todo_item *added = &list->todo_items[arrlen(list->todo_items) - 1];
+    if (!origin) {
+        // keep the peer's id so its later removes / completes find the item
+        added->created = item->created;
+        added->completed = item->completed;
+    } else if (added->created <= server->last_created) {
+        added->created = server->last_created + 1;
+    }
+    if (added->created > server->last_created) {
+        server->last_created = added->created;
+    }
+
+    char   *frame = NULL;
+    size_t start  = server_begin_delta(server, &frame, list_id, TODO_DELTA_ADD);
+    proto_put_item(&frame, added);
+    proto_end_frame(&frame, start);
+    server_publish(server, origin, list_id, frame);
+    arrfree(frame);
+    return added;
+}
+
+static bool server_remove_item(todo_server_t *server, todo_conn_t *origin, uint32_t list_id, time_t created)
+{
+    if (!todo_list_remove_by_created(&main_list[list_id], created)) {
+        return false;
+    }
+
+    char   *frame = NULL;
+    size_t start  = server_begin_delta(server, &frame, list_id, TODO_DELTA_REMOVE);
+    proto_put_u64(&frame, (uint64_t)(int64_t)created);
+    proto_end_frame(&frame, start);
+    server_publish(server, origin, list_id, frame);
+    arrfree(frame);
+    return true;
+}
+
+static todo_item *server_complete_item(todo_server_t *server, todo_conn_t *origin, uint32_t list_id, time_t created, bool completed)
+{
+    todo_item *item = server_find_item(&main_list[list_id], created);
+    if (!item) return NULL;
+
+    item->completed = completed;
+
+    char   *frame = NULL;
+    size_t start  = server_begin_delta(server, &frame, list_id, TODO_DELTA_COMPLETE);
+    proto_put_u64(&frame, (uint64_t)(int64_t)created);
+    proto_put_u8(&frame, completed ? 1 : 0);
+    proto_end_frame(&frame, start);
+    server_publish(server, origin, list_id, frame);
+    arrfree(frame);
+    return item;
+}
+
+/* -------------------- Requests -------------------- */
+
+static void server_handle_follow(todo_server_t *server, todo_conn_t *conn, proto_reader_t *r)
+{
+    uint32_t epoch = proto_get_u32(r);
+    uint64_t from  = proto_get_u64(r);
+
+    if (r->error) {
+        server_send_error(server, conn, "truncated request");
+        return;
+    }
+
+    if (!conn->follower) {
+        conn->follower = true;
+        arrput(server->followers, conn);
+    }
+
+    uint64_t end = server->journal_base + arrlenu(server->journal);
+    conn->follow_pos   = from;
+    conn->follow_reset = from == 0 || epoch != server->journal_epoch || from < server->journal_base || from > end;
+
+    printf("Follower attached (fd: %d), %s at %llu\n", conn->fd,
+           conn->follow_reset ? "full sync" : "resuming", (unsigned long long)from);
+
+    // always one JOURNAL right away, even an empty one tells where we are
+    server_enqueue_journal(server, conn);
+}
+
+static void server_put_counter(char **frame, uint32_t *count, const char *name, uint64_t value)
+{
+    proto_put_str(frame, name, strlen(name));
+    proto_put_u64(frame, value);
+    (*count)++;
+}
+
+/*
+    Everything is read under the server lock, the loop counters with
+    relaxed loads, so the numbers of one reply are close to but not
+    exactly one instant while workers are busy.
+ */
+static void server_handle_stats(todo_server_t *server, todo_conn_t *conn, bool per_conn)
+{
+    event_poll_stats_t es;
+    event_poll_get_stats(server->ep, &es);
+
+    char     name[64];
+    char     *frame = NULL;
+    uint32_t count  = 0;
+
+    size_t start    = proto_begin_frame(&frame, TODO_MSG_COUNTERS);
+    size_t count_at = arrlenu(frame);
+    proto_put_u32(&frame, 0);
+
+    server_put_counter(&frame, &count, "uptime_ms",       timer_now_ms() - es.started_ms);
+    server_put_counter(&frame, &count, "bytes_in",        es.bytes_in);
+    server_put_counter(&frame, &count, "bytes_out",       es.bytes_out);
+    server_put_counter(&frame, &count, "accepts",         es.accepts);
+    server_put_counter(&frame, &count, "closes",          es.closes);
+    server_put_counter(&frame, &count, "wakeups",         es.wakeups);
+    server_put_counter(&frame, &count, "events",          es.events);
+    server_put_counter(&frame, &count, "syscalls",        es.syscalls);
+    server_put_counter(&frame, &count, "eagain",          es.eagain);
+    server_put_counter(&frame, &count, "pool_pending",    es.pool_pending);
+    server_put_counter(&frame, &count, "throttles",       es.throttles);
+    server_put_counter(&frame, &count, "read_pauses",     es.read_pauses);
+
+    for (int i = 0; i < EVENT_CB_COUNT; i++) {
+        snprintf(name, sizeof(name), "cb.%s.calls", event_cb_names[i]);
+        server_put_counter(&frame, &count, name, es.cb_calls[i]);
+        snprintf(name, sizeof(name), "cb.%s.ns", event_cb_names[i]);
+        server_put_counter(&frame, &count, name, es.cb_ns[i]);
+    }
+
+    uint64_t queued = 0, queued_max = 0;
+    for (ptrdiff_t i = 0; i < hmlen(server->conns); i++) {
+        uint64_t bytes = server->conns[i].value->out_bytes;
+        queued += bytes;
+        if (bytes > queued_max) queued_max = bytes;
+    }
+
+    server_put_counter(&frame, &count, "frames_in",        server->stats.frames_in);
+    server_put_counter(&frame, &count, "frames_out",       server->stats.frames_out);
+    server_put_counter(&frame, &count, "handle_ns",        server->stats.handle_ns);
+    server_put_counter(&frame, &count, "flush_ns",         server->stats.flush_ns);
+    server_put_counter(&frame, &count, "resyncs",          server->stats.resyncs);
+    server_put_counter(&frame, &count, "deltas_dropped",   server->stats.deltas_dropped);
+    server_put_counter(&frame, &count, "corks",            server->stats.corks);
+    server_put_counter(&frame, &count, "nagle_toggles",    server->stats.nagle_toggles);
+    server_put_counter(&frame, &count, "packed",           server->stats.packed);
+    server_put_counter(&frame, &count, "packed_raw_bytes", server->stats.packed_raw_bytes);
+    server_put_counter(&frame, &count, "packed_bytes",     server->stats.packed_bytes);
+    server_put_counter(&frame, &count, "http_requests",    server->stats.http_requests);
+    server_put_counter(&frame, &count, "http_errors",      server->stats.http_errors);
+    server_put_counter(&frame, &count, "connections",      (uint64_t)hmlen(server->conns));
+    server_put_counter(&frame, &count, "followers",        arrlenu(server->followers));
+    server_put_counter(&frame, &count, "journal",          arrlenu(server->journal));
+    server_put_counter(&frame, &count, "queued_bytes",     queued);
+    server_put_counter(&frame, &count, "queued_bytes_max", queued_max);
+    server_put_counter(&frame, &count, "queued_bytes_peak", server->stats.bytes_queued_max);
+
+    for (ptrdiff_t i = 0; per_conn && i < hmlen(server->conns); i++)
+    {
+        todo_conn_t *c = server->conns[i].value;
+
+        event_conn_stats_t cs;
+        event_poll_get_conn_stats(server->ep, c->ctx, &cs);
+
+        struct { const char *key; uint64_t value; } fields[] = {
+            { "bytes_in",     cs.bytes_in },
+            { "bytes_out",    cs.bytes_out },
+            { "recv_calls",   cs.recv_calls },
+            { "send_calls",   cs.send_calls },
+            { "eagain_in",    cs.eagain_in },
+            { "eagain_out",   cs.eagain_out },
+            { "connected_ms", cs.connected_ms },
+            { "idle_ms",      cs.idle_ms },
+            { "queued_bytes", c->out_bytes },
+            { "queued",       arrlenu(c->out) - c->out_head },
+            { "subs",         arrlenu(c->subs) },
+            { "read_paused",  c->read_paused },
+            { "nodelay",      c->nodelay },
+            { "pack_min",     c->pack_min },
+            { "http",         c->http },
+        };
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            snprintf(name, sizeof(name), "conn.%d.%s", (int)c->fd, fields[f].key);
+            server_put_counter(&frame, &count, name, fields[f].value);
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        frame[count_at + i] = (char)(count >> (8 * i));
+    }
+    proto_end_frame(&frame, start);
+    server_enqueue_frame(server, conn, frame);
+    arrfree(frame);
+}
+
+static void server_handle_compress(todo_server_t *server, todo_conn_t *conn, proto_reader_t *r)
+{
+    uint32_t threshold = proto_get_u32(r);
+    if (r->error) {
+        server_send_error(server, conn, "truncated request");
+        return;
+    }
+    conn->pack_min = threshold == 0 ? 0 : threshold < TODO_SERVER_PACK_MIN ? TODO_SERVER_PACK_MIN : threshold;
+
+    char *frame = NULL;
+    size_t start = proto_begin_frame(&frame, TODO_MSG_OK);
+    proto_put_u8(&frame, TODO_MSG_COMPRESS);
+    proto_end_frame(&frame, start);
+    server_enqueue_frame(server, conn, frame);
+    arrfree(frame);
+}
+
+static bool server_is_write(uint8_t type)
+{
+    return type == TODO_MSG_ADD || type == TODO_MSG_REMOVE || type == TODO_MSG_COMPLETE;
+}
+
+/*
+    What a request locks, pool workers handle requests side by side.
+    main_list changes only with lists_lock exclusive AND the server
+    lock held, so holding either one is enough to read it. Writes take
+    both, everything else shares lists_lock and only takes the server
+    lock for what it queues. A SEARCH scans before it takes the server
+    lock at all, searches don't wait on each other nor on flushes.
+ */
+static void server_lock_lists(todo_server_t *server, bool write)
+{
+    if (write) {
+        rwlock_write_lock(&server->lists_lock);
+    } else {
+        rwlock_read_lock(&server->lists_lock);
+    }
+}
+
+static void server_unlock_lists(todo_server_t *server, bool write)
+{
+    if (write) {
+        rwlock_write_unlock(&server->lists_lock);
+    } else {
+        rwlock_read_unlock(&server->lists_lock);
+    }
+}
+
+// the RESULT frame, only reads main_list so the lists lock shared is enough
+static char *server_search(uint32_t list_id, const char *text)
+{
+    todo_list *list  = &main_list[list_id];
+    char      *frame = NULL;
+
+    // count is patched once we know it
+    size_t start = proto_begin_frame(&frame, TODO_MSG_RESULT);
+    proto_put_u32(&frame, list_id);
+    size_t count_at = arrlenu(frame);
+    proto_put_u32(&frame, 0);
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < arrlenu(list->todo_items); i++)
+    {
+        todo_item *item = &list->todo_items[i];
+        if (server_item_matches(item, text)) {
+            proto_put_item(&frame, item);
+            count++;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        frame[count_at + i] = (char)(count >> (8 * i));
+    }
+    proto_end_frame(&frame, start);
+    return frame;
+}
+
+static void server_handle_frame(todo_server_t *server, todo_conn_t *conn, const char *body, size_t len)
+{
+    proto_reader_t r;
+    proto_reader_init(&r, body, len);
+
+    uint8_t type = proto_get_u8(&r);
+
+    if (type == TODO_MSG_FOLLOW && conn) {
+        server_handle_follow(server, conn, &r);
+        return;
+    }
+    if (type == TODO_MSG_STATS && conn) {
+        server_handle_stats(server, conn, proto_get_u8(&r) != 0);
+        return;
+    }
+    if (type == TODO_MSG_COMPRESS && conn) {
+        server_handle_compress(server, conn, &r);
+        return;
+    }
+
+    // the leader's journal is the only writer a follower has
+    if (conn && server->follow && server_is_write(type)) {
+        server_send_error(server, conn, "read only follower, write to the leader");
+        return;
+    }
+
+    uint32_t list_id = proto_get_u32(&r);
+
+    if (r.error) {
+        server_send_error(server, conn, "truncated request");
+        return;
+    }
+    if (list_id >= (uint32_t)arrlenu(main_list)) {
+        server_send_error(server, conn, "no such list");
+        return;
+    }
+
+    char      *frame = NULL;
+    size_t    start;
+
+    switch (type)
+    {
+        case TODO_MSG_SUBSCRIBE:
+        {
+            if (!server_is_subscribed(conn, list_id)) {
+                arrput(server->feeds[list_id].subs, conn);
+                arrput(conn->subs, list_id);
+            }
+            server_enqueue_snapshot(server, conn, list_id);
+        } break;
+
+        case TODO_MSG_UNSUBSCRIBE:
+        {
+            server_unsubscribe(server, conn, list_id);
+
+            start = proto_begin_frame(&frame, TODO_MSG_OK);
+            proto_put_u8(&frame, type);
+            proto_end_frame(&frame, start);
+            server_enqueue_frame(server, conn, frame);
+        } break;
+
+        case TODO_MSG_GET:
+        {
+            server_enqueue_snapshot(server, conn, list_id);
+        } break;
+
+        case TODO_MSG_ADD:
+        {
+            todo_item item = {0};
+            if (!proto_get_item(&r, &item)) {
+                server_send_error(server, conn, "malformed item");
+                break;
+            }
+            server_add_item(server, conn, list_id, &item);
+        } break;
+
+        case TODO_MSG_REMOVE:
+        {
+            time_t created = (time_t)(int64_t)proto_get_u64(&r);
+
+            if (r.error || !server_remove_item(server, conn, list_id, created)) {
+                server_send_error(server, conn, "no such item");
+            }
+        } break;
+
+        case TODO_MSG_COMPLETE:
+        {
+            time_t created   = (time_t)(int64_t)proto_get_u64(&r);
+            bool   completed = proto_get_u8(&r) != 0;
+
+            if (r.error || !server_complete_item(server, conn, list_id, created, completed)) {
+                server_send_error(server, conn, "no such item");
+            }
+        } break;
+
+        case TODO_MSG_FETCH:
+        {
+            uint64_t seq    = proto_get_u64(&r);
+            uint64_t offset = proto_get_u64(&r);
+
+            if (r.error) {
+                server_send_error(server, conn, "truncated request");
+                break;
+            }
+            server_enqueue_chunk(server, conn, list_id, seq, offset);
+        } break;
+
+        case TODO_MSG_SEARCH:
+        {
+            char text[MAX_TODO_SIZE];
+            proto_get_str(&r, text, sizeof(text));
+
+            frame = server_search(list_id, text);
+            server_enqueue_frame(server, conn, frame);
+        } break;
+
+        default:
+        {
+            server_send_error(server, conn, "unknown message");
+        } break;
+    }
+
+    arrfree(frame);
+}
+
+/* -------------------- HTTP -------------------- */
+
+/*
+    Plain HTTP/1.1 on the same port. The first bytes tell it apart from
+    frames: a method read as a frame length says over 500MB, nothing a
+    frame can be. Parsed in place like frames are, a request that came
+    whole in the recv buffer is answered straight from it. Keep-alive
+    and pipelining cost nothing extra: every request in a read is
+    handled in order and the answers queue up behind each other in the
+    same output queue, leaving together at the end of the wakeup.
+
+        GET    /lists                           every list, name and size
+        GET    /lists/<id>                      { id, seq, items: [...] }
+        GET    /lists/<id>?q=<text>             only the items with text in them
+        POST   /lists/<id>                      todo=..&note=..&priority=..&deadline=..  -> 201, the item
+        GET    /lists/<id>/items/<created>      the item
+        POST   /lists/<id>/items/<created>      completed=0|1  -> the item
+        DELETE /lists/<id>/items/<created>      -> 204
+
+    Lists and results go out chunked, a chunk per HTTP_CHUNK_SIZE of
+    JSON. A full list's body is made once per version and queued by
+    reference like snapshots are. Writes are published like binary ones,
+    subscribers, the LAN and followers see them the same way.
+ */
+#define SERVER_HTTP_JSON    "application/json"
+
+static bool server_is_http(const char *p)
+{
+    static const char *methods[] = { "GET ", "POST", "PUT ", "DELE", "HEAD", "OPTI", "PATC" };
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (!memcmp(p, methods[i], 4)) return true;
+    }
+    return false;
+}
+
+// queue what is written so far and start over, pieces of one response go out in order
+static void server_http_queue(todo_server_t *server, todo_conn_t *conn, char **response)
+{
+    todo_buf_t *buf = todo_buf_create(*response, arrlenu(*response));
+    server_enqueue(server, conn, buf, false);
+    todo_buf_release(buf);
+    arrsetlen(*response, 0);
+}
+
+static void server_http_error(todo_server_t *server, todo_conn_t *conn, bool keep_alive, int status, const char *message)
+{
+    char *body = NULL, *response = NULL;
+
+    http_put(&body, "{\"error\":", 9);
+    http_put_json_str(&body, message, strlen(message));
+    http_put(&body, "}", 1);
+
+    http_put_response(&response, status, SERVER_HTTP_JSON, keep_alive, body, arrlenu(body));
+    server_http_queue(server, conn, &response);
+    server->stats.http_errors++;
+
+    arrfree(body);
+    arrfree(response);
+}
+
+static void server_http_put_item(char **out, const todo_item *item)
+{
+    http_putf(out, "{\"created\":%lld,\"deadline\":%lld,\"priority\":%d,\"completed\":%s,\"todo\":",
+              (long long)item->created, (long long)item->deadline, (int)item->priority, item->completed ? "true" : "false");
+    http_put_json_str(out, item->todo, strnlen(item->todo, MAX_TODO_SIZE));
+    http_put(out, ",\"note\":", 8);
+    http_put_json_str(out, item->note, strnlen(item->note, MAX_NOTE_SIZE));
+    http_put(out, "}", 1);
+}
+
+static void server_http_item(todo_server_t *server, todo_conn_t *conn, bool keep_alive, int status, const todo_item *item)
+{
+    char *body = NULL, *response = NULL;
+
+    server_http_put_item(&body, item);
+    http_put_response(&response, status, SERVER_HTTP_JSON, keep_alive, body, arrlenu(body));
+    server_http_queue(server, conn, &response);
+
+    arrfree(body);
+    arrfree(response);
+}
+
+static void server_http_lists(todo_server_t *server, todo_conn_t *conn, bool keep_alive)
+{
+    char *body = NULL, *response = NULL;
+
+    http_put(&body, "[", 1);
+    for (size_t i = 0; i < arrlenu(main_list); i++)
+    {
+        if (i) http_put(&body, ",", 1);
+        http_putf(&body, "{\"id\":%zu,\"seq\":%llu,\"items\":%zu,\"name\":", i,
+                  (unsigned long long)server->feeds[i].seq, arrlenu(main_list[i].todo_items));
+        http_put_json_str(&body, main_list[i].name, strnlen(main_list[i].name, MAX_LIST_NAME_SIZE));
+        http_put(&body, "}", 1);
+    }
+    http_put(&body, "]", 1);
+
+    http_put_response(&response, 200, SERVER_HTTP_JSON, keep_alive, body, arrlenu(body));
+    server_http_queue(server, conn, &response);
+
+    arrfree(body);
+    arrfree(response);
+}
+
+// chunked JSON body of the whole list, or with text only what matches it
+static void server_http_put_list(todo_server_t *server, char **out, uint32_t list_id, const char *text)
+{
+    todo_list *list  = &main_list[list_id];
+    size_t    chunk  = http_begin_chunk(out);
+    size_t    count  = 0;
+
+    http_putf(out, "{\"id\":%u,\"seq\":%llu,\"items\":[", list_id, (unsigned long long)server->feeds[list_id].seq);
+
+    for (size_t i = 0; i < arrlenu(list->todo_items); i++)
+    {
+        todo_item *item = &list->todo_items[i];
+        if (text && !server_item_matches(item, text)) continue;
+
+        if (count++) http_put(out, ",", 1);
+        server_http_put_item(out, item);
+
+        if (arrlenu(*out) - chunk >= HTTP_CHUNK_SIZE) {
+            http_end_chunk(out, chunk);
+            chunk = http_begin_chunk(out);
+        }
+    }
+
+    http_put(out, "]}", 2);
+    http_end_chunk(out, chunk);
+    http_end_chunked(out);
+}
+
+/*
+    The head differs per request (keep-alive or not), the body of a
+    full list only per list version. It is built once and shared like a
+    snapshot, a search is built for the one asking.
+ */
+static void server_http_list(todo_server_t *server, todo_conn_t *conn, bool keep_alive, uint32_t list_id, const char *text)
+{
+    todo_feed_t *feed     = &server->feeds[list_id];
+    char        *response = NULL;
+
+    http_begin_response(&response, 200, SERVER_HTTP_JSON, keep_alive, -1);
+
+    if (text) {
+        server_http_put_list(server, &response, list_id, text);
+        server_http_queue(server, conn, &response);
+        arrfree(response);
+        return;
+    }
+
+    if (!feed->json || feed->json_seq != feed->seq)
+    {
+        char *body = NULL;
+        server_http_put_list(server, &body, list_id, NULL);
+
+        todo_buf_release(feed->json);
+        feed->json     = todo_buf_create(body, arrlenu(body));
+        feed->json_seq = feed->seq;
+        arrfree(body);
+    }
+
+    server_http_queue(server, conn, &response);
+    server_enqueue(server, conn, feed->json, false);
+    arrfree(response);
+}
+
+static void server_http_add(todo_server_t *server, todo_conn_t *conn, const http_request_t *req, uint32_t list_id)
+{
+    char      number[32];
+    todo_item item = {0};
+
+    if (!http_form_value(req->body, "todo", item.todo, sizeof(item.todo)) || !item.todo[0]) {
+        server_http_error(server, conn, req->keep_alive, 400, "todo is required");
+        return;
+    }
+    http_form_value(req->body, "note", item.note, sizeof(item.note));
+    if (http_form_value(req->body, "priority", number, sizeof(number))) {
+        item.priority = (i32)strtol(number, NULL, 10);
+    }
+    if (http_form_value(req->body, "deadline", number, sizeof(number))) {
+        item.deadline = (time_t)strtoll(number, NULL, 10);
+    }
+
+    todo_item *added = server_add_item(server, conn, list_id, &item);
+    server_http_item(server, conn, req->keep_alive, 201, added);
+}
+
+static void server_handle_http(todo_server_t *server, todo_conn_t *conn, const http_request_t *req)
+{
+    bool keep_alive = req->keep_alive;
+    bool get    = http_slice_eq(req->method, "GET");
+    bool post   = http_slice_eq(req->method, "POST");
+    bool delete = http_slice_eq(req->method, "DELETE");
+
+    // routes are short, a copy makes them a string sscanf can take apart
+    char path[TODO_SERVER_HTTP_PATH_MAX];
+    if (req->path.len >= sizeof(path)) {
+        server_http_error(server, conn, keep_alive, 404, "no such route");
+        return;
+    }
+    memcpy(path, req->path.p, req->path.len);
+    path[req->path.len] = '\0';
+
+    unsigned  list_id = 0;
+    long long created = 0;
+    int       end     = -1;
+    bool      is_list = false, is_item = false;
+
+    if (!strcmp(path, "/lists") || !strcmp(path, "/lists/"))
+    {
+        if (!get) {
+            server_http_error(server, conn, keep_alive, 405, "method not allowed");
+            return;
+        }
+        server_http_lists(server, conn, keep_alive);
+        return;
+    }
+    if (sscanf(path, "/lists/%u%n", &list_id, &end) == 1 && path[end] == '\0') {
+        is_list = true;
+    } else if (sscanf(path, "/lists/%u/items/%lld%n", &list_id, &created, &end) == 2 && path[end] == '\0') {
+        is_item = true;
+    }
+
+    if (!is_list && !is_item) {
+        server_http_error(server, conn, keep_alive, 404, "no such route");
+        return;
+    }
+    if (!(get || post || (delete && is_item))) {
+        server_http_error(server, conn, keep_alive, 405, "method not allowed");
+        return;
+    }
+    if (list_id >= (uint32_t)arrlenu(main_list)) {
+        server_http_error(server, conn, keep_alive, 404, "no such list");
+        return;
+    }
+    // the leader's journal is the only writer a follower has
+    if (!get && server->follow) {
+        server_http_error(server, conn, keep_alive, 403, "read only follower, write to the leader");
+        return;
+    }
+
+    if (is_list)
+    {
+        char text[MAX_TODO_SIZE];
+        if (post) {
+            server_http_add(server, conn, req, list_id);
+        } else if (http_form_value(req->query, "q", text, sizeof(text))) {
+            server_http_list(server, conn, keep_alive, list_id, text);
+        } else {
+            server_http_list(server, conn, keep_alive, list_id, NULL);
+        }
+        return;
+    }
+
+    todo_item *item;
+    if (get) {
+        item = server_find_item(&main_list[list_id], (time_t)created);
+    } else if (post) {
+        char value[8] = "1";
+        http_form_value(req->body, "completed", value, sizeof(value));
+        item = server_complete_item(server, conn, list_id, (time_t)created, strcmp(value, "0") && strcmp(value, "false"));
+    } else {
+        item = NULL;
+        if (server_remove_item(server, conn, list_id, (time_t)created))
+        {
+            char *response = NULL;
+            http_begin_response(&response, 204, NULL, keep_alive, 0);
+            server_http_queue(server, conn, &response);
+            arrfree(response);
+            return;
+        }
+    }
+
+    if (!item) {
+        server_http_error(server, conn, keep_alive, 404, "no such item");
+        return;
+    }
+    server_http_item(server, conn, keep_alive, 200, item);
+}
+
+/*
+    Same as frames: complete requests straight from p, what is used is
+    returned and the caller keeps the rest. Nothing after a request that
+    closes the connection is read, nor after one we couldn't parse,
+    there is no telling where the next one would start.
+ */
+static size_t server_consume_http(todo_server_t *server, todo_conn_t *conn, const char *p, size_t avail)
+{
+    size_t used = 0;
+
+    while (used < avail && !conn->http_close)
+    {
+        http_request_t req;
+        int64_t size = http_parse_request(p + used, avail - used, &req);
+        if (size == 0) break;
+
+        // same locking as server_handle_request, a GET only reads
+        bool write = size > 0 && !http_slice_eq(req.method, "GET");
+        server_lock_lists(server, write);
+        mutex_lock(&server->lock);
+
+        uint64_t start_ns = event_now_ns();
+        if (size < 0) {
+            fprintf(stderr, "todo_server: bad HTTP request (fd: %d), answering %d and closing\n", conn->fd, (int)-size);
+            server_http_error(server, conn, false, (int)-size, http_status_text((int)-size));
+            conn->http_close = true;
+        } else {
+            server_handle_http(server, conn, &req);
+            conn->http_close = !req.keep_alive;
+            used += (size_t)size;
+        }
+        server->stats.handle_ns += event_now_ns() - start_ns;
+        server->stats.frames_in++;
+        server->stats.http_requests++;
+        conn->window_frames++;
+
+        mutex_unlock(&server->lock);
+        server_unlock_lists(server, write);
+    }
+
+    return conn->http_close ? avail : used;
+}
+
+static void server_handle_request(todo_server_t *server, todo_conn_t *conn, const char *body, size_t len)
+{
+    uint64_t start_ns = event_now_ns();
+
+    proto_reader_t r;
+    proto_reader_init(&r, body, len);
+    uint8_t  type    = proto_get_u8(&r);
+    uint32_t list_id = proto_get_u32(&r);
+    bool     write   = server_is_write(type);
+
+    server_lock_lists(server, write);
+
+    // bad ones fall through to server_handle_frame, it has the error for them
+    char *result = NULL;
+    if (type == TODO_MSG_SEARCH && !r.error && list_id < (uint32_t)arrlenu(main_list))
+    {
+        char text[MAX_TODO_SIZE];
+        proto_get_str(&r, text, sizeof(text));
+        result = server_search(list_id, text);
+    }
+
+    mutex_lock(&server->lock);
+    if (result) {
+        server_enqueue_frame(server, conn, result);
+    } else {
+        server_handle_frame(server, conn, body, len);
+    }
+    server->stats.handle_ns += event_now_ns() - start_ns;
+    server->stats.frames_in++;
+    conn->window_frames++;
+    mutex_unlock(&server->lock);
+
+    server_unlock_lists(server, write);
+    arrfree(result);
+}
+
+/*
+    Complete frames, or HTTP requests, are handled straight out of the
+    recv buffer, only a trailing partial one is copied aside until the
+    rest arrives
+ */
+static void server_consume(todo_server_t *server, todo_conn_t *conn, const char *data, size_t len)
+{
+    const char *p = data;
+    size_t avail = len;
+
+    if (arrlenu(conn->in) > 0)
+    {
+        size_t at = arrlenu(conn->in);
+        arrsetlen(conn->in, at + len);
+        memcpy(conn->in + at, data, len);
+        p = conn->in;
+        avail = arrlenu(conn->in);
+    }
+
+    // the first bytes say what the connection speaks, shm clients only have frames
+    if (!conn->sniffed && avail >= 4) {
+        conn->sniffed = true;
+        conn->http = conn->ctx && server_is_http(p);
+    }
+
+    size_t used = 0;
+    if (conn->http) {
+        used = server_consume_http(server, conn, p, avail);
+    }
+    while (conn->sniffed && !conn->http && used < avail)
+    {
+        int64_t size = proto_frame_size(p + used, avail - used);
+
+        if (size < 0)
+        {
+            // cant resync a byte stream, let the loop close it through EOF
+            fprintf(stderr, "todo_server: bad frame (fd: %d), closing\n", conn->fd);
+            arrsetlen(conn->in, 0);
+            shutdown(conn->fd, SHUT_RD);
+            return;
+        }
+        if (size == 0) break;
+
+        server_handle_request(server, conn, p + used + 4, (size_t)size - 4);
+        used += (size_t)size;
+    }
+
+    size_t rest = avail - used;
+
+    if (p == conn->in) {
+        memmove(conn->in, conn->in + used, rest);
+        arrsetlen(conn->in, rest);
+    } else if (rest > 0) {
+        arrsetlen(conn->in, rest);
+        memcpy(conn->in, p + used, rest);
+    }
+
+    // a worker's request is applied by the loop once it hands the ctx back
+    if (conn->ctx) {
+        event_poll_set_read_deadline_ctx(server->ep, conn->ctx, rest > 0 ? TODO_SERVER_READ_TIMEOUT_MS : 0);
+    }
+}
+
+/* -------------------- Callbacks -------------------- */
+
+static void server_drop_conn(todo_server_t *server, socket_handle fd)
+{
+    todo_conn_t *conn = hmget(server->conns, fd);
+    if (!conn) return;
+
+    while (arrlenu(conn->subs) > 0) {
+        server_unsubscribe(server, conn, conn->subs[0]);
+    }
+    for (size_t i = 0; i < arrlenu(server->followers); i++) {
+        if (server->followers[i] == conn) {
+            printf("Follower detached (fd: %d)\n", fd);
+            arrdelswap(server->followers, i);
+            break;
+        }
+    }
+    for (size_t i = 0; i < arrlenu(server->dirty); i++) {
+        if (server->dirty[i] == conn) {
+            arrdelswap(server->dirty, i);
+            break;
+        }
+    }
+
+    server_release_queue(conn);
+    arrfree(conn->out);
+    arrfree(conn->in);
+    arrfree(conn->subs);
+    free(conn);
+
+    (void)hmdel(server->conns, fd);
+}
+
+static void server_on_accept(void *user_data, socket_handle fd)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    todo_conn_t *conn = calloc(1, sizeof(todo_conn_t));
+    if (!conn) {
+        fprintf(stderr, "todo_server: Failed to allocate connection\n");
+        shutdown(fd, SHUT_RDWR);
+        return;
+    }
+    conn->fd = fd;
+    conn->shm = event_poll_is_shm(server->ep, fd);
+    conn->ctx = conn->shm ? NULL : event_poll_get_ctx(server->ep, fd);
+    conn->window_ms = timer_now_ms();
+
+    // we batch ourselves, see server_tune_nagle
+    if (conn->ctx) {
+        socket_set_opt_tcp_no_delay(fd, 1);
+        conn->nodelay = true;
+    }
+
+    mutex_lock(&server->lock);
+    hmput(server->conns, fd, conn);
+    mutex_unlock(&server->lock);
+}
+
+static void server_on_receive(void *user_data, socket_handle fd, const char *buffer, size_t len)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    // conn stays ours until we return, a ctx in a worker isn't closed under it
+    mutex_lock(&server->lock);
+    todo_conn_t *conn = hmget(server->conns, fd);
+    mutex_unlock(&server->lock);
+
+    if (!conn) return;
+
+    // locks per request, see server_handle_request
+    server_consume(server, conn, buffer, len);
+
+    // the loop flushes in server_on_loop_end, a worker has no wakeup to wait for
+    if (server->ep->pool)
+    {
+        mutex_lock(&server->lock);
+        server_flush_dirty(server);
+        mutex_unlock(&server->lock);
+    }
+}
+
+static void server_on_writable(void *user_data, socket_handle fd)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    mutex_lock(&server->lock);
+    {
+        todo_conn_t *conn = hmget(server->conns, fd);
+        if (conn) {
+            server_flush(server, conn);
+            server_flush_dirty(server);
+        }
+    }
+    mutex_unlock(&server->lock);
+}
+
+// io_uring only, what server_flush_uring handed the ring is on the wire
+static void server_on_send(void *user_data, socket_handle fd, size_t bytes)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    mutex_lock(&server->lock);
+    {
+        todo_conn_t *conn = hmget(server->conns, fd);
+        if (conn) {
+            conn->ring_bytes -= bytes < conn->ring_bytes ? bytes : conn->ring_bytes;
+            if (conn->http_close && conn->ring_bytes == 0 && conn->out_head == arrlenu(conn->out)) {
+                shutdown(fd, SHUT_WR);
+            }
+
+            // the window has room again for what waited in the queue
+            if (conn->out_head < arrlenu(conn->out) && conn->ring_bytes < TODO_SERVER_RING_WINDOW) {
+                server_flush(server, conn);
+                server_flush_dirty(server);
+            }
+        }
+    }
+    mutex_unlock(&server->lock);
+}
+
+// every connection that got input this wakeup is handled, write out what they produced
+static void server_on_loop_end(void *user_data)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    mutex_lock(&server->lock);
+    if (arrlenu(server->dirty) > 0 || server->lan) {
+        server_flush_dirty(server);
+    }
+    mutex_unlock(&server->lock);
+}
+
+static void server_on_disconnect(void *user_data, socket_handle fd)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    mutex_lock(&server->lock);
+    server_drop_conn(server, fd);
+    mutex_unlock(&server->lock);
+}
+
+static void server_on_error(void *user_data, socket_handle fd, int error_code)
+{
+    (void)error_code;
+    server_on_disconnect(user_data, fd);
+}
+
+/*
+    A change some other instance made (a LAN peer, the leader we
+    follow). Its DELTA frame is turned back into the request that made
+    it and handled like one from a client, just without anyone to reply
+    to. Server lock and lists_lock exclusive held.
+ */
+static void server_apply_delta(todo_server_t *server, const char *frame, size_t len)
+{
+    proto_reader_t r;
+    proto_reader_init(&r, frame, len);
+
+    (void)proto_get_u32(&r);                // frame length
+    uint8_t  type    = proto_get_u8(&r);
+    uint32_t list_id = proto_get_u32(&r);
+    (void)proto_get_u64(&r);                // the other side's feed seq, ours differs
+    uint8_t  op      = proto_get_u8(&r);
+
+    if (r.error || type != TODO_MSG_DELTA) return;
+
+    uint8_t request;
+    switch (op)
+    {
+        case TODO_DELTA_ADD:        request = TODO_MSG_ADD;      break;
+        case TODO_DELTA_REMOVE:     request = TODO_MSG_REMOVE;   break;
+        case TODO_DELTA_COMPLETE:   request = TODO_MSG_COMPLETE; break;
+        default: return;
+    }
+
+    // the op payload is laid out exactly like the request's
+    size_t rest = (size_t)(r.end - r.p);
+    char *body = NULL;
+    proto_put_u8(&body, request);
+    proto_put_u32(&body, list_id);
+    arrsetlen(body, 5 + rest);
+    memcpy(body + 5, r.p, rest);
+
+    server_handle_frame(server, NULL, body, arrlenu(body));
+    arrfree(body);
+}
+
+static void server_on_lan_delta(void *user_data, todo_lan_peer_t *peer, const char *frame, size_t len)
+{
+    (void)peer;
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    rwlock_write_lock(&server->lists_lock);
+    mutex_lock(&server->lock);
+    server_apply_delta(server, frame, len);
+    rwlock_write_unlock(&server->lists_lock);
+
+    server_flush_dirty(server);
+    mutex_unlock(&server->lock);
+}
+
+/* -------------------- Following a leader -------------------- */
+
+static void server_follow_retry(todo_server_t *server)
+{
+    timer_wheel_schedule(&server->ep->timers, &server->follow->retry_timer, timer_now_ms() + TODO_SERVER_FOLLOW_RETRY_MS);
+}
+
+static void server_follow_disconnect(todo_server_t *server)
+{
+    todo_follow_t *follow = server->follow;
+
+    printf("Lost the leader %s:%s, retrying\n", follow->ip, follow->port);
+
+    event_poll_unwatch(server->ep, follow->watch);
+    close(follow->fd);
+    follow->watch = NULL;
+    follow->fd = -1;
+    arrsetlen(follow->in, 0);
+    server_follow_retry(server);
+}
+
+// one list in full, ours is replaced by it
+static void server_follow_snapshot(todo_server_t *server, proto_reader_t *r)
+{
+    uint32_t list_id = proto_get_u32(r);
+    (void)proto_get_u64(r);                 // the leader's feed seq
+    uint32_t count   = proto_get_u32(r);
+
+    if (r->error || list_id >= (uint32_t)arrlenu(main_list)) return;
+
+    todo_list *list = &main_list[list_id];
+    for (size_t i = 0; i < arrlenu(list->todo_items); i++) {
+        arrfree(list->todo_items[i].tags);
+    }
+    arrsetlen(list->todo_items, 0);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        todo_item item = {0};
+        if (!proto_get_item(r, &item)) break;
+        arrput(list->todo_items, item);
+        if (item.created > server->last_created) {
+            server->last_created = item.created;
+        }
+    }
+
+    // no delta says what changed, our subscribers and followers get it all again
+    todo_feed_t *feed = &server->feeds[list_id];
+    feed->seq++;
+    for (size_t i = 0; i < arrlenu(feed->subs); i++) {
+        server_enqueue_snapshot(server, feed->subs[i], list_id);
+    }
+    for (size_t i = 0; i < arrlenu(server->followers); i++) {
+        server->followers[i]->follow_reset = true;
+        server_mark_dirty(server, server->followers[i]);
+    }
+}
+
+static void server_follow_journal(todo_server_t *server, proto_reader_t *r)
+{
+    todo_follow_t *follow = server->follow;
+
+    uint32_t epoch = proto_get_u32(r);
+    uint64_t first = proto_get_u64(r);
+    uint32_t count = proto_get_u32(r);
+    if (r->error) return;
+
+    if (follow->next != 0 && epoch == follow->epoch && first != follow->next) {
+        fprintf(stderr, "todo_server: journal jumped from %llu to %llu\n",
+                (unsigned long long)follow->next, (unsigned long long)first);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int64_t size = proto_frame_size(r->p, (size_t)(r->end - r->p));
+        if (size <= 0) break;
+
+        server_apply_delta(server, r->p, (size_t)size);
+        r->p += size;
+        follow->applied++;
+    }
+
+    follow->epoch = epoch;
+    follow->next  = first + count;
+    follow->batches++;
+}
+
+/*
+    Whatever the leader sent since the last time, every complete frame
+    in it applied under one lock and flushed to our own clients once
+*/
+static void server_follow_on_ready(void *user_data, socket_handle fd)
+{
+    todo_server_t *server = (todo_server_t *)user_data;
+    todo_follow_t *follow = server->follow;
+    char buffer[64 * 1024];
+    bool lost = false;
+
+    for (;;)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            size_t at = arrlenu(follow->in);
+            arrsetlen(follow->in, at + (size_t)n);
+            memcpy(follow->in + at, buffer, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        lost = true;
+        break;
+    }
+
+    // snapshots and journal batches rewrite main_list
+    rwlock_write_lock(&server->lists_lock);
+    mutex_lock(&server->lock);
+
+    size_t used = 0;
+    while (used < arrlenu(follow->in))
+    {
+        int64_t size = proto_frame_size(follow->in + used, arrlenu(follow->in) - used);
+        if (size < 0) {
+            fprintf(stderr, "todo_server: bad frame from the leader\n");
+            lost = true;
+            break;
+        }
+        if (size == 0) break;
+
+        proto_reader_t r;
+        proto_reader_init(&r, follow->in + used + 4, (size_t)size - 4);
+        uint8_t type = proto_get_u8(&r);
+
+        switch (type)
+        {
+            case TODO_MSG_SNAPSHOT: server_follow_snapshot(server, &r); break;
+            case TODO_MSG_JOURNAL:  server_follow_journal(server, &r);  break;
+            case TODO_MSG_ERROR:
+            {
+                char message[256];
+                proto_get_str(&r, message, sizeof(message));
+                fprintf(stderr, "todo_server: leader says: %s\n", message);
+            } break;
+            default: break;
+        }
+        used += (size_t)size;
+    }
+
+    memmove(follow->in, follow->in + used, arrlenu(follow->in) - used);
+    arrsetlen(follow->in, arrlenu(follow->in) - used);
+    rwlock_write_unlock(&server->lists_lock);
+
+    server_flush_dirty(server);
+    mutex_unlock(&server->lock);
+
+    if (lost) {
+        server_follow_disconnect(server);
+    }
+}
+
+static int server_follow_connect(todo_server_t *server)
+{
+    todo_follow_t *follow = server->follow;
+
+    // blocking, the leader is expected on the same box or LAN
+    socket_handle fd = socket_connect(follow->ip, follow->port);
+    if (fd < 0) return -1;
+
+    socket_set_non_blocking(fd);
+
+    follow->watch = event_poll_watch(server->ep, fd, server_follow_on_ready, server);
+    if (!follow->watch) {
+        close(fd);
+        return -1;
+    }
+    follow->fd = fd;
+
+    char *frame = NULL;
+    size_t start = proto_begin_frame(&frame, TODO_MSG_FOLLOW);
+    proto_put_u32(&frame, follow->epoch);
+    proto_put_u64(&frame, follow->next);
+    proto_end_frame(&frame, start);
+
+    // a fresh socket has room for a few bytes
+    if (send(fd, frame, arrlenu(frame), MSG_NOSIGNAL) != (ssize_t)arrlenu(frame)) {
+        fprintf(stderr, "todo_server: Failed to send FOLLOW: %s\n", strerror(errno));
+    }
+    arrfree(frame);
+
+    printf("Following %s:%s from journal index %llu\n", follow->ip, follow->port, (unsigned long long)follow->next);
+    return 0;
+}
+
+static void server_on_follow_retry(void *user_data, timer_node_t *node)
+{
+    (void)node;
+    todo_server_t *server = (todo_server_t *)user_data;
+
+    if (server->follow->fd < 0 && server_follow_connect(server) < 0) {
+        server_follow_retry(server);
+    }
+}
+
+/* -------------------- Lifetime -------------------- */
+
+todo_server_t *todo_server_create(const char *ip, const char *port, event_backend_t backend)
+{
+    todo_server_t *server = calloc(1, sizeof(todo_server_t));
+    if (!server) {
+        fprintf(stderr, "todo_server_create: Failed to allocate todo_server_t\n");
+        return NULL;
+    }
+
+    server->ep = event_poll_create_ex(ip, port, backend);
+    if (!server->ep) {
+        free(server);
+        return NULL;
+    }
+
+    if (arrlen(main_list) == 0) {
+        todo_list_new("Default list");
+    }
+
+    arrsetlen(server->feeds, arrlen(main_list));
+    memset(server->feeds, 0, sizeof(todo_feed_t) * arrlenu(server->feeds));
+
+    server->max_lag_bytes = TODO_SERVER_MAX_LAG_BYTES;
+    server->out_high_bytes = TODO_SERVER_OUT_HIGH_BYTES;
+    server->out_low_bytes = TODO_SERVER_OUT_LOW_BYTES;
+    server->journal_base = 1;
+    server->journal_epoch = (uint32_t)(timer_now_ms() ^ ((uint64_t)getpid() << 16));
+    server->snapshot_dir = TODO_SERVER_SNAPSHOT_DIR;
+    server->last_created = time(NULL);
+    mutex_init(&server->lock);
+    rwlock_init(&server->lists_lock);
+
+    server->callbacks.on_accept     = server_on_accept;
+    server->callbacks.on_receive    = server_on_receive;
+    server->callbacks.on_writable   = server_on_writable;
+    server->callbacks.on_send       = server_on_send;
+    server->callbacks.on_disconnect = server_on_disconnect;
+    server->callbacks.on_error      = server_on_error;
+    server->callbacks.on_loop_end   = server_on_loop_end;
+
+    return server;
+}
+
+/*
+    Join the LAN sync on UDP port, see todo_lan_create for the
+    target. Call before todo_server_run.
+ */
+int todo_server_enable_lan(todo_server_t *server, const char *port, const char *target_ip, const char *target_port)
+{
+    if (!server || !server->ep) return -1;
+    if (server->lan) return 0;
+
+    uint16_t tcp_port = (uint16_t)atoi(server->ep->listener.port);
+
+    server->lan = todo_lan_create(server->ep, port, target_ip, target_port, tcp_port,
+                                  arrlenu(server->feeds), server_on_lan_delta, server);
+    return server->lan ? 0 : -1;
+}
+
+/*
+    Local clients on a unix socket at path, see event_poll_listen_shm.
+    Call before todo_server_run.
+ */
+int todo_server_enable_shm(todo_server_t *server, const char *path)
+{
+    if (!server || !server->ep) return -1;
+    return event_poll_listen_shm(server->ep, path ? path : TODO_SERVER_SHM_PATH);
+}
+
+/*
+    Become a read only follower of the server at leader_ip:leader_port.
+    Connects (and reconnects, resuming where the journal left off) from
+    the loop, call before todo_server_run.
+ */
+int todo_server_follow(todo_server_t *server, const char *leader_ip, const char *leader_port)
+{
+    if (!server || !server->ep || server->follow) return -1;
+
+    todo_follow_t *follow = calloc(1, sizeof(todo_follow_t));
+    if (!follow) {
+        fprintf(stderr, "todo_server_follow: Failed to allocate todo_follow_t\n");
+        return -1;
+    }
+    snprintf(follow->ip, sizeof(follow->ip), "%s", leader_ip);
+    snprintf(follow->port, sizeof(follow->port), "%s", leader_port);
+    follow->fd = -1;
+
+    server->follow = follow;
+    timer_node_init(&follow->retry_timer, server_on_follow_retry, server);
+    timer_wheel_schedule(&server->ep->timers, &follow->retry_timer, timer_now_ms());
+    return 0;
+}
+
+// returns once event_poll_stop is called, the poller is gone after that
+void todo_server_run(todo_server_t *server)
+{
+    if (!server || !server->ep) return;
+
+    event_poll_loop(server->ep, &server->callbacks, server);
+    server->ep = NULL;
+}
+
+void todo_server_destroy(todo_server_t *server)
+{
+    if (!server) return;
+
+    if (server->ep) {
+        event_poll_destroy(server->ep);
+    }
+
+    // after the poller, it owns the watch and the presence timer
+    todo_lan_destroy(server->lan);
+
+    // sockets are closed by the poller, only our side is left
+    while (hmlen(server->conns) > 0) {
+        server_drop_conn(server, server->conns[0].key);
+    }
+    hmfree(server->conns);
+
+    if (server->follow) {
+        if (server->follow->fd >= 0) close(server->follow->fd);
+        arrfree(server->follow->in);
+        free(server->follow);
+    }
+
+    for (size_t i = 0; i < arrlenu(server->journal); i++) {
+        todo_buf_release(server->journal[i]);
+    }
+    arrfree(server->journal);
+    arrfree(server->followers);
+
+    for (size_t i = 0; i < arrlenu(server->feeds); i++) {
+        arrfree(server->feeds[i].subs);
+        server_snapshot_release(server->feeds[i].snapshot);
+        todo_buf_release(server->feeds[i].json);
+    }
+    arrfree(server->feeds);
+    arrfree(server->dirty);
+    free(server->lz);
+
+    mutex_destroy(&server->lock);
+    rwlock_destroy(&server->lists_lock);
+    free(server);
+}
+
+#endif
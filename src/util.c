@@ -288,6 +288,17 @@ u32 fnv1a_hash(const char *str)
     return hash;
 }
 
+u64 fnv1a_hash64(u64 seed, void const *data, size_t size)
+{
+    u8 const *bytes = (u8 const *)data;
+    u64 hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
 u64 arith_mod(u64 x, u64 y) 
 {
     if (-13 / 5 == -2 &&        // Check division truncates to zero
@@ -299,7 +310,7 @@ u64 arith_mod(u64 x, u64 y)
 }
 
 // Hermite interpolation f(t)=3t²-2t³
-static inline f32 smoothstep(f32 edge0, f32 edge1, f32 x) 
+f32 smoothstep(f32 edge0, f32 edge1, f32 x) 
 {
     f32 t = Clamp(0.0f, NORMALIZE(x, edge0, edge1), 1.0f);
     return t * t * (3.0f - 2.0f * t);
@@ -1425,6 +1436,9 @@ i32 animation_item_count;
 anim_chain_t anim_chains[32];
 i32 anim_chain_count;
 
+anim_rank_t anim_ranks[ANIM_RANK_MAX];
+i32         anim_rank_count;
+
 /* https://easings.net/ */
 f64 apply_easing(f64 t, easing_type easing) 
 {
@@ -2765,21 +2779,32 @@ void thread_sleep(uint32_t milliseconds)
     #endif
 }
 
-void atomic_inc(atomic_int_t* var)
+// returns the incremented value
+int atomic_inc(atomic_int_t* var)
 {
     #ifdef _WIN32
-        InterlockedIncrement(var);
+        return InterlockedIncrement(var);
     #else
-        atomic_fetch_add(var, 1);
+        return atomic_fetch_add(var, 1) + 1;
     #endif
 }
 
-void atomic_dec(atomic_int_t* var)
+// returns the decremented value
+int atomic_dec(atomic_int_t* var)
 {
     #ifdef _WIN32
-        InterlockedDecrement(var);
+        return InterlockedDecrement(var);
     #else
-        atomic_fetch_sub(var, 1);
+        return atomic_fetch_sub(var, 1) - 1;
+    #endif
+}
+
+void atomic_store_int(atomic_int_t* var, int value)
+{
+    #ifdef _WIN32
+        InterlockedExchange(var, value);
+    #else
+        atomic_store(var, value);
     #endif
 }
 
@@ -2854,6 +2879,61 @@ void mutex_unlock(mutex_handle_t* mutex)
     #endif
 }
 
+void rwlock_init(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        InitializeSRWLock(lock);
+    #else
+        pthread_rwlock_init(lock, NULL);
+    #endif
+}
+
+// SRW locks need no cleanup
+void rwlock_destroy(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        (void)lock;
+    #else
+        pthread_rwlock_destroy(lock);
+    #endif
+}
+
+void rwlock_read_lock(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        AcquireSRWLockShared(lock);
+    #else
+        pthread_rwlock_rdlock(lock);
+    #endif
+}
+
+void rwlock_read_unlock(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        ReleaseSRWLockShared(lock);
+    #else
+        pthread_rwlock_unlock(lock);
+    #endif
+}
+
+void rwlock_write_lock(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        AcquireSRWLockExclusive(lock);
+    #else
+        pthread_rwlock_wrlock(lock);
+    #endif
+}
+
+void rwlock_write_unlock(rwlock_handle_t* lock)
+{
+    #ifdef _WIN32
+        ReleaseSRWLockExclusive(lock);
+    #else
+        pthread_rwlock_unlock(lock);
+    #endif
+}
+
 void cond_init(cond_handle_t* cond)
 {
     #ifdef _WIN32
@@ -2908,7 +2988,7 @@ void event_create(event_handle *event)
 #ifdef _WIN32
     *event = CreateEvent(NULL, FALSE, FALSE, NULL);
 #else
-    pthread_mutex_init(event->mutex, NULL);
+    pthread_mutex_init(&event->mutex, NULL);
     pthread_cond_init(&event->cond, NULL);
     event->signaled = false;
 #endif
@@ -2939,7 +3019,7 @@ bool event_wait(event_handle *event)
         return false;
     }
     
-    event_t *e = (event_t *)event;
+    event_handle *e = event;
     pthread_mutex_lock(&e->mutex);
     
     while (!e->signaled) {
@@ -2965,10 +3045,11 @@ bool event_activate(void *event)
         return false;
     }
     
-    pthread_mutex_lock(&event->mutex);
-    event->signaled = true;
-    pthread_cond_signal(&event->cond);
-    pthread_mutex_unlock(&event->mutex);
+    event_handle *e = (event_handle *)event;
+    pthread_mutex_lock(&e->mutex);
+    e->signaled = true;
+    pthread_cond_signal(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
     
     return true;
 #endif
@@ -3099,10 +3180,16 @@ thread_func_ret_t thread_loop(thread_func_param_t param)
              */
             job = pool->jobs[0];
             arrdel(pool->jobs, 0);
+
+            /*
+                counted before the lock goes, or threadpool_wait could
+                see an empty queue and nothing active while the job is
+                in between
+             */
+            atomic_inc(&pool->active_jobs);
         }
         mutex_unlock(&pool->queue_mutex);
         
-        atomic_inc(&pool->active_jobs);
         job.func(job.data);
         atomic_dec(&pool->active_jobs);
 
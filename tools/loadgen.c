@@ -0,0 +1,881 @@
+/*
+    Load generator for the todo server (linux)
+
+    gcc -O2 -Iinclude -Iexternal/include tools/loadgen.c src/hdr_hist.c src/todo_proto.c
+        src/lz.c src/http.c src/socket.c src/util.c -o loadgen -lpthread -lm
+
+    usage: loadgen [-h host] [-p port] [-c connections] [-r requests/s] [-d seconds]
+                   [-w warmup seconds] [-m read:write:search] [-l list] [-s 0|1]
+                   [-z threshold] [-H 0|1]
+
+    Open loop: requests are scheduled at a fixed rate whether or not the
+    earlier ones were answered, and latency is taken from the moment a
+    request was SUPPOSED to go out. A closed loop client (send, wait,
+    send) slows down together with the server and never sees the stalls
+    it causes (coordinated omission), this one keeps sending into them.
+
+    - reads are GET of the list (a snapshot), writes ADD an item or
+      REMOVE one the same connection added before so the list stays
+      about as big as the number of connections, searches look for
+      text that matches a handful of items
+    - everything due in one loop iteration is appended to the
+      connections' output and written with one send per connection
+    - latencies go into HDR histograms per kind of request, the warmup
+      is left out of them
+    - -s 1 asks the server for its counters (STATS) before and after the
+      run and prints what moved, what the server did for those latencies
+    - -z opts every connection in to PACKED replies from threshold bytes
+      on (COMPRESS), they are unpacked before they count as answered so
+      the latencies include it
+    - -H 1 sends the same mix as HTTP/1.1 requests (the server's REST
+      routes), pipelined on keep-alive connections the same way frames
+      are, to compare the two front ends
+ */
+#define STB_DS_IMPLEMENTATION
+#include "todo_proto.h"
+#include "http.h"
+#include "hdr_hist.h"
+#include "socket.h"
+
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define LG_MAX_EVENTS       256
+#define LG_REPORT_NS        1000000000ull
+#define LG_DRAIN_NS         2000000000ull   // wait this long for answers once sending stopped
+
+typedef enum
+{
+    LG_READ,
+    LG_WRITE,
+    LG_SEARCH,
+    LG_KIND_COUNT,
+} lg_kind;
+
+static const char *lg_kind_names[LG_KIND_COUNT] = { "read", "write", "search" };
+
+typedef enum
+{
+    LG_OP_GET,
+    LG_OP_ADD,
+    LG_OP_REMOVE,
+    LG_OP_SEARCH,
+    LG_OP_COMPRESS,     // sent once on connect, not measured
+} lg_op;
+
+typedef struct
+{
+    uint64_t    intended_ns;
+    uint8_t     op;
+} lg_pending_t;
+
+typedef struct
+{
+    socket_handle   fd;
+    char            *in;            // stb array, partial frame
+    char            *out;           // stb array, not written yet from out_head
+    size_t          out_head;
+    lg_pending_t    *pending;       // stb array used as a fifo from pending_head, replies come in order
+    size_t          pending_head;
+    int64_t         *mine;          // ids of items this connection added
+    bool            want_write;
+    bool            dead;
+} lg_conn_t;
+
+typedef struct
+{
+    const char      *host;
+    const char      *port;
+    int             connections;
+    double          rate;
+    double          duration;
+    double          warmup;
+    int             mix[LG_KIND_COUNT];
+    uint32_t        list;
+    bool            server_stats;
+    uint32_t        pack_min;       // COMPRESS threshold, 0 = don't ask
+    bool            http;           // REST requests instead of frames
+} lg_config_t;
+
+typedef struct
+{
+    char            name[64];
+    uint64_t        value;
+} lg_counter_t;
+
+typedef struct
+{
+    lg_config_t     cfg;
+    int             epoll_fd;
+    lg_conn_t       *conns;
+    lg_conn_t       **dirty;        // stb array, have output to flush this iteration
+    uint64_t        rng;
+
+    uint64_t        measure_from_ns;
+    hdr_hist_t      hist[LG_KIND_COUNT];
+    hdr_hist_t      interval;       // reset every report
+
+    uint64_t        sent;
+    uint64_t        done;
+    uint64_t        errors;
+    uint64_t        lost;           // in flight on a connection that died
+    uint64_t        in_flight;
+    int             alive;
+    uint64_t        bytes_out;
+    uint64_t        bytes_in;
+
+    char            *unpacked;      // stb array, the frame out of the last PACKED one
+    uint64_t        packed_in;
+    uint64_t        packed_wire_bytes;
+    uint64_t        packed_raw_bytes;
+} lg_t;
+
+static volatile sig_atomic_t g_stop;
+
+static void lg_on_signal(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static uint64_t lg_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// xorshift64*, good enough to pick ops
+static uint64_t lg_rand(lg_t *lg)
+{
+    lg->rng ^= lg->rng >> 12;
+    lg->rng ^= lg->rng << 25;
+    lg->rng ^= lg->rng >> 27;
+    return lg->rng * 0x2545F4914F6CDD1Dull;
+}
+
+/* -------------------- Requests -------------------- */
+
+static void lg_mark_dirty(lg_t *lg, lg_conn_t *conn)
+{
+    if (arrlenu(conn->out) - conn->out_head == 0 && !conn->want_write) {
+        arrput(lg->dirty, conn);
+    }
+}
+
+// the same requests through the REST routes
+static void lg_issue_http(lg_t *lg, lg_conn_t *conn, lg_op op)
+{
+    const char *host = lg->cfg.host;
+    uint32_t   list  = lg->cfg.list;
+
+    switch (op)
+    {
+        case LG_OP_GET:
+        {
+            http_putf(&conn->out, "GET /lists/%u HTTP/1.1\r\nHost: %s\r\n\r\n", list, host);
+        } break;
+
+        case LG_OP_ADD:
+        {
+            char body[128];
+            int len = snprintf(body, sizeof(body), "todo=lg+%llu&note=generated+by+loadgen&priority=%d",
+                               (unsigned long long)(lg_rand(lg) % 1000), (int)(lg_rand(lg) % 4));
+            http_putf(&conn->out, "POST /lists/%u HTTP/1.1\r\nHost: %s\r\n"
+                                  "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n%s",
+                      list, host, len, body);
+        } break;
+
+        case LG_OP_REMOVE:
+        {
+            http_putf(&conn->out, "DELETE /lists/%u/items/%lld HTTP/1.1\r\nHost: %s\r\n\r\n",
+                      list, (long long)arrpop(conn->mine), host);
+        } break;
+
+        default:
+        {
+            http_putf(&conn->out, "GET /lists/%u?q=lg+%llu HTTP/1.1\r\nHost: %s\r\n\r\n",
+                      list, (unsigned long long)(lg_rand(lg) % 1000), host);
+        } break;
+    }
+}
+
+static void lg_issue_frame(lg_t *lg, lg_conn_t *conn, lg_op op)
+{
+    size_t start;
+    switch (op)
+    {
+        case LG_OP_GET:
+        {
+            start = proto_begin_frame(&conn->out, TODO_MSG_GET);
+            proto_put_u32(&conn->out, lg->cfg.list);
+        } break;
+
+        case LG_OP_ADD:
+        {
+            todo_item item = {0};
+            snprintf(item.todo, sizeof(item.todo), "lg %llu", (unsigned long long)(lg_rand(lg) % 1000));
+            snprintf(item.note, sizeof(item.note), "generated by loadgen");
+            item.priority = (i32)(lg_rand(lg) % 4);
+
+            start = proto_begin_frame(&conn->out, TODO_MSG_ADD);
+            proto_put_u32(&conn->out, lg->cfg.list);
+            proto_put_item(&conn->out, &item);
+        } break;
+
+        case LG_OP_REMOVE:
+        {
+            start = proto_begin_frame(&conn->out, TODO_MSG_REMOVE);
+            proto_put_u32(&conn->out, lg->cfg.list);
+            proto_put_u64(&conn->out, (uint64_t)arrpop(conn->mine));
+        } break;
+
+        default:
+        {
+            char text[16];
+            int len = snprintf(text, sizeof(text), "lg %llu", (unsigned long long)(lg_rand(lg) % 1000));
+
+            start = proto_begin_frame(&conn->out, TODO_MSG_SEARCH);
+            proto_put_u32(&conn->out, lg->cfg.list);
+            proto_put_str(&conn->out, text, (size_t)len);
+        } break;
+    }
+    proto_end_frame(&conn->out, start);
+}
+
+static void lg_issue(lg_t *lg, lg_conn_t *conn, uint64_t intended_ns)
+{
+    int total = lg->cfg.mix[LG_READ] + lg->cfg.mix[LG_WRITE] + lg->cfg.mix[LG_SEARCH];
+    int pick  = (int)(lg_rand(lg) % (uint64_t)total);
+    lg_op op;
+
+    if (pick < lg->cfg.mix[LG_READ]) {
+        op = LG_OP_GET;
+    } else if (pick < lg->cfg.mix[LG_READ] + lg->cfg.mix[LG_WRITE]) {
+        // remove what we added about as often as we add, keeps the list size flat
+        op = (arrlen(conn->mine) > 0 && (lg_rand(lg) & 1)) ? LG_OP_REMOVE : LG_OP_ADD;
+    } else {
+        op = LG_OP_SEARCH;
+    }
+
+    lg_mark_dirty(lg, conn);
+
+    if (lg->cfg.http) {
+        lg_issue_http(lg, conn, op);
+    } else {
+        lg_issue_frame(lg, conn, op);
+    }
+
+    lg_pending_t pending = { .intended_ns = intended_ns, .op = (uint8_t)op };
+    arrput(conn->pending, pending);
+
+    lg->sent++;
+    lg->in_flight++;
+}
+
+static void lg_kill(lg_t *lg, lg_conn_t *conn, const char *why)
+{
+    if (conn->dead) return;
+
+    size_t waiting = arrlenu(conn->pending) - conn->pending_head;
+    fprintf(stderr, "connection %d closed (%s), %zu request(s) lost\n", conn->fd, why, waiting);
+
+    lg->lost += waiting;
+    lg->in_flight -= waiting;
+    conn->dead = true;
+    lg->alive--;
+
+    epoll_ctl(lg->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+}
+
+static void lg_flush(lg_t *lg, lg_conn_t *conn)
+{
+    while (!conn->dead && conn->out_head < arrlenu(conn->out))
+    {
+        ssize_t n = send(conn->fd, conn->out + conn->out_head, arrlenu(conn->out) - conn->out_head, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            lg_kill(lg, conn, strerror(errno));
+            return;
+        }
+        conn->out_head += (size_t)n;
+        lg->bytes_out += (uint64_t)n;
+    }
+
+    bool rest = conn->out_head < arrlenu(conn->out);
+    if (!rest) {
+        arrsetlen(conn->out, 0);
+        conn->out_head = 0;
+    }
+
+    // socket full, wait for room instead of spinning on it
+    if (!conn->dead && rest != conn->want_write)
+    {
+        struct epoll_event ev = { .events = EPOLLIN | (rest ? EPOLLOUT : 0), .data.ptr = conn };
+        epoll_ctl(lg->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->want_write = rest;
+    }
+}
+
+/* -------------------- Replies -------------------- */
+
+// the oldest request still waiting, replies come in order. false if nothing was asked
+static bool lg_take_pending(lg_t *lg, lg_conn_t *conn, lg_pending_t *pending)
+{
+    if (conn->pending_head >= arrlenu(conn->pending)) {
+        return false;
+    }
+
+    *pending = conn->pending[conn->pending_head++];
+    if (conn->pending_head == arrlenu(conn->pending)) {
+        arrsetlen(conn->pending, 0);
+        conn->pending_head = 0;
+    }
+
+    lg->in_flight--;
+    return true;
+}
+
+static void lg_record(lg_t *lg, const lg_pending_t *pending, uint64_t now_ns)
+{
+    uint64_t latency = now_ns > pending->intended_ns ? now_ns - pending->intended_ns : 0;
+    hdr_hist_record(&lg->interval, latency);
+
+    if (pending->intended_ns < lg->measure_from_ns) {
+        return;
+    }
+
+    lg_kind kind = (pending->op == LG_OP_GET)    ? LG_READ
+                 : (pending->op == LG_OP_SEARCH) ? LG_SEARCH
+                 :                                 LG_WRITE;
+
+    hdr_hist_record(&lg->hist[kind], latency);
+}
+
+static void lg_handle_reply(lg_t *lg, lg_conn_t *conn, const char *body, size_t len, uint64_t now_ns)
+{
+    lg_pending_t pending;
+
+    // nothing was asked, a delta for a subscription we dont have
+    if (!lg_take_pending(lg, conn, &pending)) {
+        return;
+    }
+
+    proto_reader_t r;
+    proto_reader_init(&r, body, len);
+    uint8_t type = proto_get_u8(&r);
+
+    if (pending.op == LG_OP_COMPRESS) {
+        if (type != TODO_MSG_OK) fprintf(stderr, "connection %d: server refused COMPRESS\n", conn->fd);
+        return;
+    }
+    lg->done++;
+
+    if (type == TODO_MSG_ERROR) {
+        lg->errors++;
+    }
+
+    // DELTA: u32 list, u64 seq, u8 op, then the item whose created is its id
+    if (pending.op == LG_OP_ADD && type == TODO_MSG_DELTA)
+    {
+        proto_get_u32(&r);
+        proto_get_u64(&r);
+        proto_get_u8(&r);
+        int64_t created = (int64_t)proto_get_u64(&r);
+        if (!r.error) {
+            arrput(conn->mine, created);
+        }
+    }
+
+    lg_record(lg, &pending, now_ns);
+}
+
+static void lg_handle_http_reply(lg_t *lg, lg_conn_t *conn, int status, http_slice_t body, uint64_t now_ns)
+{
+    lg_pending_t pending;
+    if (!lg_take_pending(lg, conn, &pending)) {
+        return;
+    }
+    lg->done++;
+
+    if (status >= 400) {
+        lg->errors++;
+    }
+
+    // the item comes back as JSON, created (its id) first
+    static const char prefix[] = "{\"created\":";
+    if (pending.op == LG_OP_ADD && status == 201 && body.len > sizeof(prefix) && !memcmp(body.p, prefix, sizeof(prefix) - 1)) {
+        arrput(conn->mine, strtoll(body.p + sizeof(prefix) - 1, NULL, 10));
+    }
+
+    lg_record(lg, &pending, now_ns);
+}
+
+// the HTTP replies in conn->in, how much of it they took or -1 on a malformed one
+static int64_t lg_read_http(lg_t *lg, lg_conn_t *conn, uint64_t now_ns)
+{
+    size_t used = 0;
+    for (;;)
+    {
+        int          status;
+        http_slice_t body;
+        int64_t size = http_parse_response(conn->in + used, arrlenu(conn->in) - used, &status, &body);
+        if (size < 0) return -1;
+        if (size == 0) break;
+
+        lg_handle_http_reply(lg, conn, status, body, now_ns);
+        used += (size_t)size;
+    }
+    return (int64_t)used;
+}
+
+static void lg_read(lg_t *lg, lg_conn_t *conn, uint64_t now_ns)
+{
+    char buf[65536];
+
+    for (;;)
+    {
+        ssize_t n = recv(conn->fd, buf, sizeof(buf), 0);
+
+        if (n == 0) {
+            lg_kill(lg, conn, "server closed");
+            return;
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            lg_kill(lg, conn, strerror(errno));
+            return;
+        }
+        lg->bytes_in += (uint64_t)n;
+
+        size_t at = arrlenu(conn->in);
+        arrsetlen(conn->in, at + (size_t)n);
+        memcpy(conn->in + at, buf, (size_t)n);
+
+        size_t used = 0;
+        if (lg->cfg.http)
+        {
+            int64_t taken = lg_read_http(lg, conn, now_ns);
+            if (taken < 0) {
+                lg_kill(lg, conn, "bad response");
+                return;
+            }
+            used = (size_t)taken;
+        }
+        while (!lg->cfg.http)
+        {
+            int64_t size = proto_frame_size(conn->in + used, arrlenu(conn->in) - used);
+            if (size < 0) {
+                lg_kill(lg, conn, "bad frame");
+                return;
+            }
+            if (size == 0) break;
+
+            const char *body     = conn->in + used + 4;
+            size_t      body_len = (size_t)size - 4;
+
+            if ((uint8_t)body[0] == TODO_MSG_PACKED)
+            {
+                arrsetlen(lg->unpacked, 0);
+                if (proto_unpack_frame(&lg->unpacked, body + 1, body_len - 1) < 0) {
+                    lg_kill(lg, conn, "bad packed frame");
+                    return;
+                }
+                lg->packed_in++;
+                lg->packed_wire_bytes += (uint64_t)size;
+                lg->packed_raw_bytes += arrlenu(lg->unpacked);
+
+                body     = lg->unpacked + 4;
+                body_len = arrlenu(lg->unpacked) - 4;
+            }
+
+            lg_handle_reply(lg, conn, body, body_len, now_ns);
+            used += (size_t)size;
+        }
+
+        size_t rest = arrlenu(conn->in) - used;
+        memmove(conn->in, conn->in + used, rest);
+        arrsetlen(conn->in, rest);
+
+        if ((size_t)n < sizeof(buf)) return;
+    }
+}
+
+/* -------------------- Reporting -------------------- */
+
+static void lg_print_latency(const char *name, const hdr_hist_t *h)
+{
+    if (h->total == 0) {
+        printf("  %-8s        -\n", name);
+        return;
+    }
+    printf("  %-8s %10llu  %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name, (unsigned long long)h->total,
+           hdr_hist_mean(h) / 1000.0,
+           hdr_hist_percentile(h, 50.0) / 1000.0,
+           hdr_hist_percentile(h, 90.0) / 1000.0,
+           hdr_hist_percentile(h, 99.0) / 1000.0,
+           hdr_hist_percentile(h, 99.9) / 1000.0,
+           h->max / 1000.0);
+}
+
+static void lg_report(lg_t *lg, double elapsed_s)
+{
+    hdr_hist_t all;
+    hdr_hist_init(&all);
+    for (int i = 0; i < LG_KIND_COUNT; i++) {
+        hdr_hist_merge(&all, &lg->hist[i]);
+    }
+
+    printf("\n%d connections, target %.0f req/s, %.1fs measured after %.1fs warmup\n",
+           lg->cfg.connections, lg->cfg.rate, lg->cfg.duration, lg->cfg.warmup);
+    printf("  sent %llu  answered %llu  errors %llu  lost %llu  unanswered %llu\n",
+           (unsigned long long)lg->sent, (unsigned long long)lg->done,
+           (unsigned long long)lg->errors, (unsigned long long)lg->lost,
+           (unsigned long long)lg->in_flight);
+    printf("  throughput %.0f req/s  out %.1f MB/s  in %.1f MB/s\n\n",
+           (double)all.total / lg->cfg.duration,
+           (double)lg->bytes_out / elapsed_s / 1e6, (double)lg->bytes_in / elapsed_s / 1e6);
+
+    if (lg->cfg.pack_min) {
+        printf("  packed %llu replies  %.1f MB on the wire for %.1f MB of frames\n\n",
+               (unsigned long long)lg->packed_in,
+               (double)lg->packed_wire_bytes / 1e6, (double)lg->packed_raw_bytes / 1e6);
+    }
+
+    printf("  latency us      count       mean       p50       p90       p99     p99.9       max\n");
+    for (int i = 0; i < LG_KIND_COUNT; i++) {
+        lg_print_latency(lg_kind_names[i], &lg->hist[i]);
+    }
+    lg_print_latency("all", &all);
+}
+
+/*
+    One blocking STATS round trip on its own connection, the load
+    connections stay out of it. Returns an stb array, NULL on failure.
+ */
+static lg_counter_t *lg_fetch_counters(lg_t *lg)
+{
+    socket_handle fd = socket_connect(lg->cfg.host, lg->cfg.port);
+    if (fd < 0) return NULL;
+
+    char *frame = NULL;
+    size_t start = proto_begin_frame(&frame, TODO_MSG_STATS);
+    proto_put_u8(&frame, 0);
+    proto_end_frame(&frame, start);
+    bool ok = send(fd, frame, arrlenu(frame), MSG_NOSIGNAL) == (ssize_t)arrlenu(frame);
+    arrfree(frame);
+
+    char *in = NULL;
+    int64_t size = 0;
+    while (ok && size == 0)
+    {
+        char buf[65536];
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        memcpy(arraddnptr(in, n), buf, (size_t)n);
+        size = proto_frame_size(in, arrlenu(in));
+        if (size < 0) ok = false;
+    }
+    close(fd);
+
+    lg_counter_t *counters = NULL;
+    if (ok)
+    {
+        proto_reader_t r;
+        proto_reader_init(&r, in + 4, (size_t)size - 4);
+
+        if (proto_get_u8(&r) == TODO_MSG_COUNTERS)
+        {
+            uint32_t count = proto_get_u32(&r);
+            for (uint32_t i = 0; i < count && !r.error; i++) {
+                lg_counter_t c;
+                proto_get_str(&r, c.name, sizeof(c.name));
+                c.value = proto_get_u64(&r);
+                if (!r.error) arrput(counters, c);
+            }
+        }
+    }
+    arrfree(in);
+
+    if (!counters) {
+        fprintf(stderr, "could not read the server counters\n");
+    }
+    return counters;
+}
+
+static void lg_report_counters(const lg_counter_t *before, const lg_counter_t *after, double elapsed_s)
+{
+    printf("\n  server counter                       total         run      per s\n");
+    for (size_t i = 0; i < arrlenu(after); i++)
+    {
+        uint64_t from = 0;
+        for (size_t j = 0; j < arrlenu(before); j++) {
+            if (strcmp(before[j].name, after[i].name) == 0) {
+                from = before[j].value;
+                break;
+            }
+        }
+
+        // gauges can go down, show those as they are now
+        int64_t delta = (int64_t)(after[i].value - from);
+        printf("  %-28s %12llu %12lld %10.0f\n", after[i].name, (unsigned long long)after[i].value,
+               (long long)delta, (double)delta / elapsed_s);
+    }
+}
+
+/* -------------------- Setup -------------------- */
+
+static int lg_parse_mix(const char *text, int mix[LG_KIND_COUNT])
+{
+    if (sscanf(text, "%d:%d:%d", &mix[LG_READ], &mix[LG_WRITE], &mix[LG_SEARCH]) != 3) return -1;
+    if (mix[LG_READ] < 0 || mix[LG_WRITE] < 0 || mix[LG_SEARCH] < 0) return -1;
+    return (mix[LG_READ] + mix[LG_WRITE] + mix[LG_SEARCH] > 0) ? 0 : -1;
+}
+
+static void lg_usage(void)
+{
+    fprintf(stderr, "usage: loadgen [-h host] [-p port] [-c connections] [-r requests/s] [-d seconds]\n"
+                    "               [-w warmup seconds] [-m read:write:search] [-l list] [-s 0|1]\n"
+                    "               [-z threshold] [-H 0|1]\n");
+}
+
+static int lg_connect_all(lg_t *lg)
+{
+    // thousands of sockets need more than the usual 1024 descriptors
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    arrsetlen(lg->conns, (size_t)lg->cfg.connections);
+    memset(lg->conns, 0, sizeof(lg_conn_t) * arrlenu(lg->conns));
+
+    for (int i = 0; i < lg->cfg.connections; i++)
+    {
+        lg_conn_t *conn = &lg->conns[i];
+
+        conn->fd = socket_connect(lg->cfg.host, lg->cfg.port);
+        if (conn->fd < 0) {
+            fprintf(stderr, "only %d of %d connections came up\n", i, lg->cfg.connections);
+            arrsetlen(lg->conns, (size_t)i);
+            return i > 0 ? 0 : -1;
+        }
+
+        socket_set_non_blocking(conn->fd);
+        socket_set_opt_tcp_no_delay(conn->fd, 1);
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (epoll_ctl(lg->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+            fprintf(stderr, "epoll_ctl ADD failed: %s\n", strerror(errno));
+            return -1;
+        }
+
+        // goes out with the first flush, ahead of any request
+        if (lg->cfg.pack_min)
+        {
+            lg_mark_dirty(lg, conn);
+            size_t start = proto_begin_frame(&conn->out, TODO_MSG_COMPRESS);
+            proto_put_u32(&conn->out, lg->cfg.pack_min);
+            proto_end_frame(&conn->out, start);
+
+            lg_pending_t pending = { .intended_ns = 0, .op = LG_OP_COMPRESS };
+            arrput(conn->pending, pending);
+            lg->in_flight++;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static lg_t lg;
+
+    lg.cfg.host         = "127.0.0.1";
+    lg.cfg.port         = "9000";
+    lg.cfg.connections  = 1000;
+    lg.cfg.rate         = 20000;
+    lg.cfg.duration     = 10;
+    lg.cfg.warmup       = 2;
+    lg.cfg.mix[LG_READ]   = 70;
+    lg.cfg.mix[LG_WRITE]  = 20;
+    lg.cfg.mix[LG_SEARCH] = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (!val) { lg_usage(); return 1; }
+
+        if      (strcmp(arg, "-h") == 0) lg.cfg.host = val;
+        else if (strcmp(arg, "-p") == 0) lg.cfg.port = val;
+        else if (strcmp(arg, "-c") == 0) lg.cfg.connections = atoi(val);
+        else if (strcmp(arg, "-r") == 0) lg.cfg.rate = atof(val);
+        else if (strcmp(arg, "-d") == 0) lg.cfg.duration = atof(val);
+        else if (strcmp(arg, "-w") == 0) lg.cfg.warmup = atof(val);
+        else if (strcmp(arg, "-l") == 0) lg.cfg.list = (uint32_t)atoi(val);
+        else if (strcmp(arg, "-s") == 0) lg.cfg.server_stats = atoi(val) != 0;
+        else if (strcmp(arg, "-z") == 0) lg.cfg.pack_min = (uint32_t)atoi(val);
+        else if (strcmp(arg, "-H") == 0) lg.cfg.http = atoi(val) != 0;
+        else if (strcmp(arg, "-m") == 0) {
+            if (lg_parse_mix(val, lg.cfg.mix) < 0) { lg_usage(); return 1; }
+        }
+        else { lg_usage(); return 1; }
+        i++;
+    }
+
+    // COMPRESS is a frame, HTTP connections can't send it
+    if (lg.cfg.connections <= 0 || lg.cfg.rate <= 0 || lg.cfg.duration <= 0 || lg.cfg.warmup < 0 || (lg.cfg.http && lg.cfg.pack_min)) {
+        lg_usage();
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, lg_on_signal);
+
+    for (int i = 0; i < LG_KIND_COUNT; i++) {
+        hdr_hist_init(&lg.hist[i]);
+    }
+    hdr_hist_init(&lg.interval);
+    lg.rng = lg_now_ns() | 1;
+
+    lg.epoll_fd = epoll_create1(0);
+    if (lg.epoll_fd < 0) {
+        fprintf(stderr, "epoll_create1 failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    lg_counter_t *counters_before = lg.cfg.server_stats ? lg_fetch_counters(&lg) : NULL;
+
+    printf("connecting %d to %s:%s ...\n", lg.cfg.connections, lg.cfg.host, lg.cfg.port);
+    if (lg_connect_all(&lg) < 0) {
+        return 1;
+    }
+    lg.cfg.connections = (int)arrlen(lg.conns);
+    lg.alive = lg.cfg.connections;
+
+    uint64_t interval_ns = (uint64_t)(1e9 / lg.cfg.rate);
+    if (interval_ns == 0) interval_ns = 1;
+
+    uint64_t start_ns    = lg_now_ns();
+    uint64_t stop_ns     = start_ns + (uint64_t)((lg.cfg.warmup + lg.cfg.duration) * 1e9);
+    uint64_t next_ns     = start_ns;
+    uint64_t report_ns   = start_ns + LG_REPORT_NS;
+    uint64_t last_done   = 0;
+    size_t   next_conn   = 0;
+
+    lg.measure_from_ns = start_ns + (uint64_t)(lg.cfg.warmup * 1e9);
+
+    struct epoll_event events[LG_MAX_EVENTS];
+
+    for (;;)
+    {
+        uint64_t now = lg_now_ns();
+
+        bool sending = now < stop_ns && !g_stop && lg.alive > 0;
+        if (!sending && (lg.in_flight == 0 || now >= stop_ns + LG_DRAIN_NS || g_stop || lg.alive == 0)) {
+            break;
+        }
+
+        // everything that should have gone out by now, late ones keep their intended time
+        while (sending && next_ns <= now)
+        {
+            lg_conn_t *conn = NULL;
+            for (int tries = 0; tries < lg.cfg.connections && !conn; tries++) {
+                lg_conn_t *c = &lg.conns[next_conn++ % (size_t)lg.cfg.connections];
+                if (!c->dead) conn = c;
+            }
+            if (!conn) break;
+
+            lg_issue(&lg, conn, next_ns);
+            next_ns += interval_ns;
+        }
+
+        for (size_t i = 0; i < arrlenu(lg.dirty); i++) {
+            lg_flush(&lg, lg.dirty[i]);
+        }
+        arrsetlen(lg.dirty, 0);
+
+        int timeout_ms = 100;
+        if (sending) {
+            uint64_t wait_ns = next_ns > now ? next_ns - now : 0;
+            timeout_ms = (int)(wait_ns / 1000000ull);
+        }
+
+        int nfds = epoll_wait(lg.epoll_fd, events, LG_MAX_EVENTS, timeout_ms);
+        if (nfds < 0 && errno != EINTR) {
+            fprintf(stderr, "epoll_wait error: %s\n", strerror(errno));
+            break;
+        }
+
+        now = lg_now_ns();
+        for (int i = 0; i < nfds; i++)
+        {
+            lg_conn_t *conn = (lg_conn_t *)events[i].data.ptr;
+
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                lg_kill(&lg, conn, "hangup");
+            }
+            if (!conn->dead && (events[i].events & EPOLLOUT)) {
+                lg_flush(&lg, conn);
+            }
+            if (!conn->dead && (events[i].events & EPOLLIN)) {
+                lg_read(&lg, conn, now);
+            }
+        }
+
+        if (now >= report_ns)
+        {
+            printf("%5.1fs  %8llu req/s answered  in flight %6llu  p50 %8.1fus  p99 %8.1fus%s\n",
+                   (double)(now - start_ns) / 1e9,
+                   (unsigned long long)(lg.done - last_done),
+                   (unsigned long long)lg.in_flight,
+                   hdr_hist_percentile(&lg.interval, 50.0) / 1000.0,
+                   hdr_hist_percentile(&lg.interval, 99.0) / 1000.0,
+                   now < lg.measure_from_ns ? "  (warmup)" : "");
+            fflush(stdout);
+
+            last_done = lg.done;
+            hdr_hist_init(&lg.interval);
+            report_ns += LG_REPORT_NS;
+        }
+    }
+
+    double elapsed_s = (double)(lg_now_ns() - start_ns) / 1e9;
+    lg_report(&lg, elapsed_s);
+
+    if (lg.cfg.server_stats) {
+        lg_counter_t *counters_after = lg_fetch_counters(&lg);
+        lg_report_counters(counters_before, counters_after, elapsed_s);
+        arrfree(counters_after);
+    }
+    arrfree(counters_before);
+
+    for (size_t i = 0; i < arrlenu(lg.conns); i++)
+    {
+        lg_conn_t *conn = &lg.conns[i];
+        if (!conn->dead) close(conn->fd);
+        arrfree(conn->in);
+        arrfree(conn->out);
+        arrfree(conn->pending);
+        arrfree(conn->mine);
+    }
+    arrfree(lg.conns);
+    arrfree(lg.dirty);
+    arrfree(lg.unpacked);
+    close(lg.epoll_fd);
+
+    return (lg.lost || lg.errors || lg.in_flight) ? 2 : 0;
+}
@@ -0,0 +1,116 @@
+/*
+    Standalone todo server (linux)
+
+    gcc -O2 -Iinclude -Iexternal/include tools/server_main.c src/todo_server.c src/todo_proto.c
+        src/todo_lan.c src/todo.c src/event_poll.c src/event_poll_uring.c src/event_poll_shm.c
+        src/shm_ring.c src/timer_wheel.c src/lz.c src/http.c src/socket.c src/util.c -o todo_server -lpthread -lm
+
+    usage: todo_server [port] [--uring] [--threads] [--lan udp_port] [--lan-to ip udp_port] [--shm path]
+                       [--follow ip port] [--rate bytes/s] [--global-rate bytes/s]
+
+    --lan broadcasts to 255.255.255.255, two instances on one host
+    can instead point at each other with --lan-to 127.0.0.1 <their port>
+
+    --shm lets local tools skip TCP, they connect to the unix socket at
+    path and get shared memory rings (shm_ring.h), "-" for the default
+
+    --follow makes this a read only replica of the server at ip port,
+    it tails that one's journal and answers GET / SEARCH / SUBSCRIBE,
+    start one per core to spread the read traffic
+
+    HTTP/1.1 clients use the same port, curl localhost:9000/lists/0
+    and the rest of the routes are listed in todo_server.c
+
+    --rate caps what one client may send, --global-rate all of them
+    together, a client over budget is simply not read for a while
+ */
+#include "todo_server.h"
+
+#include <signal.h>
+
+static todo_server_t *g_server;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    if (g_server && g_server->ep) {
+        event_poll_stop(g_server->ep);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char      *port    = "9000";
+    event_backend_t backend  = EVENT_BACKEND_EPOLL;
+    bool            threaded = false;
+    const char      *lan_port    = NULL;
+    const char      *lan_to_ip   = NULL;
+    const char      *lan_to_port = NULL;
+    const char      *shm_path    = NULL;
+    const char      *leader_ip   = NULL;
+    const char      *leader_port = NULL;
+    uint32_t        rate         = 0;
+    uint32_t        global_rate  = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--uring") == 0)                    backend = EVENT_BACKEND_URING;
+        else if (strcmp(argv[i], "--threads") == 0)             threaded = true;
+        else if (strcmp(argv[i], "--lan") == 0 && i + 1 < argc) lan_port = argv[++i];
+        else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) shm_path = argv[++i];
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rate = (uint32_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--global-rate") == 0 && i + 1 < argc) global_rate = (uint32_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--follow") == 0 && i + 2 < argc) {
+            leader_ip   = argv[++i];
+            leader_port = argv[++i];
+        }
+        else if (strcmp(argv[i], "--lan-to") == 0 && i + 2 < argc) {
+            lan_to_ip   = argv[++i];
+            lan_to_port = argv[++i];
+        }
+        else                                                    port = argv[i];
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    todo_list_new("Default list");
+    todo_list_new("Work stuff");
+
+    g_server = todo_server_create(NULL, port, backend);
+    if (!g_server) {
+        return 1;
+    }
+
+    event_poll_set_rate_limit(g_server->ep, rate, 0, global_rate, 0);
+
+    if (lan_port && todo_server_enable_lan(g_server, lan_port, lan_to_ip, lan_to_port) < 0) {
+        todo_server_destroy(g_server);
+        return 1;
+    }
+
+    if (shm_path && todo_server_enable_shm(g_server, strcmp(shm_path, "-") == 0 ? NULL : shm_path) < 0) {
+        todo_server_destroy(g_server);
+        return 1;
+    }
+
+    if (leader_ip && todo_server_follow(g_server, leader_ip, leader_port) < 0) {
+        todo_server_destroy(g_server);
+        return 1;
+    }
+
+    thread_pool_t *pool = NULL;
+    if (threaded) {
+        pool = threadpool_create();
+        event_poll_set_thread_pool(g_server->ep, pool);
+    }
+
+    todo_server_run(g_server);
+    todo_server_destroy(g_server);
+
+    if (pool) {
+        threadpool_destroy(pool);
+    }
+    return 0;
+}